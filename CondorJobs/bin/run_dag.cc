@@ -0,0 +1,776 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "UserCode/DataProcessing/interface/parallelism.h"
+
+//local executor of the DAGs written by write_dag, as a drop-in for condor_submit_dag: the jobs run on this machine, as
+//many at the same time as the cpus and the memory allow (RequestCpus and RequestMemory of their submission files).
+//The dependencies (PARENT ... CHILD) and the retries (RETRY) are honoured, and the jobs marked DONE are skipped.
+//With --speculate, a second copy of the jobs running much longer than the other jobs of the same step is started
+//when nothing else is waiting; the first copy to succeed is kept and the other one is killed (and reaped) before the
+//outputs of the copy are moved into place.
+
+volatile std::sig_atomic_t interrupted = 0;
+void on_signal(int) { interrupted = 1; }
+
+//seconds since the start of the executor
+double now_s()
+{
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string trim(const std::string& s)
+{
+  const size_t first = s.find_first_not_of(" \t\r\n");
+  if(first == std::string::npos)
+    return "";
+  return s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+std::string to_upper(std::string s)
+{
+  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::toupper(c); });
+  return s;
+}
+
+//'1.3GB', '400MB', or a number of MB, as in HTCondor
+double parse_memory_mb(const std::string& memory)
+{
+  size_t pos;
+  const double value = std::stod(memory, &pos);
+  const std::string unit = to_upper(trim(memory.substr(pos)));
+  if(unit.empty() or unit == "M" or unit == "MB")
+    return value;
+  else if(unit == "G" or unit == "GB")
+    return value * 1024.;
+  else if(unit == "T" or unit == "TB")
+    return value * 1024. * 1024.;
+  else if(unit == "K" or unit == "KB")
+    return value / 1024.;
+  throw std::invalid_argument("Unknown memory unit: '" + memory + "'.");
+}
+
+//the keys of the submission files used by the executor; the others (requirements, +JobFlavour, ...) are ignored
+struct SubmitDescription {
+  std::string executable, arguments, output, error, log;
+  unsigned cpus = 1;
+  double memory_mb = 0.;
+};
+
+SubmitDescription read_submit_file(const std::string& filename)
+{
+  std::ifstream in(filename);
+  if(!in.is_open())
+    throw std::invalid_argument("File " + filename + " could not be opened.");
+
+  SubmitDescription sub;
+  std::string line;
+  while(std::getline(in, line)) {
+    const size_t eq = line.find('=');
+    if(eq == std::string::npos or trim(line)[0] == '#')
+      continue;
+    const std::string key = to_upper(trim(line.substr(0, eq))); //the keys are case-insensitive
+    const std::string value = trim(line.substr(eq + 1));
+    if(key == "EXECUTABLE")
+      sub.executable = value;
+    else if(key == "ARGUMENTS")
+      sub.arguments = value;
+    else if(key == "OUTPUT")
+      sub.output = value;
+    else if(key == "ERROR")
+      sub.error = value;
+    else if(key == "LOG")
+      sub.log = value;
+    else if(key == "REQUESTCPUS" or key == "REQUEST_CPUS")
+      sub.cpus = std::max(std::stoi(value), 1);
+    else if(key == "REQUESTMEMORY" or key == "REQUEST_MEMORY")
+      sub.memory_mb = parse_memory_mb(value);
+  }
+  if(sub.executable.empty())
+    throw std::invalid_argument("The submission file " + filename + " has no executable.");
+  return sub;
+}
+
+//splits the 'arguments' value: on white space in the old syntax, and also honouring single quotes in the new syntax
+//(the whole value between double quotes)
+std::vector<std::string> split_arguments(std::string args)
+{
+  const bool new_syntax = args.size() >= 2 and args.front() == '"' and args.back() == '"';
+  if(new_syntax)
+    args = args.substr(1, args.size() - 2);
+  std::vector<std::string> split;
+  std::string current;
+  bool quoted = false, started = false;
+  for(const char c : args) {
+    if(new_syntax and c == '\'') {
+      quoted = !quoted;
+      started = true;
+    }
+    else if(!quoted and std::isspace(static_cast<unsigned char>(c))) {
+      if(started)
+	split.push_back(current);
+      current.clear();
+      started = false;
+    }
+    else {
+      current += c;
+      started = true;
+    }
+  }
+  if(started)
+    split.push_back(current);
+  return split;
+}
+
+struct DagJob {
+  enum class State { waiting, running, succeeded, failed, skipped };
+
+  std::string name, subfile;
+  SubmitDescription sub;
+  std::vector<size_t> parents, children;
+  unsigned retries = 0;
+  bool done = false; //marked DONE in the DAG file
+
+  State state = State::waiting;
+  unsigned attempts = 0, failures = 0; //attempts include the speculative copies
+  bool speculated = false, speculative_won = false;
+  double ready_s = -1., start_s = -1., end_s = -1.; //start of the first attempt, end of the successful one
+  double run_s = -1.; //duration of the successful attempt
+  int exit_code = 0; //of the last failed attempt
+
+  //the first word of the job names written by write_dag: selection, analysis, fused or merge
+  std::string step() const { return name.substr(0, name.find('_')); }
+};
+
+//reads the JOB, PARENT ... CHILD and RETRY lines; the submission files are resolved relative to the folder of the DAG
+std::vector<DagJob> read_dag(const std::string& filename)
+{
+  std::ifstream in(filename);
+  if(!in.is_open())
+    throw std::invalid_argument("File " + filename + " could not be opened.");
+  const std::filesystem::path dagdir = std::filesystem::absolute(filename).parent_path();
+
+  std::vector< std::vector<std::string> > lines;
+  std::string line;
+  while(std::getline(in, line)) {
+    std::istringstream ss(line);
+    std::vector<std::string> words;
+    std::string word;
+    while(ss >> word)
+      words.push_back(word);
+    if(!words.empty() and words[0][0] != '#')
+      lines.push_back(words);
+  }
+
+  //the jobs first, since they may be referred to before being defined
+  std::vector<DagJob> jobs;
+  std::map<std::string, size_t> index;
+  for(const auto& words : lines) {
+    if(to_upper(words[0]) != "JOB")
+      continue;
+    if(words.size() < 3)
+      throw std::invalid_argument("Wrong JOB line in the DAG " + filename + ".");
+    DagJob job;
+    job.name = words[1];
+    std::filesystem::path subfile(words[2]);
+    job.subfile = (subfile.is_absolute() ? subfile : dagdir / subfile).string();
+    for(size_t i=3; i<words.size(); ++i)
+      if(to_upper(words[i]) == "DONE")
+	job.done = true;
+    if(!index.emplace(job.name, jobs.size()).second)
+      throw std::invalid_argument("The job " + job.name + " is defined twice in the DAG " + filename + ".");
+    jobs.push_back(job);
+  }
+
+  auto find_job = [&](const std::string& name) {
+    const auto it = index.find(name);
+    if(it == index.end())
+      throw std::invalid_argument("The DAG " + filename + " refers to the undefined job " + name + ".");
+    return it->second;
+  };
+  std::set<std::string> ignored;
+  for(const auto& words : lines) {
+    const std::string keyword = to_upper(words[0]);
+    if(keyword == "JOB")
+      continue;
+    else if(keyword == "PARENT") {
+      const auto child = std::find_if(words.begin(), words.end(), [](const std::string& w) { return to_upper(w) == "CHILD"; });
+      if(child == words.end() or child == words.begin() + 1 or child + 1 == words.end())
+	throw std::invalid_argument("Wrong PARENT line in the DAG " + filename + ".");
+      for(auto p = words.begin() + 1; p != child; ++p)
+	for(auto c = child + 1; c != words.end(); ++c) {
+	  jobs[find_job(*p)].children.push_back(find_job(*c));
+	  jobs[find_job(*c)].parents.push_back(find_job(*p));
+	}
+    }
+    else if(keyword == "RETRY") {
+      if(words.size() < 3)
+	throw std::invalid_argument("Wrong RETRY line in the DAG " + filename + ".");
+      jobs[find_job(words[1])].retries = std::stoi(words[2]);
+    }
+    else if(ignored.insert(keyword).second)
+      std::cout << "Warning: the " << keyword << " lines of the DAG are ignored." << std::endl;
+  }
+
+  for(auto& job : jobs)
+    job.sub = read_submit_file(job.subfile);
+
+  //cycles would leave jobs waiting forever
+  std::vector<size_t> nparents(jobs.size());
+  std::vector<size_t> order;
+  for(size_t i=0; i<jobs.size(); ++i)
+    if((nparents[i] = jobs[i].parents.size()) == 0)
+      order.push_back(i);
+  for(size_t k=0; k<order.size(); ++k)
+    for(const size_t child : jobs[order[k]].children)
+      if(--nparents[child] == 0)
+	order.push_back(child);
+  if(order.size() != jobs.size())
+    throw std::invalid_argument("The DAG " + filename + " has a cycle.");
+  return jobs;
+}
+
+struct ExecutorOptions {
+  unsigned ncpus;
+  double memory_mb;
+  double speculate = 0.; //a copy is started after 'speculate' times the median duration of the step; disabled if zero
+  double min_speculate_s = 60.; //no copies of jobs running for less than this
+  unsigned min_speculate_samples = 3; //jobs of the same step done before the median is trusted
+  std::string report; //CSV with one line per job, if not empty
+  bool dry_run = false;
+};
+
+//one running process; a job has two of them at most (the original and its speculative copy)
+struct Attempt {
+  size_t job;
+  pid_t pid;
+  double start_s;
+  unsigned cpus;
+  double memory_mb;
+  bool speculative;
+};
+
+class LocalExecutor {
+public:
+  LocalExecutor(std::vector<DagJob>& jobs, const std::string& submit_dir, const ExecutorOptions& opt)
+    : jobs_(jobs), submit_dir_(submit_dir), opt_(opt), free_cpus_(opt.ncpus), free_memory_mb_(opt.memory_mb) {}
+  //returns the number of jobs which did not succeed
+  size_t run();
+  void print_report(std::ostream& os = std::cout) const;
+  void write_report(const std::string&) const;
+
+private:
+  std::string _resolve(const std::string& path) const;
+  unsigned _cpus(const DagJob& job) const { return std::min(job.sub.cpus, opt_.ncpus); }
+  double _memory_mb(const DagJob& job) const { return std::min(job.sub.memory_mb, opt_.memory_mb); }
+  bool _fits(const DagJob& job) const { return _cpus(job) <= free_cpus_ and _memory_mb(job) <= free_memory_mb_; }
+  void _start(const size_t&, const bool& speculative);
+  void _speculate();
+  void _finish(const Attempt&, const int& status);
+  void _kill_others(const Attempt&);
+  std::string _scratch(const DagJob& job, const bool& speculative) const { return submit_dir_ + "/local/" + job.name + (speculative ? ".speculative" : ""); }
+  std::vector<std::string> _attempt_dirs(const Attempt&) const;
+  bool _commit(const Attempt&) const;
+  void _discard(const Attempt&) const;
+  void _skip_descendants(const size_t&);
+  void _log(const DagJob&, const std::string&) const;
+  double _median_run_s(const std::string& step) const;
+
+  std::vector<DagJob>& jobs_;
+  std::string submit_dir_;
+  ExecutorOptions opt_;
+  unsigned free_cpus_;
+  double free_memory_mb_;
+  std::set<size_t> ready_; //started in the order of the DAG file
+  std::vector<size_t> npending_; //parents not succeeded yet
+  std::vector<Attempt> running_;
+  double busy_cpu_s_ = 0.; //all attempts, including the failed and killed ones
+  double makespan_s_ = 0.;
+  unsigned nspeculative_ = 0;
+};
+
+//relative paths are relative to the folder the DAG is submitted from, as with condor_submit_dag
+std::string LocalExecutor::_resolve(const std::string& path) const
+{
+  if(path.empty() or path[0] == '/')
+    return path;
+  return submit_dir_ + "/" + path;
+}
+
+void LocalExecutor::_log(const DagJob& job, const std::string& message) const
+{
+  if(job.sub.log.empty())
+    return;
+  std::ofstream log(_resolve(job.sub.log), std::ios_base::app);
+  log << std::fixed << std::setprecision(1) << now_s() << " s: " << message << std::endl;
+}
+
+//runs the executable in a fresh scratch folder (the job sandbox), with its standard output and error redirected to the
+//files of the submission file; a speculative copy writes them next to the original ones, with a '.speculative' suffix
+void LocalExecutor::_start(const size_t& ijob, const bool& speculative)
+{
+  DagJob& job = jobs_[ijob];
+  const std::string suffix = speculative ? ".speculative" : "";
+  const std::string executable = _resolve(job.sub.executable);
+  const std::string output = job.sub.output.empty() ? "/dev/null" : _resolve(job.sub.output) + suffix;
+  const std::string error = job.sub.error.empty() ? "/dev/null" : _resolve(job.sub.error) + suffix;
+  const std::string scratch = _scratch(job, speculative);
+  for(const auto& file : {output, error, _resolve(job.sub.log)})
+    if(file != "/dev/null" and !file.empty())
+      std::filesystem::create_directories(std::filesystem::path(file).parent_path());
+  std::filesystem::remove_all(scratch);
+  std::filesystem::create_directories(scratch);
+
+  //the executable need not be executable (HTCondor sets the permissions when transferring it): its interpreter is
+  //then taken from its first line
+  std::vector<std::string> args;
+  if(access(executable.c_str(), X_OK) != 0) {
+    std::ifstream in(executable);
+    std::string shebang;
+    if(!std::getline(in, shebang) or shebang.compare(0, 2, "#!") != 0)
+      throw std::runtime_error("The executable " + executable + " of job " + job.name + " cannot be run.");
+    std::istringstream ss(shebang.substr(2));
+    std::string word;
+    while(ss >> word)
+      args.push_back(word);
+  }
+  args.push_back(executable);
+  for(const auto& arg : split_arguments(job.sub.arguments))
+    args.push_back(arg);
+  std::vector<char*> argv;
+  for(auto& arg : args)
+    argv.push_back(&arg[0]);
+  argv.push_back(nullptr);
+
+  const unsigned cpus = _cpus(job);
+  const pid_t pid = fork();
+  if(pid < 0)
+    throw std::runtime_error("Job " + job.name + " could not be started: " + std::strerror(errno));
+  if(pid == 0) {
+    setpgid(0, 0); //killed together with its children
+    const int out_fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    const int err_fd = open(error.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(out_fd < 0 or err_fd < 0 or chdir(scratch.c_str()) != 0)
+      _exit(127);
+    dup2(out_fd, STDOUT_FILENO);
+    dup2(err_fd, STDERR_FILENO);
+    setenv("_CONDOR_NPROCS", std::to_string(cpus).c_str(), 1); //read by parallelism::detect_ncpus()
+    setenv("_CONDOR_SCRATCH_DIR", scratch.c_str(), 1);
+    setenv("LOCAL_DAG_EXECUTOR", "1", 1);
+    if(speculative)
+      setenv("SPECULATIVE_COPY", "1", 1);
+    execvp(argv[0], argv.data());
+    std::perror(argv[0]);
+    _exit(127);
+  }
+  setpgid(pid, pid);
+
+  running_.push_back( Attempt{ijob, pid, now_s(), cpus, _memory_mb(job), speculative} );
+  free_cpus_ -= cpus;
+  free_memory_mb_ -= running_.back().memory_mb;
+  ++job.attempts;
+  job.state = DagJob::State::running;
+  if(job.start_s < 0.)
+    job.start_s = running_.back().start_s;
+  _log(job, std::string(speculative ? "speculative copy" : "attempt") + " " + std::to_string(job.attempts) + " started (pid " + std::to_string(pid) + ")");
+}
+
+double LocalExecutor::_median_run_s(const std::string& step) const
+{
+  std::vector<double> durations;
+  for(const auto& job : jobs_)
+    if(job.state == DagJob::State::succeeded and job.run_s >= 0. and job.step() == step)
+      durations.push_back(job.run_s);
+  if(durations.size() < opt_.min_speculate_samples)
+    return -1.;
+  std::nth_element(durations.begin(), durations.begin() + durations.size()/2, durations.end());
+  return durations[durations.size()/2];
+}
+
+//stragglers: original attempts running for longer than 'speculate' times the median duration of their step
+void LocalExecutor::_speculate()
+{
+  if(opt_.speculate <= 0. or !ready_.empty())
+    return; //the speculative copies never delay the jobs waiting for resources
+  const std::vector<Attempt> attempts = running_; //_start() modifies running_
+  for(const auto& attempt : attempts) {
+    DagJob& job = jobs_[attempt.job];
+    if(attempt.speculative or job.speculated or !_fits(job))
+      continue;
+    const double median = _median_run_s(job.step());
+    const double elapsed = now_s() - attempt.start_s;
+    if(median < 0. or elapsed < opt_.min_speculate_s or elapsed < opt_.speculate * median)
+      continue;
+    std::cout << "Straggler: " << job.name << " is running for " << std::lround(elapsed) << " s (median of its step: "
+	      << std::lround(median) << " s); starting a speculative copy." << std::endl;
+    job.speculated = true;
+    ++nspeculative_;
+    _start(attempt.job, true);
+  }
+}
+
+void LocalExecutor::_skip_descendants(const size_t& ijob)
+{
+  for(const size_t child : jobs_[ijob].children)
+    if(jobs_[child].state == DagJob::State::waiting) {
+      jobs_[child].state = DagJob::State::skipped;
+      ready_.erase(child);
+      _skip_descendants(child);
+    }
+}
+
+//folders the outputs of a speculative copy are written to (see attempt_path() in CondorJobs/launcher.sh)
+std::vector<std::string> LocalExecutor::_attempt_dirs(const Attempt& attempt) const
+{
+  std::vector<std::string> dirs;
+  if(!attempt.speculative)
+    return dirs; //the original attempt writes to the final location
+  std::ifstream in(_scratch(jobs_[attempt.job], true) + "/attempt_dirs");
+  std::string dir;
+  while(std::getline(in, dir))
+    if(!dir.empty())
+      dirs.push_back(dir);
+  return dirs;
+}
+
+//moves the outputs of a successful speculative copy to their final location, once the original attempt is reaped
+bool LocalExecutor::_commit(const Attempt& attempt) const
+{
+  for(const auto& dir : _attempt_dirs(attempt)) {
+    std::error_code ec;
+    std::vector<std::filesystem::path> files;
+    for(const auto& entry : std::filesystem::directory_iterator(dir, ec))
+      files.push_back(entry.path());
+    if(ec) {
+      std::cerr << "The folder " << dir << " of job " << jobs_[attempt.job].name << " could not be read: " << ec.message() << std::endl;
+      return false;
+    }
+    for(const auto& file : files) {
+      std::filesystem::rename(file, file.parent_path().parent_path() / file.filename(), ec);
+      if(ec) {
+	std::cerr << "The output " << file.string() << " of job " << jobs_[attempt.job].name << " could not be moved: " << ec.message() << std::endl;
+	return false;
+      }
+    }
+    std::filesystem::remove(dir, ec);
+  }
+  return true;
+}
+
+//removes the outputs of a speculative copy which did not succeed, or was killed
+void LocalExecutor::_discard(const Attempt& attempt) const
+{
+  std::error_code ec;
+  for(const auto& dir : _attempt_dirs(attempt))
+    std::filesystem::remove_all(dir, ec);
+}
+
+//kills the other copy of the job of a successful attempt and waits for it, so that it writes nothing afterwards
+void LocalExecutor::_kill_others(const Attempt& attempt)
+{
+  for(auto it = running_.begin(); it != running_.end(); ) {
+    if(it->job != attempt.job) {
+      ++it;
+      continue;
+    }
+    const Attempt other = *it;
+    it = running_.erase(it);
+    kill(-other.pid, SIGKILL);
+    int status;
+    while(waitpid(other.pid, &status, 0) < 0 and errno == EINTR) {}
+    busy_cpu_s_ += other.cpus * (now_s() - other.start_s);
+    free_cpus_ += other.cpus;
+    free_memory_mb_ += other.memory_mb;
+    _discard(other);
+    _log(jobs_[other.job], std::string(other.speculative ? "speculative copy" : "attempt") + " killed");
+  }
+}
+
+void LocalExecutor::_finish(const Attempt& attempt, const int& status)
+{
+  const double end = now_s();
+  busy_cpu_s_ += attempt.cpus * (end - attempt.start_s);
+  free_cpus_ += attempt.cpus;
+  free_memory_mb_ += attempt.memory_mb;
+  DagJob& job = jobs_[attempt.job];
+  bool succeeded = WIFEXITED(status) and WEXITSTATUS(status) == 0;
+  const std::string what = attempt.speculative ? "speculative copy" : "attempt";
+  if(succeeded) {
+    _kill_others(attempt);
+    succeeded = _commit(attempt);
+  }
+  if(!succeeded)
+    _discard(attempt);
+  const bool other_running = std::any_of(running_.begin(), running_.end(), [&](const Attempt& a) { return a.job == attempt.job; });
+
+  if(succeeded) {
+    job.state = DagJob::State::succeeded;
+    job.end_s = end;
+    job.run_s = end - attempt.start_s;
+    job.speculative_won = attempt.speculative;
+    _log(job, what + " terminated with return value 0");
+    //the job summary of the successful attempt is where write_dag expects it
+    for(const auto& file : {job.sub.output, job.sub.error})
+      if(!file.empty()) {
+	const std::string path = _resolve(file);
+	std::error_code ec;
+	if(attempt.speculative)
+	  std::filesystem::rename(path + ".speculative", path, ec);
+	else if(job.speculated)
+	  std::filesystem::remove(path + ".speculative", ec);
+      }
+    for(const size_t child : job.children)
+      if(--npending_[child] == 0 and jobs_[child].state == DagJob::State::waiting) {
+	jobs_[child].ready_s = end;
+	ready_.insert(child);
+      }
+    return;
+  }
+
+  job.exit_code = WIFEXITED(status) ? (WEXITSTATUS(status) == 0 ? 1 : WEXITSTATUS(status)) : 128 + WTERMSIG(status); //1: not committed
+  _log(job, what + " terminated with return value " + std::to_string(job.exit_code));
+  if(other_running)
+    return; //the other copy may still succeed
+  ++job.failures;
+  if(job.failures <= job.retries and !interrupted) {
+    std::cout << "Job " << job.name << " failed (return value " << job.exit_code << "); retry " << job.failures
+	      << " of " << job.retries << "." << std::endl;
+    job.state = DagJob::State::waiting;
+    job.speculated = false;
+    ready_.insert(attempt.job);
+  }
+  else {
+    std::cout << "Job " << job.name << " failed (return value " << job.exit_code << ")." << std::endl;
+    job.state = DagJob::State::failed;
+    job.end_s = end;
+    _skip_descendants(attempt.job);
+  }
+}
+
+size_t LocalExecutor::run()
+{
+  npending_.assign(jobs_.size(), 0);
+  for(size_t i=0; i<jobs_.size(); ++i)
+    if(jobs_[i].done)
+      jobs_[i].state = DagJob::State::succeeded;
+  for(size_t i=0; i<jobs_.size(); ++i) {
+    for(const size_t parent : jobs_[i].parents)
+      npending_[i] += jobs_[parent].state != DagJob::State::succeeded;
+    if(npending_[i] == 0 and jobs_[i].state == DagJob::State::waiting) {
+      jobs_[i].ready_s = 0.;
+      ready_.insert(i);
+    }
+  }
+
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+  bool terminated = false; //the running attempts are sent SIGTERM once
+  while(true) {
+    if(interrupted) {
+      if(!terminated)
+	for(const auto& attempt : running_)
+	  kill(-attempt.pid, SIGTERM);
+      terminated = true;
+      ready_.clear();
+    }
+    //the ready jobs are started in the order of the DAG file (the longest first, for balanced DAGs), the smaller ones
+    //filling the resources left by the larger ones; a job requesting more than the machine runs alone
+    for(auto it = ready_.begin(); it != ready_.end(); ) {
+      if(_fits(jobs_[*it])) {
+	const size_t ijob = *it;
+	it = ready_.erase(it);
+	_start(ijob, false);
+      }
+      else
+	++it;
+    }
+    _speculate();
+    if(running_.empty())
+      break;
+
+    int status;
+    const pid_t pid = waitpid(-1, &status, WNOHANG);
+    if(pid == 0 or (pid < 0 and errno == EINTR)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      continue;
+    }
+    if(pid < 0)
+      throw std::runtime_error(std::string("waitpid failed: ") + std::strerror(errno));
+    const auto attempt = std::find_if(running_.begin(), running_.end(), [&](const Attempt& a) { return a.pid == pid; });
+    if(attempt == running_.end())
+      continue;
+    const Attempt finished = *attempt;
+    running_.erase(attempt);
+    _finish(finished, status);
+  }
+  makespan_s_ = now_s();
+
+  for(auto& job : jobs_)
+    if(job.state == DagJob::State::waiting)
+      job.state = DagJob::State::skipped; //interrupted
+  return std::count_if(jobs_.begin(), jobs_.end(), [](const DagJob& job) { return job.state != DagJob::State::succeeded; });
+}
+
+//per step and overall durations, cpu usage and critical path (longest chain of dependent jobs, by measured duration)
+void LocalExecutor::print_report(std::ostream& os) const
+{
+  struct StepStats { unsigned njobs = 0, nsucceeded = 0, nfailed = 0; double total_s = 0., max_s = 0.; };
+  std::map<std::string, StepStats> steps;
+  unsigned nretried = 0, nwon = 0;
+  for(const auto& job : jobs_) {
+    if(job.done)
+      continue;
+    StepStats& s = steps[job.step()];
+    ++s.njobs;
+    s.nfailed += job.state == DagJob::State::failed;
+    if(job.state == DagJob::State::succeeded) {
+      ++s.nsucceeded;
+      s.total_s += job.run_s;
+      s.max_s = std::max(s.max_s, job.run_s);
+    }
+    nretried += job.failures > 0;
+    nwon += job.speculative_won;
+  }
+
+  std::vector<double> path_s(jobs_.size(), -1.);
+  std::vector<size_t> path_prev(jobs_.size(), jobs_.size());
+  std::function<double(size_t)> longest = [&](size_t i) { //ending at job i
+    if(path_s[i] >= 0.)
+      return path_s[i];
+    double prev = 0.;
+    for(const size_t parent : jobs_[i].parents)
+      if(longest(parent) > prev) {
+	prev = path_s[parent];
+	path_prev[i] = parent;
+      }
+    return path_s[i] = prev + std::max(jobs_[i].run_s, 0.);
+  };
+  size_t last = 0;
+  for(size_t i=0; i<jobs_.size(); ++i)
+    if(longest(i) > longest(last))
+      last = i;
+
+  os << std::fixed << std::setprecision(1);
+  os << "##### Timing report #####" << std::endl;
+  os << std::left << std::setw(12) << "step" << std::right << std::setw(8) << "jobs" << std::setw(8) << "failed"
+     << std::setw(12) << "mean [s]" << std::setw(12) << "max [s]" << std::setw(14) << "total [s]" << std::endl;
+  for(const auto& s : steps) {
+    const unsigned nok = s.second.nsucceeded;
+    os << std::left << std::setw(12) << s.first << std::right << std::setw(8) << s.second.njobs << std::setw(8) << s.second.nfailed
+       << std::setw(12) << (nok > 0 ? s.second.total_s / nok : 0.) << std::setw(12) << s.second.max_s << std::setw(14) << s.second.total_s << std::endl;
+  }
+  os << "Wall time: " << makespan_s_ << " s with " << opt_.ncpus << " cpus and " << std::lround(opt_.memory_mb) << " MB" << std::endl;
+  if(makespan_s_ > 0.)
+    os << "Cpu occupancy: " << 100. * busy_cpu_s_ / (opt_.ncpus * makespan_s_) << "% of the requested cpus" << std::endl;
+  if(!jobs_.empty()) {
+    size_t njobs = 0;
+    for(size_t i=last; i<jobs_.size(); i=path_prev[i])
+      ++njobs;
+    os << "Critical path: " << path_s[last] << " s over " << njobs << " jobs, ending with " << jobs_[last].name << std::endl;
+  }
+  os << "Jobs retried: " << nretried << "; speculative copies: " << nspeculative_ << " (" << nwon << " finished first)" << std::endl;
+  for(const auto& job : jobs_)
+    if(job.state == DagJob::State::failed or job.state == DagJob::State::skipped)
+      os << (job.state == DagJob::State::failed ? "Failed: " : "Not run: ") << job.name << std::endl;
+  os << "#########################" << std::endl;
+}
+
+void LocalExecutor::write_report(const std::string& filename) const
+{
+  std::ofstream out(filename);
+  if(!out.is_open())
+    throw std::invalid_argument("File " + filename + " could not be opened.");
+  const std::map<DagJob::State, std::string> states = { {DagJob::State::waiting, "waiting"}, {DagJob::State::running, "running"},
+							 {DagJob::State::succeeded, "succeeded"}, {DagJob::State::failed, "failed"},
+							 {DagJob::State::skipped, "skipped"} };
+  out << "job,step,state,attempts,failures,speculative_won,cpus,memory_mb,ready_s,start_s,end_s,run_s" << std::endl;
+  for(const auto& job : jobs_)
+    out << job.name << "," << job.step() << "," << (job.done ? "done" : states.at(job.state)) << "," << job.attempts << ","
+	<< job.failures << "," << job.speculative_won << "," << job.sub.cpus << "," << job.sub.memory_mb << ","
+	<< job.ready_s << "," << job.start_s << "," << job.end_s << "," << job.run_s << std::endl;
+}
+
+//physical memory of the machine in MB
+double physical_memory_mb()
+{
+  return static_cast<double>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE) / (1024. * 1024.);
+}
+
+//run example: run_dag clue_data_em.dag --ncpus 16 --memory 32GB --speculate 2 --report timing.csv
+int main(int argc, char **argv) {
+  if(argc < 2) {
+    std::cout << "Usage: run_dag <dag file> [--ncpus <n>] [--memory <size>] [--speculate <factor>] [--report <csv>] [--dry_run]" << std::endl;
+    std::cout << "ncpus: cpus shared by the jobs (default: the cpus available to this process)" << std::endl;
+    std::cout << "memory: memory shared by the jobs, as in RequestMemory (default: the physical memory)" << std::endl;
+    std::cout << "speculate: starts a copy of the jobs running for longer than <factor> times the median of their step" << std::endl;
+    std::cout << "report: writes the timing of each job to <csv>" << std::endl;
+    std::cout << "dry_run: prints the jobs in the order they would be started" << std::endl;
+    return 1;
+  }
+  const std::string dagfile = argv[1];
+  ExecutorOptions opt;
+  opt.ncpus = parallelism::detect_ncpus();
+  opt.memory_mb = physical_memory_mb();
+  for(int iarg=2; iarg<argc; ++iarg) {
+    const std::string arg = argv[iarg];
+    if(arg == "--dry_run") {
+      opt.dry_run = true;
+      continue;
+    }
+    if(arg != "--ncpus" and arg != "--memory" and arg != "--speculate" and arg != "--report")
+      throw std::invalid_argument("Unknown option '" + arg + "'.");
+    if(iarg+1 >= argc)
+      throw std::invalid_argument("The '" + arg + "' option requires a value.");
+    const std::string value = argv[++iarg];
+    if(arg == "--ncpus")
+      opt.ncpus = std::stoi(value);
+    else if(arg == "--memory")
+      opt.memory_mb = parse_memory_mb(value);
+    else if(arg == "--speculate")
+      opt.speculate = std::stod(value);
+    else
+      opt.report = value;
+  }
+  if(opt.ncpus == 0 or opt.memory_mb <= 0.)
+    throw std::invalid_argument("The number of cpus and the memory have to be positive.");
+  if(opt.speculate != 0. and opt.speculate <= 1.)
+    throw std::invalid_argument("The speculation factor has to be larger than one.");
+
+  std::vector<DagJob> jobs = read_dag(dagfile);
+  const std::string submit_dir = std::filesystem::absolute(dagfile).parent_path().string();
+  std::cout << "DAG " << dagfile << ": " << jobs.size() << " jobs, run with " << opt.ncpus << " cpus and "
+	    << std::lround(opt.memory_mb) << " MB." << std::endl;
+  if(opt.dry_run) {
+    for(const auto& job : jobs)
+      std::cout << job.name << ": " << job.sub.cpus << " cpus, " << job.sub.memory_mb << " MB, " << job.parents.size()
+		<< " parents, " << job.retries << " retries" << (job.done ? " (done)" : "") << std::endl;
+    return 0;
+  }
+
+  LocalExecutor executor(jobs, submit_dir, opt);
+  const size_t nfailed = executor.run();
+  executor.print_report();
+  if(!opt.report.empty())
+    executor.write_report(opt.report);
+  return nfailed == 0 and !interrupted ? 0 : 1;
+}
@@ -1,5 +1,11 @@
 #include <cstdlib>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 #include "UserCode/DataProcessing/interface/analyzer.h"
+#include "UserCode/DataProcessing/interface/memory_profile.h"
+#include "UserCode/DataProcessing/interface/calibration_db.h"
 #include "UserCode/CondorJobs/interface/run_en_map.h"
 
 //convenience function which prints all the elements in a vector of strings to std::cout
@@ -16,52 +22,238 @@ void print_vector_elements(const std::vector<std::string>& v)
 struct DataParameters {
   std::string datatype;
   std::string showertype;
-  bool last_step_only;
+  bool last_step_only = false;
+  bool fused = false; //selection and analysis in a single job, without the intermediate ntuple
   std::string tag;
   std::string w0;
   std::string dpos;
+  std::string ncpus; //number of cpus used per job; if empty, the cpus of the slot (see parallelism::detect_ncpus())
+  std::string request_cpus() const { return ncpus.empty() ? "4" : ncpus; } //number of cpus requested per job
+  bool balance = false; //packs short runs and splits long ones, based on previous submissions
+  std::string target_minutes = "60"; //duration of the jobs aimed at when balancing
+  bool force = false; //the jobs run even if their outputs are up to date
 };
 
-//write all individual submission jobs: selection stage
-void write_submission_file(const int& id, const std::string& jobpath, const std::string& base, std::string mode,
-			   const unsigned int& energy, const DataParameters& p)
+//runs processed by a job: a single run, several short runs one after the other (packed), or an entry range of a long
+//run (split), whose parts are merged by a 'merge' job
+struct JobUnit {
+  std::vector< std::pair<unsigned int, std::string> > runs; //(beam energy, ntuple id)
+  std::string label; //'<id>', 'pack<k>' or '<id>_part<k>'
+  unsigned int part = 0, nparts = 0; //split runs only
+  unsigned long long first_entry = 0, last_entry = 0;
+  double cost = -1.; //estimated processing time in seconds of all the steps; negative if unknown
+};
+
+//name of the output, error and log files of a job; the output file holds the job summary (see memory_profile.h)
+std::string job_outname(const std::string& mode, const DataParameters& p, const unsigned int& energy, const std::string& n)
+{
+  return mode + "_" + p.datatype + "_" + p.showertype + "_beamen" + std::to_string(energy) + "_" + p.tag + "." + n;
+}
+
+//summary of each run of a packed job, printed after a '<run_marker> <ntupleid> <energy>' line (see launcher.sh)
+constexpr const char* run_marker = "JOBRUN";
+
+//summaries printed by the jobs of previous submissions, by output file name. The summaries of the runs of a packed job
+//are stored under the name of the output file of a job of that run alone, so that the next submission finds them
+//whether the run is packed or not; the peak memory and the cpus of the whole job are used where they are missing.
+const std::map< std::string, std::map<std::string, double> >& job_summaries(const std::string& outdir)
+{
+  static std::map< std::string, std::map<std::string, double> > summaries;
+  static bool loaded = false;
+  if(!loaded) {
+    loaded = true;
+    if(std::filesystem::is_directory(outdir))
+      for(const auto& entry : std::filesystem::directory_iterator(outdir)) {
+	if(entry.path().extension() != ".out")
+	  continue;
+	std::map<std::string, double> summary; //the whole job
+	std::vector< std::pair<std::string, std::map<std::string, double> > > runs; //(output file name, summary)
+	std::ifstream f(entry.path());
+	std::string line;
+	while(std::getline(f, line)) {
+	  std::istringstream ss(line);
+	  std::string word, key, energy;
+	  double value;
+	  if(!(ss >> word >> key))
+	    continue;
+	  if(word == run_marker and ss >> energy) {
+	    //'<step>_<datatype>_<showertype>_beamen<energy>_<tag>.<label>.out' of the packed job
+	    const std::string name = entry.path().stem().string();
+	    const size_t ibeam = name.find("_beamen");
+	    const size_t itag = name.find('_', ibeam + 1);
+	    const size_t ilabel = name.rfind('.');
+	    if(ibeam == std::string::npos or itag == std::string::npos or ilabel == std::string::npos or ilabel < itag)
+	      break;
+	    runs.emplace_back(name.substr(0, ibeam) + "_beamen" + energy + name.substr(itag, ilabel - itag) + "." + key + ".out",
+			      std::map<std::string, double>());
+	  }
+	  else if(word == memprof::JobSummary::prefix and ss >> value)
+	    (runs.empty() ? summary : runs.back().second)[key] = value;
+	}
+	for(auto& run : runs) {
+	  for(const std::string key : {"peak_rss_mb", "ncpus"})
+	    if(run.second.count(key) == 0 and summary.count(key) > 0)
+	      run.second[key] = summary.at(key);
+	  if(run.second.count("peak_rss_mb") > 0)
+	    summaries[run.first] = run.second;
+	}
+	if(summary.count("peak_rss_mb") > 0)
+	  summaries[entry.path().filename().string()] = summary;
+      }
+  }
+  return summaries;
+}
+
+//summaries of the jobs whose output file starts with 'prefix' and ends with 'suffix' (any tag in between),
+//run with the same number of cpus
+std::vector< std::map<std::string, double> > matching_summaries(const std::string& outdir, const std::string& prefix, const std::string& suffix, const DataParameters& p)
+{
+  std::vector< std::map<std::string, double> > matches;
+  for(const auto& elem : job_summaries(outdir)) {
+    const std::string& name = elem.first;
+    if(name.size() < prefix.size() + suffix.size() or name.compare(0, prefix.size(), prefix) != 0 or
+       name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+      continue;
+    const auto ncpus = elem.second.find("ncpus");
+    if(ncpus != elem.second.end() and ncpus->second != std::stod(p.request_cpus()))
+      continue;
+    matches.push_back(elem.second);
+  }
+  return matches;
+}
+
+//memory requested per job in MB, with a safety margin, taken from the peak memory recorded by the same job in a
+//previous submission (any tag); otherwise predicted by a linear model of the input events, fitted to the previous jobs
+//of the same step, datatype and showertype, where the input events of an analysis job are the events kept by the
+//selection job of the same run. The fixed default is used when no summary is available.
+std::string request_memory(const std::string& base, const std::string& mode, const unsigned int& energy, const std::string& n,
+			   const DataParameters& p, const std::string& default_memory)
+{
+  constexpr double margin = 1.2;
+  constexpr double min_memory = 256.; //MB
+  const std::string outdir = base + "out/";
+  const std::string step_prefix = mode + "_" + p.datatype + "_" + p.showertype + "_";
+  const std::string job_prefix = step_prefix + "beamen" + std::to_string(energy) + "_";
+  const std::string job_suffix = "." + n + ".out";
+  auto to_request = [&](const double& mb) {
+    return std::to_string( static_cast<unsigned>(std::ceil( std::max(mb * margin, min_memory) )) ) + "MB";
+  };
+
+  double peak = 0.;
+  for(const auto& summary : matching_summaries(outdir, job_prefix, job_suffix, p))
+    peak = std::max(peak, summary.at("peak_rss_mb"));
+  if(peak > 0.)
+    return to_request(peak);
+
+  if(mode != "analysis")
+    return default_memory;
+  double nevents = -1.;
+  const std::string selection_prefix = "selection_" + p.datatype + "_" + p.showertype + "_beamen" + std::to_string(energy) + "_";
+  for(const auto& summary : job_summaries(outdir)) //the selection may have run with a different number of cpus
+    if(summary.first.rfind(selection_prefix, 0) == 0 and summary.first.size() > job_suffix.size() and
+       summary.first.compare(summary.first.size() - job_suffix.size(), job_suffix.size(), job_suffix) == 0 and
+       summary.second.count("selected_events") > 0)
+      nevents = std::max(nevents, summary.second.at("selected_events"));
+  if(nevents < 0.)
+    return default_memory;
+
+  //least-squares fit of the peak memory as a function of the input events
+  double sx = 0., sy = 0., sxx = 0., sxy = 0., ymax = 0.;
+  unsigned npoints = 0;
+  for(const auto& summary : matching_summaries(outdir, step_prefix, ".out", p)) {
+    if(summary.count("input_events") == 0)
+      continue;
+    const double x = summary.at("input_events"), y = summary.at("peak_rss_mb");
+    sx += x; sy += y; sxx += x*x; sxy += x*y;
+    ymax = std::max(ymax, y);
+    ++npoints;
+  }
+  const double det = npoints * sxx - sx * sx;
+  if(npoints < 3 or det <= 0.)
+    return default_memory;
+  const double slope = (npoints * sxy - sx * sy) / det;
+  const double intercept = (sy - slope * sx) / npoints;
+  if(slope < 0.)
+    return to_request(ymax);
+  return to_request(intercept + slope * nevents);
+}
+
+//amount of memory in MB, as written in the submission files ('1.3GB', '400MB')
+double memory_mb(const std::string& memory)
+{
+  size_t pos;
+  const double value = std::stod(memory, &pos);
+  return memory.substr(pos) == "GB" ? value * 1024. : value;
+}
+
+//write all individual submission jobs
+void write_submission_file(const JobUnit& unit, const std::string& jobpath, const std::string& base, std::string mode,
+			   const DataParameters& p)
 {
   std::string cpp_exec;
   if(mode == "selection")
     cpp_exec = "process_data_exe";
-  else if(mode == "analysis")
+  else if(mode == "analysis" or mode == "fused")
     cpp_exec = "analyze_data_exe";
-  else
+  else if(mode != "merge") //the merge jobs run hadd, available in the CMSSW environment
     throw std::invalid_argument("Mode " + mode + " does not exist.");
-  std::string n = std::to_string(id);
+  const unsigned int energy = unit.runs.front().first;
+  std::string n = unit.label;
   std::ofstream fw(jobpath, std::ios_base::ate);
 
+  //the runs of a packed job are processed one after the other: the largest request of the runs is used
   std::string memory, flavour;
-  if(mode == "selection") {
-    memory = "1.3GB";
-    flavour = "\"workday\"";
-  }
+  const std::string default_memory = (mode == "selection" or mode == "fused") ? "1.3GB" : "400MB";
+  if(mode == "merge")
+    memory = default_memory;
+  else if(unit.runs.size() == 1)
+    memory = request_memory(base, mode, energy, unit.runs.front().second, p, default_memory);
   else {
-    memory = "400MB";
-    flavour = "\"longlunch\"";
+    double mb = 0.;
+    for(const auto& run : unit.runs)
+      mb = std::max(mb, memory_mb( request_memory(base, mode, run.first, run.second, p, default_memory) ));
+    memory = std::to_string( static_cast<unsigned>(std::ceil(mb)) ) + "MB";
   }
+  if(mode == "selection" or mode == "fused")
+    flavour = "\"workday\"";
+  else if(mode == "merge")
+    flavour = "\"microcentury\"";
+  else
+    flavour = "\"longlunch\"";
   fw << "indir = " + base << std::endl;
   fw << "executable = launcher.sh" << std::endl;
 
   fw << "should_transfer_files = YES" << std::endl;
   fw << "when_to_transfer_output = ON_EXIT" << std::endl;
-  fw << "public_input_files = ../../../../TestBeamAnalysis/bin/" + std::string(getenv("SCRAM_ARCH")) + "/" + cpp_exec << std::endl;
-  
-  fw << "arguments = --ntupleid " + n + " --datatype " + p.datatype + " --showertype " + p.showertype + " --tag " + p.tag;
+  if(!cpp_exec.empty())
+    fw << "public_input_files = ../../../../TestBeamAnalysis/bin/" + std::string(getenv("SCRAM_ARCH")) + "/" + cpp_exec << std::endl;
+
+  std::string ids, energies; //comma-separated for packed jobs
+  for(const auto& run : unit.runs) {
+    ids += (ids.empty() ? "" : ",") + run.second;
+    energies += (energies.empty() ? "" : ",") + std::to_string(run.first);
+  }
+  fw << "arguments = --ntupleid " + ids + " --datatype " + p.datatype + " --showertype " + p.showertype + " --tag " + p.tag;
   fw << " --w0 " + p.w0 + " --dpos " + p.dpos;
-  fw << " --energy " + std::to_string(energy);
+  fw << " --energy " + energies;
   fw << " --step " + mode;
+  if(mode != "merge" and !p.ncpus.empty())
+    fw << " --ncpus " + p.ncpus;
+  if(p.force)
+    fw << " --force";
+  if(mode == "merge")
+    fw << " --nparts " + std::to_string(unit.nparts);
+  else if(unit.nparts > 0) {
+    fw << " --part " + std::to_string(unit.part);
+    if(mode != "analysis") //the analysis of a part reads the output of the selection of the same part
+      fw << " --entries " + std::to_string(unit.first_entry) + ":" + std::to_string(unit.last_entry);
+  }
   fw << std::endl;
 
   fw << "universe = vanilla" << std::endl;
   fw << "requirements = (OpSysAndVer =?= \"CentOS7\")" << std::endl;
 
-  std::string outname = mode + "_" + p.datatype + "_" + p.showertype + "_" + p.tag + "." + n;
+  std::string outname = job_outname(mode, p, energy, n);
   fw << "output = out/" + outname + ".out" << std::endl;
   fw << "error =  out/" + outname + ".err" << std::endl;
   fw << "log =    log/" + outname + ".log" << std::endl;
@@ -69,10 +261,20 @@ void write_submission_file(const int& id, const std::string& jobpath, const std:
   fw << "getenv = True" << std::endl;
   
   fw << "RequestMemory = " + memory << std::endl;
+  fw << "RequestCpus = " + (mode == "merge" ? std::string("1") : p.request_cpus()) << std::endl;
   fw << "+JobFlavour = " + flavour << std::endl;
   fw << "queue" << std::endl;
 }
 
+void write_submission_file(const int& id, const std::string& jobpath, const std::string& base, std::string mode,
+			   const unsigned int& energy, const DataParameters& p)
+{
+  JobUnit unit;
+  unit.runs = { {energy, std::to_string(id)} };
+  unit.label = std::to_string(id);
+  write_submission_file(unit, jobpath, base, mode, p);
+}
+
 //write Direct Acyclic Graph (DAG) submission file: jobs definition
 void write_dag_jobs(const std::string& filepath, const std::vector<std::string>& jobnames, const std::vector<std::string>& jobpaths, const std::ios_base::openmode& mode)
 {
@@ -115,8 +317,225 @@ void write_dag_repetitions(const std::string& filepath, const std::vector<std::s
   f_write << std::endl;
 }
 
+//beam energy of each data run taken with configuration #22: from the calibration database when available (see
+//compile_calibration_exe), from run_en_map.h otherwise
+std::map<unsigned, unsigned> data_run_energies()
+{
+  const std::string db_file = calibdb::default_path();
+  if(!std::filesystem::exists(db_file))
+    return run_en_map;
+  const auto db = CalibrationDB::open(db_file);
+  std::map<unsigned, unsigned> energies;
+  for(const unsigned run : db->runs(22))
+    energies[run] = db->run(run)->beam_energy;
+  return energies;
+}
+
+//processing rate (input events per second, excluding the startup) and mean startup time of the previous jobs of a step,
+//run with the same number of cpus; the rate is zero when unknown
+std::pair<double, double> step_timing(const std::string& outdir, const std::string& mode, const DataParameters& p)
+{
+  double events = 0., seconds = 0., startup = 0.;
+  unsigned njobs = 0;
+  for(const auto& summary : matching_summaries(outdir, mode + "_" + p.datatype + "_" + p.showertype + "_", ".out", p)) {
+    if(summary.count("wall_s") == 0 or summary.count("input_events") == 0)
+      continue;
+    const double s = summary.count("startup_s") > 0 ? std::max(summary.at("startup_s"), 0.) : 0.;
+    events += summary.at("input_events");
+    seconds += std::max(summary.at("wall_s") - s, 1.);
+    startup += s;
+    ++njobs;
+  }
+  if(njobs == 0 or events <= 0.)
+    return std::make_pair(0., 0.);
+  return std::make_pair(events / seconds, startup / njobs);
+}
+
+//events read by a step for a given run, taken from the previous jobs of any step reading the same events (the events
+//kept by the selection, for the analysis); negative if unknown
+double run_events(const std::string& outdir, const std::string& mode, const unsigned int& energy, const std::string& n, const DataParameters& p)
+{
+  std::vector< std::pair<std::string, std::string> > sources; //(step, summary key)
+  if(mode == "analysis")
+    sources = { {"analysis", "input_events"}, {"selection", "selected_events"} };
+  else
+    sources = { {"selection", "input_events"}, {"fused", "input_events"} };
+  const std::string job_suffix = "." + n + ".out";
+  for(const auto& source : sources) {
+    double nevents = -1.;
+    const std::string job_prefix = source.first + "_" + p.datatype + "_" + p.showertype + "_beamen" + std::to_string(energy) + "_";
+    for(const auto& summary : job_summaries(outdir)) //any number of cpus
+      if(summary.first.rfind(job_prefix, 0) == 0 and summary.first.size() > job_suffix.size() and
+	 summary.first.compare(summary.first.size() - job_suffix.size(), job_suffix.size(), job_suffix) == 0 and
+	 summary.second.count(source.second) > 0)
+	nevents = std::max(nevents, summary.second.at(source.second));
+    if(nevents >= 0.)
+      return nevents;
+  }
+  return -1.;
+}
+
+//groups the runs in jobs of similar duration, estimated from the job summaries of previous submissions: the runs
+//longer than the target are split in entry ranges of the original ntuple, and the runs shorter than half the target
+//are packed together (first-fit decreasing). The runs without timing information keep a job each.
+std::vector<JobUnit> plan_jobs(const std::vector< std::pair<unsigned int, std::string> >& runs, const std::vector<std::string>& steps,
+			       const std::string& base, const DataParameters& p, double& overhead)
+{
+  constexpr double job_overhead = 120.; //seconds: scheduling, transfer of the executable and environment setup
+  const std::string outdir = base + "out/";
+  const double target = std::stod(p.target_minutes) * 60.;
+  const bool splittable = steps.front() != "analysis"; //the analysis of a split run reads the part written by its selection
+
+  std::vector< std::pair<double, double> > timing; //(rate, startup) per step
+  overhead = 0.;
+  for(const auto& step : steps) {
+    timing.push_back( step_timing(outdir, step, p) );
+    overhead += job_overhead + timing.back().second;
+  }
+
+  std::vector<JobUnit> units, short_units;
+  for(const auto& run : runs) {
+    JobUnit unit;
+    unit.runs = {run};
+    unit.label = run.second;
+    double cost = 0.;
+    for(auto k: util::lang::indices(steps)) {
+      const double nevents = run_events(outdir, steps[k], run.first, run.second, p);
+      if(nevents < 0. or timing[k].first <= 0.) {
+	cost = -1.;
+	break;
+      }
+      cost += nevents / timing[k].first;
+    }
+    unit.cost = cost;
+    const double entries = splittable ? run_events(outdir, steps.front(), run.first, run.second, p) : -1.;
+
+    if(cost < 0.)
+      units.push_back(unit);
+    else if(overhead + cost > target and entries > 0.) {
+      const unsigned int nparts = std::max(2., std::ceil( cost / std::max(target - overhead, target / 2.) ));
+      for(unsigned int k=0; k<nparts; ++k) {
+	JobUnit part = unit;
+	part.label = run.second + "_part" + std::to_string(k);
+	part.part = k;
+	part.nparts = nparts;
+	part.first_entry = static_cast<unsigned long long>(entries) * k / nparts;
+	//the last part reads up to the end, in case the run grew since the previous submission
+	part.last_entry = k+1 == nparts ? std::numeric_limits<unsigned long long>::max() : static_cast<unsigned long long>(entries) * (k+1) / nparts;
+	part.cost = cost / nparts;
+	units.push_back(part);
+      }
+    }
+    else if(overhead + cost <= target / 2.)
+      short_units.push_back(unit);
+    else
+      units.push_back(unit);
+  }
+
+  std::stable_sort(short_units.begin(), short_units.end(), [](const JobUnit& a, const JobUnit& b) { return a.cost > b.cost; });
+  std::vector<JobUnit> packs;
+  for(const auto& unit : short_units) {
+    auto pack = std::find_if(packs.begin(), packs.end(), [&](const JobUnit& pk) { return overhead + pk.cost + unit.cost <= target; });
+    if(pack == packs.end())
+      packs.push_back(unit);
+    else {
+      pack->runs.push_back(unit.runs.front());
+      pack->cost += unit.cost;
+    }
+  }
+  unsigned int npacks = 0;
+  for(auto& pack : packs) {
+    if(pack.runs.size() > 1)
+      pack.label = "pack" + std::to_string(npacks++);
+    units.push_back(pack);
+  }
+
+  //the longest jobs are submitted first, and the unknown ones before them, so that none of them starts last
+  std::stable_sort(units.begin(), units.end(), [](const JobUnit& a, const JobUnit& b) {
+      const double ca = a.cost < 0. ? std::numeric_limits<double>::max() : a.cost;
+      const double cb = b.cost < 0. ? std::numeric_limits<double>::max() : b.cost;
+      return ca > cb;
+    });
+  return units;
+}
+
+//balanced DAG: one chain of steps per job unit (see plan_jobs()), and a merge job per split run, child of the last
+//step of all its parts
+void write_balanced_dag(const std::string& filepath, const std::vector< std::pair<unsigned int, std::string> >& runs,
+			const std::vector<std::string>& steps, const std::string& submission_folder, const std::string& base, const DataParameters& p)
+{
+  double overhead;
+  const std::vector<JobUnit> units = plan_jobs(runs, steps, base, p, overhead);
+  const unsigned int nsteps = steps.size();
+  auto jobname = [&](const std::string& mode, const JobUnit& unit) {
+    return mode + "_" + p.datatype + "_" + p.showertype + "_beamen" + std::to_string(unit.runs.front().first) + "_" + unit.label
+      + (p.datatype == "data" ? "_" + p.tag : "");
+  };
+
+  std::vector< std::vector<std::string> > jobnames(nsteps, std::vector<std::string>());
+  std::vector< std::vector<std::string> > jobpaths(nsteps, std::vector<std::string>());
+  std::vector<JobUnit> merges;
+  std::vector<std::string> mergenames, mergepaths, mergedads, mergechilds;
+  for(const auto& unit : units) {
+    for(auto thisStep: util::lang::indices(steps)) {
+      jobnames[thisStep].push_back( jobname(steps[thisStep], unit) );
+      jobpaths[thisStep].push_back( base + submission_folder + steps[thisStep] + "/" + jobnames[thisStep].back() + ".sub" );
+    }
+    if(unit.nparts == 0)
+      continue;
+    if(unit.part == 0) {
+      JobUnit merge = unit;
+      merge.label = unit.runs.front().second;
+      merges.push_back(merge);
+      mergenames.push_back( jobname("merge", merge) );
+      mergepaths.push_back( base + submission_folder + "merge/" + mergenames.back() + ".sub" );
+    }
+    const auto imerge = std::find_if(merges.begin(), merges.end(), [&](const JobUnit& m) { return m.runs == unit.runs; }) - merges.begin();
+    mergedads.push_back(jobnames.back().back());
+    mergechilds.push_back(mergenames[imerge]);
+  }
+
+  for(auto thisStep: util::lang::indices(steps))
+    write_dag_jobs(filepath, jobnames[thisStep], jobpaths[thisStep], thisStep == 0 ? std::ios_base::ate : std::ios_base::app);
+  if(!merges.empty())
+    write_dag_jobs(filepath, mergenames, mergepaths, std::ios_base::app);
+  if(nsteps > 1)
+    {
+      write_dag_hierarchy(filepath, jobnames[0], jobnames[1]);
+      write_dag_repetitions(filepath, jobnames[1], 2);
+    }
+  if(!merges.empty())
+    {
+      write_dag_hierarchy(filepath, mergedads, mergechilds);
+      write_dag_repetitions(filepath, mergenames, 2);
+    }
+  write_dag_repetitions(filepath, jobnames[0], p.fused ? 2 : 1); //the fused jobs resume from their checkpoint
+
+  for(auto i: util::lang::indices(units))
+    for(auto thisStep: util::lang::indices(steps))
+      write_submission_file(units[i], jobpaths[thisStep][i], base, steps[thisStep], p);
+  for(auto i: util::lang::indices(merges))
+    write_submission_file(merges[i], mergepaths[i], base, "merge", p);
+
+  unsigned int npacked = 0, nknown = 0;
+  double longest = 0.;
+  for(const auto& unit : units) {
+    npacked += unit.runs.size() > 1 ? unit.runs.size() : 0;
+    if(unit.cost >= 0.) {
+      ++nknown;
+      longest = std::max(longest, overhead + unit.cost);
+    }
+  }
+  std::cout << "Balanced DAG: " << runs.size() << " runs in " << units.size() << " jobs (" << npacked << " runs packed, "
+	    << merges.size() << " runs split); " << units.size() - nknown << " jobs without timing information";
+  if(nknown > 0)
+    std::cout << "; longest estimated job: " << std::lround(longest / 60.) << " minutes";
+  std::cout << "." << std::endl;
+}
+
 void write_data(const std::string& submission_folder, const std::string& base, const DataParameters& p)
 {
+  const std::map<unsigned, unsigned> run_energies = data_run_energies();
   std::ifstream infile(base + "ntuple_ids.txt");
   std::vector<int> a;
   int _a;
@@ -125,7 +544,7 @@ void write_data(const std::string& submission_folder, const std::string& base, c
   //std::vector<int> avoid = {620,621,622};
 
   std::vector<int> file_id;
-  unsigned keymin=run_en_map.cbegin()->first, keymax=run_en_map.crbegin()->first;
+  unsigned keymin=run_energies.cbegin()->first, keymax=run_energies.crbegin()->first;
   for(unsigned i=keymin; i<=keymax; ++i) //min and max run numbers for data configuration #22
     {
       if( ( p.showertype == "em" and ( (i>=435 and i<=509) or (i>=594 and i<=676) ) )
@@ -139,7 +558,11 @@ void write_data(const std::string& submission_folder, const std::string& base, c
 
   std::string filepath;
   std::vector<std::string> steps;
-  if(p.last_step_only) {
+  if(p.fused) {
+    steps = {"fused"};
+    filepath = base + "clue_data_" + p.showertype + "_" + p.tag + "_" + steps[0] + ".dag";
+  }
+  else if(p.last_step_only) {
     steps = {"analysis"};
     filepath = base + "clue_data_" + p.showertype + "_" + p.tag + "_" + steps[0] + "_only.dag";
   }
@@ -147,6 +570,13 @@ void write_data(const std::string& submission_folder, const std::string& base, c
     steps = {"selection", "analysis"};
     filepath = base + "clue_data_" + p.showertype + ".dag";
   }
+  if(p.balance) {
+    std::vector< std::pair<unsigned int, std::string> > runs;
+    for(const int id : file_id)
+      runs.emplace_back(run_energies.at(id), std::to_string(id));
+    write_balanced_dag(filepath, runs, steps, submission_folder, base, p);
+    return;
+  }
   const unsigned int nsteps = steps.size();
   
   std::vector< std::vector<std::string> > jobnames(nsteps, std::vector<std::string>());
@@ -156,7 +586,7 @@ void write_data(const std::string& submission_folder, const std::string& base, c
       for(auto i: util::lang::indices(file_id))
 	{
 	  const std::string n = std::to_string(file_id[i]);
-	  const std::string thisJobname = steps[thisStep] + "_data_" + p.showertype + "_beamen" + std::to_string(run_en_map.at(file_id[i])) + "_" + n + "_" + p.tag;
+	  const std::string thisJobname = steps[thisStep] + "_data_" + p.showertype + "_beamen" + std::to_string(run_energies.at(file_id[i])) + "_" + n + "_" + p.tag;
 	  jobnames[thisStep].push_back(thisJobname);
 	  jobpaths[thisStep].push_back(base + submission_folder + steps[thisStep] + "/" + thisJobname + ".sub");
 	}
@@ -166,20 +596,20 @@ void write_data(const std::string& submission_folder, const std::string& base, c
 	write_dag_jobs(filepath, jobnames[thisStep], jobpaths[thisStep], std::ios_base::app);
     }
 
-  if(!p.last_step_only)
+  if(nsteps > 1)
     {
       write_dag_hierarchy(filepath, jobnames[0], jobnames[1]);
       write_dag_repetitions(filepath, jobnames[1], 2);
     }
-  write_dag_repetitions(filepath, jobnames[0], 1);
+  write_dag_repetitions(filepath, jobnames[0], p.fused ? 2 : 1); //the fused jobs resume from their checkpoint
 
   //write individual analysis jobs which will be submitted all at once by the DAG written above
   for(auto i: util::lang::indices(file_id))
     {
       const unsigned int thisID = file_id[i];
-      const unsigned int thisEnergy = run_en_map.at(thisID);
+      const unsigned int thisEnergy = run_energies.at(thisID);
       write_submission_file(thisID, jobpaths[0][i], base, steps[0], thisEnergy, p);
-      if(!p.last_step_only)
+      if(nsteps > 1)
 	write_submission_file(thisID, jobpaths[1][i], base, steps[1], thisEnergy, p); 
     }
 }
@@ -193,7 +623,11 @@ void write_simulation(const std::string& submission_folder, const std::string& b
 
   std::string filepath;
   std::vector<std::string> steps;
-  if(p.last_step_only) {
+  if(p.fused) {
+    steps = {"fused"};
+    filepath = base + "clue_" + p.datatype + "_" + p.showertype + "_" + p.tag + "_" + steps[0] + ".dag";
+  }
+  else if(p.last_step_only) {
     steps = {"analysis"};
     filepath = base + "clue_" + p.datatype + "_" + p.showertype + "_" + p.tag + "_" + steps[0] + "_only.dag";
   }
@@ -201,6 +635,14 @@ void write_simulation(const std::string& submission_folder, const std::string& b
     steps = {"selection", "analysis"};
     filepath = base + "clue_" + p.datatype + "_" + p.showertype + ".dag";
   }
+  if(p.balance) {
+    std::vector< std::pair<unsigned int, std::string> > runs;
+    for(const unsigned int energy : energies)
+      for(unsigned int j=0; j<ntuples_per_energy; ++j)
+	runs.emplace_back(energy, std::to_string(j));
+    write_balanced_dag(filepath, runs, steps, submission_folder, base, p);
+    return;
+  }
   const unsigned int nsteps = steps.size();
   
   std::vector< std::vector<std::string> > jobnames(nsteps, std::vector<std::string>(njobs));
@@ -222,19 +664,19 @@ void write_simulation(const std::string& submission_folder, const std::string& b
 	write_dag_jobs(filepath, jobnames[thisStep], jobpaths[thisStep], std::ios_base::app);
     }
 
-  if(!p.last_step_only)
+  if(nsteps > 1)
     {
       write_dag_hierarchy(filepath, jobnames[0], jobnames[1]);
       write_dag_repetitions(filepath, jobnames[1], 2);
     }
-  write_dag_repetitions(filepath, jobnames[0], 1);
+  write_dag_repetitions(filepath, jobnames[0], p.fused ? 2 : 1); //the fused jobs resume from their checkpoint
 
   //write individual analysis jobs which will be submitted all at once by the DAG written above
   for(auto i: util::lang::indices(energies)) {
     for(unsigned int j=0; j<ntuples_per_energy; ++j)
       {
 	write_submission_file(j, jobpaths[0][j + i*ntuples_per_energy], base, steps[0], energies[i], p);
-	if(!p.last_step_only)
+	if(nsteps > 1)
 	  write_submission_file(j, jobpaths[1][j + i*ntuples_per_energy], base, steps[1], energies[i], p);
       }
   }
@@ -245,10 +687,12 @@ int main(int argc, char **argv) {
   valid_args["--datatype"] = {"data", "sim_noproton", "sim_proton"};
   valid_args["--showertype"] = {"em", "had"};
   std::vector<std::string> free_args = {"--tag", "--w0", "--dpos"}; //any argument allowed
-  std::vector<std::string> optional_args = {"--last_step_only"}; //any argument allowed
+  std::vector<std::string> optional_args = {"--last_step_only", "--fused", "--balance", "--force"}; //any argument allowed
+  std::vector<std::string> optional_free_args = {"--ncpus", "--target_minutes"}; //optional, any value allowed
   
   int nargsmin = (valid_args.size()+free_args.size()) * 2 + 1;
-  if(argc < nargsmin or argc > nargsmin+1) {
+  int nargsmax = nargsmin + optional_args.size() + optional_free_args.size() * 2;
+  if(argc < nargsmin or argc > nargsmax) {
     std::cout << "You must specify the following:" << std::endl;
     for(auto& elem : valid_args) {
       std::string elem2 = elem.first;
@@ -262,19 +706,29 @@ int main(int argc, char **argv) {
       std::cout << elem2 + ": required, any choice allowed" << std::endl;
     }
     std::cout << "last_step_only: optional" << std::endl;
+    std::cout << "fused: optional, selection and analysis in the same job, without the intermediate ntuple" << std::endl;
+    std::cout << "ncpus: optional, number of cpus requested and used per job (default: " << DataParameters().request_cpus() << " requested, the cpus of the slot used)" << std::endl;
+    std::cout << "balance: optional, packs short runs and splits long ones into jobs of similar duration, using previous job summaries" << std::endl;
+    std::cout << "force: optional, the jobs run even if their outputs are up to date (see DataProcessing/interface/job_stamp.h)" << std::endl;
+    std::cout << "target_minutes: optional, duration of the balanced jobs (default: " << DataParameters().target_minutes << ")" << std::endl;
     return 1;
   }
   for(int iarg=0; iarg<argc; ++iarg) {
     if(std::string(argv[iarg]).find("--") != std::string::npos and
        valid_args.find(std::string(argv[iarg])) == valid_args.end() and
        std::find(free_args.begin(), free_args.end(), std::string(argv[iarg])) == free_args.end() and
-       std::find(optional_args.begin(), optional_args.end(), std::string(argv[iarg])) == optional_args.end())
+       std::find(optional_args.begin(), optional_args.end(), std::string(argv[iarg])) == optional_args.end() and
+       std::find(optional_free_args.begin(), optional_free_args.end(), std::string(argv[iarg])) == optional_free_args.end())
       {
 	std::cout << "The arguments currently supported are:" << std::endl;
 	for(auto& elem : valid_args)
 	  std::cout << elem.first << std::endl;
 	for(auto& elem : free_args)
 	  std::cout << elem << std::endl;
+	for(auto& elem : optional_args)
+	  std::cout << elem << std::endl;
+	for(auto& elem : optional_free_args)
+	  std::cout << elem << std::endl;
 	return 1;
       }
   }
@@ -294,17 +748,42 @@ int main(int argc, char **argv) {
 	else
 	  chosen_args[argvstr] = std::string(argv[iarg+1]);
       }
-      else if( std::find(free_args.begin(), free_args.end(), argvstr) != free_args.end() )
+      else if( std::find(free_args.begin(), free_args.end(), argvstr) != free_args.end() or
+	       std::find(optional_free_args.begin(), optional_free_args.end(), argvstr) != optional_free_args.end() )
 	chosen_args[argvstr] = std::string(argv[iarg+1]);
       else if(std::string(argv[iarg]) == "--last_step_only")
 	pars.last_step_only = true;
+      else if(std::string(argv[iarg]) == "--fused")
+	pars.fused = true;
+      else if(std::string(argv[iarg]) == "--balance")
+	pars.balance = true;
+      else if(std::string(argv[iarg]) == "--force")
+	pars.force = true;
     }
+  if(pars.fused and pars.last_step_only) {
+    std::cout << "The fused mode runs both steps: it cannot be combined with 'last_step_only'." << std::endl;
+    return 1;
+  }
   
   pars.datatype = chosen_args["--datatype"];
   pars.showertype = chosen_args["--showertype"];
   pars.tag = chosen_args["--tag"];
   pars.w0 = chosen_args["--w0"];
   pars.dpos = chosen_args["--dpos"];
+  if(chosen_args.find("--ncpus") != chosen_args.end()) {
+    if(std::stoi(chosen_args["--ncpus"]) <= 0) {
+      std::cout << "The number of cpus has to be positive." << std::endl;
+      return 1;
+    }
+    pars.ncpus = chosen_args["--ncpus"];
+  }
+  if(chosen_args.find("--target_minutes") != chosen_args.end()) {
+    if(std::stod(chosen_args["--target_minutes"]) <= 0.) {
+      std::cout << "The target duration of the jobs has to be positive." << std::endl;
+      return 1;
+    }
+    pars.target_minutes = chosen_args["--target_minutes"];
+  }
   
   //define common variables
   std::string cmssw_base = std::getenv("CMSSW_BASE");
@@ -316,6 +795,8 @@ int main(int argc, char **argv) {
   system( (std::string("mkdir -p ") + condorjobs_base).c_str() );
   system( (std::string("mkdir -p ") + condorjobs_base + std::string("selection/")).c_str() );
   system( (std::string("mkdir -p ") + condorjobs_base + std::string("analysis/")).c_str() );
+  system( (std::string("mkdir -p ") + condorjobs_base + submission_folder + std::string("fused/")).c_str() );
+  system( (std::string("mkdir -p ") + condorjobs_base + submission_folder + std::string("merge/")).c_str() );
 
   //write DAG files
   if(pars.datatype == "data")
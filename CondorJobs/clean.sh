@@ -1,5 +1,5 @@
 #!/usr/bin/env bash
-echo "Are you sure you want to delete the contents of the out/, log/ and submission/ folders? [y/n]"
+echo "Are you sure you want to delete the contents of the out/, log/, local/ and submission/ folders? [y/n]"
 eval `scramv1 runtime -sh`;
 CLEANPATH="$HOME/TestBeamAnalysis/src/UserCode/CondorJobs"
 while true; do
@@ -7,6 +7,7 @@ while true; do
     if [[ "${in}" == "y" ]]; then 
 	rm -rf $CLEANPATH/out/*;
 	rm -rf $CLEANPATH/log/*;
+	rm -rf $CLEANPATH/local/*;
 	rm $CLEANPATH/clue_*.out;
 	rm $CLEANPATH/clue_*.err;
 	rm $CLEANPATH/clue_*.log;
@@ -16,6 +17,8 @@ while true; do
 	rm $CLEANPATH/clue_*metrics;
 	rm $CLEANPATH/submission/selection/*sub
 	rm $CLEANPATH/submission/analysis/*sub
+	rm $CLEANPATH/submission/fused/*sub
+	rm $CLEANPATH/submission/merge/*sub
 	exit 0;
     elif [[ "${in}" == "n" ]]; then 
 	exit 1;
@@ -2,7 +2,7 @@
 declare -a ENERGIES=("20" "30" "50" "80" "100" "120" "150" "200" "250" "300")
 declare -a DATATYPES=("data" "sim_proton" "sim_noproton")
 declare -a SHOWERTYPES=("em" "had")
-declare -a STEPS=("selection" "analysis")
+declare -a STEPS=("selection" "analysis" "fused" "merge")
 
 varExists() { 
     # Checks whether a certain environment variable already exists
@@ -18,7 +18,7 @@ varExists() {
 ##########################
 ########PARSING###########
 ##########################
-ARGS=`getopt -o "" -l ",ntupleid:,step:,datatype:,showertype:,energy:,tag:,w0:,dpos:" -n "getopts_${0}" -- "$@"`
+ARGS=`getopt -o "" -l ",ntupleid:,step:,datatype:,showertype:,energy:,tag:,w0:,dpos:,ncpus:,part:,nparts:,entries:,force" -n "getopts_${0}" -- "$@"`
 
 #Bad arguments
 if [ $? -ne 0 ];
@@ -77,13 +77,14 @@ while true; do
 
 	--energy)
 	    if [ -n "$2" ]; then
-		if [[ ! " ${ENERGIES[@]} " =~ " ${2} " ]]; then
-		    echo "Energy with value ${2} is not part of the analysis."
-		    exit 1;
-		else
-		    ENERGY="${2}";
-		    echo "Beam energy: ${ENERGY} GeV";
-		fi
+		for en in ${2//,/ }; do #one energy per run of a packed job
+		    if [[ ! " ${ENERGIES[@]} " =~ " ${en} " ]]; then
+			echo "Energy with value ${en} is not part of the analysis."
+			exit 1;
+		    fi
+		done
+		ENERGY="${2}";
+		echo "Beam energy: ${ENERGY} GeV";
 	    fi
 	    shift 2;;
 
@@ -107,6 +108,39 @@ while true; do
 		echo "dpos (cluster position measurement): ${DPOS}";
 	    fi
 	    shift 2;;
+
+	--ncpus)
+	    if [ -n "$2" ]; then
+		NCPUS="${2}";
+		echo "Number of cpus: ${NCPUS}";
+	    fi
+	    shift 2;;
+
+	--part)
+	    if [ -n "$2" ]; then
+		PART="${2}";
+		echo "Part of a split run: ${PART}";
+	    fi
+	    shift 2;;
+
+	--nparts)
+	    if [ -n "$2" ]; then
+		NPARTS="${2}";
+		echo "Parts to merge: ${NPARTS}";
+	    fi
+	    shift 2;;
+
+	--entries)
+	    if [ -n "$2" ]; then
+		ENTRIES="${2}";
+		echo "Entries of the input ntuple: ${ENTRIES}";
+	    fi
+	    shift 2;;
+
+	--force)
+	    FORCE=true;
+	    echo "Outputs written again even if up to date";
+	    shift;;
 	
 	--)
 	    shift
@@ -136,8 +170,25 @@ if [[ -z "${DATATYPE}" ]]; then
     printf "\n"
     exit 1;
 fi
-if [[ ( "${DATATYPE}" == *"sim"* ) && ( "${NTUPLEID}" -gt 4 ) ]]; then
-    echo "Simulation data has Ntuples numbered from 0 to 4."
+#packed jobs process several runs, given as comma-separated lists of ntuple ids and energies
+IFS="," read -r -a NTUPLEIDS <<< "${NTUPLEID}"
+IFS="," read -r -a RUNENERGIES <<< "${ENERGY}"
+if [[ "${#NTUPLEIDS[@]}" -ne "${#RUNENERGIES[@]}" ]]; then
+    echo "Please specify one beam energy per ntuple id."
+    exit 1;
+fi
+for id in "${NTUPLEIDS[@]}"; do
+    if [[ ( "${DATATYPE}" == *"sim"* ) && ( "${id}" -gt 4 ) ]]; then
+	echo "Simulation data has Ntuples numbered from 0 to 4."
+	exit 1;
+    fi
+done
+if [[ ( -n "${PART}${ENTRIES}" ) && ( "${#NTUPLEIDS[@]}" -gt 1 ) ]]; then
+    echo "Only single runs can be split."
+    exit 1;
+fi
+if [[ ( "${STEP}" == "merge" ) && ( -z "${NPARTS}" ) ]]; then
+    echo "Please specify the number of parts to merge."
     exit 1;
 fi
 if [[ -z "${SHOWERTYPE}" ]]; then
@@ -158,19 +209,25 @@ if [[ -z "${ENERGY}" ]]; then
     printf "[GeV].\n"
     exit 1;
 fi
-if [[ ( -z "${TAG}" ) && ( "${STEP}" == "analysis" ) ]]; then
-    echo "Please specify the tag when running the analysis step."
+if [[ ( -z "${TAG}" ) && ( "${STEP}" != "selection" ) ]]; then
+    echo "Please specify the tag when running the analysis (or fused) step."
     exit 1;
 fi
-if [[ ( -z "${W0}" ) && ( "${STEP}" == "analysis" ) ]]; then
+if [[ ( -z "${W0}" ) && ( "${STEP}" != "selection" ) ]]; then
     echo "Please specify the 'w0' parameter when running the analysis step, to fully specify the cluster position measurement algorithm."
     exit 1;
 fi
-if [[ ( -z "${DPOS}" ) && ( "${STEP}" == "analysis" ) ]]; then
+if [[ ( -z "${DPOS}" ) && ( "${STEP}" != "selection" ) ]]; then
     echo "Please specify the 'dpos' parameter when running the analysis step, to fully specify the cluster position measurement algorithm."
     exit 1;
 fi
 
+#the executables auto-detect the number of cpus when it is not specified
+CPU_OPTS=""
+if [[ -n "${NCPUS}" ]]; then
+    CPU_OPTS="--ncpus ${NCPUS}"
+fi
+
 ##########################
 ##########################
 ##########################
@@ -186,15 +243,45 @@ else
     exit 0;
 fi
 
-cd "${ANALYSIS_PATH}";
-source /afs/cern.ch/cms/cmsset_default.sh
-eval `scramv1 runtime -sh` #cmsenv substitute
+#the local executor (run_dag) runs the jobs in the environment it was started from
+if [[ -z "${LOCAL_DAG_EXECUTOR}" ]]; then
+    cd "${ANALYSIS_PATH}";
+    source /afs/cern.ch/cms/cmsset_default.sh
+    eval `scramv1 runtime -sh` #cmsenv substitute
+
+    #back to the job folder
+    cd "${INIT_FOLDER}";
+fi
 
-#back to the job folder
-cd "${INIT_FOLDER}";
 
-if [[ "${STEP}" == "selection" ]]; then
+part_path() {
+    # Location of an output of a split run: in the 'parts/part<k>' subfolder, with the same file name
+    # Arguments:
+    # 1. Output of the whole run
+    if [[ -z "${PART}" ]]; then
+	echo "${1}";
+    else
+	local dir="$(dirname "${1}")/parts/part${PART}";
+	mkdir -p "${dir}";
+	echo "${dir}/$(basename "${1}")";
+    fi
+}
+
+part_files() {
+    # Sets PARTS to the NPARTS parts of an output of a split run and MISSING to the number of them not written
+    # Arguments:
+    # 1. Output of the whole run
+    PARTS=()
+    MISSING=0
+    for ((k=0; k<NPARTS; k++)); do
+	local part="$(dirname "${1}")/parts/part${k}/$(basename "${1}")";
+	PARTS+=("${part}");
+	[[ -f "${part}" ]] || MISSING=$((MISSING+1));
+    done
+}
 
+selection_files() {
+    # Sets INFILE, OUTFILE and IMPACT_CACHE for the selection of the run NTUPLEID at energy ENERGY
     if [[ "${DATATYPE}" == "data" ]]; then
 	if [[ "${SHOWERTYPE}" == "em" ]]; then
 	    INFILE="/eos/cms/store/group/dpg_hgcal/tb_hgcal/2018/cern_h2_october/offline_analysis/ntuples/v16/ntuple_${NTUPLEID}.root"; #HGCAL only
@@ -213,21 +300,12 @@ if [[ "${STEP}" == "selection" ]]; then
 	fi
 	OUTFILE="/eos/user/b/bfontana/TestBeamReconstruction/ntuple_selection_${DATATYPE}_${SHOWERTYPE}_beamen${ENERGY}_${NTUPLEID}.root";
     fi
-    echo "Input file: ${INFILE}"
-    echo "Output file: ${OUTFILE}"
-    process_data_exe "${INFILE}" "${OUTFILE}" "${DATATYPE}" "${SHOWERTYPE}" "${ENERGY}";
-
-elif [[ "${STEP}" == "analysis" ]]; then
-
-    OUTNAME="outEcut"
-    if [[ "${DATATYPE}" == "data" ]]; then
-	INFILE="/eos/user/b/bfontana/TestBeamReconstruction/ntuple_selection_${DATATYPE}_${SHOWERTYPE}_${NTUPLEID}.root";
-    elif [[ "${DATATYPE}" == "sim_noproton" ]]; then
-	INFILE="/eos/user/b/bfontana/TestBeamReconstruction/ntuple_selection_${DATATYPE}_${SHOWERTYPE}_beamen${ENERGY}_${NTUPLEID}.root"
-    elif [[ "${DATATYPE}" == "sim_proton" ]]; then
-	INFILE="/eos/user/b/bfontana/TestBeamReconstruction/ntuple_selection_${DATATYPE}_${SHOWERTYPE}_beamen${ENERGY}_${NTUPLEID}.root"
-    fi
+    #shifted impact points of the run, built by its first selection and read by the following ones (shared by the parts)
+    IMPACT_CACHE="${OUTFILE/ntuple_selection_/impact_cache_}"
+}
 
+analysis_files() {
+    # Sets OUTFILE1, OUTFILE2 and OUTFILE3 for the analysis of the run NTUPLEID at energy ENERGY
     EOS_PATH="/eos/user/b/bfontana/TestBeamReconstruction/${TAG}/"
     mkdir -p "${EOS_PATH}"
 
@@ -238,12 +316,139 @@ elif [[ "${STEP}" == "analysis" ]]; then
     mkdir -p "${EOS_PATH}${LAYERFOLDER}"
     mkdir -p "${EOS_PATH}${CLUSTERFOLDER}"
     
+    OUTNAME="outEcut"
     OUTFILE1="${EOS_PATH}${HITFOLDER}${OUTNAME}_${DATATYPE}_${SHOWERTYPE}_beamen${ENERGY}_${NTUPLEID}.csv"; 
     OUTFILE2="${EOS_PATH}${LAYERFOLDER}${OUTNAME}_${DATATYPE}_${SHOWERTYPE}_beamen${ENERGY}_${NTUPLEID}.root";
     OUTFILE3="${EOS_PATH}${CLUSTERFOLDER}${OUTNAME}_${DATATYPE}_${SHOWERTYPE}_beamen${ENERGY}_${NTUPLEID}.root";
+}
 
-    echo "Input file: ${INFILE}"
-    echo -e "Output files:\n${OUTFILE1}\n${OUTFILE2}\n${OUTFILE3}"
-    analyze_data_exe "${INFILE}" "${OUTFILE1}" "${OUTFILE2}" "${OUTFILE3}" "${SHOWERTYPE}" "${W0}" "${DPOS}";
+attempt_path() {
+    # A speculative copy of the job (see CondorJobs/bin/run_dag.cc) writes its outputs to a folder of its own, listed in
+    # its scratch folder: run_dag moves them to their final location once the original job is killed, or removes them
+    # Arguments:
+    # 1. Name of the variable holding the output, modified in place
+    if [[ -n "${SPECULATIVE_COPY}" ]]; then
+	local dir="$(dirname "${!1}")/speculative_$$"; #no '.': the executables derive names from the first '.'
+	mkdir -p "${dir}";
+	if ! grep -qxF "${dir}" "${_CONDOR_SCRATCH_DIR}/attempt_dirs" 2> /dev/null; then
+	    echo "${dir}" >> "${_CONDOR_SCRATCH_DIR}/attempt_dirs";
+	fi
+	printf -v "${1}" "%s" "${dir}/$(basename "${!1}")";
+    fi
+}
+
+#the executables skip their work when their outputs were written from the same inputs, executable and options, as
+#recorded in the '.stamp' file next to the outputs
+SKIP_OPTS="--skip_up_to_date"
+if [[ -n "${FORCE}" ]]; then
+    SKIP_OPTS=""
+fi
+
+ENTRY_OPTS=""
+if [[ -n "${ENTRIES}" ]]; then
+    ENTRY_OPTS="--entries ${ENTRIES%:*} ${ENTRIES#*:}"
+fi
 
+#the selection of a packed job runs in batch mode: the calibration and the thread pool are loaded once for all its runs
+if [[ ( "${STEP}" == "selection" ) && ( "${#NTUPLEIDS[@]}" -gt 1 ) ]]; then
+    RUNLIST="${INIT_FOLDER}/run_list_${TAG}.txt"
+    rm -f "${RUNLIST}"
+    RUNOUTFILES=()
+    for irun in "${!NTUPLEIDS[@]}"; do
+	NTUPLEID="${NTUPLEIDS[${irun}]}"
+	ENERGY="${RUNENERGIES[${irun}]}"
+	selection_files
+	attempt_path OUTFILE
+	RUNOUTFILES+=("${OUTFILE}")
+	echo "${INFILE} ${OUTFILE} ${ENERGY} ${IMPACT_CACHE}" >> "${RUNLIST}"
+    done
+    cat "${RUNLIST}"
+    process_data_exe --batch "${RUNLIST}" "${DATATYPE}" "${SHOWERTYPE}" ${CPU_OPTS} ${SKIP_OPTS} || exit 1;
+    #the summary of each run, stored in the stamp of its output, is read by write_dag from the output of the job
+    for irun in "${!NTUPLEIDS[@]}"; do
+	echo "JOBRUN ${NTUPLEIDS[${irun}]} ${RUNENERGIES[${irun}]}"
+	grep "^JOBSUMMARY " "${RUNOUTFILES[${irun}]}.stamp"
+    done
+    exit 0;
 fi
+
+for irun in "${!NTUPLEIDS[@]}"; do
+    NTUPLEID="${NTUPLEIDS[${irun}]}"
+    ENERGY="${RUNENERGIES[${irun}]}"
+
+    #the fused step reads the same input as the selection and writes the same outputs as the analysis
+    if [[ "${STEP}" == "selection" || "${STEP}" == "fused" ]]; then
+	selection_files
+	OUTFILE=$(part_path "${OUTFILE}")
+	attempt_path OUTFILE
+	if [[ "${STEP}" == "selection" ]]; then
+	    #the parts of a split run are merged without their event index
+	    INDEX_OPTS=""
+	    if [[ -n "${PART}" ]]; then
+		INDEX_OPTS="--no_index"
+	    fi
+	    echo "Input file: ${INFILE}"
+	    echo "Output file: ${OUTFILE}"
+	    process_data_exe "${INFILE}" "${OUTFILE}" "${DATATYPE}" "${SHOWERTYPE}" "${ENERGY}" ${CPU_OPTS} --impact_cache "${IMPACT_CACHE}" ${ENTRY_OPTS} ${INDEX_OPTS} ${SKIP_OPTS} || exit 1;
+	fi
+    fi
+
+    if [[ "${STEP}" == "analysis" || "${STEP}" == "fused" ]]; then
+	FUSED_OPTS=""
+	if [[ "${STEP}" == "fused" ]]; then
+	    FUSED_OPTS="--fused ${DATATYPE} ${ENERGY} --impact_cache ${IMPACT_CACHE} ${ENTRY_OPTS}" #INFILE is the input of the selection
+	else
+	    selection_files
+	    INFILE=$(part_path "${OUTFILE}")
+	fi
+
+	analysis_files
+	OUTFILE1=$(part_path "${OUTFILE1}")
+	OUTFILE2=$(part_path "${OUTFILE2}")
+	OUTFILE3=$(part_path "${OUTFILE3}")
+	attempt_path OUTFILE1
+	attempt_path OUTFILE2
+	attempt_path OUTFILE3
+
+	echo "Input file: ${INFILE}"
+	echo -e "Output files:\n${OUTFILE1}\n${OUTFILE2}\n${OUTFILE3}"
+	#the summary printed by each run of a packed job is read by write_dag as the summary of that run
+	if [[ "${#NTUPLEIDS[@]}" -gt 1 ]]; then
+	    echo "JOBRUN ${NTUPLEID} ${ENERGY}"
+	fi
+	#a retried job resumes from the checkpoint stored next to the hit-level output
+	analyze_data_exe "${INFILE}" "${OUTFILE1}" "${OUTFILE2}" "${OUTFILE3}" "${SHOWERTYPE}" "${W0}" "${DPOS}" ${CPU_OPTS} ${FUSED_OPTS} --checkpoint ${SKIP_OPTS} || exit 1;
+    fi
+
+    #the outputs of the parts of a split run are merged into the outputs of the whole run, and then removed
+    if [[ "${STEP}" == "merge" ]]; then
+	selection_files
+	analysis_files
+	#names written by analyze_data_exe: the layer-dependent output of a run also carries its beam energy
+	MERGED=("${OUTFILE}" "${OUTFILE2%.root}_layerdep_${SHOWERTYPE}_beamen${ENERGY}.root" "${OUTFILE3%.root}_clusterdep${SHOWERTYPE}.root"
+		"${OUTFILE1}" "${OUTFILE1%.csv}_noclusters.csv")
+	#every part has to be there before anything is merged (and its parts removed), so that the job can be retried
+	for target in "${MERGED[@]}"; do
+	    part_files "${target}"
+	    if [[ ${MISSING} -gt 0 && ! ( "${target}" == "${OUTFILE}" && ${MISSING} -eq ${NPARTS} ) ]]; then
+		echo "${MISSING} of the ${NPARTS} parts of ${target} are missing."
+		exit 1;
+	    fi
+	done
+	for target in "${MERGED[@]}"; do
+	    part_files "${target}"
+	    if [[ ${MISSING} -gt 0 ]]; then
+		continue; #the selection ntuple is not written by the fused jobs
+	    fi
+	    echo "Merging ${NPARTS} parts into ${target}"
+	    MERGEDFILE="${target}"
+	    attempt_path MERGEDFILE
+	    if [[ "${target}" == *".csv" ]]; then
+		{ cat "${PARTS[0]}"; for part in "${PARTS[@]:1}"; do tail -n +2 "${part}"; done; } > "${MERGEDFILE}" || exit 1; #one header
+	    else
+		hadd -f "${MERGEDFILE}" "${PARTS[@]}" || exit 1;
+	    fi
+	    rm -f "${PARTS[@]}"
+	done
+    fi
+done
@@ -1,26 +1,131 @@
+#include <sstream>
 #include "UserCode/DataProcessing/interface/analyzer.h"
+#include "UserCode/DataProcessing/interface/selector.h"
+#include "UserCode/DataProcessing/interface/job_stamp.h"
 
-void analysis_CLUE(const std::string& in_fname, const std::string& out_fname, const std::string& out_fname2, const std::string& out_fname3, const std::string& in_tname, const SHOWERTYPE& st, const float W0, const float dpos) {
+//fused mode: the inputs are the original ntuples, whose events are selected in the same event loop as the clustering
+struct FusedOptions {
+  bool enabled = false;
+  std::string datatype, showertype;
+  int beam_energy = 0;
+  std::string snapshot_fname; //the selected events are also written to this file (for debugging or caching) if not empty
+  std::string impact_cache; //shifted impact points of the run, shared with the selection jobs
+  ULong64_t first_entry = 0, last_entry = 0; //entry range of the original ntuple, when a large run is split
+};
+
+void analysis_CLUE(const std::vector<std::string>& in_fnames, const std::string& out_fname, const std::string& out_fname2, const std::string& out_fname3, const std::string& in_tname, const SHOWERTYPE& st, const float W0, const float dpos, const parallelism::Options& popt, const columnar::WriterOptions& wopt, const bool& npy_output, const bool& async_output, const bool& multirun, const unsigned& batch_events, const bool& checkpoint, const FusedOptions& fopt, const bool& skip_up_to_date) {
   const float dc = 1.3f /*centimeters*/;
   const float kappa = 9.f;
   const float ecut = 3.f;
+  const std::string out_stem = out_fname.substr(0, out_fname.rfind('.'));
+
+  //content-addressed stamp of the outputs, next to the hit-level output (see job_stamp.h): the inputs are the stamps
+  //of the selection outputs, so that the analysis is skipped when only the selection was submitted again
+  jobstamp::Stamp stamp;
+  stamp.add_executable();
+  for(const auto& in_fname : in_fnames)
+    stamp.add_input(in_fname);
+  if(fopt.enabled) {
+    stamp.add_calibration();
+    stamp.add_config("datatype", fopt.datatype);
+    stamp.add_config("beam_energy", fopt.beam_energy);
+    stamp.add_config("first_entry", fopt.first_entry);
+    stamp.add_config("last_entry", fopt.last_entry);
+    stamp.add_config("snapshot", fopt.snapshot_fname);
+  }
+  stamp.add_config("showertype", static_cast<int>(st));
+  stamp.add_config("w0", W0);
+  stamp.add_config("dpos", dpos);
+  stamp.add_config("dc", dc);
+  stamp.add_config("kappa", kappa);
+  stamp.add_config("ecut", ecut);
+  stamp.add_config("npy", npy_output);
+  stamp.add_config("multirun", multirun);
+  stamp.add_config("batch_events", batch_events);
+  stamp.add_config("columnar", wopt.enabled);
+  stamp.add_config("compression", columnar::compression_settings(wopt));
+  stamp.add_config("basket_size", wopt.basket_size);
+  //the layer- and cluster-dependent outputs are named after the beam energy of each run: the names recorded in the stamp
+  //by the last run are checked instead
+  if(skip_up_to_date and stamp.up_to_date(out_fname)) {
+    std::cout << "The outputs of " << out_fname << " are up to date: the analysis is skipped." << std::endl;
+    jobstamp::Stamp::print_summary(out_fname);
+    return;
+  }
+  jobstamp::Stamp::remove(out_fname);
+
   /*////////////////////////
     Run custom analyzer
   *////////////////////////
-  Analyzer ana(in_fname, in_tname, dc, kappa, ecut, st, W0, dpos);
-  ana.runCLUE();
-  ana.save_to_file(out_fname);
-  ana.save_to_file_layer_dependent(out_fname2);
-  ana.save_to_file_cluster_dependent(out_fname3);
-
-  //sum rechit energy directly without clustering
-  bool sum_with_ecut = true;
-  ana.sum_energy(sum_with_ecut);
+  Analyzer ana(in_fnames, in_tname, dc, kappa, ecut, st, W0, dpos);
+  if(popt.ncpus != std::nullopt)
+    ana.set_ncpus(popt.ncpus.value());
+  ana.set_thread_pinning(popt.pin);
+  //the selection of each input file feeds the clustering directly, without the intermediate ntuple
+  std::vector< std::unique_ptr<Selector> > selectors;
+  if(fopt.enabled) {
+    if(!fopt.snapshot_fname.empty() and in_fnames.size() > 1)
+      throw std::invalid_argument("The snapshot of the selected events requires a single input file.");
+    std::vector<ROOT::RDF::RNode> nodes;
+    std::vector<std::string> sources; //identify the selected events in the checkpoints
+    const auto calib = Selector::load_calibration(); //shared by the runs
+    for(const auto& in_fname : in_fnames) {
+      selectors.emplace_back( new Selector(in_fname, fopt.snapshot_fname, fopt.datatype, fopt.showertype, fopt.beam_energy, calib) );
+      if(popt.ncpus != std::nullopt)
+	selectors.back()->set_ncpus(popt.ncpus.value());
+      selectors.back()->set_thread_pinning(popt.pin);
+      selectors.back()->set_impact_cache(fopt.impact_cache);
+      if(fopt.last_entry > 0)
+	selectors.back()->set_entry_range(fopt.first_entry, fopt.last_entry);
+      nodes.push_back( selectors.back()->selection(!fopt.snapshot_fname.empty()) );
+      sources.push_back( selectors.back()->source_id() );
+    }
+    ana.set_input_nodes(nodes, sources);
+  }
+  //several runs are processed together, splitting them in entry ranges scheduled on a work-stealing pool
+  ana.set_multirun(multirun);
+  //events with few hits are clustered together, amortizing the cost of each call to CLUE
+  ana.set_batch_events(batch_events);
+  //an interrupted job restarted with the same inputs and parameters resumes from the last checkpoint
+  if(checkpoint)
+    ana.set_checkpoint(out_stem + ".ckpt");
+  //the layer- and cluster-dependent outputs are written by a background thread while the clustering is running
+  if(async_output)
+    ana.set_async_output(out_fname2, out_fname3, wopt);
+  ana.runCLUE(); //also sums the rechit energy directly without clustering (with ecut), in the same pass
+  //the energy sums are written either in the CSV or in the NumPy ('.npy', one file per column) format
+  if(npy_output)
+    ana.save_to_file_npy(out_stem);
+  else
+    ana.save_to_file(out_fname);
+  if(async_output)
+    ; //already written during runCLUE()
+  else if(wopt.enabled) {
+    ana.save_to_file_layer_dependent_columnar(out_fname2, wopt);
+    ana.save_to_file_cluster_dependent_columnar(out_fname3, wopt);
+  }
+  else {
+    ana.save_to_file_layer_dependent(out_fname2);
+    ana.save_to_file_cluster_dependent(out_fname3);
+  }
+
   std::string first_half = out_fname.substr(0,out_fname.find('.', 20)); //the 20 avoids the '.' in 'cern.ch'
   std::string second_half = out_fname.substr(out_fname.find('.', 20), 4);
   std::string first_half2 = out_fname2.substr(0,out_fname2.find('.', 20)); //the 20 avoids the '.' in 'cern.ch'
   std::string second_half2 = out_fname2.substr(out_fname2.find('.', 20), 4);
-  ana.save_to_file(first_half + "_noclusters" + second_half);
+  if(npy_output)
+    ana.save_to_file_noclusters_npy(out_stem + "_noclusters");
+  else
+    ana.save_to_file_noclusters(first_half + "_noclusters" + second_half);
+  ana.clear_checkpoint();
+
+  //job summary, printed to the job output: sizes the memory requested by the next submissions of the same job
+  memprof::JobSummary summary;
+  ana.fill_summary(summary);
+  summary.add_rss();
+  summary.add_wall_time();
+  summary.print();
+  stamp.write(out_fname, summary, ana.written_outputs()); //once all the outputs are complete
 }
 
 //run example: analyze_data_exe /eos/user/b/bfontana/TestBeamReconstruction/ntuple_selection_437.root out_TEST.csv
@@ -33,6 +138,79 @@ int main(int argc, char **argv) {
   const std::string showertype = std::string(argv[5]);  
   const float W0 = std::stof(argv[6]);  
   const float dpos = std::stof(argv[7]);  
+  //optional: --ncpus <n> (defaults to the cpus available to the job) and --pin (pin threads to cores)
+  const parallelism::Options popt = parallelism::parse_args(argc, argv, 8);
+  //optional: --columnar, --compression <lz4|zstd|zlib|lzma>, --compression_level <n>, --basket_size <n>
+  const columnar::WriterOptions wopt = columnar::parse_args(argc, argv, 8);
+  //optional: --npy, writes the energy sums in the NumPy format instead of CSV
+  //optional: --async_output, streams the layer- and cluster-dependent outputs to disk while clustering
+  //optional: --multirun, processes the comma-separated input files together instead of one after the other
+  //optional: --batch_events <n>, clusters the events in batches of <n> with a single call to CLUE each (1 by default)
+  //optional: --checkpoint, saves the progress periodically next to the hit-level output and resumes from it
+  //optional: --fused <datatype> <beam_energy>, reads the original ntuples and selects their events in memory
+  //optional: --snapshot <file>, in the fused mode, also writes the selected events to <file>
+  //optional: --impact_cache <file>, in the fused mode, reads the shifted impact points from <file>
+  //optional: --entries <first> <last>, in the fused mode, processes the entries in [first, last) of the original ntuple
+  //optional: --skip_up_to_date, does nothing if the outputs were written with the same inputs, executable and options
+  bool npy_output = false, async_output = false, multirun = false, checkpoint = false, skip_up_to_date = false;
+  unsigned batch_events = 1;
+  FusedOptions fopt;
+  fopt.showertype = showertype;
+  for(int iarg=8; iarg<argc; ++iarg) {
+    if(std::string(argv[iarg]) == "--npy")
+      npy_output = true;
+    else if(std::string(argv[iarg]) == "--async_output")
+      async_output = true;
+    else if(std::string(argv[iarg]) == "--multirun")
+      multirun = true;
+    else if(std::string(argv[iarg]) == "--batch_events") {
+      if(iarg+1 >= argc)
+	throw std::invalid_argument("The '--batch_events' option requires a value.");
+      batch_events = std::stoul(argv[++iarg]);
+    }
+    else if(std::string(argv[iarg]) == "--checkpoint")
+      checkpoint = true;
+    else if(std::string(argv[iarg]) == "--skip_up_to_date")
+      skip_up_to_date = true;
+    else if(std::string(argv[iarg]) == "--fused") {
+      if(iarg+2 >= argc)
+	throw std::invalid_argument("The '--fused' option requires the data type and the beam energy.");
+      fopt.enabled = true;
+      fopt.datatype = argv[iarg+1];
+      fopt.beam_energy = std::stoi(argv[iarg+2]);
+      iarg += 2;
+    }
+    else if(std::string(argv[iarg]) == "--snapshot") {
+      if(iarg+1 >= argc)
+	throw std::invalid_argument("The '--snapshot' option requires a value.");
+      fopt.snapshot_fname = argv[++iarg];
+    }
+    else if(std::string(argv[iarg]) == "--impact_cache") {
+      if(iarg+1 >= argc)
+	throw std::invalid_argument("The '--impact_cache' option requires a value.");
+      fopt.impact_cache = argv[++iarg];
+    }
+    else if(std::string(argv[iarg]) == "--entries") {
+      if(iarg+2 >= argc)
+	throw std::invalid_argument("The '--entries' option requires the first and the last entries.");
+      fopt.first_entry = std::stoull(argv[iarg+1]);
+      fopt.last_entry = std::stoull(argv[iarg+2]);
+      iarg += 2;
+    }
+  }
+  if(!fopt.snapshot_fname.empty() and !fopt.enabled)
+    throw std::invalid_argument("The '--snapshot' option is only supported in the fused mode.");
+  if(!fopt.impact_cache.empty() and !fopt.enabled)
+    throw std::invalid_argument("The '--impact_cache' option is only supported in the fused mode.");
+  if(fopt.last_entry > 0 and !fopt.enabled)
+    throw std::invalid_argument("The '--entries' option is only supported in the fused mode.");
+
+  //the input may be a comma-separated list of files (runs)
+  std::vector<std::string> in_fnames;
+  std::stringstream in_stream(in_fname);
+  std::string fname;
+  while(std::getline(in_stream, fname, ','))
+    in_fnames.push_back(fname);
 
   const std::string str2 = out_fname2.substr(0,out_fname2.find('.', 20)); //the 20 avoids the '.' in 'cern.ch'
   const std::string str3 = out_fname3.substr(0,out_fname3.find('.', 20)); //the 20 avoids the '.' in 'cern.ch'
@@ -45,6 +223,6 @@ int main(int argc, char **argv) {
     st = SHOWERTYPE::EM;
   else if( showertype == "had" )
     st = SHOWERTYPE::HAD;
-  analysis_CLUE(in_fname, out_fname, out_fname_layer_dependent, out_fname_cluster_dependent, in_tname, st, W0, dpos);
+  analysis_CLUE(in_fnames, out_fname, out_fname_layer_dependent, out_fname_cluster_dependent, in_tname, st, W0, dpos, popt, wopt, npy_output, async_output, multirun, batch_events, checkpoint, fopt, skip_up_to_date);
   return 0;
 }
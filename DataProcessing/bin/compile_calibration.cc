@@ -0,0 +1,33 @@
+#include <iostream>
+#include "UserCode/DataProcessing/interface/calibration_db.h"
+
+//run example: compile_calibration_exe (writes $HOME/$CMSSW_VERSION/src/UserCode/DataProcessing/Calibration.db)
+int main(int argc, char **argv) {
+  const std::string dir = calibdb::data_dir();
+  std::string noise_map = dir + "Noise_Map.txt";
+  std::string impact_shifts = dir + "Impact_Shifts.txt";
+  std::string run_list = dir + "python/HGCALBeamTestRunList_October2018.py";
+  std::string output = calibdb::default_path();
+
+  //optional: --noise_map <file>, --impact_shifts <file>, --run_list <file>, --output <file>
+  for(int iarg=1; iarg<argc; ++iarg) {
+    const std::string arg = argv[iarg];
+    if(arg != "--noise_map" and arg != "--impact_shifts" and arg != "--run_list" and arg != "--output")
+      throw std::invalid_argument("Unknown option '" + arg + "'.");
+    if(iarg+1 >= argc)
+      throw std::invalid_argument("The '" + arg + "' option requires a value.");
+    const std::string value = argv[++iarg];
+    if(arg == "--noise_map")
+      noise_map = value;
+    else if(arg == "--impact_shifts")
+      impact_shifts = value;
+    else if(arg == "--run_list")
+      run_list = value;
+    else
+      output = value;
+  }
+
+  calibdb::compile(noise_map, impact_shifts, run_list, output);
+  std::cout << "Calibration database (version " << calibdb::version << ") written to " << output << "." << std::endl;
+  return 0;
+}
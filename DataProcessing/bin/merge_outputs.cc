@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+#include "UserCode/DataProcessing/interface/merger.h"
+#include "UserCode/DataProcessing/interface/parallelism.h"
+#include "UserCode/DataProcessing/interface/CLUEAnalysis.h"
+
+//per-run outputs of one beam energy: '<folder>/outEcut_<datatype>_<showertype>_beamen<energy>_*.root'
+std::vector<std::string> find_inputs(const std::string& folder, const std::string& datatype, const std::string& showertype, const std::string& energy) {
+  const std::string prefix = "outEcut_" + datatype + "_" + showertype + "_beamen" + energy + "_";
+  const std::string suffix = ".root";
+  std::vector<std::string> inputs;
+  for(const auto& entry : std::filesystem::directory_iterator(folder)) {
+    const std::string name = entry.path().filename().string();
+    if(name.size() > prefix.size() + suffix.size() and name.compare(0, prefix.size(), prefix) == 0
+       and name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+      inputs.push_back(entry.path().string());
+  }
+  std::sort(inputs.begin(), inputs.end());
+  return inputs;
+}
+
+//run example: merge_outputs_exe /eos/user/b/bfontana/TestBeamReconstruction/<tag>/layer_dependent/ layerdep sim_proton em
+int main(int argc, char **argv) {
+  if(argc < 5)
+    throw std::invalid_argument("Usage: merge_outputs_exe <folder> <layerdep|clusterdep> <datatype> <showertype> [options]");
+  const std::string folder = std::string(argv[1]);
+  const std::string analysistype = std::string(argv[2]);
+  const std::string datatype = std::string(argv[3]);
+  const std::string showertype = std::string(argv[4]);
+
+  merging::Options opt;
+  //optional: --ncpus <n> (defaults to the cpus available to the job) and --pin (pin threads to cores)
+  const parallelism::Options popt = parallelism::parse_args(argc, argv, 5);
+  opt.ncpus = parallelism::resolve_ncpus(popt.ncpus);
+  opt.pin = popt.pin;
+  //optional: --columnar, --compression <lz4|zstd|zlib|lzma>, --compression_level <n>, --basket_size <n>
+  opt.wopt = columnar::parse_args(argc, argv, 5);
+  //optional: --energies <e1,e2,...>, the beam energies to merge (all by default)
+  //optional: --summary, also writes per-layer profiles and histograms to the 'summary' directory of the outputs
+  //optional: --fast, copies the compressed baskets as hadd does (legacy layout only, without summary)
+  std::string energies = "20,30,50,80,100,120,150,200,250,300";
+  for(int iarg=5; iarg<argc; ++iarg) {
+    if(std::string(argv[iarg]) == "--summary")
+      opt.summary = true;
+    else if(std::string(argv[iarg]) == "--fast")
+      opt.fast = true;
+    else if(std::string(argv[iarg]) == "--energies") {
+      if(iarg+1 >= argc)
+	throw std::invalid_argument("The '--energies' option requires a value.");
+      energies = argv[++iarg];
+    }
+  }
+
+  SHOWERTYPE st;
+  if( showertype=="em" )
+    st = SHOWERTYPE::EM;
+  else if( showertype == "had" )
+    st = SHOWERTYPE::HAD;
+  else
+    throw std::invalid_argument("Wrong shower type.");
+  const unsigned lmax = CLUEAnalysis(st, 0.f, 0.f).getLayerMax();
+  const merging::Analysis analysis = merging::parse_analysis(analysistype);
+
+  std::vector<merging::Job> jobs;
+  std::stringstream energy_stream(energies);
+  std::string energy;
+  while(std::getline(energy_stream, energy, ',')) {
+    merging::Job job;
+    job.inputs = find_inputs(folder, datatype, showertype, energy);
+    if(job.inputs.empty())
+      continue;
+    job.output = (std::filesystem::path(folder) / ("hadd_" + analysistype + "_" + datatype + "_" + showertype + "_beamen" + energy + ".root")).string();
+    job.beam_energy = std::stof(energy);
+    jobs.push_back(job);
+  }
+  if(jobs.empty())
+    throw std::invalid_argument("There are no inputs to merge in " + folder + ".");
+
+  const std::vector<merging::Result> results = merging::merge(jobs, analysis, lmax, opt);
+  for(const auto& r : results)
+    std::cout << "SAVE (merged): " << r.output << ": " << r.ninputs - r.nskipped << " inputs (" << r.nskipped << " skipped), "
+	      << r.nentries << " entries, " << r.seconds << " s." << std::endl;
+
+  memprof::JobSummary summary;
+  merging::fill_summary(results, summary);
+  summary.add("ncpus", opt.ncpus);
+  summary.add_rss();
+  summary.add_wall_time();
+  summary.print();
+  return 0;
+}
@@ -1,14 +1,218 @@
+#include <algorithm>
+#include <chrono>
+#include <sstream>
 #include "UserCode/DataProcessing/interface/selector.h"
+#include "UserCode/DataProcessing/interface/job_stamp.h"
 
+//one line of the run list of a batch: '<input> <output> <beam_energy> [<impact_cache>]'
+struct BatchRun {
+  std::string input, output;
+  int beam_energy;
+  std::string impact_cache;
+  ULong64_t input_events = 0, selected_events = 0;
+  double startup_s = -1.;
+  bool up_to_date = false; //skipped
+};
+
+//content-addressed stamp of a selection output (see job_stamp.h); 'base' holds the executable and the calibration,
+//common to all the runs
+jobstamp::Stamp selection_stamp(jobstamp::Stamp base, const std::string& input, const std::string& datatype, const std::string& showertype,
+				const int& beam_energy, const bool& event_index, const ULong64_t& first_entry = 0, const ULong64_t& last_entry = 0) {
+  base.add_input(input);
+  base.add_config("datatype", datatype);
+  base.add_config("showertype", showertype);
+  base.add_config("beam_energy", beam_energy);
+  base.add_config("event_index", event_index);
+  base.add_config("first_entry", first_entry);
+  base.add_config("last_entry", last_entry);
+  return base;
+}
+
+//empty lines and lines starting with '#' are skipped
+std::vector<BatchRun> read_run_list(const std::string& filename) {
+  std::ifstream in(filename);
+  if(!in.is_open())
+    throw std::invalid_argument("File " + filename + " could not be opened.");
+  std::vector<BatchRun> runs;
+  std::string line;
+  while(std::getline(in, line)) {
+    std::istringstream ss(line);
+    BatchRun run;
+    if(!(ss >> run.input) or run.input[0] == '#')
+      continue;
+    if(!(ss >> run.output >> run.beam_energy))
+      throw std::invalid_argument("Wrong line in the run list " + filename + ": '" + line + "'.");
+    ss >> run.impact_cache;
+    runs.push_back(run);
+  }
+  if(runs.empty())
+    throw std::invalid_argument("The run list " + filename + " is empty.");
+  return runs;
+}
+
+//selects the events of all the runs in the list within the same process, which loads the calibration and starts the
+//thread pool once; 'concurrent_runs' runs are processed at the same time, sharing the pool
+void process_batch(std::vector<BatchRun>& runs, const std::string& datatype, const std::string& showertype, const parallelism::Options& popt, const bool& event_index, const unsigned& concurrent_runs, const bool& skip_up_to_date) {
+  const auto start = std::chrono::steady_clock::now();
+  const auto calib = Selector::load_calibration();
+  const unsigned ncpus = parallelism::resolve_ncpus(popt.ncpus);
+  ROOT::EnableImplicitMT(ncpus); //before any Selector is created, since they might run concurrently
+  jobstamp::Stamp base_stamp;
+  base_stamp.add_executable();
+  base_stamp.add_calibration();
+
+  auto process = [&](BatchRun& run) {
+    const jobstamp::Stamp stamp = selection_stamp(base_stamp, run.input, datatype, showertype, run.beam_energy, event_index);
+    if(skip_up_to_date and stamp.up_to_date(run.output, {run.output})) {
+      const auto previous = memprof::read_summary(run.output + jobstamp::suffix);
+      run.up_to_date = true;
+      run.input_events = previous.count("input_events") ? previous.at("input_events") : 0;
+      run.selected_events = previous.count("selected_events") ? previous.at("selected_events") : 0;
+      return;
+    }
+    jobstamp::Stamp::remove(run.output);
+    Selector selector(run.input, run.output, datatype, showertype, run.beam_energy, calib);
+    selector.set_ncpus(ncpus);
+    selector.set_thread_pinning(popt.pin);
+    selector.set_event_index(event_index);
+    selector.set_impact_cache(run.impact_cache);
+    selector.select_relevant_branches();
+    run.input_events = selector.input_events();
+    run.selected_events = selector.selected_events();
+    run.startup_s = selector.startup_seconds();
+    memprof::JobSummary run_summary;
+    run_summary.add("input_events", run.input_events);
+    run_summary.add("selected_events", run.selected_events);
+    run_summary.add("startup_s", run.startup_s);
+    stamp.write(run.output, run_summary);
+  }; //the input file and the event loop are released before the next run
+
+  if(concurrent_runs <= 1) {
+    for(auto& run : runs)
+      process(run);
+  }
+  else {
+    parallelism::WorkStealingPool pool(std::min(static_cast<size_t>(concurrent_runs), runs.size()));
+    for(auto& run : runs)
+      pool.submit([&process, &run]() { process(run); });
+    pool.wait();
+  }
+
+  memprof::JobSummary summary;
+  ULong64_t input_events = 0, selected_events = 0;
+  unsigned nup_to_date = 0;
+  for(const auto& run : runs) {
+    std::cout << "Batch: " << run.input << ": " << run.input_events << " input events, "
+	      << run.selected_events << " selected events" << (run.up_to_date ? " (up to date, skipped)." : ".") << std::endl;
+    nup_to_date += run.up_to_date;
+    input_events += run.input_events;
+    selected_events += run.selected_events;
+  }
+  summary.add("ncpus", ncpus);
+  summary.add("nruns", runs.size());
+  summary.add("concurrent_runs", concurrent_runs);
+  summary.add("input_events", input_events);
+  summary.add("selected_events", selected_events);
+  summary.add("up_to_date", nup_to_date);
+  //startup of the first run processed (not skipped as up to date), if any
+  const auto first_run = std::find_if(runs.begin(), runs.end(), [](const BatchRun& run) { return !run.up_to_date; });
+  if(first_run != runs.end())
+    summary.add("startup_s", first_run->startup_s);
+  summary.add("batch_s", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  summary.add_bytes("mem_channel_thresholds", calib->thresholds.size() * sizeof(float));
+  summary.add_rss();
+  summary.add_wall_time();
+  summary.print();
+}
+
+//batch mode: process_data_exe --batch <run_list> <datatype> <showertype> [--concurrent_runs <n>] [options]
 int main(int argc, char **argv) {
+  if(argc > 1 and std::string(argv[1]) == "--batch") {
+    if(argc < 5)
+      throw std::invalid_argument("The '--batch' option requires the run list, the data type and the shower type.");
+    std::vector<BatchRun> runs = read_run_list(argv[2]);
+    parallelism::Options popt = parallelism::parse_args(argc, argv, 5);
+    bool event_index = true, skip_up_to_date = false;
+    unsigned concurrent_runs = 1;
+    for(int iarg=5; iarg<argc; ++iarg) {
+      if(std::string(argv[iarg]) == "--no_index")
+	event_index = false;
+      else if(std::string(argv[iarg]) == "--concurrent_runs") {
+	if(iarg+1 >= argc)
+	  throw std::invalid_argument("The '--concurrent_runs' option requires a value.");
+	concurrent_runs = std::stoi(argv[++iarg]);
+      }
+      else if(std::string(argv[iarg]) == "--skip_up_to_date")
+	skip_up_to_date = true;
+      else if(std::string(argv[iarg]) == "--impact_cache")
+	throw std::invalid_argument("In the batch mode, the impact point caches are specified in the run list.");
+    }
+    process_batch(runs, std::string(argv[3]), std::string(argv[4]), popt, event_index, concurrent_runs, skip_up_to_date);
+    return 0;
+  }
+
   std::string input_file = std::string(argv[1]);
   std::string output_file = std::string(argv[2]);
   std::string datatype = std::string(argv[3]);
   std::string showertype = std::string(argv[4]);
   int beam_energy = std::stoi( std::string(argv[5]) );
 
+  //optional: --ncpus <n> (defaults to the cpus available to the job) and --pin (pin threads to cores)
+  parallelism::Options popt = parallelism::parse_args(argc, argv, 6);
+  //optional: --no_index, skips the per-event index tree written next to the selected hits
+  //optional: --impact_cache <file>, reads the shifted impact points from <file>, built from the friend tree if needed
+  //optional: --entries <first> <last>, selects the input entries in [first, last) only
+  //optional: --skip_up_to_date, does nothing if the output was written with the same input, executable and options
+  bool event_index = true, skip_up_to_date = false;
+  std::string impact_cache;
+  ULong64_t first_entry = 0, last_entry = 0;
+  for(int iarg=6; iarg<argc; ++iarg) {
+    if(std::string(argv[iarg]) == "--no_index")
+      event_index = false;
+    else if(std::string(argv[iarg]) == "--impact_cache") {
+      if(iarg+1 >= argc)
+	throw std::invalid_argument("The '--impact_cache' option requires a value.");
+      impact_cache = argv[++iarg];
+    }
+    else if(std::string(argv[iarg]) == "--entries") {
+      if(iarg+2 >= argc)
+	throw std::invalid_argument("The '--entries' option requires the first and the last entries.");
+      first_entry = std::stoull(argv[iarg+1]);
+      last_entry = std::stoull(argv[iarg+2]);
+      iarg += 2;
+    }
+    else if(std::string(argv[iarg]) == "--skip_up_to_date")
+      skip_up_to_date = true;
+  }
+
+  jobstamp::Stamp base_stamp;
+  base_stamp.add_executable();
+  base_stamp.add_calibration();
+  const jobstamp::Stamp stamp = selection_stamp(base_stamp, input_file, datatype, showertype, beam_energy, event_index, first_entry, last_entry);
+  if(skip_up_to_date and stamp.up_to_date(output_file, {output_file})) {
+    std::cout << "The output " << output_file << " is up to date: the selection is skipped." << std::endl;
+    jobstamp::Stamp::print_summary(output_file);
+    return 0;
+  }
+  jobstamp::Stamp::remove(output_file);
+
   Selector selector(input_file, output_file, datatype, showertype, beam_energy);
+  if(popt.ncpus != std::nullopt)
+    selector.set_ncpus(popt.ncpus.value());
+  selector.set_thread_pinning(popt.pin);
+  selector.set_event_index(event_index);
+  selector.set_impact_cache(impact_cache);
+  if(last_entry > 0)
+    selector.set_entry_range(first_entry, last_entry);
   selector.select_relevant_branches();
-  
+
+  //job summary, printed to the job output: sizes the memory requested by the next submissions of the same job
+  memprof::JobSummary summary;
+  selector.fill_summary(summary);
+  summary.add_rss();
+  summary.add_wall_time();
+  summary.print();
+  stamp.write(output_file, summary); //once the output is complete
+
   return 0;
 }
@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+#include "UserCode/DataProcessing/interface/reducer.h"
+
+//hit-level outputs of the runs: '<folder>/outEcut_<datatype>_<showertype>*', either the sums of all the hits
+//('_noclusters') or of the clusterized hits (ending with the run number), in the CSV or in the NumPy ('_ensum') format
+void find_inputs(const std::string& folder, const std::string& datatype, const std::string& showertype, const bool& npy,
+		 std::vector<std::string>& rechits, std::vector<std::string>& clusterized) {
+  const std::string prefix = "outEcut_" + datatype + "_" + showertype;
+  auto ends_with = [](const std::string& s, const std::string& end) {
+    return s.size() >= end.size() and s.compare(s.size() - end.size(), end.size(), end) == 0;
+  };
+  for(const auto& entry : std::filesystem::directory_iterator(folder)) {
+    const std::string name = entry.path().filename().string();
+    if(name.compare(0, prefix.size(), prefix) != 0)
+      continue;
+    if(npy) {
+      const size_t pos = name.rfind("_ensum");
+      if(pos == std::string::npos or !ends_with(name, ".npy"))
+	continue;
+      if(ends_with(name.substr(0, pos), "_noclusters"))
+	rechits.push_back(entry.path().string());
+      else if(pos > 0 and std::isdigit(name[pos-1]))
+	clusterized.push_back(entry.path().string());
+    }
+    else if(ends_with(name, "_noclusters.csv"))
+      rechits.push_back(entry.path().string());
+    else if(ends_with(name, ".csv") and name.size() > 4 and std::isdigit(name[name.size()-5]))
+      clusterized.push_back(entry.path().string());
+  }
+  std::sort(rechits.begin(), rechits.end());
+  std::sort(clusterized.begin(), clusterized.end());
+}
+
+//run example: reduce_outputs_exe /eos/user/b/bfontana/TestBeamReconstruction/<tag>/hit_dependent/ sim_proton em /eos/user/b/bfontana/TestBeamReconstruction/<tag>/sim_proton_em_resp_res
+int main(int argc, char **argv) {
+  if(argc < 5)
+    throw std::invalid_argument("Usage: reduce_outputs_exe <folder> <datatype> <showertype> <output stem> [options]");
+  const std::string folder = std::string(argv[1]);
+  const std::string datatype = std::string(argv[2]);
+  const std::string showertype = std::string(argv[3]);
+  const std::string out_stem = std::string(argv[4]);
+
+  //optional: --ncpus <n> (defaults to the cpus available to the job) and --pin (pin threads to cores)
+  const parallelism::Options popt = parallelism::parse_args(argc, argv, 5);
+  //optional: --npy, reads the NumPy files written by 'analyze_data_exe --npy' instead of the CSV files
+  bool npy = false;
+  for(int iarg=5; iarg<argc; ++iarg)
+    if(std::string(argv[iarg]) == "--npy")
+      npy = true;
+
+  std::vector<std::string> rechits_files, clusterized_files;
+  find_inputs(folder, datatype, showertype, npy, rechits_files, clusterized_files);
+  if(rechits_files.empty() and clusterized_files.empty())
+    throw std::invalid_argument("There are no hit-level outputs in " + folder + ".");
+
+  parallelism::WorkStealingPool pool(parallelism::resolve_ncpus(popt.ncpus), popt.pin);
+  const reduction::Samples rechits = reduction::read_samples(rechits_files, npy, pool);
+  const reduction::Samples clusterized = reduction::read_samples(clusterized_files, npy, pool);
+
+  //histograms and fits, to be drawn by the plotting scripts
+  TFile histograms((out_stem + ".root").c_str(), "RECREATE");
+  std::cout << "SAVE: " << out_stem + ".root" << std::endl;
+  const reduction::Results res = reduction::reduce(rechits, clusterized, showertype, &histograms);
+  histograms.Close();
+  reduction::write_csv(res, out_stem + ".csv");
+  std::cout << "Calibration slopes: " << res.slope1 << " (rechits), " << res.slope2 << " (clusterized)." << std::endl;
+  return 0;
+}
@@ -0,0 +1,107 @@
+#ifndef BatchTiles_h
+#define BatchTiles_h
+
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <memory_resource>
+
+#include "LayerTilesConstants.h"
+#include "Points.h"
+
+
+//Tiles of several events clustered in a single call (see CLUEAlgo::setPointsBatch()).
+//The event is an extra tiling dimension: the hits are grouped per plane (one per event and layer) and, within a plane,
+//sorted by bin, so that hits of different events never share a bin. Unlike LayerTiles, the memory only scales with the
+//number of hits and the number of planes, not with the number of bins.
+class BatchTiles {
+
+  public:
+    explicit BatchTiles(std::pmr::memory_resource* mr = std::pmr::get_default_resource()):
+      plane_(mr), planeOffsets_(mr), bins_(mr), indices_(mr) {}
+
+    //indices of the hits of a bin, in increasing order (as the bins of LayerTiles)
+    struct Range {
+      const int* first;
+      const int* last;
+      const int* begin() const { return first; }
+      const int* end() const { return last; }
+    };
+
+    void fill(const Points& points, const int nlayers) {
+      const int nevents = static_cast<int>(points.eventOffsets.size()) - 1;
+      plane_.resize(points.n);
+      planeOffsets_.assign(nevents * nlayers + 1, 0);
+      for(int ev = 0; ev < nevents; ++ev) {
+        for(int i = points.eventOffsets[ev]; i < points.eventOffsets[ev+1]; ++i) {
+          plane_[i] = ev * nlayers + points.layer[i];
+          ++planeOffsets_[plane_[i] + 1];
+        }
+      }
+      for(size_t p = 1; p < planeOffsets_.size(); ++p)
+        planeOffsets_[p] += planeOffsets_[p-1];
+
+      //counting sort by plane, then by bin within each plane (the hit index breaks the ties)
+      std::pmr::memory_resource* mr = plane_.get_allocator().resource();
+      std::pmr::vector< std::pair<int,int> > entries(points.n, mr);
+      std::pmr::vector<int> next(planeOffsets_.begin(), planeOffsets_.end() - 1, mr);
+      for(int i = 0; i < points.n; ++i)
+        entries[ next[plane_[i]]++ ] = std::make_pair(getGlobalBin(points.x[i], points.y[i]), i);
+      for(size_t p = 0; p + 1 < planeOffsets_.size(); ++p)
+        std::sort(entries.begin() + planeOffsets_[p], entries.begin() + planeOffsets_[p+1]);
+
+      bins_.resize(points.n);
+      indices_.resize(points.n);
+      for(int k = 0; k < points.n; ++k) {
+        bins_[k] = entries[k].first;
+        indices_[k] = entries[k].second;
+      }
+    }
+
+    int plane(int i) const {
+      return plane_[i];
+    }
+
+    Range bin(int plane, int globalBinId) const {
+      auto first = bins_.begin() + planeOffsets_[plane];
+      auto last = bins_.begin() + planeOffsets_[plane+1];
+      auto range = std::equal_range(first, last, globalBinId);
+      return Range{ indices_.data() + (range.first - bins_.begin()), indices_.data() + (range.second - bins_.begin()) };
+    }
+
+    int getXBin(float x) const {
+      int xBin = (x - LayerTilesConstants::minX)*LayerTilesConstants::rX;
+      xBin = std::min(xBin,LayerTilesConstants::nColumns-1);
+      xBin = std::max(xBin,0);
+      return xBin;
+    }
+
+    int getYBin(float y) const {
+      int yBin = (y - LayerTilesConstants::minY)*LayerTilesConstants::rY;
+      yBin = std::min(yBin,LayerTilesConstants::nRows-1);
+      yBin = std::max(yBin,0);
+      return yBin;
+    }
+
+    int getGlobalBin(float x, float y) const {
+      return getXBin(x) + getYBin(y)*LayerTilesConstants::nColumns;
+    }
+
+    int getGlobalBinByBin(int xBin, int yBin) const {
+      return xBin + yBin*LayerTilesConstants::nColumns;
+    }
+
+    std::array<int,4> searchBox(float xMin, float xMax, float yMin, float yMax) const {
+      return std::array<int, 4>({{ getXBin(xMin), getXBin(xMax), getYBin(yMin), getYBin(yMax) }});
+    }
+
+  private:
+    std::pmr::vector<int> plane_; //per hit
+    std::pmr::vector<int> planeOffsets_; //hits of plane p: [planeOffsets_[p], planeOffsets_[p+1]) of bins_ and indices_
+    std::pmr::vector<int> bins_, indices_;
+
+};
+
+
+#endif //BatchTiles_h
@@ -9,16 +9,22 @@
 #include <fstream>
 #include <functional>
 #include <chrono>
+#include <memory_resource>
+#include <new>
 
 #include "CLUEAnalysis.h"
 #include "LayerTiles.h"
+#include "BatchTiles.h"
 #include "Points.h"
 
 class CLUEAlgo{
 
   public:
     // constructor
-  CLUEAlgo(float dc, float kappa, float ecut, bool verbose=false ){ 
+    //with 'eventResource' (see arena::EventArena), the hits and the temporaries of the clustering draw from it; it has
+    //to be released between events, and the hits are then rebuilt by the next setPoints() or setPointsBatch()
+  CLUEAlgo(float dc, float kappa, float ecut, bool verbose=false, std::pmr::memory_resource* eventResource=nullptr ):
+    points_(eventResource != nullptr ? eventResource : std::pmr::get_default_resource()), eventResource_(eventResource) { 
       dc_ = dc; 
       ecut_ = ecut;
       kappa_ = kappa;
@@ -28,7 +34,10 @@ class CLUEAlgo{
     
     }
     // destructor
-    ~CLUEAlgo(){} 
+    ~CLUEAlgo(){
+      if(eventResource_ != nullptr) //the hits may point to memory already released with the arena
+	new (&points_) Points(eventResource_);
+    } 
     
     // public variables
     float dc_, ecut_, kappa_, outlierDeltaFactor_;
@@ -49,44 +58,50 @@ class CLUEAlgo{
     //returns 1 if no hit passes the initial energy cut
     //Note: The layer input and output (see getHitsLayerId()) start counting at 1, but the calculations inside use a 0-based index
     bool setPoints(int n, float* x, float* y, unsigned int* layer, float* weight) {
-      points_.clear();
+      resetPoints();
 
       // input variables
       for(int i=0; i<n; ++i)
-	{
-	  if(layer[i] > detectorConstants::totalnlayers) //em filters should be applied
-	    continue;
-	  float endeposited_mip = layer[i] <= detectorConstants::layerBoundary ? detectorConstants::energyDepositedByMIP[0] : detectorConstants::energyDepositedByMIP[1];
-
-	  float weight_tmp;
-	  if(layer[i] > detectorConstants::nlayers_emshowers)
-	    weight_tmp = detectorConstants::globalWeightCEH;
-	  else
-	    weight_tmp = detectorConstants::dEdX.at(layer[i]-1);
-	  if( weight[i] < ecut_ * detectorConstants::sigmaNoiseSiSensor / endeposited_mip * weight_tmp )
-	    continue;
-	  
-	  points_.x.push_back(x[i]);
-	  points_.y.push_back(y[i]);
-	  points_.layer.push_back(layer[i]-1);
-	  points_.weight.push_back(weight[i]);
-	}
+	addPoint(x[i], y[i], layer[i], weight[i]);
 
       points_.n = points_.x.size();
+      points_.eventOffsets = {0, points_.n};
       if(points_.n == 0)
 	return 1;
 
-      // result variables
-      points_.rho.resize(points_.n,0);
-      points_.delta.resize(points_.n,std::numeric_limits<float>::max());
-      points_.nearestHigher.resize(points_.n,-1);
-      points_.isSeed.resize(points_.n,0);
-      points_.nHitsCluster.resize(points_.n,0);
-      points_.followers.resize(points_.n);
-      points_.clusterIndex.resize(points_.n,-1);
+      resizeResults();
       return 0;
     }
 
+    //batched mode, for events with few hits: the 'nevents' events are packed one after the other in the input arrays,
+    //the hits of event i being [offsets[i], offsets[i+1]), and makeClusters() clusters them all at once without
+    //any interaction between them; the hits of event i passing the energy cut are then
+    //[points_.eventOffsets[i], points_.eventOffsets[i+1]) of the outputs, with cluster ids starting at 0 in each event
+    //returns the number of events with at least one hit passing the initial energy cut
+    int setPointsBatch(int nevents, const int* offsets, float* x, float* y, unsigned int* layer, float* weight) {
+      resetPoints();
+
+      int nfilled = 0;
+      points_.eventOffsets.reserve(nevents+1);
+      points_.eventOffsets.push_back(0);
+      for(int ev=0; ev<nevents; ++ev)
+	{
+	  for(int i=offsets[ev]; i<offsets[ev+1]; ++i)
+	    addPoint(x[i], y[i], layer[i], weight[i]);
+	  if(static_cast<int>(points_.x.size()) > points_.eventOffsets.back())
+	    ++nfilled;
+	  points_.eventOffsets.push_back(points_.x.size());
+	}
+
+      points_.n = points_.x.size();
+      resizeResults();
+      return nfilled;
+    }
+
+    int nEvents() const { return static_cast<int>(points_.eventOffsets.size()) - 1; }
+
+    std::pmr::memory_resource* memoryResource() const { return points_.x.get_allocator().resource(); }
+
     void clearPoints(){ points_.clear(); }
 
     void makeClusters();
@@ -185,10 +200,54 @@ class CLUEAlgo{
     }
         
   private:
+    std::pmr::memory_resource* eventResource_;
+
+    //the containers of the previous event are kept (cleared) on the heap, or forgotten when they were drawn from an
+    //arena, which has been released since
+    void resetPoints() {
+      if(eventResource_ == nullptr)
+	points_.clear();
+      else
+	new (&points_) Points(eventResource_);
+    }
+
+    //Note: the layer input starts counting at 1, but the calculations inside use a 0-based index
+    void addPoint(float x, float y, unsigned int layer, float weight) {
+      if(layer > detectorConstants::totalnlayers) //em filters should be applied
+	return;
+      float endeposited_mip = layer <= detectorConstants::layerBoundary ? detectorConstants::energyDepositedByMIP[0] : detectorConstants::energyDepositedByMIP[1];
+
+      float weight_tmp;
+      if(layer > detectorConstants::nlayers_emshowers)
+	weight_tmp = detectorConstants::globalWeightCEH;
+      else
+	weight_tmp = detectorConstants::dEdX.at(layer-1);
+      if( weight < ecut_ * detectorConstants::sigmaNoiseSiSensor / endeposited_mip * weight_tmp )
+	return;
+
+      points_.x.push_back(x);
+      points_.y.push_back(y);
+      points_.layer.push_back(layer-1);
+      points_.weight.push_back(weight);
+    }
+
+    // result variables
+    void resizeResults() {
+      points_.rho.resize(points_.n,0);
+      points_.delta.resize(points_.n,std::numeric_limits<float>::max());
+      points_.nearestHigher.resize(points_.n,-1);
+      points_.isSeed.resize(points_.n,0);
+      points_.nHitsCluster.resize(points_.n,0);
+      points_.followers.resize(points_.n);
+      points_.clusterIndex.resize(points_.n,-1);
+    }
+
     // private member methods
     void prepareDataStructures(std::array<LayerTiles, detectorConstants::totalnlayers> & );
     void calculateLocalDensity(std::array<LayerTiles, detectorConstants::totalnlayers> & );
     void calculateDistanceToHigher(std::array<LayerTiles, detectorConstants::totalnlayers> & );
+    void calculateLocalDensity(const BatchTiles & );
+    void calculateDistanceToHigher(const BatchTiles & );
     void findAndAssignClusters();
     inline float distance(int , int) const ;
 };
@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <tuple>
 #include <vector>
+#include <memory_resource>
 #include <numeric>
 #include <unordered_map>
 #include <cmath>
@@ -55,6 +56,7 @@ private:
   SHOWERTYPE showertype;
   unsigned lmax;
   float W0_, dpos_; //tunable parameters for cluster position measurement
+  std::pmr::memory_resource* mr_; //temporaries of the calculations (see arena::EventArena)
   std::vector<dataformats::position> pos_;
   std::vector< float > en_;
   dataformats::layervars layerdep_vars_; //clusterized nhits and clusterized energy per event and per layer, densities, distances, isSeed boolean flag, x position and y position
@@ -64,12 +66,14 @@ private:
   float hit_distance(const float&, const float&, const float&, const float&);
   
 public:
-  CLUEAnalysis(const SHOWERTYPE&, const float&, const float&);
+  CLUEAnalysis(const SHOWERTYPE&, const float&, const float&, std::pmr::memory_resource* mr=std::pmr::get_default_resource());
   unsigned getLayerMax() {return lmax;}
-  void calculateEnergy(const std::vector<float>&, const std::vector<int>&);
+  std::pmr::memory_resource* getMemoryResource() {return mr_;}
+  //the hit-level inputs are those of CLUEAlgo::points_, except for the layers, which start at 1
+  void calculateEnergy(const std::pmr::vector<float>&, const std::pmr::vector<int>&);
   void verboseResults(std::string&);
-  void calculateLayerDepVars(const std::vector<float>&, const std::vector<float>&, const std::vector<float>&, const std::vector<int>&, const std::vector<int>&, const std::vector<float>&, const std::vector<float>&, const std::vector<bool>&, const std::vector<unsigned int>&);
-  void calculateClusterDepVars(const std::vector<float>&, const std::vector<float>&, const std::vector<float>&, const std::vector<int>&, const std::vector<int>&, const std::vector<float>&, const std::vector<float>&);
+  void calculateLayerDepVars(const std::pmr::vector<float>&, const std::pmr::vector<float>&, const std::pmr::vector<float>&, const std::pmr::vector<int>&, const std::pmr::vector<int>&, const std::pmr::vector<float>&, const std::pmr::vector<float>&, const std::pmr::vector<bool>&, const std::pmr::vector<unsigned int>&);
+  void calculateClusterDepVars(const std::pmr::vector<float>&, const std::pmr::vector<float>&, const std::pmr::vector<float>&, const std::pmr::vector<int>&, const std::pmr::vector<int>&, const std::vector<float>&, const std::vector<float>&);
   std::vector<dataformats::data> getTotalPositionsAndEnergyOutput(std::string& outputFileName, bool verbose=0);
   float getTotalEnergyOutput(const std::string& outputFileName, bool verbose=0);
   dataformats::layervars getTotalLayerDepOutput();
@@ -1,20 +1,28 @@
 #ifndef Points_h
 #define Points_h
 
+#include <memory_resource>
+#include <vector>
+
+//the containers draw from 'mr', by default the heap (see CLUEAlgo for the per-event arena)
 struct Points {
   
-  std::vector<float> x;
-  std::vector<float> y;
-  std::vector<unsigned int> layer;
-  std::vector<float> weight;
+  explicit Points(std::pmr::memory_resource* mr = std::pmr::get_default_resource()):
+    x(mr), y(mr), layer(mr), weight(mr), rho(mr), delta(mr), nearestHigher(mr), clusterIndex(mr),
+    followers(mr), isSeed(mr), nHitsCluster(mr), n(0), eventOffsets(mr) {}
+
+  std::pmr::vector<float> x;
+  std::pmr::vector<float> y;
+  std::pmr::vector<unsigned int> layer;
+  std::pmr::vector<float> weight;
   
-  std::vector<float> rho;
-  std::vector<float> delta;
-  std::vector<int> nearestHigher;
-  std::vector<int> clusterIndex;
-  std::vector<std::vector<int>> followers;
-  std::vector<bool> isSeed;
-  std::vector<unsigned int> nHitsCluster;
+  std::pmr::vector<float> rho;
+  std::pmr::vector<float> delta;
+  std::pmr::vector<int> nearestHigher;
+  std::pmr::vector<int> clusterIndex;
+  std::pmr::vector<std::pmr::vector<int>> followers;
+  std::pmr::vector<bool> isSeed;
+  std::pmr::vector<unsigned int> nHitsCluster;
   
   // why use int instead of bool?
   // https://en.cppreference.com/w/cpp/container/vector_bool
@@ -22,6 +30,8 @@ struct Points {
   // Does not necessarily store its elements as a contiguous array (so &v[0] + n != &v[n])
 
   int n;
+  //hits of event i: [eventOffsets[i], eventOffsets[i+1]); a single entry pair unless the events are batched
+  std::pmr::vector<int> eventOffsets;
 
   void clear() {
     x.clear();
@@ -36,6 +46,7 @@ struct Points {
     followers.clear();
     isSeed.clear();
     nHitsCluster.clear();
+    eventOffsets.clear();
     
     n = 0;
   }
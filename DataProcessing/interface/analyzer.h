@@ -3,14 +3,25 @@
 #include <string>
 #include <thread>
 #include <numeric>
+#include <functional>
 #include "TFile.h"
 #include "TCanvas.h"
 #include "TTree.h"
+#include "TROOT.h"
 #include "ROOT/RDataFrame.hxx"
 #include "ROOT/RDF/InterfaceUtils.hxx"
+#include "ROOT/TBufferMerger.hxx"
 #include "UserCode/DataProcessing/interface/range.h"
 #include "UserCode/DataProcessing/interface/CLUEAlgo.h"
 #include "UserCode/DataProcessing/interface/CLUEAnalysis.h"
+#include "UserCode/DataProcessing/interface/parallelism.h"
+#include "UserCode/DataProcessing/interface/columnar.h"
+#include "UserCode/DataProcessing/interface/npy.h"
+#include "UserCode/DataProcessing/interface/output_sinks.h"
+#include "UserCode/DataProcessing/interface/async_writer.h"
+#include "UserCode/DataProcessing/interface/checkpoint.h"
+#include "UserCode/DataProcessing/interface/memory_profile.h"
+#include "UserCode/DataProcessing/interface/event_arena.h"
 
 #ifndef NDEBUG
 #   define M_Assert(Expr, Msg) \
@@ -38,28 +49,116 @@ class Analyzer {
   void runCLUE();
   void sum_energy(const bool&);
   void save_to_file(const std::string&);
+  void save_to_file_noclusters(const std::string&);
+  void save_to_file_npy(const std::string&);
+  void save_to_file_noclusters_npy(const std::string&);
   void save_to_file_layer_dependent(const std::string&);
   void save_to_file_cluster_dependent(const std::string&);
+  void save_to_file_layer_dependent_columnar(const std::string&, const columnar::WriterOptions&);
+  void save_to_file_cluster_dependent_columnar(const std::string&, const columnar::WriterOptions&);
+  void set_async_output(const std::string&, const std::string&, const columnar::WriterOptions&, const unsigned& batch_size=1000);
+  void set_input_nodes(const std::vector<ROOT::RDF::RNode>&, const std::vector<std::string>&);
+  void set_multirun(const bool&, const unsigned& chunk_size=5000);
+  void set_checkpoint(const std::string&, const unsigned& every=1000);
+  void clear_checkpoint();
+  void fill_summary(memprof::JobSummary&);
+  void set_ncpus(const unsigned&);
+  void set_thread_pinning(const bool&);
+  void set_batch_events(const unsigned&);
+  //files written by the save functions (and by the asynchronous output stage), with the names derived for each run
+  const std::vector<std::string>& written_outputs() const { return outputs_; }
   
  private:
+  //events whose layer- and cluster-dependent outputs are handed over to the asynchronous output stage
+  struct OutputBatch {
+    unsigned file = 0;
+    float beamen = 0.f;
+    std::vector< dataformats::layerfracs > fracs;
+    std::vector< dataformats::layerhitvars > hitvars;
+    std::vector< dataformats::clustervars > clusters;
+  };
+
+  //clustering outputs of a single event
+  struct EventOutput {
+    float en_total = 0.f;
+    dataformats::layerfracs fracs;
+    dataformats::layerhitvars hitvars;
+    dataformats::clustervars clusters;
+  };
+
   //methods 
-  std::pair<unsigned int, float> _readTree( const std::string&, std::vector< std::vector<float> >& x, std::vector< std::vector<float> >&, std::vector< std::vector<unsigned int> >&, std::vector< std::vector<float> >&, std::vector< std::vector<unsigned int> >&, std::vector< std::vector<float> >&, std::vector< std::vector<float> >&);
+  std::pair<unsigned int, float> _readTree( const unsigned&, std::vector< std::vector<float> >& x, std::vector< std::vector<float> >&, std::vector< std::vector<unsigned int> >&, std::vector< std::vector<float> >&, std::vector< std::vector<unsigned int> >&, std::vector< std::vector<float> >&, std::vector< std::vector<float> >&, std::vector<float>&, const bool& implicit_mt=true, const ULong64_t& begin=0, const ULong64_t& end=0);
+  bool _cluster_event(CLUEAlgo&, CLUEAnalysis&, std::vector<float>&, std::vector<float>&, std::vector<unsigned int>&, std::vector<float>&, std::vector<float>&, std::vector<float>&, EventOutput&);
+  void _cluster_events(CLUEAlgo&, CLUEAnalysis&, const unsigned&, const unsigned&, std::vector< std::vector<float> >&, std::vector< std::vector<float> >&, std::vector< std::vector<unsigned int> >&, std::vector< std::vector<float> >&, std::vector< std::vector<float> >&, std::vector< std::vector<float> >&, std::vector< std::pair<bool, EventOutput> >&);
+  void _analyze_event(CLUEAnalysis&, const Points&, const std::vector<unsigned int>&, const std::vector<float>&, const std::vector<float>&, const std::vector<float>&, EventOutput&);
+  ROOT::RDF::RNode _input_node(const unsigned&, std::unique_ptr<ROOT::RDataFrame>&);
+  ULong64_t _count_entries(const unsigned&);
+  std::vector<unsigned> _schedule_runs(const std::function<void(const unsigned&, const unsigned&, const ULong64_t&, const ULong64_t&)>&);
+  void _runCLUE_multirun();
+  std::uint64_t _config_hash();
+  void _restore_checkpoint(std::vector< std::vector< std::pair<unsigned, EventOutput> > >&, unsigned&, unsigned&);
+  void _checkpoint_event(const unsigned&, const unsigned&, const EventOutput*);
+  void _flush_checkpoint(const unsigned&, const unsigned&);
+  void _sum_energy_multirun(const bool&);
+  float _sum_energy_event(const std::vector<float>&, const std::vector<unsigned int>&, const std::vector<float>&, const bool&);
+  void _write_energy_sums(const std::string&, const std::vector< std::vector< std::tuple<float, float> > >&);
+  void _write_energy_sums_npy(const std::string&, const std::vector< std::vector< std::tuple<float, float> > >&);
   int sanity_checks(const std::string&);
   bool ecut_selection(const float&, const unsigned int&);
   void resize_vectors();
+  std::string _layerdep_filename(const std::string&, const unsigned&);
+  void _consume_batch(OutputBatch&);
+  void _close_async_files();
+  void _parallel_fill(const std::string&, const columnar::WriterOptions&, const unsigned&, const std::function<void(TFile&, const unsigned&, const unsigned&)>&);
   
   //data
   size_t nfiles_;
-  static const int ncpus_ = 4;
+  unsigned ncpus_ = parallelism::detect_ncpus(); //overridden by set_ncpus()
+  bool pin_threads_ = false;
+  bool multirun_ = false; //runs split in entry ranges scheduled together on a work-stealing pool
+  unsigned chunk_size_ = 5000; //entries per task in the multi-run mode
+  unsigned batch_events_ = 1; //events clustered together by a single call to CLUE
   unsigned lmax=0;
   float dc_, kappa_, ecut_;
   SHOWERTYPE st_;
   float W0_, dpos_;
   //weights and thickness corrections taken from the third column of Table 3 of CMS DN-19-019
   std::vector< std::pair<std::string, std::string> > names_; //file and tree names
+  std::vector<ROOT::RDF::RNode> input_nodes_; //replace the files when set
+  std::vector<std::string> input_sources_; //identify the events of the input nodes (see Selector::source_id())
   std::vector<float> beam_energies_;
   std::vector< std::vector< std::tuple<float, float> > > en_total_; //total energy per event (vector of RecHits) per file (run) and corresponding beam energy
+  std::vector< std::vector< std::tuple<float, float> > > en_total_noclusters_; //same as en_total_, but summing all hits (no clustering), including the AHCAL for hadronic showers
   std::vector< std::vector< dataformats::layerfracs > > layer_fracs_; //fraction of clusterized nhits and clusterized energy per event
   std::vector< std::vector< dataformats::layerhitvars > > layer_hitvars_; //hit-dependent variables that will be plotted in the layer-level analysis: energy, density, distance and isSeed boolena flag
   std::vector< std::vector< dataformats::clustervars > > clusterdep_;
+  size_t input_bytes_ = 0; //largest memory taken by the hits of a single file, read before the clustering
+  size_t arena_bytes_ = 0; //largest per-event arena of the workers, sized by the largest event (or batch)
+  memprof::StartupTimer startup_; //until the first entry is read
+  std::vector<std::string> outputs_; //see written_outputs()
+
+  //asynchronous output stage: when enabled, runCLUE() streams the layer- and cluster-dependent outputs to disk
+  struct AsyncOutput {
+    bool enabled = false;
+    std::string layer_fname, cluster_fname;
+    columnar::WriterOptions opt;
+    unsigned batch_size = 1000;
+    //state below is only accessed by the writer thread while it runs
+    int file = -1;
+    ULong64_t entry = 0, layer_offset = 0, cluster_offset = 0;
+    std::unique_ptr<TFile> layer_tfile, cluster_tfile;
+    std::unique_ptr<sinks::LayerDepTree> layer_tree;
+    std::unique_ptr<sinks::ClusterDepTree> cluster_tree;
+    std::unique_ptr<sinks::LayerDepColumns> layer_cols;
+    std::unique_ptr<sinks::ClusterDepColumns> cluster_cols;
+  } async_;
+
+  //checkpoint of runCLUE(): blocks of clustered events, each with the file and the next event to process
+  struct Checkpoint {
+    std::string path; //disabled if empty
+    unsigned every = 1000; //events processed between two blocks
+    std::unique_ptr<checkpoint::Log> log;
+    std::string payload; //events clustered since the last block
+    unsigned nclustered = 0, nprocessed = 0;
+  } ckpt_;
 };
@@ -0,0 +1,91 @@
+#ifndef async_writer_h
+#define async_writer_h
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+//Output stage running on a dedicated thread: batches pushed by the producer are consumed (serialized and
+//compressed) in the background while the producer keeps working. At most 'capacity' batches wait in the queue
+//(2 by default, i.e. double buffering), after which push() blocks, bounding the memory used by pending output.
+template<typename T>
+class AsyncWriter {
+ public:
+  AsyncWriter(std::function<void(T&)> consume, const size_t& capacity=2): consume_(consume), capacity_(capacity) {
+    if(capacity_ == 0)
+      throw std::invalid_argument("The capacity of the AsyncWriter has to be positive.");
+    worker_ = std::thread(&AsyncWriter::run, this);
+  }
+
+  ~AsyncWriter() {
+    if(worker_.joinable()) {
+      try { close(); }
+      catch(...) {} //errors are only reported by an explicit close()
+    }
+  }
+
+  AsyncWriter(const AsyncWriter&) = delete;
+  AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+  void push(T&& batch) {
+    std::unique_lock<std::mutex> lock(mut_);
+    not_full_.wait(lock, [this]{ return queue_.size() < capacity_ or error_ != nullptr; });
+    if(error_ != nullptr)
+      std::rethrow_exception(error_);
+    queue_.push_back(std::move(batch));
+    not_empty_.notify_one();
+  }
+
+  //waits until all batches are consumed; rethrows the first error raised by the consumer
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mut_);
+      closed_ = true;
+    }
+    not_empty_.notify_one();
+    worker_.join();
+    if(error_ != nullptr)
+      std::rethrow_exception(error_);
+  }
+
+ private:
+  void run() {
+    while(true) {
+      T batch;
+      {
+	std::unique_lock<std::mutex> lock(mut_);
+	not_empty_.wait(lock, [this]{ return !queue_.empty() or closed_; });
+	if(queue_.empty())
+	  return; //closed and drained
+	batch = std::move(queue_.front());
+	queue_.pop_front();
+      }
+      not_full_.notify_one();
+      try {
+	consume_(batch);
+      }
+      catch(...) {
+	std::lock_guard<std::mutex> lock(mut_);
+	error_ = std::current_exception();
+	queue_.clear();
+	not_full_.notify_all();
+	return;
+      }
+    }
+  }
+
+  std::function<void(T&)> consume_;
+  size_t capacity_;
+  std::deque<T> queue_;
+  bool closed_ = false;
+  std::exception_ptr error_ = nullptr;
+  std::mutex mut_;
+  std::condition_variable not_empty_, not_full_;
+  std::thread worker_;
+};
+
+#endif //async_writer_h
@@ -0,0 +1,88 @@
+#ifndef calibration_db_h
+#define calibration_db_h
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "UserCode/DataProcessing/interface/channel_thresholds.h"
+
+//binary calibration database: channel thresholds, impact point shifts, layer weights and run metadata, stored in dense
+//tables behind a versioned header. It is compiled from the text sources (Noise_Map.txt, Impact_Shifts.txt, the run
+//list in python/HGCALBeamTestRunList_October2018.py and the constants in CLUEAnalysis.h) by compile_calibration_exe,
+//and memory-mapped read-only by the executables: loading it takes constant time, and the pages are shared by all
+//the threads and processes of the same machine.
+namespace calibdb {
+  constexpr char magic[8] = {'H','G','C','A','L','C','D','B'};
+  constexpr std::uint32_t version = 1; //to be increased whenever the layout changes
+
+  //noisy channels (chip, channel), masked in all modules
+  const std::vector< std::pair<unsigned,unsigned> > masked_channels = { {0,44}, {3,22}, {3,28} };
+
+  struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t nmodules, nchips, nchannels; //channel thresholds
+    std::uint32_t nlayers, nlayers_em; //impact point shifts and layer weights
+    std::uint32_t run_min, nruns; //runs from 'run_min' to 'run_min + nruns - 1'
+    std::uint64_t thresholds_offset, shifts_offset, weights_offset, runs_offset, file_size; //bytes from the start
+  };
+
+  struct RunInfo {
+    std::uint32_t beam_energy; //GeV; zero if the run is not in the run list
+    std::int32_t pdgid;
+    std::uint32_t setup; //detector configuration
+    std::uint8_t valid_dwc, valid_xcet, valid_mcp, padding;
+  };
+
+  //folder of the text sources and default location of the database: $HOME/$CMSSW_VERSION/src/UserCode/DataProcessing/
+  std::string data_dir();
+  //$CALIBRATION_DB if set, data_dir() + "Calibration.db" otherwise
+  std::string default_path();
+
+  //text sources
+  std::map< std::pair<unsigned,unsigned>, float > read_noise_map(const std::string&); //(module, chip) -> noise
+  std::vector< std::pair<float,float> > read_impact_shifts(const std::string&); //one (x, y) pair per layer
+  std::map<unsigned, RunInfo> read_run_list(const std::string&);
+  //weights applied to the energy of the CE-E and CE-H hits (per layer) and of the AHCAL hits, from CLUEAnalysis.h
+  float default_layer_weight(const unsigned& layer, const bool& st);
+  float default_ahc_weight(const bool& st);
+
+  //writes the database; the file is written under a temporary name and then renamed
+  void compile(const std::string& noise_map, const std::string& impact_shifts, const std::string& run_list, const std::string& output);
+}
+
+class CalibrationDB: public std::enable_shared_from_this<CalibrationDB> {
+ public:
+  //throws if the file is not a database of the current version
+  static std::shared_ptr<const CalibrationDB> open(const std::string&);
+  ~CalibrationDB();
+  CalibrationDB(const CalibrationDB&) = delete;
+  CalibrationDB& operator=(const CalibrationDB&) = delete;
+
+  //view of the mapped table, which stays mapped while the returned object exists
+  ChannelThresholds channel_thresholds() const;
+  //layers start at 1
+  std::pair<float,float> shift(const unsigned& layer) const;
+  float layer_weight(const unsigned& layer, const bool& st) const;
+  float ahc_weight(const bool& st) const;
+  unsigned nlayers() const { return header_->nlayers; }
+  //nullptr if the run is not in the run list
+  const calibdb::RunInfo* run(const unsigned&) const;
+  //runs in the list taken with the given detector configuration, in increasing order
+  std::vector<unsigned> runs(const unsigned& setup) const;
+
+ private:
+  CalibrationDB() = default;
+  template<typename T> const T* _table(const std::uint64_t& offset) const {
+    return reinterpret_cast<const T*>(static_cast<const char*>(data_) + offset);
+  }
+
+  void* data_ = nullptr;
+  size_t size_ = 0;
+  const calibdb::Header* header_ = nullptr;
+};
+
+#endif //calibration_db_h
@@ -0,0 +1,51 @@
+#ifndef channel_thresholds_h
+#define channel_thresholds_h
+
+#include <array>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+//dense table of the amplitude thresholds of the CE-E and CE-H channels, indexed by module, chip and channel, for both
+//shower types (3 and 4 times the noise of the chip for em and had showers, respectively). Built once per job.
+//Masked channels have an infinite threshold, on every module (also those missing in the table).
+//Chips missing in the noise map have a NaN threshold: the noise rejection of a hit is a single load and compare.
+class ChannelThresholds {
+ public:
+  static constexpr unsigned nchips = 4;
+  static constexpr unsigned nchannels = 64;
+  static constexpr float sigma_em = 3.f;
+  static constexpr float sigma_had = 4.f;
+
+  ChannelThresholds() = default;
+  //'noise': noise per (module, chip); 'masked': (chip, channel) pairs masked in all modules
+  ChannelThresholds(const std::map< std::pair<unsigned,unsigned>, float >& noise, const std::vector< std::pair<unsigned,unsigned> >& masked);
+  //table built elsewhere (e.g. mapped from the calibration database), with the layout described above; not copied
+  ChannelThresholds(std::shared_ptr<const float> values, const unsigned& nmodules, const std::vector< std::pair<unsigned,unsigned> >& masked);
+
+  //st: true for had showers
+  float threshold(const unsigned& module, const unsigned& chip, const unsigned& channel, const bool& st) const {
+    if(chip < nchips and channel < nchannels and masked_[chip * nchannels + channel])
+      return std::numeric_limits<float>::infinity();
+    if(module >= nmodules_ or chip >= nchips or channel >= nchannels)
+      throw std::out_of_range("Value NOT found for Module = " + std::to_string(module) + ", chip = " + std::to_string(chip) + " and channel = " + std::to_string(channel));
+    return values_.get()[ ((module * nchips + chip) * nchannels + channel) * 2 + st ];
+  }
+
+  size_t size() const { return nmodules_ * nchips * nchannels * 2; }
+  unsigned nmodules() const { return nmodules_; }
+  const float* data() const { return values_.get(); }
+
+ private:
+  void _mask(const std::vector< std::pair<unsigned,unsigned> >& masked);
+
+  unsigned nmodules_ = 0;
+  std::array<bool, nchips * nchannels> masked_ = {}; //checked before the table, whose size depends on the modules
+  std::shared_ptr<const float> values_; //both shower types next to each other; shared by the copies
+};
+
+#endif //channel_thresholds_h
@@ -0,0 +1,104 @@
+#ifndef checkpoint_h
+#define checkpoint_h
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+//append-only checkpoint file: a header with a hash of the job configuration, followed by blocks of binary data.
+//Every block carries its size and checksum, so that a block left incomplete by an interrupted job is discarded.
+namespace checkpoint {
+  std::uint64_t hash(const std::string&); //FNV-1a
+
+  //binary serialization of arithmetic types, vectors and tuples into a string (native byte order)
+  template<typename T>
+  typename std::enable_if<std::is_arithmetic<T>::value>::type put(std::string& buf, const T& x) {
+    buf.append(reinterpret_cast<const char*>(&x), sizeof(T));
+  }
+  inline void put(std::string& buf, const std::vector<bool>& v) {
+    put(buf, static_cast<std::uint64_t>(v.size()));
+    for(const bool b : v)
+      put(buf, static_cast<std::uint8_t>(b));
+  }
+  template<typename T> void put(std::string& buf, const std::vector<T>& v);
+  template<typename... T> void put(std::string& buf, const std::tuple<T...>& t) {
+    std::apply([&buf](const T&... x) { (put(buf, x), ...); }, t);
+  }
+  template<typename T> void put(std::string& buf, const std::vector<T>& v) {
+    put(buf, static_cast<std::uint64_t>(v.size()));
+    if constexpr (std::is_arithmetic<T>::value)
+      buf.append(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+    else
+      for(const auto& x : v)
+	put(buf, x);
+  }
+
+  //reads back what put() wrote, starting at 'pos'; throws if the buffer is too short
+  template<typename T>
+  typename std::enable_if<std::is_arithmetic<T>::value>::type get(const std::string& buf, size_t& pos, T& x) {
+    if(pos + sizeof(T) > buf.size())
+      throw std::runtime_error("checkpoint::get(): truncated buffer.");
+    std::memcpy(&x, buf.data() + pos, sizeof(T));
+    pos += sizeof(T);
+  }
+  inline void get(const std::string& buf, size_t& pos, std::vector<bool>& v) {
+    std::uint64_t n;
+    get(buf, pos, n);
+    v.resize(n);
+    for(std::uint64_t i=0; i<n; ++i) {
+      std::uint8_t b;
+      get(buf, pos, b);
+      v[i] = b;
+    }
+  }
+  template<typename T> void get(const std::string& buf, size_t& pos, std::vector<T>& v);
+  template<typename... T> void get(const std::string& buf, size_t& pos, std::tuple<T...>& t) {
+    std::apply([&buf, &pos](T&... x) { (get(buf, pos, x), ...); }, t);
+  }
+  template<typename T> void get(const std::string& buf, size_t& pos, std::vector<T>& v) {
+    std::uint64_t n;
+    get(buf, pos, n);
+    if constexpr (std::is_arithmetic<T>::value) {
+      if(pos + n * sizeof(T) > buf.size())
+	throw std::runtime_error("checkpoint::get(): truncated buffer.");
+      v.resize(n);
+      if(n > 0)
+	std::memcpy(v.data(), buf.data() + pos, n * sizeof(T));
+      pos += n * sizeof(T);
+    }
+    else {
+      v.resize(n);
+      for(auto& x : v)
+	get(buf, pos, x);
+    }
+  }
+
+  class Log {
+  public:
+    //opens the checkpoint at 'path'; its blocks are kept only if it was written with the same configuration hash,
+    //otherwise the file is started over
+    Log(const std::string& path, const std::uint64_t& confighash);
+    ~Log();
+    Log(const Log&) = delete;
+    Log& operator=(const Log&) = delete;
+
+    //valid blocks found when opening the file
+    const std::vector<std::string>& blocks() const { return blocks_; }
+    //appends a block and flushes it to disk
+    void append(const std::string&);
+    //closes and deletes the file, once the job outputs are safely written
+    void remove();
+
+  private:
+    std::string path_;
+    std::FILE *file_ = nullptr;
+    std::vector<std::string> blocks_;
+  };
+}
+
+#endif //checkpoint_h
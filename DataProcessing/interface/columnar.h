@@ -0,0 +1,63 @@
+#ifndef columnar_h
+#define columnar_h
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "TTree.h"
+#include "TBranch.h"
+#include "Compression.h"
+
+//flat (columnar) output layout: one entry per event, with per-hit or per-cluster quantities stored
+//as variable-size arrays sharing a single counter, plus the layer of each element and per-event offsets
+namespace columnar {
+  enum class Compression { LZ4, ZSTD, ZLIB, LZMA };
+
+  struct WriterOptions {
+    bool enabled = false; //the legacy per-layer branches are written otherwise
+    Compression algorithm = Compression::ZSTD;
+    int level = 5;
+    int basket_size = 256000; //bytes
+    unsigned nworkers = 0; //threads filling the output through a TBufferMerger; 0 uses as many as the Analyzer cpus
+  };
+
+  Compression parse_compression(const std::string&);
+  int compression_settings(const WriterOptions&);
+  //parses the optional '--columnar', '--compression <lz4|zstd|zlib|lzma>', '--compression_level <n>' and '--basket_size <n>' arguments
+  WriterOptions parse_args(int argc, char **argv, int first);
+
+  template<typename T> constexpr char leaf_code();
+  template<> constexpr char leaf_code<Float_t>()   { return 'F'; }
+  template<> constexpr char leaf_code<UInt_t>()    { return 'i'; }
+  template<> constexpr char leaf_code<Int_t>()     { return 'I'; }
+  template<> constexpr char leaf_code<UChar_t>()   { return 'b'; }
+  template<> constexpr char leaf_code<ULong64_t>() { return 'l'; }
+
+  //contiguous buffer behind a variable-size array branch; the branch address is updated whenever the buffer grows
+  template<typename T>
+  class ArrayColumn {
+  public:
+    void attach(TTree& tree, const std::string& name, const std::string& counter, const int& basket_size) {
+      buf_.resize(initial_capacity_);
+      const std::string leaflist = name + "[" + counter + "]/" + leaf_code<T>();
+      branch_ = tree.Branch(name.c_str(), buf_.data(), leaflist.c_str(), basket_size);
+    }
+    void clear() { n_ = 0; }
+    void push_back(const T& x) {
+      if(n_ == buf_.size()) {
+	buf_.resize(2 * buf_.size());
+	branch_->SetAddress(buf_.data());
+      }
+      buf_[n_++] = x;
+    }
+    size_t size() const { return n_; }
+
+  private:
+    static constexpr size_t initial_capacity_ = 256;
+    std::vector<T> buf_;
+    TBranch *branch_ = nullptr;
+    size_t n_ = 0;
+  };
+}
+
+#endif //columnar_h
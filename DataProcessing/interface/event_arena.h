@@ -0,0 +1,44 @@
+#ifndef event_arena_h
+#define event_arena_h
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+//Per-worker memory arena for the short-lived containers of an event (std::pmr containers built with resource()).
+//An allocation is a pointer bump in a buffer and deallocations do nothing; reset() releases all of them at once at the
+//end of the event. When an event exhausts the buffer, the extra memory is taken from the heap and the buffer is
+//enlarged at the next reset(), so that after a few events the clustering no longer reaches the heap.
+//Not thread-safe: each worker (thread or task) has its own arena.
+namespace arena {
+  class EventArena {
+  public:
+    explicit EventArena(const size_t& initial_bytes = 1 << 20);
+    EventArena(const EventArena&) = delete;
+    EventArena& operator=(const EventArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return &*buffer_resource_; }
+    //to be called once nothing allocated from the arena is in use anymore
+    void reset();
+    size_t capacity() const { return capacity_; }
+
+  private:
+    //heap memory requested when the buffer is exhausted
+    class Overflow : public std::pmr::memory_resource {
+    public:
+      size_t bytes = 0;
+    private:
+      void* do_allocate(size_t, size_t) override;
+      void do_deallocate(void*, size_t, size_t) override;
+      bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    };
+
+    size_t capacity_;
+    std::unique_ptr<std::byte[]> buffer_;
+    Overflow overflow_;
+    std::optional<std::pmr::monotonic_buffer_resource> buffer_resource_;
+  };
+}
+
+#endif //event_arena_h
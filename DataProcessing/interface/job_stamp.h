@@ -0,0 +1,55 @@
+#ifndef job_stamp_h
+#define job_stamp_h
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "UserCode/DataProcessing/interface/memory_profile.h"
+
+//content-addressed stamps of the job outputs: a job whose inputs, executable and configuration did not change since it
+//last succeeded is skipped instead of being run again. The stamp ('<output>.stamp') is written once all the outputs
+//are written, and holds the key, the components it was computed from and the job summary of the run, which is printed
+//again by the skipped job so that write_dag keeps sizing the next submissions.
+namespace jobstamp {
+  constexpr const char* suffix = ".stamp";
+
+  //key of the stamp of an output; empty if the output has no stamp
+  std::string read_key(const std::string& output);
+
+  class Stamp {
+  public:
+    //the running executable and the libraries of this project it loaded
+    void add_executable();
+    //the output of a previous step is identified by the key of its stamp, so that a step is not run again when its
+    //input was skipped; an input without stamp (an original ntuple: never modified in place, and too large to be read
+    //for hashing) is identified by its path, size and modification time
+    void add_input(const std::string&);
+    //small files are identified by their content
+    void add_file(const std::string&);
+    //the calibration sources read by the selection: the database and the text files
+    void add_calibration();
+    template<typename T> void add_config(const std::string& key, const T& value) {
+      std::ostringstream ss;
+      ss.precision(9);
+      ss << value;
+      components_.emplace_back("config " + key, ss.str());
+    }
+    std::string key() const;
+
+    //the output has a stamp with the same key, and all the outputs exist: those given and those recorded in the stamp
+    bool up_to_date(const std::string& output, const std::vector<std::string>& outputs = {}) const;
+    //removed before the outputs are written again, so that an interrupted job never leaves a matching stamp
+    static void remove(const std::string& output);
+    //'outputs' records the files whose names are only known once written (e.g. one per run of the input)
+    void write(const std::string& output, const memprof::JobSummary&, const std::vector<std::string>& outputs = {}) const;
+    //prints the job summary stored in the stamp of the output, adding 'up_to_date 1'
+    static void print_summary(const std::string& output, std::ostream& os = std::cout);
+
+  private:
+    std::vector< std::pair<std::string, std::string> > components_; //the key depends on their order
+  };
+}
+
+#endif //job_stamp_h
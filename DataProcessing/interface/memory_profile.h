@@ -0,0 +1,82 @@
+#ifndef memory_profile_h
+#define memory_profile_h
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//memory accounting of the jobs: resident set size of the process and deep sizes of the containers holding the results.
+//The quantities are reported in a job summary, one "JOBSUMMARY <key> <value>" line each, printed to the job output,
+//from which the memory requested by later submissions of the same job is derived (CondorJobs/bin/write_dag.cc).
+namespace memprof {
+  double peak_rss_mb(); //high-water mark of the resident set size
+  double current_rss_mb();
+  double elapsed_s(); //since the start of the process (more precisely, since this library was loaded)
+
+  //heap memory owned by arithmetic types, vectors (full capacity) and tuples
+  template<typename T>
+  typename std::enable_if<std::is_arithmetic<T>::value, size_t>::type heap_bytes(const T&) { return 0; }
+  inline size_t heap_bytes(const std::vector<bool>& v) { return (v.capacity() + 7) / 8; }
+  template<typename T> size_t heap_bytes(const std::vector<T>& v);
+  template<typename T1, typename T2> size_t heap_bytes(const std::pair<T1, T2>& p) {
+    return heap_bytes(p.first) + heap_bytes(p.second);
+  }
+  template<typename... T> size_t heap_bytes(const std::tuple<T...>& t) {
+    return std::apply([](const T&... x) { return (size_t(0) + ... + heap_bytes(x)); }, t);
+  }
+  template<typename T> size_t heap_bytes(const std::vector<T>& v) {
+    size_t n = v.capacity() * sizeof(T);
+    if constexpr (!std::is_arithmetic<T>::value)
+      for(const auto& x : v)
+	n += heap_bytes(x);
+    return n;
+  }
+
+  template<typename T> size_t bytes(const T& x) { return sizeof(T) + heap_bytes(x); }
+
+  //time elapsed from the creation of the timer to the first call of mark() (e.g. when the first event is processed),
+  //which includes the opening of the inputs and any just-in-time compilation; thread-safe
+  class StartupTimer {
+  public:
+    void mark() {
+      std::call_once(first_, [this]() {
+	  seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+	});
+    }
+    double seconds() const { return seconds_; } //negative until mark() is called
+
+  private:
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+    std::once_flag first_;
+    double seconds_ = -1.;
+  };
+
+  class JobSummary {
+  public:
+    static constexpr const char* prefix = "JOBSUMMARY";
+
+    void add(const std::string&, const double&);
+    //stored in MB, with the '_mb' suffix appended to the key
+    void add_bytes(const std::string&, const size_t&);
+    //adds the peak and current resident set sizes
+    void add_rss();
+    //adds the elapsed time, with which the duration of the next submissions of the same job is estimated
+    void add_wall_time();
+    void print(std::ostream& os = std::cout) const;
+
+  private:
+    std::vector< std::pair<std::string, double> > entries_;
+  };
+
+  //summary printed in a job output file; empty if the file does not exist or has no summary (e.g. the job failed)
+  std::map<std::string, double> read_summary(const std::string&);
+}
+
+#endif //memory_profile_h
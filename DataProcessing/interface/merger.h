@@ -0,0 +1,45 @@
+#ifndef merger_h
+#define merger_h
+
+#include <string>
+#include <vector>
+#include "UserCode/DataProcessing/interface/columnar.h"
+#include "UserCode/DataProcessing/interface/memory_profile.h"
+
+//Merges the per-run layer- and cluster-dependent outputs of the analysis into one file per beam energy (replaces hadd).
+//All the outputs are merged at the same time: the entries of every output are split in chunks, which are read,
+//decompressed, converted and compressed again by a shared pool of threads and written through a TBufferMerger per output.
+//The inputs can have either layout (legacy or columnar, see columnar.h), and the output is written in the layout requested.
+namespace merging {
+  enum class Analysis { LAYERDEP, CLUSTERDEP };
+  Analysis parse_analysis(const std::string&);
+
+  struct Options {
+    unsigned ncpus = 1;
+    bool pin = false;
+    columnar::WriterOptions wopt; //the columnar layout is written when enabled, the legacy one otherwise
+    bool summary = false; //per-layer profiles and histograms written to the 'summary' directory of each output, in the same pass
+    bool fast = false; //copies the compressed baskets of legacy inputs (as hadd does) instead of converting the entries
+    std::string tname = "tree0"; //name of the input and output trees
+  };
+
+  struct Job {
+    std::vector<std::string> inputs;
+    std::string output;
+    float beam_energy;
+  };
+
+  struct Result {
+    std::string output;
+    unsigned ninputs = 0, nskipped = 0; //unreadable inputs are skipped, as 'hadd -k' does
+    unsigned long long nentries = 0;
+    double seconds = 0.;
+  };
+
+  //'lmax' is the number of layers of the outputs; jobs without readable inputs write no output
+  std::vector<Result> merge(const std::vector<Job>&, const Analysis&, const unsigned& lmax, const Options&);
+
+  void fill_summary(const std::vector<Result>&, memprof::JobSummary&);
+}
+
+#endif //merger_h
@@ -0,0 +1,15 @@
+#ifndef npy_h
+#define npy_h
+
+#include <string>
+#include <vector>
+
+//minimal writer and reader of the NumPy '.npy' format (version 1.0): a self-describing header (dtype, order and shape)
+//followed by the raw little-endian data; the files can be memory-mapped with numpy.load(..., mmap_mode='r')
+namespace npy {
+  template<typename T> void save(const std::string& filename, const std::vector<T>& data);
+  //reads a one-dimensional array of the same type, written by save() or numpy.save()
+  template<typename T> std::vector<T> load(const std::string& filename);
+}
+
+#endif //npy_h
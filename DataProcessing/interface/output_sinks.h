@@ -0,0 +1,90 @@
+#ifndef output_sinks_h
+#define output_sinks_h
+
+#include <string>
+#include <vector>
+#include "TTree.h"
+#include "UserCode/DataProcessing/interface/CLUEAnalysis.h"
+#include "UserCode/DataProcessing/interface/columnar.h"
+
+//Trees filled event by event with the layer- and cluster-dependent outputs of the Analyzer.
+//Each sink creates its tree in the current ROOT directory (which owns it) and keeps the branch buffers,
+//so it can neither be copied nor moved once created.
+namespace sinks {
+
+  //legacy layout: one branch per quantity and per layer
+  class LayerDepTree {
+  public:
+    LayerDepTree(const std::string&, const float&, const unsigned&);
+    LayerDepTree(const LayerDepTree&) = delete;
+    LayerDepTree& operator=(const LayerDepTree&) = delete;
+    void fill(const dataformats::layerfracs&, const dataformats::layerhitvars&);
+
+  private:
+    TTree *tree_;
+    unsigned lmax_;
+    float beamen_;
+    std::vector< float > fracs_hits_, fracs_en_;
+    std::vector< std::vector<float> > energies_, posx_, posy_, rhos_, deltas_;
+    std::vector< std::vector<bool> > seeds_;
+    std::vector< std::vector<unsigned> > clustersizes_;
+  };
+
+  class ClusterDepTree {
+  public:
+    ClusterDepTree(const std::string&, const float&, const unsigned&);
+    ClusterDepTree(const ClusterDepTree&) = delete;
+    ClusterDepTree& operator=(const ClusterDepTree&) = delete;
+    void fill(const dataformats::clustervars&);
+
+  private:
+    TTree *tree_;
+    unsigned lmax_;
+    float beamen_;
+    std::vector< std::vector<unsigned> > hits_;
+    std::vector< std::vector<float> > en_, x_, y_, dx_, dy_;
+  };
+
+  //columnar layout (see columnar.h): flat per-hit columns plus the entry and offset of each event
+  class LayerDepColumns {
+  public:
+    LayerDepColumns(const std::string&, const float&, const unsigned&, const int&);
+    LayerDepColumns(const LayerDepColumns&) = delete;
+    LayerDepColumns& operator=(const LayerDepColumns&) = delete;
+    void fill(const ULong64_t&, const ULong64_t&, const dataformats::layerfracs&, const dataformats::layerhitvars&);
+
+  private:
+    TTree *tree_;
+    unsigned lmax_;
+    Float_t beamen_;
+    ULong64_t entry_, offset_;
+    UInt_t nhits_;
+    std::vector<Float_t> fracs_hits_, fracs_en_;
+    columnar::ArrayColumn<UInt_t>  layer_, clustersize_;
+    columnar::ArrayColumn<Float_t> energy_, posx_, posy_, rho_, delta_;
+    columnar::ArrayColumn<UChar_t> seed_;
+  };
+
+  class ClusterDepColumns {
+  public:
+    ClusterDepColumns(const std::string&, const float&, const unsigned&, const int&);
+    ClusterDepColumns(const ClusterDepColumns&) = delete;
+    ClusterDepColumns& operator=(const ClusterDepColumns&) = delete;
+    void fill(const ULong64_t&, const ULong64_t&, const dataformats::clustervars&);
+
+  private:
+    TTree *tree_;
+    unsigned lmax_;
+    Float_t beamen_;
+    ULong64_t entry_, offset_;
+    UInt_t nclusters_;
+    columnar::ArrayColumn<UInt_t>  layer_, nhits_;
+    columnar::ArrayColumn<Float_t> energy_, x_, y_, dx_, dy_;
+  };
+
+  //number of hits (clusters) an event contributes to the flat columns
+  ULong64_t nelements(const dataformats::layerhitvars&);
+  ULong64_t nelements(const dataformats::clustervars&);
+}
+
+#endif //output_sinks_h
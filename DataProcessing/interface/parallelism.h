@@ -0,0 +1,69 @@
+#ifndef parallelism_h
+#define parallelism_h
+
+#include <string>
+#include <optional>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//runtime control of the number of threads used by ROOT's implicit multi-threading
+namespace parallelism {
+  //number of cpus made available to this process, considering (by order of priority):
+  //the Condor slot (_CONDOR_NPROCS), the affinity mask and the cgroup cpu quota
+  unsigned detect_ncpus();
+
+  //number of cpus to use: the override when specified, the auto-detected value otherwise
+  unsigned resolve_ncpus(std::optional<unsigned> ncpus_override = std::nullopt);
+
+  //pins the calling thread to one of the cores in the affinity mask; each thread is pinned once only
+  //cores are assigned in a round-robin fashion
+  void pin_this_thread();
+
+  //parses the optional '--ncpus N' and '--pin' command line arguments starting at 'first'
+  struct Options {
+    std::optional<unsigned> ncpus = std::nullopt;
+    bool pin = false;
+  };
+  Options parse_args(int argc, char **argv, int first);
+
+  //pool of worker threads, each with its own task queue; idle workers steal tasks from the back of the other queues,
+  //so that short tasks fill the gaps left by long ones. Tasks submitted from a worker go to its own queue,
+  //the others are distributed in a round-robin fashion.
+  class WorkStealingPool {
+  public:
+    WorkStealingPool(const unsigned& nworkers, const bool& pin=false);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+    void submit(std::function<void()>);
+    //blocks until all submitted tasks are done; rethrows the first exception raised by a task
+    void wait();
+    unsigned size() const { return queues_.size(); }
+
+  private:
+    struct Queue {
+      std::mutex mut;
+      std::deque< std::function<void()> > tasks;
+    };
+    bool _pop(const unsigned&, std::function<void()>&);
+    void _run(const unsigned&);
+
+    std::vector< std::unique_ptr<Queue> > queues_;
+    std::vector<std::thread> workers_;
+    std::mutex mut_;
+    std::condition_variable work_, done_;
+    long queued_ = 0; //tasks waiting in the queues; briefly negative when a task is popped before being counted
+    size_t pending_ = 0; //tasks submitted and not finished yet
+    unsigned next_ = 0;
+    bool stop_ = false;
+    std::exception_ptr error_ = nullptr;
+  };
+}
+
+#endif //parallelism_h
@@ -0,0 +1,46 @@
+#ifndef reducer_h
+#define reducer_h
+
+#include <array>
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "UserCode/DataProcessing/interface/parallelism.h"
+
+//Reduces the hit-level outputs of the analysis (energy sums per event, see Analyzer::save_to_file) to the responses and
+//resolutions per beam energy, as resp_res.py does: the files are parsed in parallel, each into its own buffers merged
+//per beam energy; the energy sums are then histogrammed and fitted twice with a Gaussian (the second fit within
+//[mean - sigma, mean + 2.5 sigma] of the first), before and after the linear calibration of the fitted means.
+namespace reduction {
+  constexpr unsigned nenergies = 10;
+  constexpr std::array<int, nenergies> beam_energies = {{20, 30, 50, 80, 100, 120, 150, 200, 250, 300}};
+  constexpr std::array<double, nenergies> true_beam_energies = {{20., 30., 49.99, 79.93, 99.83, 119.65, 149.14, 197.32, 243.61, 287.18}}; //GeV
+
+  //energy sums of each beam energy, in the order of 'beam_energies'
+  using Samples = std::array< std::vector<float>, nenergies >;
+
+  //reads the CSV files written by Analyzer::save_to_file or the '_ensum' NumPy files written by Analyzer::save_to_file_npy
+  //(the '_beamen' file is found next to it); the padding of the CSV files and the negative sums are dropped
+  Samples read_samples(const std::vector<std::string>& files, const bool& npy, parallelism::WorkStealingPool&);
+
+  struct GaussianFit {
+    bool valid = false;
+    double mean = 0., emean = 0., sigma = 0., esigma = 0.; //MeV
+  };
+
+  //per beam energy; zero when the fit failed or there are no data
+  struct Results {
+    std::array<GaussianFit, nenergies> rechits, clusterized; //before the calibration
+    std::array<double, nenergies> resp1{}, eresp1{}, res1{}, eres1{}, resp2{}, eresp2{}, res2{}, eres2{};
+    double slope1 = 1., shift1 = 0., slope2 = 1., shift2 = 0.; //reconstructed [GeV] = slope * true [GeV] + shift
+  };
+
+  //'rechits' are the sums of all the hits above the energy cut (the '_noclusters' outputs), 'clusterized' the sums of
+  //the clusterized hits; the histograms and their fits are written to 'histograms' if not null
+  Results reduce(const Samples& rechits, const Samples& clusterized, const std::string& showertype, TFile* histograms = nullptr);
+
+  //one line per beam energy, with the columns of the HDF5 file written by resp_res.py
+  void write_csv(const Results&, const std::string&);
+}
+
+#endif //reducer_h
@@ -1,42 +1,96 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <array>
+#include "TFile.h"
 #include "TTree.h"
 #include "ROOT/RDataFrame.hxx"
 #include "ROOT/RDF/InterfaceUtils.hxx"
 #include "ROOT/RDFHelpers.hxx"
 #include "UserCode/DataProcessing/interface/range.h"
 #include "UserCode/DataProcessing/interface/CLUEAnalysis.h"
-
-using mapT = std::map< std::pair<unsigned,unsigned>, float >;
+#include "UserCode/DataProcessing/interface/parallelism.h"
+#include "UserCode/DataProcessing/interface/memory_profile.h"
+#include "UserCode/DataProcessing/interface/channel_thresholds.h"
+#include "UserCode/DataProcessing/interface/calibration_db.h"
+#include "UserCode/DataProcessing/interface/checkpoint.h"
 
 class Selector {
  public:
+  //external data, loaded once and shared by the Selectors of a batch of runs
+  struct Calibration {
+    ChannelThresholds thresholds; //amplitude threshold per channel, built from the noise map
+    std::vector< std::pair<float,float> > shifts; //impact point shifts per layer
+    std::array<float, 2*detectorConstants::totalnlayers> weights_ce; //per layer, em then had showers
+    std::array<float, 2> weights_ahc; //em and had showers
+  };
+  static std::shared_ptr<const Calibration> load_calibration();
+
   Selector(const std::string&, const std::string&, const std::string&, const std::string&, const int&, std::optional<std::string> in_tree_name = std::nullopt, std::optional<std::string> in_tree_name_friend = std::nullopt, std::optional<std::string> out_tree_name = std::nullopt);
+  Selector(const std::string&, const std::string&, const std::string&, const std::string&, const int&, std::shared_ptr<const Calibration>, std::optional<std::string> in_tree_name = std::nullopt, std::optional<std::string> in_tree_name_friend = std::nullopt, std::optional<std::string> out_tree_name = std::nullopt);
   ~Selector();
   void select_relevant_branches();
+  ROOT::RDF::RNode selection(const bool& snapshot=false);
+  double startup_seconds() const;
+  ULong64_t input_events();
+  ULong64_t selected_events();
+  std::string source_id() const;
   void print_relevant_branches(const int&, std::optional<std::string> filename = std::nullopt);
+  void set_ncpus(const unsigned&);
+  void set_thread_pinning(const bool&);
+  void set_event_index(const bool&);
+  void set_impact_cache(const std::string&);
+  void set_entry_range(const ULong64_t&, const ULong64_t&);
+  void fill_summary(memprof::JobSummary&);
 
  private:
+  using SnapshotResult = ROOT::RDF::RResultPtr< ROOT::RDF::RInterface<ROOT::Detail::RDF::RLoopManager> >;
+
+  //per-event summary stored in the index tree, next to the selected hits
+  struct IndexRow {
+    ULong64_t source_entry; //entry in the input ntuple
+    UInt_t run, event, nrechits, nhits;
+    Float_t beamen, energy, ahc_energy, chi2x, chi2y;
+    Int_t dwc_type;
+    std::array<UInt_t, detectorConstants::totalnlayers> nhits_layer;
+    std::array<Float_t, detectorConstants::totalnlayers> energy_layer;
+  };
+
   int sanity_checks(const std::string&);
-  static bool common_selection(const unsigned& layer, const float& energy, const unsigned& chip, const unsigned& channel, const unsigned& module, const float& amplitude, const bool& noise_flag, const mapT& map, const bool& showertype);
-  template<typename T> static std::vector<T> clean_ce(const std::vector<T>&, const std::vector<float>&, const std::vector<unsigned>&, const std::vector<unsigned>&, const std::vector<unsigned>&, const std::vector<unsigned>&, const std::vector<float>&, const std::vector<bool>&, const mapT&, const bool&);
-  template<typename T> static std::vector<T> clean_ahc(const std::vector<T>&, const std::vector<float>&, const std::vector<int>&, const bool&);
-  static std::vector<float> weight_energy_ce(const std::vector<float>&, const std::vector<unsigned>&, const bool&);
-  static std::vector<float> weight_energy_ahc(const std::vector<float>&, const bool&);
-  void load_noise_values();
-  void load_shift_values();
-  static bool reject_noise(const mapT& map, const unsigned& mod, const unsigned& chip, const unsigned& l, const float& amp, const bool& st);
+  static bool common_selection(const unsigned& layer, const float& energy, const unsigned& chip, const unsigned& channel, const unsigned& module, const float& amplitude, const bool& noise_flag, const ChannelThresholds& thresholds, const bool& showertype);
+  static std::vector<unsigned> clean_ce_indices(const std::vector<float>&, const std::vector<unsigned>&, const std::vector<unsigned>&, const std::vector<unsigned>&, const std::vector<unsigned>&, const std::vector<float>&, const std::vector<bool>&, const ChannelThresholds&, const bool&);
+  static std::vector<unsigned> clean_ahc_indices(const std::vector<int>&, const bool&);
+  template<typename T> static std::vector<T> gather(const std::vector<T>&, const std::vector<unsigned>&);
+  static std::vector<float> weight_energy_ce(const std::vector<float>&, const std::vector<unsigned>&, const Calibration&, const bool&);
+  static std::vector<float> weight_energy_ahc(const std::vector<float>&, const Calibration&, const bool&);
   static float ahc_energy_sum(const std::vector<float>&);
   static bool remove_missing_dwc(const std::vector<float>&);
+  static float shift_impact(const float&, const float&);
+  std::string impact_cache_key() const;
+  bool impact_cache_valid(const Long64_t&) const;
+  void build_impact_cache(const Long64_t&);
+  void write_event_index(std::vector< std::vector<IndexRow> >&);
+  SnapshotResult _snapshot(ROOT::RDF::RNode&, const ROOT::RDF::RSnapshotOptions&);
   
   SHOWERTYPE showertype;
   DATATYPE datatype;
   int beam_energy;
-  static const int ncpus_ = 4;
-  mapT noise_map_;
-  std::vector< std::pair<float,float> > shifts_map_;
+  unsigned ncpus_ = parallelism::detect_ncpus(); //overridden by set_ncpus()
+  bool pin_threads_ = false;
+  bool event_index_ = true; //writes the per-event index tree
+  ULong64_t first_entry_ = 0, last_entry_ = 0; //all entries unless last_entry_ > first_entry_
+  std::shared_ptr<const Calibration> calib_;
+  std::unique_ptr<TFile> in_file_; //opened by selection(), closed with the Selector
+  std::unique_ptr<ROOT::RDataFrame> df_;
+  ROOT::RDF::RResultPtr<ULong64_t> count_in_, count_out_; //booked by selection()
+  SnapshotResult snapshot_; //booked by selection()
+  size_t index_bytes_ = 0; //memory taken by the rows of the index tree before being written
+  memprof::StartupTimer startup_; //until the first entry is processed
+  std::string impact_cache_; //shifted impact points of the run, read instead of the friend tree if not empty
+  bool impact_cache_built_ = false; //by this job
+  size_t impact_cache_bytes_ = 0; //memory taken by the cache rows before being written
   
+  std::string new_indices_  = "ce_clean_indices"; //hits passing the cleaning
   std::string new_detid_    = "ce_clean_detid";
   std::string new_x_        = "ce_clean_x";
   std::string new_y_        = "ce_clean_y";
@@ -47,11 +101,17 @@ class Selector {
   std::string new_impX_     = "impactX_shifted";
   std::string new_impY_     = "impactY_shifted";
   //had showers only
+  std::string new_ahc_indices_ = "ahc_clean_indices";
   std::string new_ahc_en_     = "ahc_clean_energy";
   std::string new_ahc_en_MeV_ = "ahc_clean_energy_MeV";
+  std::string source_entry_ = "source_entry"; //entry in the input ntuple; links the selected events to the index
   //columns to save
   ROOT::Detail::RDF::ColumnNames_t savedcols_;
   ROOT::Detail::RDF::ColumnNames_t impactcols_, impactXcols_, impactYcols_;
+  //columns of the impact point cache; the track variables keep the names of the friend tree
+  std::string cache_impX_  = "impact_x"; //Float_t[totalnlayers]
+  std::string cache_impY_  = "impact_y";
+  std::string cache_valid_ = "impact_valid"; //false if the track is missing in any layer
 
   struct indata {
     std::string file_path = "/eos/cms/store/group/dpg_hgcal/tb_hgcal/2018/cern_h2_october/offline_analysis/ntuples/v16/ntuple_1000.root";
@@ -62,5 +122,7 @@ class Selector {
   struct outdata {
     std::string file_path = "/eos/user/b/bfontana/TestBeamReconstruction/default_output.txt";
     std::string tree_name = "relevant_branches";
+    std::string index_tree_name = "event_index";
+    std::string impact_cache_tree_name = "impact_points";
   } outdata_;
 };
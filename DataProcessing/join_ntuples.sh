@@ -3,11 +3,12 @@ declare -a ENERGIES=("20" "30" "50" "80" "100" "120" "150" "200" "250" "300")
 declare -a DATATYPES=("data" "sim_proton" "sim_noproton")
 declare -a SHOWERTYPES=("em" "had")
 declare -a ANALYSISTYPES=("layerdep" "clusterdep")
+declare -a MERGE_OPTS=()
 
 ##########################
 ########PARSING###########
 ##########################
-ARGS=`getopt -o "" -l ",datatype:,showertype:,analysistype:,tag:" -n "getopts_${0}" -- "$@"`
+ARGS=`getopt -o "" -l ",datatype:,showertype:,analysistype:,tag:,ncpus:,columnar,summary,hadd" -n "getopts_${0}" -- "$@"`
 
 #Bad arguments
 if [ $? -ne 0 ];
@@ -64,6 +65,28 @@ while true; do
 	    fi
 	    shift 2;;
 
+	--ncpus)
+	    if [ -n "$2" ]; then
+		MERGE_OPTS+=("--ncpus" "${2}");
+		echo "Number of cpus: ${2}";
+	    fi
+	    shift 2;;
+
+	--columnar)
+	    MERGE_OPTS+=("--columnar");
+	    echo "Columnar output: yes";
+	    shift;;
+
+	--summary)
+	    MERGE_OPTS+=("--summary");
+	    echo "Per-layer summary: yes";
+	    shift;;
+
+	--hadd)
+	    USE_HADD=1;
+	    echo "Merging with hadd: yes";
+	    shift;;
+
 	--)
 	    shift
 	    break;;
@@ -118,6 +141,15 @@ if [[ "${ANALYSISTYPE}" == "layerdep" ]]; then
 elif [[ "${ANALYSISTYPE}" == "clusterdep" ]]; then
     JOBSFOLDER="cluster_dependent"
 fi
+if [[ -z "${USE_HADD}" ]]; then #all the energies are merged at the same time, by several threads
+    IFS=, ; ENERGIES_LIST="${ENERGIES[*]}"; unset IFS
+    merge_outputs_exe "${BASEFOLDER}${JOBSFOLDER}/" "${ANALYSISTYPE}" "${DATATYPE}" "${SHOWERTYPE}" --energies "${ENERGIES_LIST}" "${MERGE_OPTS[@]}"
+    exit $?
+fi
+if [[ ${#MERGE_OPTS[@]} -ne 0 ]]; then
+    echo "The '--ncpus', '--columnar' and '--summary' options are not supported with '--hadd'."
+    exit 1;
+fi
 len="${#ENERGIES[@]}"
 for(( j=0; j<${len}; j++ )); do
     IN="${BASEFOLDER}${JOBSFOLDER}/outEcut_${DATATYPE}_${SHOWERTYPE}_beamen${ENERGIES[j]}_";
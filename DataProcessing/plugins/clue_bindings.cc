@@ -0,0 +1,202 @@
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include "UserCode/DataProcessing/interface/CLUEAlgo.h"
+#include "UserCode/DataProcessing/interface/CLUEAnalysis.h"
+
+namespace py = pybind11;
+using namespace pybind11::literals;
+
+//Python bindings of CLUEAlgo and CLUEAnalysis ('import libDataProcessingCLUE', or the wrapper in python/clue.py).
+//The inputs are read from the NumPy buffers without copies (arrays of another type or layout are rejected instead of
+//converted) and the outputs of the clustering are NumPy views over the vectors of CLUEAlgo::points_, which stay valid
+//until the next call to 'set_points' or 'cluster' of the same object. The GIL is released while the C++ code runs, so
+//that several CLUEAlgo objects can cluster events in parallel from Python threads; a single object is not thread-safe.
+namespace {
+  template<typename T>
+  using carray = py::array_t<T, py::array::c_style>;
+
+  //view over a vector owned by 'owner' (the Python object of the CLUEAlgo), which is kept alive by the view
+  template<typename T>
+  py::array_t<T> view(const std::pmr::vector<T>& v, py::handle owner) {
+    return py::array_t<T>(v.size(), v.data(), owner);
+  }
+
+  //hands the vector over to NumPy without copying its buffer
+  template<typename T>
+  py::array_t<T> to_array(std::vector<T>&& v) {
+    auto* p = new std::vector<T>(std::move(v));
+    py::capsule owner(p, [](void* q) { delete static_cast<std::vector<T>*>(q); });
+    return py::array_t<T>(p->size(), p->data(), owner);
+  }
+
+  //std::vector<bool> is not contiguous, its elements have to be copied
+  template<typename Alloc>
+  py::array_t<uint8_t> to_array(const std::vector<bool, Alloc>& v) {
+    py::array_t<uint8_t> arr(v.size());
+    auto buf = arr.mutable_unchecked<1>();
+    for(size_t i=0; i<v.size(); ++i)
+      buf(i) = v[i];
+    return arr;
+  }
+
+  //returns true if no hit passes the energy cut, as CLUEAlgo::setPoints
+  bool set_points(CLUEAlgo& algo, const carray<float>& x, const carray<float>& y, const carray<unsigned>& layer, const carray<float>& weight) {
+    const py::ssize_t n = x.size();
+    if(x.ndim() != 1 or y.size() != n or layer.size() != n or weight.size() != n)
+      throw std::invalid_argument("The 'x', 'y', 'layer' and 'weight' arrays must be one-dimensional and have the same size.");
+    //setPoints takes non-const pointers but only reads them
+    float* px = const_cast<float*>(x.data());
+    float* py_ = const_cast<float*>(y.data());
+    unsigned* pl = const_cast<unsigned*>(layer.data());
+    float* pw = const_cast<float*>(weight.data());
+    py::gil_scoped_release release;
+    return algo.setPoints(static_cast<int>(n), px, py_, pl, pw);
+  }
+
+  //events packed one after the other, the hits of event i in [offsets[i], offsets[i+1]); returns the number of events
+  //with at least one hit passing the energy cut, as CLUEAlgo::setPointsBatch
+  int set_points_batch(CLUEAlgo& algo, const carray<float>& x, const carray<float>& y, const carray<unsigned>& layer, const carray<float>& weight,
+		       const carray<int>& offsets) {
+    const py::ssize_t n = x.size();
+    if(x.ndim() != 1 or y.size() != n or layer.size() != n or weight.size() != n)
+      throw std::invalid_argument("The 'x', 'y', 'layer' and 'weight' arrays must be one-dimensional and have the same size.");
+    const int* po = offsets.data();
+    const py::ssize_t nevents = offsets.size() - 1;
+    if(nevents < 1 or po[0] != 0 or po[nevents] != n)
+      throw std::invalid_argument("The 'offsets' array must start at 0 and end with the number of hits.");
+    for(py::ssize_t i=0; i<nevents; ++i)
+      if(po[i+1] < po[i])
+	throw std::invalid_argument("The 'offsets' array must be increasing.");
+    float* px = const_cast<float*>(x.data());
+    float* py_ = const_cast<float*>(y.data());
+    unsigned* pl = const_cast<unsigned*>(layer.data());
+    float* pw = const_cast<float*>(weight.data());
+    py::gil_scoped_release release;
+    return algo.setPointsBatch(static_cast<int>(nevents), po, px, py_, pl, pw);
+  }
+
+  //as Analyzer::_cluster_event, which fills the seed flags and the cluster sizes after the clustering
+  void make_clusters(CLUEAlgo& algo) {
+    algo.makeClusters();
+    algo.infoSeeds();
+    algo.infoHits();
+  }
+
+  //layer ids as returned by CLUEAlgo::getHitsLayerId (starting at 1), as the CLUEAnalysis calculations expect
+  std::pmr::vector<int> layer_ids(const Points& p) {
+    std::pmr::vector<int> ids(p.layer.size());
+    for(size_t i=0; i<p.layer.size(); ++i)
+      ids[i] = p.layer[i] + 1;
+    return ids;
+  }
+
+  //the analysis of an event requires its hits to be clustered
+  const Points& clustered_points(const CLUEAlgo& algo) {
+    if(algo.points_.n == 0 or algo.points_.clusterIndex.size() != algo.points_.x.size())
+      throw std::runtime_error("The CLUEAlgo object holds no clustered hits.");
+    if(algo.nEvents() != 1)
+      throw std::runtime_error("The analysis of batched events is not supported.");
+    return algo.points_;
+  }
+
+  SHOWERTYPE parse_showertype(const std::string& showertype) {
+    if(showertype == "em")
+      return SHOWERTYPE::EM;
+    else if(showertype == "had")
+      return SHOWERTYPE::HAD;
+    throw std::invalid_argument("Wrong shower type.");
+  }
+}
+
+PYBIND11_MODULE(libDataProcessingCLUE, m) {
+  m.doc() = "CLUE clustering and analysis of the HGCAL test beam hits";
+
+  py::class_<CLUEAlgo>(m, "CLUEAlgo")
+    .def(py::init<float, float, float>(), "dc"_a, "kappa"_a, "ecut"_a)
+    .def("set_points", &set_points, "x"_a.noconvert(), "y"_a.noconvert(), "layer"_a.noconvert(), "weight"_a.noconvert(),
+	 "Copies the hits that pass the energy cut (layers start at 1); returns True if there is none.")
+    .def("make_clusters", &make_clusters, py::call_guard<py::gil_scoped_release>(),
+	 "Clusters the hits and flags the seeds and the number of hits of the cluster of each hit.")
+    .def("cluster", [](CLUEAlgo& algo, const carray<float>& x, const carray<float>& y, const carray<unsigned>& layer, const carray<float>& weight) {
+	if( set_points(algo, x, y, layer, weight) )
+	  return false;
+	py::gil_scoped_release release;
+	make_clusters(algo);
+	return true;
+      }, "x"_a.noconvert(), "y"_a.noconvert(), "layer"_a.noconvert(), "weight"_a.noconvert(),
+      "set_points followed by make_clusters; returns False if no hit passes the energy cut.")
+    .def("cluster_batch", [](CLUEAlgo& algo, const carray<float>& x, const carray<float>& y, const carray<unsigned>& layer, const carray<float>& weight,
+			     const carray<int>& offsets) {
+	const int nfilled = set_points_batch(algo, x, y, layer, weight, offsets);
+	py::gil_scoped_release release;
+	make_clusters(algo);
+	return nfilled;
+      }, "x"_a.noconvert(), "y"_a.noconvert(), "layer"_a.noconvert(), "weight"_a.noconvert(), "offsets"_a.noconvert(),
+      "Clusters several events, packed one after the other (int32 'offsets', one more than the events), in a single call; "
+      "returns the number of events with hits passing the energy cut. The hits of event i are then [event_offsets[i], event_offsets[i+1]).")
+    .def_property_readonly("n", [](const CLUEAlgo& algo) { return algo.points_.n; })
+    .def_property_readonly("event_offsets", [](py::object self) { return view(self.cast<CLUEAlgo&>().points_.eventOffsets, self); })
+    .def_property_readonly("x", [](py::object self) { return view(self.cast<CLUEAlgo&>().points_.x, self); })
+    .def_property_readonly("y", [](py::object self) { return view(self.cast<CLUEAlgo&>().points_.y, self); })
+    .def_property_readonly("layer", [](py::object self) { return view(self.cast<CLUEAlgo&>().points_.layer, self); },
+			   "Layers of the hits, starting at 0.")
+    .def_property_readonly("weight", [](py::object self) { return view(self.cast<CLUEAlgo&>().points_.weight, self); })
+    .def_property_readonly("rho", [](py::object self) { return view(self.cast<CLUEAlgo&>().points_.rho, self); })
+    .def_property_readonly("delta", [](py::object self) { return view(self.cast<CLUEAlgo&>().points_.delta, self); })
+    .def_property_readonly("nearest_higher", [](py::object self) { return view(self.cast<CLUEAlgo&>().points_.nearestHigher, self); })
+    .def_property_readonly("cluster_index", [](py::object self) { return view(self.cast<CLUEAlgo&>().points_.clusterIndex, self); },
+			   "Cluster of the hits; -1 for the outliers.")
+    .def_property_readonly("n_hits_cluster", [](py::object self) { return view(self.cast<CLUEAlgo&>().points_.nHitsCluster, self); })
+    .def_property_readonly("is_seed", [](const CLUEAlgo& algo) { return to_array(algo.points_.isSeed); },
+			   "Copy of the seed flags (std::vector<bool> cannot be viewed).");
+
+  py::class_<CLUEAnalysis>(m, "CLUEAnalysis")
+    .def(py::init([](const std::string& showertype, float W0, float dpos) { return new CLUEAnalysis(parse_showertype(showertype), W0, dpos); }),
+	 "showertype"_a, "W0"_a, "dpos"_a)
+    .def_property_readonly("lmax", &CLUEAnalysis::getLayerMax)
+    .def("energy", [](CLUEAnalysis& ana, const CLUEAlgo& algo) {
+	const Points& p = clustered_points(algo);
+	py::gil_scoped_release release;
+	ana.calculateEnergy(p.weight, p.clusterIndex);
+	return ana.getTotalEnergyOutput("", false);
+      }, "algo"_a, "Clusterized energy of the event clustered by 'algo' (outliers excluded).")
+    .def("layer_dep", [](CLUEAnalysis& ana, const CLUEAlgo& algo) {
+	const Points& p = clustered_points(algo);
+	dataformats::layervars vars;
+	{
+	  py::gil_scoped_release release;
+	  ana.calculateLayerDepVars(p.x, p.y, p.weight, p.clusterIndex, layer_ids(p), p.rho, p.delta, p.isSeed, p.nHitsCluster);
+	  vars = ana.getTotalLayerDepOutput();
+	}
+	py::list layers;
+	for(auto& v : vars)
+	  layers.append( py::dict("nhits"_a=std::get<0>(v), "energy"_a=to_array(std::move(std::get<1>(v))),
+				  "rho"_a=to_array(std::move(std::get<2>(v))), "delta"_a=to_array(std::move(std::get<3>(v))),
+				  "is_seed"_a=to_array(std::get<4>(v)), "x"_a=to_array(std::move(std::get<5>(v))),
+				  "y"_a=to_array(std::move(std::get<6>(v))), "cluster_size"_a=to_array(std::move(std::get<7>(v)))) );
+	return layers;
+      }, "algo"_a, "Clusterized hits of each layer, as written by Analyzer::runCLUE to the layer-dependent outputs.")
+    .def("cluster_dep", [](CLUEAnalysis& ana, const CLUEAlgo& algo, const carray<float>& impactX, const carray<float>& impactY) {
+	if(impactX.size() != impactY.size() or static_cast<size_t>(impactX.size()) < ana.getLayerMax())
+	  throw std::invalid_argument("The 'impactX' and 'impactY' arrays must have one entry per layer.");
+	const std::vector<float> ix(impactX.data(), impactX.data() + impactX.size());
+	const std::vector<float> iy(impactY.data(), impactY.data() + impactY.size());
+	const Points& p = clustered_points(algo);
+	dataformats::clustervars vars;
+	{
+	  py::gil_scoped_release release;
+	  ana.calculateClusterDepVars(p.x, p.y, p.weight, p.clusterIndex, layer_ids(p), ix, iy);
+	  vars = ana.getTotalClusterDepOutput();
+	}
+	py::list layers;
+	for(auto& v : vars)
+	  layers.append( py::dict("nhits"_a=to_array(std::move(std::get<0>(v))), "energy"_a=to_array(std::move(std::get<1>(v))),
+				  "x"_a=to_array(std::move(std::get<2>(v))), "y"_a=to_array(std::move(std::get<3>(v))),
+				  "dx"_a=to_array(std::move(std::get<4>(v))), "dy"_a=to_array(std::move(std::get<5>(v)))) );
+	return layers;
+      }, "algo"_a, "impactX"_a, "impactY"_a, "Clusters of each layer, as written by Analyzer::runCLUE to the cluster-dependent outputs.");
+}
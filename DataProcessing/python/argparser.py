@@ -23,6 +23,16 @@ def add_args(parser, mode):
             action='store_true',
             help='Run solely the plotting step.'
         )
+        parser.add_argument(
+            '--npy',
+            action='store_true',
+            help='Read the energy sums from the NumPy files written by "analyze_data_exe --npy" instead of the CSV files.'
+        )
+        parser.add_argument(
+            '--reduced',
+            action='store_true',
+            help='Plot the responses and resolutions computed by "reduce_outputs_exe" instead of running the analysis step.'
+        )
         
         requiredNamedGroup = parser.add_argument_group('required named arguments')
         requiredNamedGroup.add_argument(
@@ -109,7 +119,13 @@ def add_args(parser, mode):
             help='Beam energy used for all the plots that are layer dependent (positions, resolutions, ...)'
         )
 
-        variables_to_ignore = ['datatype', 'showertype', 'tag']
+        parser.add_argument(
+            '--summary',
+            action='store_true',
+            help='Plot the histograms written to the "summary" directory of the merged outputs by "merge_outputs_exe --summary" instead of reading the trees.'
+        )
+
+        variables_to_ignore = ['datatype', 'showertype', 'tag', 'summary']
         parser.add_argument(
             '--all',
             action=AllAction,
@@ -215,8 +231,13 @@ def add_args(parser, mode):
             action='store_true',
             help="Run the layer analysis on the hits' X and Y positions in the same plot"
         )
+        parser.add_argument(
+            '--summary',
+            action='store_true',
+            help='Plot the histograms written to the "summary" directory of the merged outputs by "merge_outputs_exe --summary" instead of reading the trees.'
+        )
         
-        variables_to_ignore = ['datatype', 'showertype', 'distances_2D', 'densities_2D', 'posx_posy', 'tag']
+        variables_to_ignore = ['datatype', 'showertype', 'distances_2D', 'densities_2D', 'posx_posy', 'tag', 'summary']
         parser.add_argument(
             '--all',
             action=AllAction,
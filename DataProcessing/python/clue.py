@@ -0,0 +1,26 @@
+import threading
+import numpy as np
+from concurrent.futures import ThreadPoolExecutor
+from libDataProcessingCLUE import CLUEAlgo, CLUEAnalysis
+
+def as_hits(x, y, layer, weight):
+    """Arrays with the types the bindings read without copies (float32 positions and weights, uint32 layers)."""
+    return ( np.ascontiguousarray(x, dtype=np.float32), np.ascontiguousarray(y, dtype=np.float32),
+             np.ascontiguousarray(layer, dtype=np.uint32), np.ascontiguousarray(weight, dtype=np.float32) )
+
+def cluster_events(events, dc, kappa, ecut, showertype, W0, dpos, nthreads=1):
+    """
+    Clusterized energy of each event, an iterable of (x, y, layer, weight) arrays; -1 when no hit passes the energy cut.
+    The bindings release the GIL, so that each thread clusters its events with its own CLUEAlgo and CLUEAnalysis.
+    """
+    local = threading.local()
+    def energy(event):
+        if not hasattr(local, 'algo'):
+            local.algo = CLUEAlgo(dc, kappa, ecut)
+            local.ana = CLUEAnalysis(showertype, W0, dpos)
+        if len(event[0]) == 0 or not local.algo.cluster(*as_hits(*event)):
+            return -1.
+        return local.ana.energy(local.algo)
+
+    with ThreadPoolExecutor(max_workers=nthreads) as pool:
+        return np.array(list(pool.map(energy, events)), dtype=np.float32)
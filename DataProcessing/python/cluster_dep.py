@@ -56,11 +56,8 @@ def graphs_per_energy(df, axis_kwargs, columns_field, iframe, variable, energy_i
     else:
         nbins = tuple( 20 if datamax[x]>20 else int(datamax[x]-1) for x in range(ncuts) )
     bins = tuple( np.linspace(datamin[x], datamax[x], nbins[x]+1) for x in range(ncuts) )
-    height_hits = tuple( utils.height_for_plot_bins(bins[x], scale='linear', nlayers=nlayers) for x in range(ncuts) )
-    all_counts, all_layers, all_centers = ([[] for _ in range(ncuts)] for _ in range(3))
-    means, sigmas_l, sigmas_r = ( [[] for _ in range(ncuts)] for _ in range(3) ) #the second list is for the results with cuts
+    counts = [ [] for _ in range(ncuts) ]
 
-    #plot data as 2d graphs
     for ilayer in range(1,nlayers+1):
         for thisCut in range(ncuts):
             if weight_by_energy:
@@ -71,30 +68,42 @@ def graphs_per_energy(df, axis_kwargs, columns_field, iframe, variable, energy_i
                 if data_weights.size == 0:
                     if thisCut==0:
                         warnings.warn('The weights dataframe with energy cut {} in layer {} is empty!'.format(energy_cuts[thisCut], ilayer))
-                    counts, edges = np.zeros(nbins[thisCut]), np.linspace(datamin[thisCut],datamax[thisCut],nbins[thisCut]+1)
+                    counts[thisCut].append( np.zeros(nbins[thisCut]) )
                 else:
-                    counts, edges = np.histogram(dl[thisCut][ilayer-1], bins=bins[thisCut], weights=data_weights)
+                    counts[thisCut].append( np.histogram(dl[thisCut][ilayer-1], bins=bins[thisCut], weights=data_weights)[0] )
             else:
-                counts, edges = np.histogram(dl[thisCut][ilayer-1], bins=bins[thisCut], range=(-1.,1.))
+                counts[thisCut].append( np.histogram(dl[thisCut][ilayer-1], bins=bins[thisCut], range=(-1.,1.))[0] )
+
+    dl.clear()
+    del dl
+    plot_per_energy(counts, bins, axis_kwargs, iframe, variable, energy_index)
+
+def plot_per_energy(counts, bins, axis_kwargs, iframe, variable, energy_index):
+    """Plots the distributions of a cluster-related quantity as a function of the layers, with their means;
+    `counts` holds the counts of each layer and `bins` the bin edges, for each energy cut"""
+    height_hits = tuple( utils.height_for_plot_bins(bins[x], scale='linear', nlayers=nlayers) for x in range(ncuts) )
+    all_counts, all_layers, all_centers = ([[] for _ in range(ncuts)] for _ in range(3))
+    means, sigmas_l, sigmas_r = ( [[] for _ in range(ncuts)] for _ in range(3) ) #the second list is for the results with cuts
 
+    #plot data as 2d graphs
+    for ilayer in range(1,nlayers+1):
+        for thisCut in range(ncuts):
+            counts_layer, edges = counts[thisCut][ilayer-1], bins[thisCut]
             centers = (edges[:-1]+edges[1:])/2
-            assert(len(counts) == len(centers))
+            assert(len(counts_layer) == len(centers))
             same_layer_array = ilayer*np.ones(len(centers))
-            all_counts[thisCut].extend(counts.tolist())
+            all_counts[thisCut].extend(counts_layer.tolist())
             all_layers[thisCut].extend(same_layer_array.tolist())
             all_centers[thisCut].extend(centers.tolist())
 
             #use histogram and not original data to calculate mean and std/sqrt(n)
             #original data cannot be used for the case of weighted histograms
-            mean, _ = utils.get_mean_and_sigma(centers, counts)
-            sigma_left, sigma_right = utils.get_sigma_band(centers, counts)
+            mean, _ = utils.get_mean_and_sigma(centers, counts_layer)
+            sigma_left, sigma_right = utils.get_sigma_band(centers, counts_layer)
             means[thisCut].append(mean)
             sigmas_l[thisCut].append(sigma_left)
             sigmas_r[thisCut].append(sigma_right)
 
-    dl.clear()
-    del dl
-
     layers_x = np.arange(1,nlayers+1)
     interp_thickness = 0.02
     if variable == 'hits':
@@ -245,12 +254,102 @@ def graphs_per_layer(tree, cache, axis_kwargs, iframe, variable, energy_index=2,
                              idx=ncuts*nlayers, iframe=iframe, color='orange',
                              fig_kwargs=emptyfrac_kwargs)
     elif variable == 'spatialres_x' or variable == 'spatialres_y':
-        extra = variable[-1]
-        hdf5_name_summ = os.path.join(data_path_start, hdf5_name_ + '_d' + variable[-1] + '_summary.h5' )
-        pd.Series(bias).to_hdf(hdf5_name_summ, key='bias'+extra, complevel=compression_level, mode='w')
-        pd.Series(ebias).to_hdf(hdf5_name_summ, key='ebias'+extra, complevel=compression_level, mode='r+')
-        pd.Series(res).to_hdf(hdf5_name_summ, key='res'+extra, complevel=compression_level, mode='r+')
-        pd.Series(eres).to_hdf(hdf5_name_summ, key='eres'+extra, complevel=compression_level, mode='r+')
+        write_resolution_summary(variable, bias, ebias, res, eres)
+
+def write_resolution_summary(variable, bias, ebias, res, eres):
+    """Stores the per-layer biases and resolutions fitted by graphs_per_layer(), read by summarize_tags.py"""
+    compression_level = 9
+    extra = variable[-1]
+    hdf5_name_ = 'cluster_' + FLAGS.showertype + '_' + FLAGS.datatype + '_' + str(FLAGS.chosen_energy) + 'GeV_' + FLAGS.tag
+    hdf5_name_summ = os.path.join(data_path_start, hdf5_name_ + '_d' + extra + '_summary.h5' )
+    pd.Series(bias).to_hdf(hdf5_name_summ, key='bias'+extra, complevel=compression_level, mode='w')
+    pd.Series(ebias).to_hdf(hdf5_name_summ, key='ebias'+extra, complevel=compression_level, mode='r+')
+    pd.Series(res).to_hdf(hdf5_name_summ, key='res'+extra, complevel=compression_level, mode='r+')
+    pd.Series(eres).to_hdf(hdf5_name_summ, key='eres'+extra, complevel=compression_level, mode='r+')
+
+def graphs_per_energy_summary(filename, axis_kwargs, name, iframe, variable, energy_index):
+    """Same plots as graphs_per_energy(), from the histograms written to the 'summary' directory of the merged output of one beam energy"""
+    counts, bins = ([] for _ in range(2))
+    for thisCut in range(ncuts):
+        counts_cut, (_, edges) = utils.read_summary(filename, name + '2D_Ecut' + str(energy_cuts[thisCut]))
+        counts.append(counts_cut)
+        bins.append(edges)
+    plot_per_energy(counts, bins, axis_kwargs, iframe, variable, energy_index)
+
+def graphs_per_layer_summary(filename, axis_kwargs, iframe, variable, energy_index=2):
+    """Same plots as graphs_per_layer(), from the histograms written to the 'summary' directory of the merged output of one beam energy"""
+    if variable not in ('pos', 'spatialres_x', 'spatialres_y', 'spatialres_xy'):
+        raise ValueError('graphs_per_layer_summary: Variable {} is not supported.'.format(variable))
+    fig_kwargs = {'plot_width': plot_width, 'plot_height': plot_height}
+    fig_kwargs.update(axis_kwargs)
+    text = lambda ilayer: '{} GeV beam energy | Layer {}'.format(true_beam_energies_GeV[energy_index], ilayer)
+
+    if variable == 'pos':
+        for thisCut in range(ncuts):
+            counts, (_, xedges, yedges) = utils.read_summary(filename, 'XY3D_Ecut' + str(energy_cuts[thisCut]))
+            for ilayer in range(1,nlayers+1):
+                tmp_fig_kwargs = {'t.text': '{} GeV beam energy | E(cluster) > {} MeV | Layer {}'.format(true_beam_energies_GeV[energy_index], energy_cuts[thisCut], ilayer)}
+                tmp_fig_kwargs.update(fig_kwargs)
+                bokehplot.histogram( (counts[ilayer-1], xedges, yedges), idx=ilayer-1+thisCut*nlayers, iframe=iframe, style='quad%Cividis', fig_kwargs=tmp_fig_kwargs)
+
+        failed, _ = utils.read_summary(filename, 'PosFailed2D')
+        nclusters = failed.sum(axis=1)
+        emptyfracs = np.divide(failed[:,1], nclusters, out=np.zeros(len(nclusters)), where=nclusters>0)
+        emptyfrac_kwargs = {'t.text': '{} GeV beam energy'.format(true_beam_energies_GeV[energy_index]),
+                            'x.axis_label': 'Layer', 'y.axis_label': 'Fraction of clusters were the position measurement failed',
+                            'plot_width': plot_width, 'plot_height': plot_height}
+        bokehplot.histogram( (emptyfracs, np.arange(.5,nlayers+1)), idx=ncuts*nlayers, iframe=iframe, color='orange', fig_kwargs=emptyfrac_kwargs)
+
+    elif variable == 'spatialres_x' or variable == 'spatialres_y':
+        counts, (_, edges) = utils.read_summary(filename, 'dXres2D' if variable == 'spatialres_x' else 'dYres2D')
+        bias, ebias, res, eres = ([] for _ in range(4))
+        for ilayer in range(1,nlayers+1):
+            tmp_fig_kwargs = {'t.text': text(ilayer)}
+            tmp_fig_kwargs.update(fig_kwargs)
+            bokehplot.histogram( (counts[ilayer-1], edges), idx=ilayer-1, iframe=iframe,
+                                 color='green' if variable == 'spatialres_x' else 'blue', fig_kwargs=tmp_fig_kwargs)
+            common_args = {'pdf': 'gaus', 'line_width': 2.5, 'alpha': 0.8}
+            coeff, var = bokehplot.fit(p0=[2000, 0.,  .2], idx=ilayer-1, iframe=iframe, obj_idx=0, color='black', line_dash='dashed', debug=False, **common_args)
+            bias.append( coeff[1] )
+            res.append( coeff[2] )
+            err = np.sqrt(np.diag(var))
+            ebias.append( round(err[1],3) )
+            eres.append( round(err[2],3) )
+        write_resolution_summary(variable, bias, ebias, res, eres)
+
+    else:
+        counts, (_, xedges, yedges) = utils.read_summary(filename, 'dXdY3D')
+        counts_other, (_, xedges_other, yedges_other) = utils.read_summary(filename, 'NhitsEnergy3D')
+        for ilayer in range(1,nlayers+1):
+            tmp_fig_kwargs = {'t.text': text(ilayer)}
+            tmp_fig_kwargs.update(fig_kwargs)
+            bokehplot.histogram( (counts[ilayer-1], xedges, yedges), idx=ilayer-1, iframe=iframe, style='quad%CET_L17', fig_kwargs=tmp_fig_kwargs )
+            kwargs_other = {'x.axis_label': "#hits / cluster", 'y.axis_label': "hit energy [MeV]",
+                            't.text': text(ilayer), 'plot_width': plot_width, 'plot_height': plot_height }
+            bokehplot.histogram( (counts_other[ilayer-1], xedges_other, yedges_other), idx=ilayer-1+nlayers, iframe=iframe, style='quad%CET_L17', scale='log', fig_kwargs=kwargs_other )
+
+def graphs_summary(filename, energy_index):
+    """Plots of one beam energy read from the 'summary' directory of its merged output ('--summary')"""
+    per_energy = ( ('hits', 'ClusterNhits', 'hits', {'x.axis_label': 'Layer', 'y.axis_label': '#hits / cluster'}),
+                   ('energies', 'ClusterEnergy', 'energy', {'x.axis_label': 'Layer', 'y.axis_label': 'Total energy per cluster [MeV]'}),
+                   ('numbers', 'Nclusters', 'number', {'x.axis_label': 'Layer', 'y.axis_label': 'Number of clusters'}),
+                   ('posx', 'X', 'pos', {'x.axis_label': 'Layer', 'y.axis_label': "Clusters' X position"}),
+                   ('posy', 'Y', 'pos', {'x.axis_label': 'Layer', 'y.axis_label': "Clusters' Y position"}),
+                   ('dx_2D', 'dX', 'pos', {'x.axis_label': 'Layer', 'y.axis_label': "Clusters' X spatial resolution"}),
+                   ('dy_2D', 'dY', 'pos', {'x.axis_label': 'Layer', 'y.axis_label': "Clusters' Y spatial resolution"}) )
+    for flag, name, variable, axis_kwargs in per_energy:
+        if getattr(FLAGS, flag):
+            graphs_per_energy_summary(filename, axis_kwargs, name, iframe=output_html_files_map[flag][1], variable=variable, energy_index=energy_index)
+
+    if beam_energies[energy_index] != FLAGS.chosen_energy:
+        return
+    per_layer = ( ('posx_posy', 'pos', {'x.axis_label': "Clusters' X position", 'y.axis_label': "Clusters' Y position"}),
+                  ('dx', 'spatialres_x', {'x.axis_label': "Clusters' X spatial resolution [cm]", 'y.axis_label': "Counts"}),
+                  ('dy', 'spatialres_y', {'x.axis_label': "Clusters' Y spatial resolution [cm]", 'y.axis_label': "Counts"}),
+                  ('dx_dy', 'spatialres_xy', {'x.axis_label': "Clusters' X spatial resolution [cm]", 'y.axis_label': "Clusters' Y spatial resolution [cm]"}) )
+    for flag, variable, axis_kwargs in per_layer:
+        if getattr(FLAGS, flag):
+            graphs_per_layer_summary(filename, axis_kwargs, iframe=output_html_files_map[flag][1], variable=variable, energy_index=energy_index)
 
 def save_plots(frame_key):
     mode = 'png'
@@ -289,6 +388,10 @@ def main():
             warnings.warn('Missing dataset for {} GeV.'.format(thisEn))
             continue
 
+        if FLAGS.summary:
+            graphs_summary(data_paths[iEn], iEn)
+            continue
+
         #load ROOT TTree
         file = up.open( data_paths[iEn] )
         tree = file['tree0']
@@ -64,139 +64,134 @@ def graphs_single(df, columns_field, iframe, do_2D=False, energy_index=None):
     else:
         nbins = 20 if datamax>20 else int(datamax-1)
     bins = np.linspace(datamin, datamax, nbins+1) #bins = np.logspace(np.log10(m1), np.log10(m2), nbins+1)
-    height = utils.calculate_rect_side_for_plot_bins(bins, scale='linear', nlayers=nlayers)
 
-    #plot data as 2d graphs
+    if do_2D:
+        counts = np.array([ np.histogram(data_per_layer[ilayer], bins=bins)[0] for ilayer in range(nlayers) ])
+        plot_layers_2D(counts, bins, columns_field, iframe, energy_index)
+    elif columns_field == 'Densities':
+        hist_min, hist_max, norm, hist_bins = 1000, 5500, False, 100
+        hist, hist2, hist3 = ( [np.histogram(x, bins=hist_bins, density=norm, range=(hist_min,hist_max)) for x in data]
+                               for data in (data_per_layer, data_per_layer_seeds, data_per_layer_noseeds) )
+        plot_layers_1D(hist, columns_field, iframe, energy_index, hist_seeds=hist2, hist_noseeds=hist3)
+    else:
+        plot_layers_1D([np.histogram(x, bins=100, density=True) for x in data_per_layer], columns_field, iframe, energy_index)
+
+    del data_per_layer
+
+def plot_layers_2D(counts, bins, columns_field, iframe, energy_index):
+    """Plots the distributions of a layer-related quantity (one row of `counts` per layer) as a function of the layers"""
+    height = utils.height_for_plot_bins(bins, scale='linear', nlayers=nlayers)
     all_counts, all_layers, all_centers = ([] for _ in range(3))
     means, sigmas = ([] for _ in range(2))
     for ilayer in range(1,nlayers+1):
-        counts, edges = np.histogram(data_per_layer[ilayer-1], bins=bins)        
-        centers = (edges[:-1]+edges[1:])/2
+        counts_layer = counts[ilayer-1]
+        centers = (bins[:-1]+bins[1:])/2
         same_layer_array = ilayer*np.ones(len(centers))
-        all_counts.extend(counts.tolist())
+        all_counts.extend(counts_layer.tolist())
         all_layers.extend(same_layer_array.tolist())
         all_centers.extend(centers.tolist())
 
         #use histogram and not original data to calculate mean and std/sqrt(n)
         #original data cannot be used for the case of weighted histograms
         sel_idx = centers>=0 #do not use the non-clusterized values (set to -1) to calculate the mean and sigmas
-        mean, sigma = utils.get_mean_and_sigma(centers[sel_idx], counts[sel_idx])
+        mean, sigma = utils.get_mean_and_sigma(centers[sel_idx], counts_layer[sel_idx])
         means.append(mean)
         sigmas.append(sigma)
 
-    if columns_field == 'Densities':
-        xlabel = 'Density [MeV]'
-    elif columns_field == 'Distances':
-        xlabel = 'Distance to nearest higher density [cm]'
-    elif columns_field == 'Nhits':
-        xlabel = 'Fraction of clusterized hits'
-    elif columns_field == 'Energy':
-        xlabel = 'Fraction of clusterized energy'
-
-    if do_2D:
-        print('plotting 2D (i.e., as a function of the layers)...')
-        fig_kwargs = {'plot_width': plot_width, 'plot_height': plot_height,
-                      't.text': 'Beam energy: {} GeV'.format(true_beam_energies_GeV[energy_index]),
-                      'x.axis_label': 'Layer', 'y.axis_label': xlabel}
-        bokehplot.graph(data=[np.array(all_layers), np.array(all_centers), np.array(all_counts)],
-                        width=np.ones((len(all_layers))), height=height,
-                        idx=energy_index, iframe=iframe, style='rect%Cividis', fig_kwargs=fig_kwargs, alpha=0.6)
-        print('SIGMAS: ', np.array(sigmas)/2)
-        bokehplot.graph(data=[np.arange(1,nlayers+1), np.array(means)],
-                        errors=[[np.zeros(nlayers),np.zeros(nlayers)],[np.array(sigmas)/2, np.array(sigmas)/2]],
-                        idx=energy_index, iframe=iframe, color='red', style='circle', size=2, legend_label='mean')
-
-    else:
-        print('plotting 1D (i.e., counts in the Y axis) ...')
-        fig_kwargs_1D = {'plot_width': plot_width, 'plot_height': plot_height,
-                         't.text': 'Beam energy: {} GeV'.format(true_beam_energies_GeV[energy_index]),
-                         'x.axis_label': xlabel, 'y.axis_label': 'Counts'}
-        hist, hist2, hist3, peaks, peaks2, peaks3, indexes, leg_labels, leg_labels2, leg_labels3 = ([] for _ in range(10))
-        hist_min, hist_max, norm, hist_bins = 1000, 5500, False, 100
-
-        for ilayer in range(nlayers):
-            if columns_field == 'Densities':
-                fig_kwargs_1D['t.text'] = 'Beam energy: {} GeV'.format(true_beam_energies_GeV[energy_index]) + ' | E{(hit) > ' + str(energy_cut) + 'MeV '
-
-                hist_tmp = np.histogram(data_per_layer[ilayer], bins=hist_bins, density=norm, range=(hist_min,hist_max))
-                hist_seeds_tmp = np.histogram(data_per_layer_seeds[ilayer], bins=hist_bins, density=norm, range=(hist_min,hist_max))
-                hist_noseeds_tmp = np.histogram(data_per_layer_noseeds[ilayer], bins=hist_bins, density=norm, range=(hist_min,hist_max))
+    print('plotting 2D (i.e., as a function of the layers)...')
+    fig_kwargs = {'plot_width': plot_width, 'plot_height': plot_height,
+                  't.text': 'Beam energy: {} GeV'.format(true_beam_energies_GeV[energy_index]),
+                  'x.axis_label': 'Layer', 'y.axis_label': axis_labels[columns_field]}
+    bokehplot.graph(data=[np.array(all_layers), np.array(all_centers), np.array(all_counts)],
+                    width=np.ones((len(all_layers))), height=height,
+                    idx=energy_index, iframe=iframe, style='rect%Cividis', fig_kwargs=fig_kwargs, alpha=0.6)
+    print('SIGMAS: ', np.array(sigmas)/2)
+    bokehplot.graph(data=[np.arange(1,nlayers+1), np.array(means)],
+                    errors=[[np.zeros(nlayers),np.zeros(nlayers)],[np.array(sigmas)/2, np.array(sigmas)/2]],
+                    idx=energy_index, iframe=iframe, color='red', style='circle', size=2, legend_label='mean')
+
+def plot_layers_1D(hist, columns_field, iframe, energy_index, hist_seeds=None, hist_noseeds=None):
+    """Plots the distributions of a layer-related quantity, one figure per layer; `hist` holds the counts and edges of each layer,
+    `hist_seeds` and `hist_noseeds` those of the seeds and of the other hits for the densities"""
+    print('plotting 1D (i.e., counts in the Y axis) ...')
+    fig_kwargs_1D = {'plot_width': plot_width, 'plot_height': plot_height,
+                     't.text': 'Beam energy: {} GeV'.format(true_beam_energies_GeV[energy_index]),
+                     'x.axis_label': axis_labels[columns_field], 'y.axis_label': 'Counts'}
+    indexes = list(range(nlayers))
+    leg_labels = [ 'Layer ' + str(ilayer+1) + ', all hits' for ilayer in indexes ]
 
-                if all(hist_tmp[0] == 0) or all(np.isnan(hist_tmp[0])):
-                    hist.append( [np.zeros((hist_tmp[1].size-1)), hist_tmp[1]] )
-                    peaks.append( 0. )
+    if columns_field == 'Densities':
+        fig_kwargs_1D['t.text'] = 'Beam energy: {} GeV'.format(true_beam_energies_GeV[energy_index]) + ' | E{(hit) > ' + str(energy_cut) + 'MeV '
+        hists = (hist, hist_seeds, hist_noseeds)
+        peaks = [[] for _ in range(3)]
+        for ih in range(len(hists)):
+            for ilayer in indexes:
+                counts, edges = hists[ih][ilayer]
+                if all(counts == 0) or all(np.isnan(counts)):
+                    hists[ih][ilayer] = [np.zeros((edges.size-1)), edges]
+                    peaks[ih].append( 0. )
                 else:
-                    hist.append( hist_tmp )
-                    peaks.append( utils.peak_abciss(hist_tmp[0], hist_tmp[1]) )
+                    peaks[ih].append( utils.peak_abciss(counts, edges) )
 
-                if all(hist_seeds_tmp[0] == 0) or all(np.isnan(hist_seeds_tmp[0])):
-                    hist2.append( [np.zeros((hist_seeds_tmp[1].size-1)), hist_seeds_tmp[1]] )
-                    peaks2.append( 0. )
-                else:
-                    hist2.append( hist_seeds_tmp )
-                    peaks2.append( utils.peak_abciss(hist_seeds_tmp[0], hist_seeds_tmp[1]) )
+    bokehplot.histogram(data=hist, idx=indexes, legend_label=leg_labels, iframe=iframe, style='step', fig_kwargs=fig_kwargs_1D)
+    if columns_field == 'Densities':
+        leg_labels2 = [ 'Layer ' + str(ilayer+1) + ', seeds only' for ilayer in indexes ]
+        leg_labels3 = [ 'Layer ' + str(ilayer+1) + ', no seeds' for ilayer in indexes ]
+        bokehplot.histogram(data=hist_seeds, idx=indexes, legend_label=leg_labels2,
+                            iframe=iframe, style='step', color='red', fig_kwargs=fig_kwargs_1D)
+        bokehplot.histogram(data=hist_noseeds, idx=indexes, legend_label=leg_labels3,
+                            iframe=iframe, style='step', color='purple', fig_kwargs=fig_kwargs_1D)
+        bokehplot.graph(data=[np.arange(1,nlayers+1), np.array(peaks[0])], idx=nlayers, legend_label='All hits', iframe=iframe, style='circle', line=True,
+                        fig_kwargs={'t.text': 'Beam energy: {} GeV'.format(true_beam_energies_GeV[energy_index]),
+                                    'x.axis_label': 'Layer', 'y.axis_label': 'Maximum density [MeV]', 'l.location': 'bottom_left'})
+        bokehplot.graph(data=[np.arange(1,nlayers+1), np.array(peaks[1])], idx=nlayers, legend_label='Seeds only', iframe=iframe, style='square', color='red', line=True)
+        bokehplot.graph(data=[np.arange(1,nlayers+1), np.array(peaks[2])], idx=nlayers, legend_label='No seeds', iframe=iframe, style='triangle', color='purple', line=True)
+
+    #plotting additional vertical lines
+    if columns_field == 'Densities':
+        pass
+        #bokehplot.line(x=[[sigmaNoiseTimesKappa,sigmaNoiseTimesKappa] for _ in range(nlayers)], 
+        #               y=[[0,hist[i][0].max()] for i in range(nlayers)], 
+        #               idx=indexes, iframe=iframe, color='orange', legend_label='approximate kappa cut')
+    elif columns_field == 'Distances':
+        bokehplot.line(x=[[1.3,1.3] for _ in range(nlayers)], 
+                       y=[[0,hist[i][0].max()] for i in range(nlayers)], 
+                       idx=indexes, iframe=iframe, color='orange', legend_label='1.3cm')
 
-                if all(hist_noseeds_tmp[0] == 0) or all(np.isnan(hist_noseeds_tmp[0])):
-                    hist3.append( [np.zeros((hist_noseeds_tmp[1].size-1)), hist_noseeds_tmp[1]] )
-                    peaks3.append( 0. )
-                else:
-                    hist3.append( hist_noseeds_tmp )
-                    peaks3.append( utils.peak_abciss(hist_noseeds_tmp[0], hist_noseeds_tmp[1]) )
-                
-            else:
-                hist.append( np.histogram(data_per_layer[ilayer], bins=100, density=True) )
-            indexes.append( ilayer )
-            leg_labels.append( 'Layer ' + str(ilayer+1) + ', all hits' )
-            leg_labels2.append( 'Layer ' + str(ilayer+1) + ', seeds only')
-            leg_labels3.append( 'Layer ' + str(ilayer+1) + ', no seeds')
-
-        bokehplot.histogram(data=hist, idx=indexes, legend_label=leg_labels, iframe=iframe, style='step', fig_kwargs=fig_kwargs_1D)
-        if columns_field == 'Densities':
-            bokehplot.histogram(data=hist2, idx=indexes, legend_label=leg_labels2,
-                                iframe=iframe, style='step', color='red', fig_kwargs=fig_kwargs_1D)
-            bokehplot.histogram(data=hist3, idx=indexes, legend_label=leg_labels3,
-                                iframe=iframe, style='step', color='purple', fig_kwargs=fig_kwargs_1D)
-            bokehplot.graph(data=[np.arange(1,nlayers+1), np.array(peaks)], idx=nlayers, legend_label='All hits', iframe=iframe, style='circle', line=True,
-                            fig_kwargs={'t.text': 'Beam energy: {} GeV'.format(true_beam_energies_GeV[energy_index]),
-                                        'x.axis_label': 'Layer', 'y.axis_label': 'Maximum density [MeV]', 'l.location': 'bottom_left'})
-            bokehplot.graph(data=[np.arange(1,nlayers+1), np.array(peaks2)], idx=nlayers, legend_label='Seeds only', iframe=iframe, style='square', color='red', line=True)
-            bokehplot.graph(data=[np.arange(1,nlayers+1), np.array(peaks3)], idx=nlayers, legend_label='No seeds', iframe=iframe, style='triangle', color='purple', line=True)
-
-        #plotting additional vertical lines
-        if columns_field == 'Densities':
-            pass
-            #bokehplot.line(x=[[sigmaNoiseTimesKappa,sigmaNoiseTimesKappa] for _ in range(nlayers)], 
-            #               y=[[0,hist[i][0].max()] for i in range(nlayers)], 
-            #               idx=indexes, iframe=iframe, color='orange', legend_label='approximate kappa cut')
-        elif columns_field == 'Distances':
-            bokehplot.line(x=[[1.3,1.3] for _ in range(nlayers)], 
-                           y=[[0,hist[i][0].max()] for i in range(nlayers)], 
-                           idx=indexes, iframe=iframe, color='orange', legend_label='1.3cm')
+def graphs_single_summary(filename, columns_field, iframe, do_2D=False, energy_index=None):
+    """Same plots as graphs_single(), from the histograms written to the 'summary' directory of the merged output of one beam energy"""
+    if do_2D == False and energy_index == None:
+        raise ValueError('graphs_single_summary: When doing 1D plots, please specify the energy you want to plot.')
 
-    del all_counts
-    del all_layers
-    del all_centers
-    del means
-    del sigmas
+    counts, (_, bins) = utils.read_summary(filename, summary_names[columns_field] + '2D')
+    if do_2D:
+        if columns_field == 'Densities' or columns_field == 'Distances': #same number of bins as graphs_single()
+            rebin = counts.shape[1] // 20
+            counts = counts.reshape(counts.shape[0], -1, rebin).sum(axis=2)
+            bins = bins[::rebin]
+        plot_layers_2D(counts, bins, columns_field, iframe, energy_index)
+    elif columns_field == 'Densities':
+        counts_seeds, _ = utils.read_summary(filename, 'DensitiesSeeds2D')
+        counts_noseeds, _ = utils.read_summary(filename, 'DensitiesNoSeeds2D')
+        hist, hist2, hist3 = ( [(c, bins) for c in x] for x in (counts, counts_seeds, counts_noseeds) )
+        plot_layers_1D(hist, columns_field, iframe, energy_index, hist_seeds=hist2, hist_noseeds=hist3)
+    else:
+        widths = np.diff(bins)
+        plot_layers_1D([(c / np.sum(c*widths) if np.sum(c) > 0 else c, bins) for c in counts], columns_field, iframe, energy_index)
 
 def graphs_double(df, mode, iframe, energy_index=2): #default to energy_index=2 (=50GeV)
     """Plots density vs distance or posx vs poxy (the latter weighted by the energy density). The variables are defined according to CLUE."""
     if mode == 'dens_dist':
         columns_fields = ('Densities', 'Distances', 'isSeed')
-        fig_kwargs = {'plot_width': plot_width, 'plot_height': plot_height,
-                      't.text': 'Beam energy: {} GeV'.format(true_beam_energies_GeV[energy_index]),
-                      'x.axis_label': 'Density [MeV]', 'y.axis_label': 'Distance to nearest higher density [cm]'}
         nbins_max_x = 35
         nbins_max_y = 8
     elif mode == 'pos':
         columns_fields = ('PosX', 'PosY', 'Densities')
-        fig_kwargs = {'plot_width': plot_width, 'plot_height': plot_height,
-                      't.text': 'Beam energy: {} GeV'.format(true_beam_energies_GeV[energy_index]),
-                      'x.axis_label': 'X hit position [cm]', 'y.axis_label': 'Y hit position [cm]'}
         nbins_max_x = 30
         nbins_max_y = 30
     else:
         raise ValueError('Wrong mode!')
+    fig_kwargs = double_fig_kwargs(mode, energy_index)
     len_col_fields = len(columns_fields)
     nbins = (nbins_max_x, nbins_max_y)
 
@@ -241,15 +236,56 @@ def graphs_double(df, mode, iframe, energy_index=2): #default to energy_index=2
                      np.linspace(-limit, limit, nbins[1]+1) )
 
         counts, xedges, yedges = np.histogram2d(x=arr[0], y=arr[1], bins=bins, weights=data_weights, density=False)
-        bokehplot.histogram(data=(counts, xedges, yedges),
-                            idx=ilayer-1, iframe=iframe, style='quad%blues', fig_kwargs=fig_kwargs,
-                            continuum_value=0, continuum_color='white')
-        layer_label = 'Layer '+str(ilayer)
-        label_props = {'text_font_size': '10pt', 'x_units': 'screen', 'y_units': 'screen',
-                       'border_line_color': 'black', 'background_fill_color': 'LightCyan'}
-        bokehplot.label(layer_label, idx=ilayer-1, iframe=iframe, x=340, y=290, **label_props)
+        plot_layer_double(counts, xedges, yedges, ilayer, iframe, fig_kwargs)
         #bokehplot.box(x=[sigmaNoiseTimesKappa,xmaxlimit], y=[1.3, datamax[1]], idx=ilayer-1, color='red', line_width=3)
 
+def double_fig_kwargs(mode, energy_index):
+    if mode == 'dens_dist':
+        labels = ('Density [MeV]', 'Distance to nearest higher density [cm]')
+    else:
+        labels = ('X hit position [cm]', 'Y hit position [cm]')
+    return {'plot_width': plot_width, 'plot_height': plot_height,
+            't.text': 'Beam energy: {} GeV'.format(true_beam_energies_GeV[energy_index]),
+            'x.axis_label': labels[0], 'y.axis_label': labels[1]}
+
+def plot_layer_double(counts, xedges, yedges, ilayer, iframe, fig_kwargs):
+    bokehplot.histogram(data=(counts, xedges, yedges),
+                        idx=ilayer-1, iframe=iframe, style='quad%blues', fig_kwargs=fig_kwargs,
+                        continuum_value=0, continuum_color='white')
+    layer_label = 'Layer '+str(ilayer)
+    label_props = {'text_font_size': '10pt', 'x_units': 'screen', 'y_units': 'screen',
+                   'border_line_color': 'black', 'background_fill_color': 'LightCyan'}
+    bokehplot.label(layer_label, idx=ilayer-1, iframe=iframe, x=340, y=290, **label_props)
+
+def graphs_double_summary(filename, mode, iframe, energy_index=2):
+    """Same plots as graphs_double(), from the histograms written to the 'summary' directory of the merged output of one beam energy"""
+    if mode not in ('dens_dist', 'pos'):
+        raise ValueError('Wrong mode!')
+    counts, (_, xedges, yedges) = utils.read_summary(filename, 'DensDist3D' if mode == 'dens_dist' else 'PosXY3D')
+    fig_kwargs = double_fig_kwargs(mode, energy_index)
+    for ilayer in range(1,nlayers+1):
+        plot_layer_double(counts[ilayer-1], xedges, yedges, ilayer, iframe, fig_kwargs)
+
+def graphs_summary(filename, energy_index):
+    """Plots of one beam energy read from the 'summary' directory of its merged output ('--summary')"""
+    if beam_energies[energy_index] == chosen_energy:
+        if FLAGS.densities_distances:
+            graphs_double_summary(filename, mode='dens_dist', iframe=output_html_files_map['densities_distances'][1], energy_index=energy_index)
+        if FLAGS.densities:
+            graphs_single_summary(filename, columns_field='Densities', energy_index=energy_index, iframe=output_html_files_map['densities'][1], do_2D=False)
+        if FLAGS.distances:
+            graphs_single_summary(filename, columns_field='Distances', energy_index=energy_index, iframe=output_html_files_map['distances'][1], do_2D=False)
+        if FLAGS.posx_posy:
+            graphs_double_summary(filename, mode='pos', iframe=output_html_files_map['posx_posy'][1], energy_index=energy_index)
+    if FLAGS.densities_2D:
+        graphs_single_summary(filename, columns_field='Densities', energy_index=energy_index, iframe=output_html_files_map['densities_2D'][1], do_2D=True)
+    if FLAGS.distances_2D:
+        graphs_single_summary(filename, columns_field='Distances', energy_index=energy_index, iframe=output_html_files_map['distances_2D'][1], do_2D=True)
+    if FLAGS.hits_fraction:
+        graphs_single_summary(filename, columns_field='Nhits', energy_index=energy_index, iframe=output_html_files_map['hits_fraction'][1], do_2D=True)
+    if FLAGS.energy_fraction:
+        graphs_single_summary(filename, columns_field='Energy', energy_index=energy_index, iframe=output_html_files_map['energy_fraction'][1], do_2D=True)
+
 class CacheManager:
     def __init__(self, name):
         self.name_ = name
@@ -274,15 +310,16 @@ class CacheManager:
 
 def main():
 
-    chosen_energy = 50 #density vs densities plots will only refer to this energy (one plot per layer)
-    assert(chosen_energy in beam_energies)
-    
     for iEn,thisEn in enumerate(beam_energies):
 
         #check the file exists
         if not os.path.isfile(data_paths[iEn]):
             print('WARNING: Missing dataset for {} GeV.'.format(thisEn))
             continue
+
+        if FLAGS.summary:
+            graphs_summary(data_paths[iEn], iEn)
+            continue
         
         #load ROOT TTree for a specific energy
         file = up.open( data_paths[iEn] )
@@ -373,6 +410,8 @@ if __name__ == '__main__':
     #define analysis constants
     nlayers = 28 if FLAGS.showertype=='em' else 40
     beam_energies = (20,30,50,80,100,120,150,200,250,300)
+    chosen_energy = 50 #density vs densities plots will only refer to this energy (one plot per layer)
+    assert(chosen_energy in beam_energies)
     energy_cut = 1000
     sigmaNoiseTimesKappa = 9 * 10. / 6.
     true_beam_energies_GeV = (20,30,49.99,79.93,99.83,119.65,149.14,197.32,243.61,287.18)
@@ -400,6 +439,9 @@ if __name__ == '__main__':
     output_html_dir = os.path.join(eos_base, cms_user[0], cms_user, 'www', analysis_directory, 'layer_dep', FLAGS.datatype, FLAGS.showertype, FLAGS.tag)
     utils.create_dir( output_html_dir )
     plot_width, plot_height = 600, 400
+    axis_labels = {'Densities': 'Density [MeV]', 'Distances': 'Distance to nearest higher density [cm]',
+                   'Nhits': 'Fraction of clusterized hits', 'Energy': 'Fraction of clusterized energy'}
+    summary_names = {'Densities': 'Densities', 'Distances': 'Distances', 'Nhits': 'NhitsFrac', 'Energy': 'EnergyFrac'} #histograms written by 'merge_outputs_exe --summary'
     
     #the keys are the attributes of FLAGS (except 'all')
     #the values are: 1) the name of all potential bokehplot frames, 2) number of bokehplot figures in each frame       
@@ -31,6 +31,20 @@ class ProcessData:
             df_beamen.append( red.loc[:, cols].stack() if cols != [] else None )
         return df_beamen
 
+    @staticmethod
+    def join_npy(glob_path):
+        """Same as join(), but memory-maps the '.npy' columns written by 'analyze_data_exe --npy'"""
+        ensums = {b: [] for b in beam_energies}
+        for f in glob.glob(glob_path):
+            ensum = np.load(f, mmap_mode='r')
+            beamen = np.load(f.replace('_ensum', '_beamen'), mmap_mode='r')
+            if len(ensum) == 0:
+                continue
+            b = int(round(beamen[0]))
+            if b in ensums:
+                ensums[b].append(ensum)
+        return [ pd.Series(np.concatenate(ensums[b])) if ensums[b] != [] else None for b in beam_energies ]
+
     @staticmethod
     def scale_energy(dfs, scale_factor, shift_factor):
         dfs_scaled = []
@@ -267,7 +281,10 @@ def analyze_data():
                  [750, 250000., 4000.], #250GeV
                  [750, 310000., 4500.]) #300GeV
 
-    data1 = ProcessData.join(path + '*_noclusters.csv')
+    if FLAGS.npy:
+        data1 = ProcessData.join_npy(path + '*_noclusters_ensum*.npy')
+    else:
+        data1 = ProcessData.join(path + '*_noclusters.csv')
 
     hist1 = HandleHistograms.create(data1, bins, iframe=0)
     mean1, emean1, _, _, _, _ = HandleHistograms.fit(hist1, pars1, histo_ranges1, iframe=0)
@@ -296,7 +313,10 @@ def analyze_data():
              [750, 185000., 3500.], #200GeV
              [750, 240000., 4000.], #250GeV
              [750, 290000., 4500.]) #300GeV 
-    data2 = ProcessData.join(path + '*[0-9].csv')
+    if FLAGS.npy:
+        data2 = ProcessData.join_npy(path + '*[0-9]_ensum*.npy')
+    else:
+        data2 = ProcessData.join(path + '*[0-9].csv')
     hist2 = HandleHistograms.create(data2, bins, iframe=2)
     mean2, emean2, _, _, _, _ = HandleHistograms.fit(hist2, pars2, histo_ranges2, iframe=2)
     
@@ -342,9 +362,15 @@ def analyze_data():
 
 def final_plots():
     variables_stored = []
-    hf = h5py.File(h5filename, 'r') 
-    for name in variables_created:
-        variables_stored.append( hf.get(name) )
+    if FLAGS.reduced: #same variables, computed by 'reduce_outputs_exe'
+        df = pd.read_csv(reduced_filename)
+        hf = None
+        for name in variables_created:
+            variables_stored.append( df[name].to_numpy() )
+    else:
+        hf = h5py.File(h5filename, 'r') 
+        for name in variables_created:
+            variables_stored.append( hf.get(name) )
 
     save_folder = os.path.join(eos_base, cms_user[0], cms_user, 'www', data_directory, 'resp_res', FLAGS.datatype, FLAGS.tag)
     utils.create_dir( save_folder )
@@ -357,10 +383,13 @@ def final_plots():
     bokehplot.save_figs(iframe=frameid, path=save_folder, mode='png')
     bokehplot.save_figs(iframe=frameid, path=presentation_path, mode='png')
 
-    hf.close()
+    if hf is not None:
+        hf.close()
 
 def main():
-    if FLAGS.analyze_only: #analysis and some plotting (store data into HDF5)
+    if FLAGS.reduced:
+        final_plots()
+    elif FLAGS.analyze_only: #analysis and some plotting (store data into HDF5)
         analyze_data()
     elif FLAGS.plot_only: #final resolution and response plots (read data from HDF5)
         final_plots()
@@ -405,5 +434,6 @@ if __name__ == '__main__':
     #HDF5 data file related variables
     h5filename = os.path.join( eos_base, cms_user[0], cms_user, data_directory, FLAGS.tag, FLAGS.datatype + "_" + FLAGS.showertype + '_' + os.path.splitext( os.path.basename(__file__) )[0] + '.h5')
     variables_created = ('resp1', 'eresp1', 'res1', 'eres1', 'resp2', 'eresp2', 'res2', 'eres2')
+    reduced_filename = os.path.join( eos_base, cms_user[0], cms_user, data_directory, FLAGS.tag, FLAGS.datatype + "_" + FLAGS.showertype + '_resp_res.csv')
 
     main()
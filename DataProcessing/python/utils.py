@@ -69,6 +69,32 @@ def get_mean_and_sigma(x, y=None):
             sigma = np.sqrt( mean_squared - mean**2 )
     return mean, sigma
 
+def select_entries(filename, selection, tree='event_index'):
+    """entries of the 'relevant_branches' tree written by process_data_exe whose per-event summary passes 'selection',
+    a function taking the arrays of the index tree (NhitsClean, EnergyLayer, AhcEnergy, ...) and returning a boolean mask"""
+    index = up.open(filename)[tree].arrays(namedecode='utf-8')
+    return index['Entry'][ selection(index) ]
+
+def iterate_selected(filename, entries, branches, tree='relevant_branches', maxgap=1000):
+    """yields the 'branches' of the selected entries, reading only the ranges of entries which contain them;
+    entries closer than 'maxgap' are read within the same range"""
+    entries = np.sort(np.asarray(entries))
+    if len(entries) == 0:
+        return
+    t = up.open(filename)[tree]
+    for chunk in np.split(entries, np.where(np.diff(entries) > maxgap)[0] + 1):
+        start, stop = chunk[0], chunk[-1] + 1
+        arrays = t.arrays(branches, entrystart=start, entrystop=stop, namedecode='utf-8')
+        yield {k: v[chunk - start] for k,v in arrays.items()}
+
+def read_summary(filename, name):
+    """counts and bin edges (one array per axis, the first being the layer) of the histogram 'name' written to the
+    'summary' directory of a merged output by 'merge_outputs_exe --summary'"""
+    counts, edges = up.open(filename)['summary/' + name].numpy()
+    if isinstance(edges, list): #TH2 and TH3
+        return counts, tuple(edges[0])
+    return counts, (edges,)
+
 def get_layer_col(df, starts_with, ilayer=None):
     """Obtains list of columns that match a specific column name ending."""
     if ilayer is None:
@@ -1,6 +1,16 @@
 #include "UserCode/DataProcessing/interface/CLUEAlgo.h"
 
 void CLUEAlgo::makeClusters(){
+  //batched events: a single pass over all the hits, with tiles per event and layer
+  if(nEvents() > 1) {
+    BatchTiles tiles(memoryResource());
+    tiles.fill(points_, detectorConstants::totalnlayers);
+    calculateLocalDensity(tiles);
+    calculateDistanceToHigher(tiles);
+    findAndAssignClusters();
+    return;
+  }
+
   std::array<LayerTiles, detectorConstants::totalnlayers> allLayerTiles;
   // start clustering
   auto start = std::chrono::high_resolution_clock::now();
@@ -117,15 +127,81 @@ void CLUEAlgo::calculateDistanceToHigher( std::array<LayerTiles, detectorConstan
   } // end of loop over points
 }
 
+void CLUEAlgo::calculateLocalDensity( const BatchTiles & tiles ){
+  
+  // loop over all points of all events
+  for(int i = 0; i < points_.n; i++) {
+    const int plane = tiles.plane(i);
+    
+    // get search box
+    std::array<int,4> search_box = tiles.searchBox(points_.x[i]-dc_, points_.x[i]+dc_, points_.y[i]-dc_, points_.y[i]+dc_);
+    
+    // loop over bins in the search box, only within the event and layer of i
+    for(int xBin = search_box[0]; xBin < search_box[1]+1; ++xBin) {
+      for(int yBin = search_box[2]; yBin < search_box[3]+1; ++yBin) {
+        for(int j : tiles.bin(plane, tiles.getGlobalBinByBin(xBin,yBin))) {
+          // query N_{dc_}(i)
+          float dist_ij = distance(i, j);
+          if(dist_ij <= dc_) {
+            // sum weights within N_{dc_}(i)
+            points_.rho[i] += (i == j ? 1.f : 0.5f) * points_.weight[j];
+          }
+        }
+      }
+    } // end of loop over bins in search box
+  } // end of loop over points
+}
+
+
+void CLUEAlgo::calculateDistanceToHigher( const BatchTiles & tiles ){
+  // loop over all points of all events
+  float dm = outlierDeltaFactor_ * dc_;
+  for(int i = 0; i < points_.n; i++) {
+    // default values of delta and nearest higher for i
+    float delta_i = std::numeric_limits<float>::max();
+    int nearestHigher_i = -1;
+    const int plane = tiles.plane(i);
+
+    // get search box 
+    std::array<int,4> search_box = tiles.searchBox(points_.x[i]-dm, points_.x[i]+dm, points_.y[i]-dm, points_.y[i]+dm);
+    
+    // loop over all bins in the search box, only within the event and layer of i
+    for(int xBin = search_box[0]; xBin < search_box[1]+1; ++xBin) {
+      for(int yBin = search_box[2]; yBin < search_box[3]+1; ++yBin) {
+        for(int j : tiles.bin(plane, tiles.getGlobalBinByBin(xBin,yBin))) {
+          // query N'_{dm}(i); within an event, the hits keep their relative order
+          bool foundHigher = (points_.rho[j] > points_.rho[i]);
+          foundHigher = foundHigher || ((points_.rho[j] == points_.rho[i]) && (j>i) );
+          float dist_ij = distance(i, j);
+          if(foundHigher && dist_ij <= dm && dist_ij < delta_i) {
+            // update delta_i and nearestHigher_i
+            delta_i = dist_ij;
+            nearestHigher_i = j;
+          }
+        }
+      }
+    } // end of loop over bins in search box
+    
+    points_.delta[i] = delta_i;
+    points_.nearestHigher[i] = nearestHigher_i;
+  } // end of loop over points
+}
+
 void CLUEAlgo::findAndAssignClusters(){
   auto start = std::chrono::high_resolution_clock::now();
   
   int nClusters = 0;
+  int ev = 0;
   
   // find cluster seeds and outlier  
-  std::vector<int> localStack;
+  std::pmr::vector<int> localStack(memoryResource());
   // loop over all points
   for(int i = 0; i < points_.n; i++) {
+    // cluster ids start at zero in each event (batched mode)
+    while(i == points_.eventOffsets[ev+1]) {
+      ++ev;
+      nClusters = 0;
+    }
     // initialize clusterIndex
     points_.clusterIndex[i] = -1;
     //note that the layer array starts at 0
@@ -188,41 +264,52 @@ void CLUEAlgo::findAndAssignClusters(){
 void CLUEAlgo::infoSeeds()
 {
   int noutliers = 0;
-  std::vector<int> clusterIdxUsed;
-  for(int i = 0; i < points_.n; i++)
+  std::pmr::vector<int> clusterIdxUsed(memoryResource());
+  //the cluster ids start at zero in each event (batched mode)
+  for(int ev = 0; ev < nEvents(); ev++)
     {
-      if(points_.clusterIndex[i] == -1) { //no outliers
-	noutliers += 1;
-	continue;
-      }
-      if( std::find(clusterIdxUsed.begin(), clusterIdxUsed.end(), points_.clusterIndex[i]) == clusterIdxUsed.end() ) //not found
+      const int begin = points_.eventOffsets[ev], end = points_.eventOffsets[ev+1];
+      clusterIdxUsed.clear();
+      for(int i = begin; i < end; i++)
 	{
-	  clusterIdxUsed.push_back( points_.clusterIndex[i] );
-	  float maxrho = -1.f; //a negative density is lower than any physical hit density
-	  int seedIdx = i; //by default the first hit is the seed (always true when the cluster only has one hit)
-	  for(int j = i+1; j < points_.n; j++)
+	  if(points_.clusterIndex[i] == -1) { //no outliers
+	    noutliers += 1;
+	    continue;
+	  }
+	  if( std::find(clusterIdxUsed.begin(), clusterIdxUsed.end(), points_.clusterIndex[i]) == clusterIdxUsed.end() ) //not found
 	    {
-	      if(points_.clusterIndex[j] == points_.clusterIndex[i] and points_.rho[j] > maxrho)
+	      clusterIdxUsed.push_back( points_.clusterIndex[i] );
+	      float maxrho = -1.f; //a negative density is lower than any physical hit density
+	      int seedIdx = i; //by default the first hit is the seed (always true when the cluster only has one hit)
+	      for(int j = i+1; j < end; j++)
 		{
-		  maxrho = points_.rho[j];
-		  seedIdx = j;
+		  if(points_.clusterIndex[j] == points_.clusterIndex[i] and points_.rho[j] > maxrho)
+		    {
+		      maxrho = points_.rho[j];
+		      seedIdx = j;
+		    }
 		}
-	    }
-	  points_.isSeed[seedIdx] = true;
-	} 
+	      points_.isSeed[seedIdx] = true;
+	    } 
+	}
     }
 }
 
 void CLUEAlgo::infoHits()
 {
-  for(int i = 0; i < points_.n; i++)
+  //the cluster ids start at zero in each event (batched mode)
+  for(int ev = 0; ev < nEvents(); ev++)
     {
-      if(points_.clusterIndex[i] == -1) //no outliers
-	continue;
-      for(int j = 0; j < points_.n; j++)
+      const int begin = points_.eventOffsets[ev], end = points_.eventOffsets[ev+1];
+      for(int i = begin; i < end; i++)
 	{
-	  if(points_.clusterIndex[j] == points_.clusterIndex[i])
-	    points_.nHitsCluster[i] += 1;
+	  if(points_.clusterIndex[i] == -1) //no outliers
+	    continue;
+	  for(int j = begin; j < end; j++)
+	    {
+	      if(points_.clusterIndex[j] == points_.clusterIndex[i])
+		points_.nHitsCluster[i] += 1;
+	    }
 	}
     }
 }
@@ -232,7 +319,7 @@ std::vector<float> CLUEAlgo::getHitsPosX() {
     std::cout << "ERROR: CLUEAlgo::getHitsPosX()" << std::endl;
     throw std::bad_function_call();
   }
-  return points_.x;
+  return {points_.x.begin(), points_.x.end()};
 }
 
 std::vector<float> CLUEAlgo::getHitsPosY() {
@@ -240,7 +327,7 @@ std::vector<float> CLUEAlgo::getHitsPosY() {
     std::cout << "ERROR: CLUEAlgo::getHitsPosY()" << std::endl;
     throw std::bad_function_call();
   }
-  return points_.y;
+  return {points_.y.begin(), points_.y.end()};
 }
 
 std::vector<float> CLUEAlgo::getHitsWeight() {
@@ -248,7 +335,7 @@ std::vector<float> CLUEAlgo::getHitsWeight() {
     std::cout << "ERROR: CLUEAlgo::getHitsWeight()" << std::endl;
     throw std::bad_function_call();
   }
-  return points_.weight;
+  return {points_.weight.begin(), points_.weight.end()};
 }
 
 std::vector<int> CLUEAlgo::getHitsClusterId() {
@@ -256,7 +343,7 @@ std::vector<int> CLUEAlgo::getHitsClusterId() {
     std::cout << "ERROR: CLUEAlgo::getHitsClusterId()" << std::endl;
     throw std::bad_function_call();
   }
-  return points_.clusterIndex;
+  return {points_.clusterIndex.begin(), points_.clusterIndex.end()};
 }
 
 std::vector<int> CLUEAlgo::getHitsLayerId() {
@@ -275,7 +362,7 @@ std::vector<float> CLUEAlgo::getHitsRho() {
     std::cout << "ERROR: CLUEAlgo::getHitsRho()" << std::endl;
     throw std::bad_function_call();
   }
-  return points_.rho;
+  return {points_.rho.begin(), points_.rho.end()};
 }
 
 std::vector<float> CLUEAlgo::getHitsDistanceToHighest() {
@@ -283,7 +370,7 @@ std::vector<float> CLUEAlgo::getHitsDistanceToHighest() {
     std::cout << "ERROR: CLUEAlgo::getDistanceToHighest()" << std::endl;
     throw std::bad_function_call();
   }
-  return points_.delta;
+  return {points_.delta.begin(), points_.delta.end()};
 }
 
 std::vector<bool> CLUEAlgo::getHitsSeeds() {
@@ -299,7 +386,7 @@ std::vector<bool> CLUEAlgo::getHitsSeeds() {
 	throw std::bad_function_call();
       }
   }
-  return points_.isSeed;
+  return {points_.isSeed.begin(), points_.isSeed.end()};
 }
 
 std::vector<unsigned int> CLUEAlgo::getNHitsInCluster() {
@@ -315,7 +402,7 @@ std::vector<unsigned int> CLUEAlgo::getNHitsInCluster() {
 	throw std::bad_function_call();
       }
   }
-  return points_.nHitsCluster;
+  return {points_.nHitsCluster.begin(), points_.nHitsCluster.end()};
 }
 
 inline float CLUEAlgo::distance(int i, int j) const {
@@ -1,6 +1,12 @@
 #include "UserCode/DataProcessing/interface/CLUEAnalysis.h"
 
-CLUEAnalysis::CLUEAnalysis(const SHOWERTYPE& s, const float& W0, const float& dpos): showertype(s), W0_(W0), dpos_(dpos)
+namespace {
+  //the outputs outlive the event: they are copied out of the temporaries
+  template<typename T>
+  std::vector<T> heap_copy(const std::pmr::vector<T>& v) { return std::vector<T>(v.begin(), v.end()); }
+}
+
+CLUEAnalysis::CLUEAnalysis(const SHOWERTYPE& s, const float& W0, const float& dpos, std::pmr::memory_resource* mr): showertype(s), W0_(W0), dpos_(dpos), mr_(mr)
 {
   if(showertype == SHOWERTYPE::EM)
     lmax = detectorConstants::nlayers_emshowers;
@@ -13,32 +19,32 @@ CLUEAnalysis::CLUEAnalysis(const SHOWERTYPE& s, const float& W0, const float& dp
   this->clusterdep_vars_.resize(lmax);
 }
 
-void CLUEAnalysis::calculateEnergy( const std::vector<float>& weights, const std::vector<int>& clusterid ) {
+void CLUEAnalysis::calculateEnergy( const std::pmr::vector<float>& weights, const std::pmr::vector<int>& clusterid ) {
   const int nclusters = *( std::max_element(clusterid.begin(), clusterid.end()) ) 
     + 1 /*cluster index starts at zero*/ + 1 /*outliers*/;
-  std::vector<float> total_weight(nclusters, 0.);
+  std::pmr::vector<float> total_weight(nclusters, 0., mr_);
 
   for(auto i: util::lang::indices(weights))
     {
       unsigned weight_index = clusterid.at(i) + 1; //outliers will correspond to total_weight[0]
       total_weight.at(weight_index) += weights[i];
     }
-  en_ = total_weight;
+  en_.assign(total_weight.begin(), total_weight.end());
 }
 
 //calculate the number of clusterized hits and clusterized energy per layer
-void CLUEAnalysis::calculateLayerDepVars(const std::vector<float>& xpos, const std::vector<float>& ypos, const std::vector<float>& weights, const std::vector<int>& clusterid, const std::vector<int>& layerid, const std::vector<float>& rhos, const std::vector<float>& deltas, const std::vector<bool>& seeds, const std::vector<unsigned>& nhitsincluster) {
+void CLUEAnalysis::calculateLayerDepVars(const std::pmr::vector<float>& xpos, const std::pmr::vector<float>& ypos, const std::pmr::vector<float>& weights, const std::pmr::vector<int>& clusterid, const std::pmr::vector<int>& layerid, const std::pmr::vector<float>& rhos, const std::pmr::vector<float>& deltas, const std::pmr::vector<bool>& seeds, const std::pmr::vector<unsigned>& nhitsincluster) {
   assert(!weights.empty() && !clusterid.empty() && !layerid.empty() && !rhos.empty() && !deltas.empty());
 
   //calculate the number of rechits and clusterized energy per layer
-  std::vector<unsigned> hits_per_layer(this->lmax, 0);
-  std::vector< std::vector<float> > en_per_layer(this->lmax);
-  std::vector< std::vector<float> > rhos_per_layer(this->lmax);
-  std::vector< std::vector<float> > deltas_per_layer(this->lmax);
-  std::vector< std::vector<bool>  > seeds_per_layer(this->lmax);
-  std::vector< std::vector<float> > xpos_per_layer(this->lmax);
-  std::vector< std::vector<float> > ypos_per_layer(this->lmax);
-  std::vector< std::vector<unsigned> > cluster_size_per_layer(this->lmax); //number of hits in the cluster for each hit and layer
+  std::pmr::vector<unsigned> hits_per_layer(this->lmax, 0, mr_);
+  std::pmr::vector< std::pmr::vector<float> > en_per_layer(this->lmax, mr_);
+  std::pmr::vector< std::pmr::vector<float> > rhos_per_layer(this->lmax, mr_);
+  std::pmr::vector< std::pmr::vector<float> > deltas_per_layer(this->lmax, mr_);
+  std::pmr::vector< std::pmr::vector<bool>  > seeds_per_layer(this->lmax, mr_);
+  std::pmr::vector< std::pmr::vector<float> > xpos_per_layer(this->lmax, mr_);
+  std::pmr::vector< std::pmr::vector<float> > ypos_per_layer(this->lmax, mr_);
+  std::pmr::vector< std::pmr::vector<unsigned> > cluster_size_per_layer(this->lmax, mr_); //number of hits in the cluster for each hit and layer
 
   //unsigned this_cluster_size = 1;
   //int old_i = -1;
@@ -61,19 +67,19 @@ void CLUEAnalysis::calculateLayerDepVars(const std::vector<float>& xpos, const s
     }
   //fill std::arra1y with fractions
   for(unsigned ilayer=0; ilayer<lmax; ++ilayer) {
-    layerdep_vars_.at(ilayer) = std::make_tuple(hits_per_layer.at(ilayer), en_per_layer.at(ilayer), 
-						rhos_per_layer.at(ilayer), deltas_per_layer.at(ilayer), seeds_per_layer.at(ilayer),
-						xpos_per_layer.at(ilayer), ypos_per_layer.at(ilayer),
-						cluster_size_per_layer.at(ilayer));
+    layerdep_vars_.at(ilayer) = std::make_tuple(hits_per_layer.at(ilayer), heap_copy(en_per_layer.at(ilayer)), 
+						heap_copy(rhos_per_layer.at(ilayer)), heap_copy(deltas_per_layer.at(ilayer)), heap_copy(seeds_per_layer.at(ilayer)),
+						heap_copy(xpos_per_layer.at(ilayer)), heap_copy(ypos_per_layer.at(ilayer)),
+						heap_copy(cluster_size_per_layer.at(ilayer)));
   }
 }
 
 //calculate the number of clusterized hits and clusterized energy per layer and per cluster
-void CLUEAnalysis::calculateClusterDepVars(const std::vector<float>& xpos, const std::vector<float>& ypos, const std::vector<float>& weights, const std::vector<int>& clusterid, const std::vector<int>& layerid, const std::vector<float>& impactX, const std::vector<float>& impactY) {
+void CLUEAnalysis::calculateClusterDepVars(const std::pmr::vector<float>& xpos, const std::pmr::vector<float>& ypos, const std::pmr::vector<float>& weights, const std::pmr::vector<int>& clusterid, const std::pmr::vector<int>& layerid, const std::vector<float>& impactX, const std::vector<float>& impactY) {
   assert(!weights.empty() && !clusterid.empty() && !layerid.empty());
 
-  std::vector<unsigned> nclusters_per_layer(this->lmax, 0); //number of clusters per layer for resizing the vectors
-  std::unordered_map<unsigned, unsigned> clusterIndexMap;
+  std::pmr::vector<unsigned> nclusters_per_layer(this->lmax, 0, mr_); //number of clusters per layer for resizing the vectors
+  std::pmr::unordered_map<unsigned, unsigned> clusterIndexMap(mr_);
 
   //calculate number of clusters per layer
   for(auto i: util::lang::indices(weights))
@@ -86,18 +92,18 @@ void CLUEAnalysis::calculateClusterDepVars(const std::vector<float>& xpos, const
 	  nclusters_per_layer[layeridx] += 1;
 	}
     }
-  std::vector< std::vector<float> > en_per_cluster(this->lmax);
-  std::vector< std::vector<float> > en_per_cluster_ecut(this->lmax); //helper for position measurement
-  std::vector< std::vector<float> > en_per_cluster_log_ecut(this->lmax); //helper for position measurement
-  std::vector< std::vector<unsigned> > hits_per_cluster(this->lmax);
-  std::vector< std::vector<float> > x_per_cluster(this->lmax);
-  std::vector< std::vector<float> > y_per_cluster(this->lmax);
+  std::pmr::vector< std::pmr::vector<float> > en_per_cluster(this->lmax, mr_);
+  std::pmr::vector< std::pmr::vector<float> > en_per_cluster_ecut(this->lmax, mr_); //helper for position measurement
+  std::pmr::vector< std::pmr::vector<float> > en_per_cluster_log_ecut(this->lmax, mr_); //helper for position measurement
+  std::pmr::vector< std::pmr::vector<unsigned> > hits_per_cluster(this->lmax, mr_);
+  std::pmr::vector< std::pmr::vector<float> > x_per_cluster(this->lmax, mr_);
+  std::pmr::vector< std::pmr::vector<float> > y_per_cluster(this->lmax, mr_);
   //helpers for position measurement (distance cut)
-  std::vector< std::vector<float> > xmax_per_cluster(this->lmax);
-  std::vector< std::vector<float> > ymax_per_cluster(this->lmax);
-  std::vector< std::vector< std::vector<float> > > xpositions(this->lmax);
-  std::vector< std::vector< std::vector<float> > > ypositions(this->lmax);
-  std::vector< std::vector< std::vector<float> > > energies(this->lmax);
+  std::pmr::vector< std::pmr::vector<float> > xmax_per_cluster(this->lmax, mr_);
+  std::pmr::vector< std::pmr::vector<float> > ymax_per_cluster(this->lmax, mr_);
+  std::pmr::vector< std::pmr::vector< std::pmr::vector<float> > > xpositions(this->lmax, mr_);
+  std::pmr::vector< std::pmr::vector< std::pmr::vector<float> > > ypositions(this->lmax, mr_);
+  std::pmr::vector< std::pmr::vector< std::pmr::vector<float> > > energies(this->lmax, mr_);
   
   for(unsigned i=0; i<lmax; ++i)
     {
@@ -110,9 +116,9 @@ void CLUEAnalysis::calculateClusterDepVars(const std::vector<float>& xpos, const
 
       xmax_per_cluster[i].resize( nclusters_per_layer[i], 9999.f );
       ymax_per_cluster[i].resize( nclusters_per_layer[i], 9999.f );
-      xpositions[i].resize( nclusters_per_layer[i], std::vector<float>() );
-      ypositions[i].resize( nclusters_per_layer[i], std::vector<float>() );
-      energies[i].resize( nclusters_per_layer[i], std::vector<float>() );
+      xpositions[i].resize( nclusters_per_layer[i] );
+      ypositions[i].resize( nclusters_per_layer[i] );
+      energies[i].resize( nclusters_per_layer[i] );
     }
 
   for(auto i: util::lang::indices(weights)) {
@@ -196,14 +202,14 @@ void CLUEAnalysis::calculateClusterDepVars(const std::vector<float>& xpos, const
     {
       //spatial resolution calculation (estimated impact point in layer minus CLUE's position of each cluster)
       assert( x_per_cluster[ilayer].size() == y_per_cluster[ilayer].size() );
-      std::vector<float> dx(x_per_cluster[ilayer].size()), dy(x_per_cluster[ilayer].size());
+      std::vector<float> dx(x_per_cluster[ilayer].size()), dy(x_per_cluster[ilayer].size()); //outputs
       for(unsigned iclust=0; iclust<x_per_cluster[ilayer].size(); ++iclust) 
 	{
 	  dx[iclust] = impactX[ilayer] - x_per_cluster[ilayer][iclust];
 	  dy[iclust] = impactY[ilayer] - y_per_cluster[ilayer][iclust];
 	}
       //store all cluster-related variables
-      clusterdep_vars_.at(ilayer) = std::make_tuple( hits_per_cluster[ilayer], en_per_cluster[ilayer], x_per_cluster[ilayer], y_per_cluster[ilayer], dx, dy);
+      clusterdep_vars_.at(ilayer) = std::make_tuple( heap_copy(hits_per_cluster[ilayer]), heap_copy(en_per_cluster[ilayer]), heap_copy(x_per_cluster[ilayer]), heap_copy(y_per_cluster[ilayer]), std::move(dx), std::move(dy));
     }
 }
 
@@ -12,6 +12,7 @@ Analyzer::Analyzer(const std::vector< std::string >& in_file_path, const std::st
       std::cout << "#" << std::to_string(i+1) << " " << in_file_path[i] << std::endl;
       names_.push_back( std::make_pair(in_file_path[i], in_tree_name) );
       en_total_.push_back( std::vector< std::tuple<float, float> >() );
+      en_total_noclusters_.push_back( std::vector< std::tuple<float, float> >() );
       layer_fracs_.push_back( std::vector< dataformats::layerfracs >() );
       layer_hitvars_.push_back( std::vector< dataformats::layerhitvars >() );
       clusterdep_.push_back( std::vector< dataformats::clustervars >() );
@@ -28,6 +29,7 @@ Analyzer::Analyzer(const std::string& in_file_path, const std::string& in_tree_n
   names_.push_back( std::make_pair(in_file_path, in_tree_name) );
   beam_energies_.resize(1, 0.f);
   en_total_.push_back( std::vector< std::tuple<float, float> >() );
+  en_total_noclusters_.push_back( std::vector< std::tuple<float, float> >() );
   layer_fracs_.push_back( std::vector< dataformats::layerfracs >() );
   layer_hitvars_.push_back( std::vector< dataformats::layerhitvars >() );
   clusterdep_.push_back( std::vector< dataformats::clustervars >() );
@@ -37,20 +39,408 @@ Analyzer::~Analyzer()
 {
 }
 
+void Analyzer::set_ncpus(const unsigned& ncpus)
+{
+  this->ncpus_ = parallelism::resolve_ncpus(ncpus);
+}
+
+void Analyzer::set_thread_pinning(const bool& pin)
+{
+  this->pin_threads_ = pin;
+}
+
+//streams the layer- and cluster-dependent outputs to disk from a dedicated thread while runCLUE() is running,
+//instead of keeping them in memory until save_to_file_layer_dependent() and save_to_file_cluster_dependent() are called
+//the columnar layout is used if 'opt.enabled' is true; events are handed over in batches of 'batch_size' events
+void Analyzer::set_async_output(const std::string& layer_fname, const std::string& cluster_fname, const columnar::WriterOptions& opt, const unsigned& batch_size)
+{
+  if(batch_size == 0)
+    throw std::invalid_argument("The batch size has to be positive.");
+  async_.enabled = true;
+  async_.layer_fname = layer_fname;
+  async_.cluster_fname = cluster_fname;
+  async_.opt = opt;
+  async_.batch_size = batch_size;
+}
+
+//reads the events from dataframe nodes providing the selected columns (one per file, e.g. Selector::selection())
+//instead of the selected ntuples, so that the selection and the clustering run in the same event loop; 'sources'
+//identifies the events of each node, since the files are then the original ntuples (see Selector::source_id())
+void Analyzer::set_input_nodes(const std::vector<ROOT::RDF::RNode>& nodes, const std::vector<std::string>& sources)
+{
+  if(nodes.size() != nfiles_ or sources.size() != nfiles_)
+    throw std::invalid_argument("One input node per file is required.");
+  this->input_nodes_ = nodes;
+  this->input_sources_ = sources;
+}
+
+//clusters the events in batches of 'nevents' (see CLUEAlgo::setPointsBatch()), with the same results;
+//worth it when the events have few hits (electromagnetic showers), for which the cost of each call dominates
+void Analyzer::set_batch_events(const unsigned& nevents)
+{
+  if(nevents == 0)
+    throw std::invalid_argument("The number of events per batch has to be positive.");
+  this->batch_events_ = nevents;
+}
+
+//processes all the runs together instead of one after the other: each run is split in ranges of 'chunk_size' entries,
+//which are scheduled on a work-stealing pool of 'ncpus' threads; the results are still stored per run, in the entry order
+void Analyzer::set_multirun(const bool& multirun, const unsigned& chunk_size)
+{
+  if(chunk_size == 0)
+    throw std::invalid_argument("The chunk size has to be positive.");
+  this->multirun_ = multirun;
+  this->chunk_size_ = chunk_size;
+}
+
+//periodically saves the clustered events to 'path', so that a job restarted after being interrupted
+//(with the same inputs and parameters) resumes from the last saved event instead of the first one
+void Analyzer::set_checkpoint(const std::string& path, const unsigned& every)
+{
+  if(every == 0)
+    throw std::invalid_argument("The checkpoint period has to be positive.");
+  ckpt_.path = path;
+  ckpt_.every = every;
+}
+
+//to be called once all the outputs are written
+void Analyzer::clear_checkpoint()
+{
+  if(ckpt_.log != nullptr)
+    ckpt_.log->remove();
+  ckpt_.log.reset();
+}
+
+//memory taken by the results kept in memory (and by the largest set of input hits read at once), with the event counts
+//which the memory scales with; the caller adds the resident set size once the outputs are written
+void Analyzer::fill_summary(memprof::JobSummary& summary)
+{
+  size_t nevents = 0, nclustered = 0;
+  for(unsigned i=0; i<nfiles_; ++i) {
+    nevents += en_total_noclusters_[i].size();
+    nclustered += en_total_[i].size();
+  }
+  summary.add("nfiles", nfiles_);
+  summary.add("ncpus", ncpus_);
+  summary.add("batch_events", batch_events_);
+  summary.add("input_events", nevents);
+  summary.add("clustered_events", nclustered);
+  summary.add("startup_s", startup_.seconds());
+  summary.add_bytes("mem_input_hits", input_bytes_);
+  summary.add_bytes("mem_event_arena", arena_bytes_);
+  summary.add_bytes("mem_en_total", memprof::bytes(en_total_));
+  summary.add_bytes("mem_en_total_noclusters", memprof::bytes(en_total_noclusters_));
+  summary.add_bytes("mem_layer_fracs", memprof::bytes(layer_fracs_));
+  summary.add_bytes("mem_layer_hitvars", memprof::bytes(layer_hitvars_));
+  summary.add_bytes("mem_clusterdep", memprof::bytes(clusterdep_));
+}
+
+//identifies the inputs and the parameters of the job: the checkpoint of a different configuration is discarded
+//with input nodes, the files are the original ntuples: their events are identified by the selection instead
+std::uint64_t Analyzer::_config_hash()
+{
+  std::string config;
+  for(unsigned i=0; i<nfiles_; ++i)
+    {
+      if(!input_nodes_.empty())
+	{
+	  config += this->input_sources_[i] + '\0';
+	  continue;
+	}
+      config += this->names_[i].first + '\0' + this->names_[i].second + '\0';
+      checkpoint::put(config, _count_entries(i));
+    }
+  checkpoint::put(config, dc_);
+  checkpoint::put(config, kappa_);
+  checkpoint::put(config, ecut_);
+  checkpoint::put(config, static_cast<int>(st_));
+  checkpoint::put(config, W0_);
+  checkpoint::put(config, dpos_);
+  checkpoint::put(config, this->lmax);
+  return checkpoint::hash(config);
+}
+
+//block layout: file, next event to process, number of clustered events and, for each of them, its index and outputs
+void Analyzer::_restore_checkpoint(std::vector< std::vector< std::pair<unsigned, EventOutput> > >& restored, unsigned& resume_file, unsigned& resume_event)
+{
+  ckpt_.log.reset( new checkpoint::Log(ckpt_.path, _config_hash()) );
+  unsigned nrestored = 0;
+  for(const std::string& block : ckpt_.log->blocks())
+    {
+      size_t pos = 0;
+      unsigned nevents;
+      checkpoint::get(block, pos, resume_file);
+      checkpoint::get(block, pos, resume_event);
+      checkpoint::get(block, pos, nevents);
+      if(resume_file >= nfiles_)
+	throw std::runtime_error("The checkpoint " + ckpt_.path + " refers to a file which is not being processed.");
+      for(unsigned iev=0; iev<nevents; ++iev)
+	{
+	  std::pair<unsigned, EventOutput> ev;
+	  checkpoint::get(block, pos, ev.first);
+	  checkpoint::get(block, pos, ev.second.en_total);
+	  checkpoint::get(block, pos, ev.second.fracs);
+	  checkpoint::get(block, pos, ev.second.hitvars);
+	  checkpoint::get(block, pos, ev.second.clusters);
+	  restored[resume_file].push_back( std::move(ev) );
+	}
+      nrestored += nevents;
+    }
+  if(nrestored > 0 or !ckpt_.log->blocks().empty())
+    std::cout << "Resuming from the checkpoint " << ckpt_.path << ": file number " << resume_file+1
+	      << ", event " << resume_event << " (" << nrestored << " clustered events restored)" << std::endl;
+}
+
+//'out' is null when the event was not clustered (empty or below the energy cut)
+void Analyzer::_checkpoint_event(const unsigned& i, const unsigned& iEvent, const EventOutput* out)
+{
+  if(out != nullptr)
+    {
+      checkpoint::put(ckpt_.payload, iEvent);
+      checkpoint::put(ckpt_.payload, out->en_total);
+      checkpoint::put(ckpt_.payload, out->fracs);
+      checkpoint::put(ckpt_.payload, out->hitvars);
+      checkpoint::put(ckpt_.payload, out->clusters);
+      ++ckpt_.nclustered;
+    }
+  if(++ckpt_.nprocessed >= ckpt_.every)
+    _flush_checkpoint(i, iEvent + 1);
+}
+
+void Analyzer::_flush_checkpoint(const unsigned& i, const unsigned& next)
+{
+  std::string block;
+  checkpoint::put(block, i);
+  checkpoint::put(block, next);
+  checkpoint::put(block, ckpt_.nclustered);
+  block += ckpt_.payload;
+  ckpt_.log->append(block);
+  ckpt_.payload.clear();
+  ckpt_.nclustered = ckpt_.nprocessed = 0;
+}
+
+std::string Analyzer::_layerdep_filename(const std::string& filename, const unsigned& i)
+{
+  const std::string str_start = filename.substr(0,filename.find('.', 20)); //the 20 avoids the '.' in 'cern.ch'
+  const std::string str_end = filename.substr(filename.find('.', 20), 5);
+  return str_start + "_beamen" + std::to_string( static_cast<int>(beam_energies_.at(i)) ) + str_end;
+}
+
+//runs on the writer thread; opens new output files whenever the batch belongs to a new input file
+void Analyzer::_consume_batch(OutputBatch& batch)
+{
+  if(static_cast<int>(batch.file) != async_.file)
+    {
+      _close_async_files();
+      async_.file = batch.file;
+      async_.entry = async_.layer_offset = async_.cluster_offset = 0;
+      const std::string name = "tree" + std::to_string(batch.file);
+      const std::string layer_fname = _layerdep_filename(async_.layer_fname, batch.file);
+      //one cluster-dependent file per run, named as by save_to_file_cluster_dependent()
+      const std::string cluster_fname = nfiles_ > 1 ? _layerdep_filename(async_.cluster_fname, batch.file) : async_.cluster_fname;
+      std::cout << "SAVE (async): " << layer_fname << std::endl;
+      std::cout << "SAVE (async): " << cluster_fname << std::endl;
+      outputs_.push_back(layer_fname);
+      outputs_.push_back(cluster_fname);
+
+      if(async_.opt.enabled) {
+	const int compress = columnar::compression_settings(async_.opt);
+	async_.layer_tfile.reset( new TFile(layer_fname.c_str(), "RECREATE", "", compress) );
+	async_.cluster_tfile.reset( new TFile(cluster_fname.c_str(), "RECREATE", "", compress) );
+	async_.layer_tfile->cd();
+	async_.layer_cols.reset( new sinks::LayerDepColumns(name, batch.beamen, this->lmax, async_.opt.basket_size) );
+	async_.cluster_tfile->cd();
+	async_.cluster_cols.reset( new sinks::ClusterDepColumns(name, batch.beamen, this->lmax, async_.opt.basket_size) );
+      }
+      else {
+	async_.layer_tfile.reset( new TFile(layer_fname.c_str(), "RECREATE") );
+	async_.cluster_tfile.reset( new TFile(cluster_fname.c_str(), "RECREATE") );
+	async_.layer_tfile->cd();
+	async_.layer_tree.reset( new sinks::LayerDepTree(name, batch.beamen, this->lmax) );
+	async_.cluster_tfile->cd();
+	async_.cluster_tree.reset( new sinks::ClusterDepTree(name, batch.beamen, this->lmax) );
+      }
+    }
+
+  for(unsigned ievent=0; ievent<batch.fracs.size(); ++ievent)
+    {
+      if(async_.opt.enabled) {
+	async_.layer_cols->fill(async_.entry, async_.layer_offset, batch.fracs[ievent], batch.hitvars[ievent]);
+	async_.cluster_cols->fill(async_.entry, async_.cluster_offset, batch.clusters[ievent]);
+	async_.layer_offset += sinks::nelements(batch.hitvars[ievent]);
+	async_.cluster_offset += sinks::nelements(batch.clusters[ievent]);
+      }
+      else {
+	async_.layer_tree->fill(batch.fracs[ievent], batch.hitvars[ievent]);
+	async_.cluster_tree->fill(batch.clusters[ievent]);
+      }
+      ++async_.entry;
+    }
+}
+
+void Analyzer::_close_async_files()
+{
+  for(auto tfile : {async_.layer_tfile.get(), async_.cluster_tfile.get()})
+    {
+      if(tfile != nullptr) {
+	tfile->Write();
+	tfile->Close();
+      }
+    }
+  //the trees were owned (and deleted) by the files
+  async_.layer_tree.reset();
+  async_.cluster_tree.reset();
+  async_.layer_cols.reset();
+  async_.cluster_cols.reset();
+  async_.layer_tfile.reset();
+  async_.cluster_tfile.reset();
+  async_.file = -1;
+}
+
 void Analyzer::resize_vectors() 
 {
   if(this->lmax == 0)
     throw std::runtime_error("Please define the maximum layer before calling resize_vectors().");
-  this->layer_fracs_.resize(this->lmax);
-  this->layer_hitvars_.resize(this->lmax);
-  this->clusterdep_.resize(this->lmax);
+  //one entry per file (run)
+  this->layer_fracs_.resize(nfiles_);
+  this->layer_hitvars_.resize(nfiles_);
+  this->clusterdep_.resize(nfiles_);
 }
 
-void Analyzer::runCLUE() {
-  float tot_en;
-  dataformats::layervars layerdep_vars;
-  dataformats::clustervars clusterdep_vars;
+//runs CLUE on a single event and computes its layer- and cluster-dependent quantities
+//returns false when the event is empty or when no hit passes the energy cut
+bool Analyzer::_cluster_event(CLUEAlgo& clueAlgo, CLUEAnalysis& clueAna,
+			      std::vector<float>& x, std::vector<float>& y, std::vector<unsigned int>& layer, std::vector<float>& weight,
+			      std::vector<float>& impactX, std::vector<float>& impactY, EventOutput& out)
+{
+  if( x.size() == 0) //empty event
+    return false;
+
+  //run the algorithm per event
+  if ( clueAlgo.setPoints(x.size(), &x[0], &y[0], &layer[0], &weight[0]) )
+    return false; //no event passed the initial energy cut
+  clueAlgo.makeClusters();
+  clueAlgo.infoSeeds();
+  clueAlgo.infoHits();
+
+  _analyze_event(clueAna, clueAlgo.points_, layer, weight, impactX, impactY, out);
+  return true;
+}
+
+//runs CLUE on the events [first, last) in a single call (see CLUEAlgo::setPointsBatch()), which amortizes its fixed
+//cost per call for events with few hits, and computes the quantities of each event as _cluster_event() does
+void Analyzer::_cluster_events(CLUEAlgo& clueAlgo, CLUEAnalysis& clueAna, const unsigned& first, const unsigned& last,
+			       std::vector< std::vector<float> >& x, std::vector< std::vector<float> >& y, std::vector< std::vector<unsigned int> >& layer, std::vector< std::vector<float> >& weight,
+			       std::vector< std::vector<float> >& impactX, std::vector< std::vector<float> >& impactY, std::vector< std::pair<bool, EventOutput> >& outs)
+{
+  //pack the hits of the events one after the other
+  std::vector<int> offsets(1, 0);
+  for(unsigned iEvent=first; iEvent<last; ++iEvent)
+    offsets.push_back( offsets.back() + x[iEvent].size() );
+  std::vector<float> x_, y_, weight_;
+  std::vector<unsigned int> layer_;
+  x_.reserve(offsets.back());
+  y_.reserve(offsets.back());
+  layer_.reserve(offsets.back());
+  weight_.reserve(offsets.back());
+  for(unsigned iEvent=first; iEvent<last; ++iEvent)
+    {
+      x_.insert(x_.end(), x[iEvent].begin(), x[iEvent].end());
+      y_.insert(y_.end(), y[iEvent].begin(), y[iEvent].end());
+      layer_.insert(layer_.end(), layer[iEvent].begin(), layer[iEvent].end());
+      weight_.insert(weight_.end(), weight[iEvent].begin(), weight[iEvent].end());
+    }
+
+  outs.clear();
+  outs.resize(last - first);
+  if( clueAlgo.setPointsBatch(last - first, offsets.data(), x_.data(), y_.data(), layer_.data(), weight_.data()) == 0 )
+    return; //no event passed the initial energy cut
+  clueAlgo.makeClusters();
+  clueAlgo.infoSeeds();
+  clueAlgo.infoHits();
+
+  //hits of each event, in turn
+  const Points& p = clueAlgo.points_;
+  Points event(clueAlgo.memoryResource());
+  for(unsigned k=0; k<last-first; ++k)
+    {
+      const int begin = p.eventOffsets[k], end = p.eventOffsets[k+1];
+      if(begin == end) //empty event or no hit passed the energy cut
+	continue;
+      event.x.assign(p.x.begin() + begin, p.x.begin() + end);
+      event.y.assign(p.y.begin() + begin, p.y.begin() + end);
+      event.layer.assign(p.layer.begin() + begin, p.layer.begin() + end);
+      event.weight.assign(p.weight.begin() + begin, p.weight.begin() + end);
+      event.rho.assign(p.rho.begin() + begin, p.rho.begin() + end);
+      event.delta.assign(p.delta.begin() + begin, p.delta.begin() + end);
+      event.clusterIndex.assign(p.clusterIndex.begin() + begin, p.clusterIndex.begin() + end);
+      event.isSeed.assign(p.isSeed.begin() + begin, p.isSeed.begin() + end);
+      event.nHitsCluster.assign(p.nHitsCluster.begin() + begin, p.nHitsCluster.begin() + end);
+      event.n = end - begin;
+
+      const unsigned iEvent = first + k;
+      outs[k].first = true;
+      _analyze_event(clueAna, event, layer[iEvent], weight[iEvent], impactX[iEvent], impactY[iEvent], outs[k].second);
+    }
+}
+
+//layer- and cluster-dependent quantities of an event clustered by CLUE, whose hits are 'p';
+//'layer' and 'weight' are all the hits of the event, before the energy cut of CLUE
+void Analyzer::_analyze_event(CLUEAnalysis& clueAna, const Points& p,
+			      const std::vector<unsigned int>& layer, const std::vector<float>& weight,
+			      const std::vector<float>& impactX, const std::vector<float>& impactY, EventOutput& out)
+{
+  std::pmr::memory_resource* mr = clueAna.getMemoryResource();
+
+  //calculate quantities including outliers
+  std::pmr::vector<unsigned> tot_hits_per_layer(this->lmax, 0, mr);
+  std::pmr::vector<float> tot_en_per_layer(this->lmax, 0.f, mr);
+  for(unsigned int j=0; j<layer.size(); ++j)
+    {
+      unsigned int layeridx = layer.at(j) - 1;
+      if(layeridx > this->lmax - 1)
+	continue;
+      if( ! ecut_selection(weight.at(j), layeridx) )
+	continue;
+      tot_hits_per_layer.at(layeridx) += 1;
+      tot_en_per_layer.at(layeridx) += weight.at(j);
+    }
+
+  std::pmr::vector<int> layerid(p.layer.size(), mr); //starting at 1, as CLUEAlgo::getHitsLayerId()
+  for(size_t i=0; i<p.layer.size(); ++i)
+    layerid[i] = p.layer[i] + 1;
+
+  //calculate the total energy that was clusterized (excluding outliers)
+  clueAna.calculateEnergy( p.weight, p.clusterIndex );
+  out.en_total = clueAna.getTotalEnergyOutput("", false); //non-verbose
+  //calculate per layer fraction of clusterized number of hits and energy
+  clueAna.calculateLayerDepVars( p.x, p.y, p.weight, p.clusterIndex, layerid, p.rho, p.delta, p.isSeed, p.nHitsCluster );
+  dataformats::layervars layerdep_vars = clueAna.getTotalLayerDepOutput();
 
+  //fill fractions (the denominators include outliers!)
+  out.fracs = dataformats::layerfracs(lmax);
+  out.hitvars = dataformats::layerhitvars(lmax);
+  for(unsigned int j=0; j<this->lmax; ++j)
+    {
+      //the hit variables of the layers without hits are left empty, as created
+      if (tot_hits_per_layer[j] != 0 and tot_en_per_layer[j] != 0)
+	{
+	  auto& vars = layerdep_vars[j]; //a copy, moved into the outputs
+	  const std::vector<float>& energy_in_this_layer = std::get<1>(vars);
+	  float energy_sum = std::accumulate( energy_in_this_layer.begin(), energy_in_this_layer.end(), 0.f );
+	  out.fracs[j] = std::make_tuple( static_cast<float>( std::get<0>(vars) ) / tot_hits_per_layer[j], energy_sum / tot_en_per_layer[j]);
+	  out.hitvars[j] = std::make_tuple( std::move(std::get<1>(vars)), std::move(std::get<2>(vars)), std::move(std::get<3>(vars)), std::move(std::get<4>(vars)),
+					    std::move(std::get<5>(vars)), std::move(std::get<6>(vars)), std::move(std::get<7>(vars)) );
+	}
+      else
+	out.fracs[j] = std::make_tuple( -.1f, -.1f );
+    }
+  //calculate per cluster and per layer clusterized number of hits and energy
+  clueAna.calculateClusterDepVars( p.x, p.y, p.weight, p.clusterIndex, layerid, impactX, impactY );
+  out.clusters = clueAna.getTotalClusterDepOutput();
+}
+
+void Analyzer::runCLUE() {
   std::vector< std::vector<float> > x_;
   std::vector< std::vector<float> > y_;
   std::vector< std::vector<unsigned int> > layer_;
@@ -58,15 +448,39 @@ void Analyzer::runCLUE() {
   std::vector< std::vector<unsigned int> > rechits_id_; //not required by CLUE
   std::vector< std::vector<float> > impactX_;
   std::vector< std::vector<float> > impactY_;
+  std::vector<float> en_noclusters_; //energy sum of all hits, computed while reading the tree
   
   std::pair<unsigned int, float> out_pair;
   unsigned int nevents = 0;
   float beam_energy = -1;
-  CLUEAlgo clueAlgo(dc_, kappa_, ecut_); //non-verbose
-  CLUEAnalysis clueAna(this->st_, this->W0_, this->dpos_);
+  //the temporaries of each event draw from the arena, released once the event is done
+  arena::EventArena arena;
+  CLUEAlgo clueAlgo(dc_, kappa_, ecut_, false, arena.resource()); //non-verbose
+  CLUEAnalysis clueAna(this->st_, this->W0_, this->dpos_, arena.resource());
   this->lmax = clueAna.getLayerMax();
   resize_vectors();
 
+  if(multirun_ and nfiles_ > 1)
+    {
+      if(!ckpt_.path.empty())
+	throw std::invalid_argument("The checkpoints are not supported in the multi-run mode.");
+      if(!input_nodes_.empty())
+	throw std::invalid_argument("The input nodes are not supported in the multi-run mode.");
+      _runCLUE_multirun();
+      return;
+    }
+
+  //events clustered by a previous job, per file, and where to resume
+  std::vector< std::vector< std::pair<unsigned, EventOutput> > > restored(nfiles_);
+  unsigned resume_file = 0, resume_event = 0;
+  if(!ckpt_.path.empty())
+    _restore_checkpoint(restored, resume_file, resume_event);
+
+  std::unique_ptr< AsyncWriter<OutputBatch> > writer;
+  OutputBatch batch;
+  if(async_.enabled)
+    writer.reset( new AsyncWriter<OutputBatch>([this](OutputBatch& b) { this->_consume_batch(b); }) );
+
   for(unsigned int i=0; i<nfiles_; ++i) 
     {
       std::cout << "Processing file number " << i+1 << std::endl;
@@ -76,113 +490,314 @@ void Analyzer::runCLUE() {
       layer_.clear();
       weight_.clear();
       rechits_id_.clear();
+      impactX_.clear();
+      impactY_.clear();
+      en_noclusters_.clear();
 
-      out_pair = this->_readTree( this->names_[i].first, x_, y_, layer_, weight_, rechits_id_, impactX_, impactY_ );
+      out_pair = this->_readTree( i, x_, y_, layer_, weight_, rechits_id_, impactX_, impactY_, en_noclusters_ );
       nevents = out_pair.first;
       beam_energy = out_pair.second;
       beam_energies_[i] = beam_energy;
+      input_bytes_ = std::max(input_bytes_, memprof::bytes(x_) + memprof::bytes(y_) + memprof::bytes(layer_) + memprof::bytes(weight_) +
+			      memprof::bytes(rechits_id_) + memprof::bytes(impactX_) + memprof::bytes(impactY_) + memprof::bytes(en_noclusters_));
+
+      this->en_total_noclusters_[i].clear();
+      this->en_total_noclusters_[i].reserve(nevents);
+      for(unsigned iEvent=0; iEvent<nevents; ++iEvent)
+	this->en_total_noclusters_[i].push_back( std::make_tuple(en_noclusters_[iEvent], beam_energy) );
+
+      batch.file = i;
+      batch.beamen = beam_energy;
+      unsigned irestored = 0;
+      //events clustered together when batched: [batch_first, batch_first + batched.size())
+      std::vector< std::pair<bool, EventOutput> > batched;
+      unsigned batch_first = 0;
 
       for(unsigned iEvent=0; iEvent<nevents; ++iEvent)
 	{	  
 	  //std::cout << "Inside this tree there are " << nevents << " events: ";
 	  //std::cout << iEvent/static_cast<float>(nevents)*100 << "% \r";
 
-	  if( x_[iEvent].size() == 0) //empty event
-	    continue;
-
-	  //calculate quantities including outliers
-	  std::vector<unsigned> tot_hits_per_layer(this->lmax, 0);
-	  std::vector<float> tot_en_per_layer(this->lmax, 0.f);
-	  for(unsigned int j=0; j<layer_[iEvent].size(); ++j)
-	    {
-	      unsigned int layeridx = layer_.at(iEvent).at(j) - 1;
-	      if(layeridx > this->lmax - 1)
-		continue;
-	      if( ! ecut_selection(weight_.at(iEvent).at(j), layeridx) )
-		continue;
-	      tot_hits_per_layer.at(layeridx) += 1;
-	      tot_en_per_layer.at(layeridx) += weight_.at(iEvent).at(j);
+	  EventOutput out;
+	  bool clustered;
+	  if(i < resume_file or (i == resume_file and iEvent < resume_event))
+	    { //already processed by a previous job
+	      clustered = irestored < restored[i].size() and restored[i][irestored].first == iEvent;
+	      if(clustered)
+		out = std::move(restored[i][irestored++].second);
 	    }
-
-	  //run the algorithm per event
-	  if ( clueAlgo.setPoints(x_[iEvent].size(), &x_[iEvent][0], &y_[iEvent][0], &layer_[iEvent][0], &weight_[iEvent][0]) )
-	    continue; //no event passed the initial energy cut
-	  clueAlgo.makeClusters();
-	  clueAlgo.infoSeeds();
-	  clueAlgo.infoHits();
-
-	  //calculate the total energy that was clusterized (excluding outliers)
-	  clueAna.calculateEnergy( clueAlgo.getHitsWeight(), clueAlgo.getHitsClusterId() );
-	  tot_en = clueAna.getTotalEnergyOutput("", false); //non-verbose
-	  this->en_total_[i].push_back( std::make_tuple( tot_en, beam_energy) ); 
-	  //calculate per layer fraction of clusterized number of hits and energy
-	  clueAna.calculateLayerDepVars( clueAlgo.getHitsPosX(), clueAlgo.getHitsPosY(),
-					 clueAlgo.getHitsWeight(), clueAlgo.getHitsClusterId(), clueAlgo.getHitsLayerId(),
-					 clueAlgo.getHitsRho(), clueAlgo.getHitsDistanceToHighest(), clueAlgo.getHitsSeeds(), clueAlgo.getNHitsInCluster());
-	  layerdep_vars = clueAna.getTotalLayerDepOutput();
-
-	  //fill fractions (the denominators include outliers!)
-	  dataformats::layerfracs fracs_tmp(lmax);
-	  dataformats::layerhitvars hitvars_tmp(lmax);
-	  for(unsigned int j=0; j<this->lmax; ++j)
+	  else
 	    {
-	      if (tot_hits_per_layer[j] != 0 and tot_en_per_layer[j] != 0)
+	      if(batch_events_ > 1)
 		{
-		  std::vector<float> energy_in_this_layer = std::get<1>(layerdep_vars[j]);
-		  float energy_sum = std::accumulate( energy_in_this_layer.begin(), energy_in_this_layer.end(), decltype(energy_in_this_layer)::value_type(0) );
-		  fracs_tmp[j] = std::make_tuple( static_cast<float>( std::get<0>(layerdep_vars[j]) ) / tot_hits_per_layer[j], energy_sum / tot_en_per_layer[j]);
-		  hitvars_tmp[j] = std::make_tuple(energy_in_this_layer, std::get<2>(layerdep_vars[j]), std::get<3>(layerdep_vars[j]), std::get<4>(layerdep_vars[j]), std::get<5>(layerdep_vars[j]), std::get<6>(layerdep_vars[j]), std::get<7>(layerdep_vars[j]) );
+		  if(iEvent >= batch_first + batched.size())
+		    {
+		      batch_first = iEvent;
+		      _cluster_events(clueAlgo, clueAna, iEvent, std::min(iEvent + batch_events_, nevents),
+				      x_, y_, layer_, weight_, impactX_, impactY_, batched);
+		      arena.reset();
+		    }
+		  clustered = batched[iEvent - batch_first].first;
+		  if(clustered)
+		    out = std::move(batched[iEvent - batch_first].second);
 		}
 	      else
 		{
-		  std::vector<float> tmpv0(0,-.1f);
-		  std::vector<float> tmpv1(0,-.1f);
-		  std::vector<float> tmpv2(0,-.1f);
-		  std::vector<bool>  tmpv3(0,false);
-		  std::vector<float> tmpv4(0,-.1f);
-		  std::vector<float> tmpv5(0,-.1f);
-		  std::vector<unsigned int> tmpv6(0,0);
-		  fracs_tmp[j] = std::make_tuple( -.1f, -.1f );
-		  hitvars_tmp[j] = std::make_tuple( std::move(tmpv0), std::move(tmpv1), std::move(tmpv2), std::move(tmpv3), std::move(tmpv4), std::move(tmpv5), std::move(tmpv6) );
+		  clustered = _cluster_event(clueAlgo, clueAna, x_[iEvent], y_[iEvent], layer_[iEvent], weight_[iEvent], impactX_[iEvent], impactY_[iEvent], out);
+		  arena.reset();
 		}
+	      if(ckpt_.log != nullptr)
+		_checkpoint_event(i, iEvent, clustered ? &out : nullptr);
 	    }
-	  this->layer_fracs_.at(i).push_back( fracs_tmp );
-	  this->layer_hitvars_.at(i).push_back( hitvars_tmp );
+	  if(!clustered)
+	    continue;
+	  this->en_total_[i].push_back( std::make_tuple( out.en_total, beam_energy) ); 
 
-	  //calculate per cluster and per layer clusterized number of hits and energy
-	  clueAna.calculateClusterDepVars( clueAlgo.getHitsPosX(), clueAlgo.getHitsPosY(), clueAlgo.getHitsWeight(), clueAlgo.getHitsClusterId(), clueAlgo.getHitsLayerId(), impactX_[iEvent], impactY_[iEvent] );
-	  clusterdep_vars = clueAna.getTotalClusterDepOutput();
-	  this->clusterdep_.at(i).push_back( clusterdep_vars );
+	  if(async_.enabled)
+	    {
+	      batch.fracs.push_back( std::move(out.fracs) );
+	      batch.hitvars.push_back( std::move(out.hitvars) );
+	      batch.clusters.push_back( std::move(out.clusters) );
+	      if(batch.fracs.size() >= async_.batch_size)
+		{
+		  writer->push( std::move(batch) );
+		  batch = OutputBatch{i, beam_energy, {}, {}, {}};
+		}
+	    }
+	  else
+	    {
+	      this->layer_fracs_.at(i).push_back( std::move(out.fracs) );
+	      this->layer_hitvars_.at(i).push_back( std::move(out.hitvars) );
+	      this->clusterdep_.at(i).push_back( std::move(out.clusters) );
+	    }
+	}
+
+      restored[i].clear();
+      if(ckpt_.log != nullptr and ckpt_.nprocessed > 0)
+	_flush_checkpoint(i, nevents);
+
+      //flush the events left for this file (an empty batch still creates its output files)
+      if(async_.enabled)
+	{
+	  writer->push( std::move(batch) );
+	  batch = OutputBatch{};
+	}
+    }
+  arena_bytes_ = std::max(arena_bytes_, arena.capacity());
+
+  if(async_.enabled)
+    {
+      writer->close();
+      _close_async_files();
+    }
+}
+
+//events of file 'i': the node set by set_input_nodes(), or a dataframe reading the file, owned by 'owner'
+ROOT::RDF::RNode Analyzer::_input_node(const unsigned& i, std::unique_ptr<ROOT::RDataFrame>& owner)
+{
+  if(!input_nodes_.empty())
+    return input_nodes_.at(i);
+  owner.reset( new ROOT::RDataFrame(this->names_[i].second.c_str(), this->names_[i].first.c_str()) );
+  return *owner;
+}
+
+ULong64_t Analyzer::_count_entries(const unsigned& i)
+{
+  std::unique_ptr<TFile> file( TFile::Open(this->names_[i].first.c_str(), "READ") );
+  if(file == nullptr or file->IsZombie())
+    throw std::runtime_error("The file " + this->names_[i].first + " could not be opened.");
+  TTree *tree = nullptr;
+  file->GetObject(this->names_[i].second.c_str(), tree);
+  if(tree == nullptr)
+    throw std::runtime_error("The tree " + this->names_[i].second + " is missing in " + this->names_[i].first + ".");
+  return tree->GetEntries();
+}
+
+//splits every run in ranges of at most 'chunk_size_' entries and runs 'task(file, chunk, begin, end)' on each of them
+//using a work-stealing pool; the largest runs are scheduled first. Returns the number of chunks per run.
+std::vector<unsigned> Analyzer::_schedule_runs(const std::function<void(const unsigned&, const unsigned&, const ULong64_t&, const ULong64_t&)>& task)
+{
+  ROOT::EnableThreadSafety();
+  ROOT::DisableImplicitMT(); //the parallelism comes from the pool instead
+
+  std::vector<ULong64_t> nentries(nfiles_);
+  std::vector<unsigned> nchunks(nfiles_);
+  for(unsigned i=0; i<nfiles_; ++i)
+    {
+      nentries[i] = _count_entries(i);
+      nchunks[i] = (nentries[i] + chunk_size_ - 1) / chunk_size_;
+    }
+  std::vector<unsigned> order(nfiles_);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&nentries](unsigned a, unsigned b) { return nentries[a] > nentries[b]; });
+
+  parallelism::WorkStealingPool pool(this->ncpus_, this->pin_threads_);
+  for(unsigned i : order)
+    {
+      std::cout << "Scheduling file number " << i+1 << ": " << nentries[i] << " entries in " << nchunks[i] << " chunks" << std::endl;
+      for(unsigned ichunk=0; ichunk<nchunks[i]; ++ichunk)
+	{
+	  const ULong64_t begin = static_cast<ULong64_t>(ichunk) * chunk_size_;
+	  const ULong64_t end = std::min(begin + chunk_size_, nentries[i]);
+	  pool.submit([&task, i, ichunk, begin, end]() { task(i, ichunk, begin, end); });
 	}
     }
+  pool.wait();
+  return nchunks;
 }
 
-std::pair<unsigned int, float> Analyzer::_readTree( const std::string& infile,
+void Analyzer::_runCLUE_multirun()
+{
+  if(async_.enabled)
+    throw std::invalid_argument("The asynchronous output is not supported in the multi-run mode.");
+
+  //outputs of a chunk of entries, concatenated per run once all chunks are done
+  struct ChunkOutput {
+    float beamen = 0.f;
+    std::vector<float> en_noclusters;
+    std::vector<EventOutput> events;
+  };
+  std::vector< std::vector<ChunkOutput> > chunks(nfiles_);
+  std::mutex mut;
+
+  auto task = [&](const unsigned& i, const unsigned& ichunk, const ULong64_t& begin, const ULong64_t& end) {
+    std::vector< std::vector<float> > x_, y_, weight_, impactX_, impactY_;
+    std::vector< std::vector<unsigned int> > layer_, rechits_id_;
+    ChunkOutput out;
+    std::pair<unsigned int, float> out_pair = this->_readTree( i, x_, y_, layer_, weight_, rechits_id_, impactX_, impactY_, out.en_noclusters, false, begin, end );
+    out.beamen = out_pair.second;
+
+    arena::EventArena arena;
+    CLUEAlgo clueAlgo(dc_, kappa_, ecut_, false, arena.resource()); //non-verbose
+    CLUEAnalysis clueAna(this->st_, this->W0_, this->dpos_, arena.resource());
+    if(batch_events_ > 1)
+      {
+	std::vector< std::pair<bool, EventOutput> > batched;
+	for(unsigned iEvent=0; iEvent<out_pair.first; iEvent+=batch_events_)
+	  {
+	    _cluster_events(clueAlgo, clueAna, iEvent, std::min(iEvent + batch_events_, out_pair.first),
+			    x_, y_, layer_, weight_, impactX_, impactY_, batched);
+	    arena.reset();
+	    for(auto& ev : batched)
+	      if(ev.first)
+		out.events.push_back( std::move(ev.second) );
+	  }
+      }
+    else
+      for(unsigned iEvent=0; iEvent<out_pair.first; ++iEvent)
+	{
+	  EventOutput ev;
+	  if( _cluster_event(clueAlgo, clueAna, x_[iEvent], y_[iEvent], layer_[iEvent], weight_[iEvent], impactX_[iEvent], impactY_[iEvent], ev) )
+	    out.events.push_back( std::move(ev) );
+	  arena.reset();
+	}
+
+    std::lock_guard<std::mutex> lock(mut); //only protects the resizing of the per-run vectors
+    arena_bytes_ = std::max(arena_bytes_, arena.capacity());
+    if(chunks[i].size() <= ichunk)
+      chunks[i].resize(ichunk + 1);
+    chunks[i][ichunk] = std::move(out);
+  };
+  _schedule_runs(task);
+
+  for(unsigned i=0; i<nfiles_; ++i)
+    {
+      beam_energies_[i] = 0.f;
+      this->en_total_[i].clear();
+      this->en_total_noclusters_[i].clear();
+      for(auto& chunk : chunks[i])
+	if(beam_energies_[i] == 0.f)
+	  beam_energies_[i] = chunk.beamen;
+      for(auto& chunk : chunks[i])
+	{
+	  for(const float& en : chunk.en_noclusters)
+	    this->en_total_noclusters_[i].push_back( std::make_tuple(en, beam_energies_[i]) );
+	  for(auto& ev : chunk.events)
+	    {
+	      this->en_total_[i].push_back( std::make_tuple(ev.en_total, beam_energies_[i]) );
+	      this->layer_fracs_.at(i).push_back( std::move(ev.fracs) );
+	      this->layer_hitvars_.at(i).push_back( std::move(ev.hitvars) );
+	      this->clusterdep_.at(i).push_back( std::move(ev.clusters) );
+	    }
+	}
+      chunks[i].clear();
+    }
+}
+
+void Analyzer::_sum_energy_multirun(const bool& with_ecut)
+{
+  std::vector< std::vector< std::vector< std::tuple<float, float> > > > chunks(nfiles_);
+  std::mutex mut;
+
+  auto task = [&](const unsigned& i, const unsigned& ichunk, const ULong64_t& begin, const ULong64_t& end) {
+    std::vector< std::tuple<float, float> > en;
+    en.reserve(end - begin);
+    auto sum_ce = [&](const std::vector<float>& ce_en, const std::vector<unsigned int>& ce_layer, float beamen)
+		  { en.push_back(std::make_tuple(this->_sum_energy_event(ce_en, ce_layer, {}, with_ecut), beamen)); };
+    auto sum_ahc = [&](const std::vector<float>& ce_en, const std::vector<unsigned int>& ce_layer, const std::vector<float>& ahc_en, float beamen)
+		   { en.push_back(std::make_tuple(this->_sum_energy_event(ce_en, ce_layer, ahc_en, with_ecut), beamen)); };
+
+    ROOT::RDataFrame d(this->names_[i].second.c_str(), this->names_[i].first.c_str());
+    ROOT::RDF::RNode drange = d.Range(begin, end);
+    if(this->st_ == SHOWERTYPE::EM)
+      drange.Foreach(sum_ce, {"ce_clean_energy_MeV", "ce_clean_layer", "beamEnergy"});
+    else if(this->st_ == SHOWERTYPE::HAD)
+      drange.Foreach(sum_ahc, {"ce_clean_energy_MeV", "ce_clean_layer", "ahc_clean_energy_MeV", "beamEnergy"});
+
+    std::lock_guard<std::mutex> lock(mut); //only protects the resizing of the per-run vectors
+    if(chunks[i].size() <= ichunk)
+      chunks[i].resize(ichunk + 1);
+    chunks[i][ichunk] = std::move(en);
+  };
+  _schedule_runs(task);
+
+  for(unsigned i=0; i<nfiles_; ++i)
+    {
+      en_total_noclusters_[i].clear();
+      for(auto& v : chunks[i])
+	en_total_noclusters_[i].insert(en_total_noclusters_[i].end(), v.begin(), v.end());
+    }
+}
+
+std::pair<unsigned int, float> Analyzer::_readTree( const unsigned& ifile,
 			std::vector< std::vector<float> >& x, std::vector< std::vector<float> >& y, 
 			std::vector< std::vector<unsigned int> >& layer, std::vector< std::vector<float> >& weight, 
 	                std::vector< std::vector<unsigned int> >& rechits_id,
-		        std::vector< std::vector<float> >& impactX, std::vector< std::vector<float> >& impactY) {
-  //enable parallel execution
-  ROOT::EnableImplicitMT( ncpus_ );
-  //creates RDataFrame object
-  std::string intree = "relevant_branches";
-  ROOT::RDataFrame d( intree.c_str(), infile.c_str() );
-  //declare data vectors per event to be separately filled by independent cpu threads. dimension: (ncpus, nentries)
-  std::array< std::vector< std::vector<float> >, ncpus_ > x_split;
-  std::array< std::vector< std::vector<float> >, ncpus_ > y_split;
-  std::array< std::vector< std::vector<unsigned int> >, ncpus_ > layer_split;
-  std::array< std::vector< std::vector<float> >, ncpus_ > weight_split;
-  std::array< std::vector< std::vector<unsigned int> >, ncpus_ > rechits_id_split;
-  std::array< std::vector< std::vector<float> >, ncpus_ > impactX_split;
-  std::array< std::vector< std::vector<float> >, ncpus_ > impactY_split;
+		        std::vector< std::vector<float> >& impactX, std::vector< std::vector<float> >& impactY,
+			std::vector<float>& en_noclusters, const bool& implicit_mt,
+			const ULong64_t& begin, const ULong64_t& end) {
+  //enable parallel execution; without it the entry range [begin;end[ can be selected (all entries if end is 0)
+  if(implicit_mt)
+    ROOT::EnableImplicitMT( ncpus_ );
+  std::unique_ptr<ROOT::RDataFrame> d;
+  ROOT::RDF::RNode drange = _input_node(ifile, d);
+  if(end > 0)
+    drange = drange.Range(begin, end);
+  //number of slots actually used by RDataFrame; ncpus is just a hint to EnableImplicitMT
+  const unsigned nslots = implicit_mt ? std::max(1u, ROOT::GetImplicitMTPoolSize()) : 1;
+  //declare data vectors per event to be separately filled by independent cpu threads. dimension: (nslots, nentries)
+  std::vector< std::vector< std::vector<float> > > x_split(nslots);
+  std::vector< std::vector< std::vector<float> > > y_split(nslots);
+  std::vector< std::vector< std::vector<unsigned int> > > layer_split(nslots);
+  std::vector< std::vector< std::vector<float> > > weight_split(nslots);
+  std::vector< std::vector< std::vector<unsigned int> > > rechits_id_split(nslots);
+  std::vector< std::vector< std::vector<float> > > impactX_split(nslots);
+  std::vector< std::vector< std::vector<float> > > impactY_split(nslots);
+  std::vector< std::vector<float> > en_noclusters_split(nslots);
+  std::vector< std::vector<ULong64_t> > entry_split(nslots);
 
   float beam_energy = 0;
-  //lambda function passed to RDataFrame.ForeachSlot(); the first parameters gives the thread number contained in [0;ncpus[
+  const bool pin = this->pin_threads_;
+  //lambda function passed to RDataFrame.ForeachSlot(); the first parameters gives the thread number contained in [0;nslots[
   auto fill = [&x_split, &y_split, &layer_split, &weight_split, &rechits_id_split, &beam_energy, 
-	       &impactX_split, &impactY_split](unsigned int slot, std::vector<float>& x_, std::vector<float>& y_, 
-					       std::vector<unsigned int>& layer_, std::vector<float>& weight_,
-					       std::vector<unsigned int>& rechits_id_, float beamen, 
-					       std::vector<float> impactX_, std::vector<float> impactY_) {
+	       &impactX_split, &impactY_split, &en_noclusters_split, &entry_split, pin, this](unsigned int slot, std::vector<float>& x_, std::vector<float>& y_, 
+									  std::vector<unsigned int>& layer_, std::vector<float>& weight_,
+									  std::vector<unsigned int>& rechits_id_, float beamen, 
+									  std::vector<float> impactX_, std::vector<float> impactY_,
+									  float en_noclusters_, ULong64_t entry) {
+    this->startup_.mark();
+    if(pin)
+      parallelism::pin_this_thread();
 
     x_split[slot].push_back(x_);
     y_split[slot].push_back(y_);
@@ -191,46 +806,48 @@ std::pair<unsigned int, float> Analyzer::_readTree( const std::string& infile,
     rechits_id_split[slot].push_back(rechits_id_);
     impactX_split[slot].push_back(impactX_);
     impactY_split[slot].push_back(impactY_);
+    en_noclusters_split[slot].push_back(en_noclusters_);
+    entry_split[slot].push_back(entry);
     if(beam_energy == 0)
       beam_energy = beamen; //only changes the first time to avoid extra operations
   };
 
-  //loop over the TTree pointed by the RDataFrame
-  d.ForeachSlot(fill, {"ce_clean_x", "ce_clean_y", "ce_clean_layer", "ce_clean_energy_MeV", "ce_clean_detid", "beamEnergy",
-	"impactX_shifted", "impactY_shifted"});
+  //energy sum without clustering, computed in the same pass over the data (ecut applied, as in sum_energy(true))
+  auto sum_ce = [this](const std::vector<float>& ce_en, const std::vector<unsigned int>& ce_layer) {
+    return this->_sum_energy_event(ce_en, ce_layer, {}, true);
+  };
+  auto sum_ahc = [this](const std::vector<float>& ce_en, const std::vector<unsigned int>& ce_layer, const std::vector<float>& ahc_en) {
+    return this->_sum_energy_event(ce_en, ce_layer, ahc_en, true);
+  };
+  ROOT::RDF::RNode dsum = drange;
+  if(this->st_ == SHOWERTYPE::EM)
+    dsum = drange.Define("en_noclusters", sum_ce, {"ce_clean_energy_MeV", "ce_clean_layer"});
+  else if(this->st_ == SHOWERTYPE::HAD)
+    dsum = drange.Define("en_noclusters", sum_ahc, {"ce_clean_energy_MeV", "ce_clean_layer", "ahc_clean_energy_MeV"});
 
-  //calculate number of events taking into account that ncpus is just a hint to EnableImplicitMT
-  std::vector<unsigned int> nevents_v;
-  for(unsigned int iThread=0; iThread<ncpus_; ++iThread) {
-    nevents_v.push_back( x_split[iThread].size() ); //assumes all the sizes are the same
-  }
-  unsigned int nevents = std::accumulate(nevents_v.begin(), nevents_v.end(), 0);
-  std::vector<unsigned int> nevents_cumsum( nevents_v.size() );
-  std::partial_sum(nevents_v.begin(), nevents_v.end(), nevents_cumsum.begin());
+  //loop over the TTree pointed by the RDataFrame
+  dsum.ForeachSlot(fill, {"ce_clean_x", "ce_clean_y", "ce_clean_layer", "ce_clean_energy_MeV", "ce_clean_detid", "beamEnergy",
+	"impactX_shifted", "impactY_shifted", "en_noclusters", "rdfentry_"});
 
   //merge arrays filled by independent cpu threads into the ones passed by reference
-  unsigned int iThread_new=0, iThread_old=0, padding=0;
-  for(unsigned int iEvent=0; iEvent<nevents; ++iEvent) {
-
-    //get cpu thread corresponding to the event being processed
-    unsigned int a = 0;
-    for(auto i: nevents_cumsum) {
-      if(iEvent<i) iThread_new = a;
-      else ++a;
-    }
+  //events are sorted by entry, so that their order does not depend on the thread scheduling (required to resume from a checkpoint)
+  std::vector< std::tuple<ULong64_t, unsigned, unsigned> > order; //entry, slot and position in the slot
+  for(unsigned iThread=0; iThread<nslots; ++iThread)
+    for(unsigned k=0; k<entry_split[iThread].size(); ++k)
+      order.push_back( std::make_tuple(entry_split[iThread][k], iThread, k) );
+  std::sort(order.begin(), order.end());
+  const unsigned int nevents = order.size();
 
-    if(iThread_new != iThread_old) {
-      padding += nevents_v[iThread_old];
-      assert(padding == iEvent);
-    }
-    iThread_old = iThread_new;
-    x.push_back(x_split[iThread_new][iEvent - padding]);
-    y.push_back(y_split[iThread_new][iEvent - padding]);
-    layer.push_back(layer_split[iThread_new][iEvent - padding]);
-    weight.push_back(weight_split[iThread_new][iEvent - padding]);
-    rechits_id.push_back(rechits_id_split[iThread_new][iEvent - padding]);
-    impactX.push_back(impactX_split[iThread_new][iEvent - padding]);
-    impactY.push_back(impactY_split[iThread_new][iEvent - padding]);
+  for(const auto& o : order) {
+    const unsigned iThread = std::get<1>(o), k = std::get<2>(o);
+    x.push_back( std::move(x_split[iThread][k]) );
+    y.push_back( std::move(y_split[iThread][k]) );
+    layer.push_back( std::move(layer_split[iThread][k]) );
+    weight.push_back( std::move(weight_split[iThread][k]) );
+    rechits_id.push_back( std::move(rechits_id_split[iThread][k]) );
+    impactX.push_back( std::move(impactX_split[iThread][k]) );
+    impactY.push_back( std::move(impactY_split[iThread][k]) );
+    en_noclusters.push_back( en_noclusters_split[iThread][k] );
   }
   assert( x.size() == y.size() );
   assert( x.size() == layer.size() );
@@ -238,6 +855,7 @@ std::pair<unsigned int, float> Analyzer::_readTree( const std::string& infile,
   assert( x.size() == rechits_id.size() );
   assert( x.size() == impactX.size() );
   assert( x.size() == impactY.size() );
+  assert( x.size() == en_noclusters.size() );
   return std::make_pair(nevents, beam_energy);
 }
 
@@ -254,61 +872,72 @@ bool Analyzer::ecut_selection(const float& energy, const unsigned int& layer)
   return energy > ecut_ * detectorConstants::sigmaNoiseSiSensor / endeposited_mip * weight_tmp;
 }
 
+//energy of a single event without clustering; the AHCAL energy is only non-empty for hadronic showers
+float Analyzer::_sum_energy_event(const std::vector<float>& ce_en, const std::vector<unsigned int>& ce_layer, const std::vector<float>& ahc_en, const bool& with_ecut)
+{
+  float entot = 0.f;
+  for(unsigned int ien=0; ien<ce_en.size(); ++ien)
+    {
+      if(ce_layer[ien] > this->lmax)
+	continue;
+      if(with_ecut and ! ecut_selection(ce_en[ien], ce_layer[ien]-1))
+	continue;
+
+      entot += ce_en[ien];
+    }
+  for(unsigned int ien=0; ien<ahc_en.size(); ++ien)
+    entot += ahc_en[ien];
+  return entot;
+}
+
+//standalone version of the energy sum computed by runCLUE(); fills the '_noclusters' energy sums
 void Analyzer::sum_energy(const bool& with_ecut)
 {
-  std::mutex mut; //anonymous function to pass to RDataFrame.ForEach()
+  if(this->lmax == 0)
+    this->lmax = CLUEAnalysis(this->st_, this->W0_, this->dpos_).getLayerMax();
+
+  if(multirun_ and nfiles_ > 1)
+    {
+      if(!input_nodes_.empty())
+	throw std::invalid_argument("The input nodes are not supported in the multi-run mode.");
+      _sum_energy_multirun(with_ecut);
+      return;
+    }
 
   ROOT::EnableImplicitMT( ncpus_ ); //enable parallelism
+  const unsigned nslots = std::max(1u, ROOT::GetImplicitMTPoolSize());
 
   for(unsigned int i=0; i<nfiles_; ++i)
     {
-      auto sum_ce = [&](const std::vector<float>& ce_en, const std::vector<unsigned int>& ce_layer, float beamen)
+      //each slot accumulates its own events, so no lock is needed
+      std::vector< std::vector< std::tuple<float, float> > > en_split(nslots);
+
+      auto sum_ce = [&](unsigned int slot, const std::vector<float>& ce_en, const std::vector<unsigned int>& ce_layer, float beamen)
 		    { 
-		      float entot = 0.f;
-		      for(unsigned int ien=0; ien<ce_en.size(); ++ien)
-			{
-			  if(ce_layer[ien] > this->lmax)
-			    continue;
-			  if(with_ecut and ! ecut_selection(ce_en[ien], ce_layer[ien]-1))
-			    continue;
-
-			  entot += ce_en[ien];
-			}
-		      { //mutex lock scope
-			std::lock_guard lock(mut);
-			this->en_total_[i].push_back(std::make_tuple(entot, beamen));
-		      }
+		      if(this->pin_threads_)
+			parallelism::pin_this_thread();
+		      en_split[slot].push_back(std::make_tuple(this->_sum_energy_event(ce_en, ce_layer, {}, with_ecut), beamen));
 		    };
 
-      auto sum_ahc = [&](const std::vector<float>& ce_en, const std::vector<unsigned int>& ce_layer, const std::vector<float>& ahc_en, float beamen)
+      auto sum_ahc = [&](unsigned int slot, const std::vector<float>& ce_en, const std::vector<unsigned int>& ce_layer, const std::vector<float>& ahc_en, float beamen)
 		     { 
-		       float entot = 0.f;
-		       for(unsigned int ien=0; ien<ce_en.size(); ++ien)
-			 {
-			   if(ce_layer[ien] > this->lmax)
-			     continue;
-			   if(with_ecut and ! ecut_selection(ce_en[ien], ce_layer[ien]-1))
-			     continue;
-
-			   entot += ce_en[ien];
-			 }
-		       for(unsigned int ien=0; ien<ahc_en.size(); ++ien)
-			 entot += ahc_en[ien];
-
-		       { //mutex lock scope
-			 std::lock_guard lock(mut);
-			 this->en_total_[i].push_back(std::make_tuple(entot, beamen));
-		       }
+		       if(this->pin_threads_)
+			 parallelism::pin_this_thread();
+		       en_split[slot].push_back(std::make_tuple(this->_sum_energy_event(ce_en, ce_layer, ahc_en, with_ecut), beamen));
 		     };
 
-      //define dataframe that owns the TTree
-      ROOT::RDataFrame d(this->names_[i].second.c_str(), this->names_[i].first.c_str());
+      //define dataframe that owns the TTree (unless the events are selected in memory)
+      std::unique_ptr<ROOT::RDataFrame> dfile;
+      ROOT::RDF::RNode d = _input_node(i, dfile);
       //store the contents of the TTree according to the specified columns
-      en_total_[i].clear();
       if(this->st_ == SHOWERTYPE::EM)
-	d.Foreach(sum_ce, {"ce_clean_energy_MeV", "ce_clean_layer", "beamEnergy"});
+	d.ForeachSlot(sum_ce, {"ce_clean_energy_MeV", "ce_clean_layer", "beamEnergy"});
       else if(this->st_ == SHOWERTYPE::HAD)
-	d.Foreach(sum_ahc, {"ce_clean_energy_MeV", "ce_clean_layer", "ahc_clean_energy_MeV", "beamEnergy"});
+	d.ForeachSlot(sum_ahc, {"ce_clean_energy_MeV", "ce_clean_layer", "ahc_clean_energy_MeV", "beamEnergy"});
+
+      en_total_noclusters_[i].clear();
+      for(auto& v : en_split)
+	en_total_noclusters_[i].insert(en_total_noclusters_[i].end(), v.begin(), v.end());
     }
 };
 
@@ -320,8 +949,47 @@ int Analyzer::sanity_checks(const std::string& fname)
 }
 
 void Analyzer::save_to_file(const std::string& filename) {
+  _write_energy_sums(filename, this->en_total_);
+}
+
+void Analyzer::save_to_file_noclusters(const std::string& filename) {
+  _write_energy_sums(filename, this->en_total_noclusters_);
+}
+
+//binary alternative to save_to_file(): one '.npy' file per column, named '<stem>_ensum.npy' and '<stem>_beamen.npy'
+//when more than one file (run) is processed, the index of the file is appended: '<stem>_ensum_<index>.npy'
+void Analyzer::save_to_file_npy(const std::string& stem) {
+  _write_energy_sums_npy(stem, this->en_total_);
+}
+
+void Analyzer::save_to_file_noclusters_npy(const std::string& stem) {
+  _write_energy_sums_npy(stem, this->en_total_noclusters_);
+}
+
+void Analyzer::_write_energy_sums_npy(const std::string& stem, const std::vector< std::vector< std::tuple<float, float> > >& en_total) {
+  for(unsigned int i=0; i<nfiles_; ++i)
+    {
+      const std::string suffix = nfiles_ > 1 ? "_" + std::to_string(i) : "";
+      std::vector<float> ensum, beamen;
+      ensum.reserve(en_total[i].size());
+      beamen.reserve(en_total[i].size());
+      for(const auto& elem : en_total[i])
+	{
+	  ensum.push_back( std::get<0>(elem) );
+	  beamen.push_back( std::get<1>(elem) );
+	}
+      std::cout << "SAVE: " << stem + "_ensum" + suffix + ".npy" << std::endl;
+      npy::save(stem + "_ensum" + suffix + ".npy", ensum);
+      npy::save(stem + "_beamen" + suffix + ".npy", beamen);
+      outputs_.push_back(stem + "_ensum" + suffix + ".npy");
+      outputs_.push_back(stem + "_beamen" + suffix + ".npy");
+    }
+}
+
+void Analyzer::_write_energy_sums(const std::string& filename, const std::vector< std::vector< std::tuple<float, float> > >& en_total) {
   std::ofstream oFile(filename);
   std::cout << "SAVE: " << filename << std::endl;
+  outputs_.push_back(filename);
   for(unsigned int i=0; i<nfiles_; ++i)
     {
       std::string curr_name = std::get<0>(names_[i]);
@@ -337,24 +1005,24 @@ void Analyzer::save_to_file(const std::string& filename) {
   //get size of larger energy vector
   std::vector<unsigned int> en_sizes(nfiles_, 0);
   for(unsigned int i=0; i<nfiles_; ++i)
-    en_sizes[i] = en_total_[i].size();
+    en_sizes[i] = en_total[i].size();
   const unsigned int max = *( std::max_element(en_sizes.begin(), en_sizes.end()) );
   
   for(unsigned int k=0; k<max; ++k)
     {
       for(unsigned int i=0; i<nfiles_; ++i)
 	{
-	  if(k<en_total_[i].size())
+	  if(k<en_total[i].size())
 	    {
-	      oFile << std::to_string( std::get<0>(en_total_[i][k]) ) << ",";
-	      oFile << std::to_string( std::get<1>(en_total_[i][k]) );
+	      oFile << std::to_string( std::get<0>(en_total[i][k]) ) << ",";
+	      oFile << std::to_string( std::get<1>(en_total[i][k]) );
 	    }
 	  else
 	    oFile << "-99., -99.";
 	  if(i<nfiles_-1)
 	    oFile << ",";
 	}
-      oFile << std::endl;
+      oFile << '\n';
     }
 }
 
@@ -363,67 +1031,15 @@ void Analyzer::save_to_file_layer_dependent(const std::string& filename) {
   std::cout << "NFILES: " << nfiles_ << std::endl;
   for(unsigned int i=0; i<nfiles_; ++i)
     {
-      //create TTree
-      const std::string str_start = filename.substr(0,filename.find('.', 20)); //the 20 avoids the '.' in 'cern.ch'
-      const std::string str_end = filename.substr(filename.find('.', 20), 5);
-      const std::string filename_with_energy = str_start + "_beamen" + std::to_string( static_cast<int>(beam_energies_.at(i)) ) + str_end;
-
-      TFile file( filename_with_energy.c_str(), "RECREATE");
-      std::string name = "tree" + std::to_string(i);
-      TTree tmptree( name.c_str(), name.c_str());
-
-      //define branches
-      tmptree.Branch("BeamEnergy", &beam_energies_.at(i));
-      std::vector< float > fracs_hits(this->lmax);
-      std::vector< float > fracs_en(this->lmax);
-      std::vector< std::vector<float> > energies(this->lmax);
-      std::vector< std::vector<float> > posx(this->lmax);
-      std::vector< std::vector<float> > posy(this->lmax);
-      std::vector< std::vector<float> > rhos(this->lmax);
-      std::vector< std::vector<float> > deltas(this->lmax);
-      std::vector< std::vector<bool> > seeds(this->lmax);
-      std::vector< std::vector<unsigned> > clustersizes(this->lmax);
-      for(unsigned int ilayer=0; ilayer<this->lmax; ++ilayer) 
-	{
-	  std::string bname_hits     = "NhitsFrac_layer"  + std::to_string(ilayer + 1);
-	  std::string bname_energy   = "EnergyFrac_layer" + std::to_string(ilayer + 1);
-	  std::string bname_energies = "Energies_layer"   + std::to_string(ilayer + 1);
-	  std::string bname_posx     = "PosX_layer"       + std::to_string(ilayer + 1);
-	  std::string bname_posy     = "PosY_layer"       + std::to_string(ilayer + 1);
-	  std::string bname_rho      = "Densities_layer"  + std::to_string(ilayer + 1);
-	  std::string bname_delta    = "Distances_layer"  + std::to_string(ilayer + 1);
-	  std::string bname_seeds    = "isSeed_layer"     + std::to_string(ilayer + 1);
-	  std::string bname_clsize   = "ClustSize_layer"  + std::to_string(ilayer + 1);
-	  tmptree.Branch(bname_hits.c_str(),     &fracs_hits[ilayer]);
-	  tmptree.Branch(bname_energy.c_str(),   &fracs_en[ilayer]);
-	  tmptree.Branch(bname_energies.c_str(), &energies[ilayer]);
-	  tmptree.Branch(bname_posx.c_str(),     &posx[ilayer]);
-	  tmptree.Branch(bname_posy.c_str(),     &posy[ilayer]);
-	  tmptree.Branch(bname_rho.c_str(),      &rhos[ilayer]);
-	  tmptree.Branch(bname_delta.c_str(),    &deltas[ilayer]);
-	  tmptree.Branch(bname_seeds.c_str(),    &seeds[ilayer]);
-	  tmptree.Branch(bname_clsize.c_str(),   &clustersizes[ilayer]);
-	}
+      outputs_.push_back( _layerdep_filename(filename, i) );
+      TFile file(outputs_.back().c_str(), "RECREATE");
+      sinks::LayerDepTree tree("tree" + std::to_string(i), beam_energies_.at(i), this->lmax);
 
       //loop over TTree and fill branches
       assert( this->layer_fracs_.at(i).size() == this->layer_hitvars_.at(i).size() );
       unsigned int nentries = this->layer_fracs_.at(i).size(); // read the number of entries in the t3
       for (unsigned int ientry = 0; ientry<nentries; ++ientry) 
-	{
-	  for(unsigned int ilayer=0; ilayer<this->lmax; ++ilayer) 
-	    {
-	      fracs_hits[ilayer]   = std::get<0>( this->layer_fracs_.at(i).at(ientry).at(ilayer) );
-	      fracs_en[ilayer]     = std::get<1>( this->layer_fracs_.at(i).at(ientry).at(ilayer) );
-	      energies[ilayer]     = std::get<0>( this->layer_hitvars_.at(i).at(ientry).at(ilayer) );
-	      rhos[ilayer]         = std::get<1>( this->layer_hitvars_.at(i).at(ientry).at(ilayer) );
-	      deltas[ilayer]       = std::get<2>( this->layer_hitvars_.at(i).at(ientry).at(ilayer) );
-	      seeds[ilayer]        = std::get<3>( this->layer_hitvars_.at(i).at(ientry).at(ilayer) );
-	      posx[ilayer]         = std::get<4>( this->layer_hitvars_.at(i).at(ientry).at(ilayer) );
-	      posy[ilayer]         = std::get<5>( this->layer_hitvars_.at(i).at(ientry).at(ilayer) );
-	      clustersizes[ilayer] = std::get<6>( this->layer_hitvars_.at(i).at(ientry).at(ilayer) );
-	    }
-	  tmptree.Fill();
-	}
+	tree.fill( this->layer_fracs_.at(i).at(ientry), this->layer_hitvars_.at(i).at(ientry) );
       file.Write();
       file.Close();
     }
@@ -434,53 +1050,97 @@ void Analyzer::save_to_file_cluster_dependent(const std::string& filename) {
   std::cout << "SAVE: " << filename << std::endl;
   for(unsigned int i=0; i<nfiles_; ++i)
     {
-      //create TTree
-      std::string name = "tree" + std::to_string(i);
-      TFile file( filename.c_str(), "RECREATE");
-      TTree tmptree( name.c_str(), name.c_str());
-
-      //define branches
-      tmptree.Branch("BeamEnergy", &beam_energies_.at(i));
-      std::vector< std::vector<unsigned> > arr_hits(this->lmax);
-      std::vector< std::vector<float> > arr_en(this->lmax);
-      std::vector< std::vector<float> > arr_x(this->lmax);
-      std::vector< std::vector<float> > arr_y(this->lmax);
-      std::vector< std::vector<float> > arr_dx(this->lmax);
-      std::vector< std::vector<float> > arr_dy(this->lmax);
-      for(unsigned int ilayer=0; ilayer<this->lmax; ++ilayer) 
-	{
-	  std::string bname_hits   = "Nhits_layer"  + std::to_string(ilayer + 1);
-	  std::string bname_energy = "Energy_layer" + std::to_string(ilayer + 1);
-	  std::string bname_x      = "X_layer"      + std::to_string(ilayer + 1);
-	  std::string bname_y      = "Y_layer"      + std::to_string(ilayer + 1);
-	  std::string bname_dx     = "dX_layer"     + std::to_string(ilayer + 1);
-	  std::string bname_dy     = "dY_layer"     + std::to_string(ilayer + 1);
-	  tmptree.Branch(bname_hits.c_str(),   &arr_hits[ilayer]);
-	  tmptree.Branch(bname_energy.c_str(), &arr_en[ilayer]);
-	  tmptree.Branch(bname_x.c_str(),      &arr_x[ilayer]);
-	  tmptree.Branch(bname_y.c_str(),      &arr_y[ilayer]);	 
-	  tmptree.Branch(bname_dx.c_str(),     &arr_dx[ilayer]);
-	  tmptree.Branch(bname_dy.c_str(),     &arr_dy[ilayer]);	 
-	}
+      //several runs are stored in separate files, as for the layer-dependent output
+      outputs_.push_back( nfiles_ > 1 ? _layerdep_filename(filename, i) : filename );
+      TFile file(outputs_.back().c_str(), "RECREATE");
+      sinks::ClusterDepTree tree("tree" + std::to_string(i), beam_energies_.at(i), this->lmax);
 
       //loop over TTree and fill branches
       unsigned int nentries = this->clusterdep_.at(i).size(); // read the number of entries in the t3
       for (unsigned int ientry = 0; ientry<nentries; ++ientry) 
-	{
-	  for(unsigned int ilayer=0; ilayer<this->lmax; ++ilayer) 
-	    {
-	      arr_hits[ilayer] = std::get<0>( this->clusterdep_.at(i).at(ientry).at(ilayer) );
-	      arr_en[ilayer]   = std::get<1>( this->clusterdep_.at(i).at(ientry).at(ilayer) );
-	      arr_x[ilayer]    = std::get<2>( this->clusterdep_.at(i).at(ientry).at(ilayer) );
-	      arr_y[ilayer]    = std::get<3>( this->clusterdep_.at(i).at(ientry).at(ilayer) );
-	      arr_dx[ilayer]   = std::get<4>( this->clusterdep_.at(i).at(ientry).at(ilayer) );
-	      arr_dy[ilayer]   = std::get<5>( this->clusterdep_.at(i).at(ientry).at(ilayer) );
-	    }
-	  tmptree.Fill();
-	}
-      //tmptree.Write("", TObject::kOverwrite); //save only the new version of the tree
+	tree.fill( this->clusterdep_.at(i).at(ientry) );
       file.Write();
       file.Close();
     }
 
 }
+
+//splits the entries [0;nentries[ in contiguous chunks; each chunk is filled by its own thread into a TBufferMerger file
+void Analyzer::_parallel_fill(const std::string& filename, const columnar::WriterOptions& opt, const unsigned& nentries,
+			      const std::function<void(TFile&, const unsigned&, const unsigned&)>& fill_chunk)
+{
+  ROOT::EnableThreadSafety();
+  ROOT::Experimental::TBufferMerger merger(filename.c_str(), "RECREATE", columnar::compression_settings(opt));
+  outputs_.push_back(filename);
+
+  const unsigned nworkers = std::max(1u, std::min(opt.nworkers == 0 ? this->ncpus_ : opt.nworkers, nentries));
+  const unsigned chunk = (nentries + nworkers - 1) / nworkers;
+  std::vector<std::thread> workers;
+  for(unsigned iw=0; iw<nworkers; ++iw)
+    {
+      const unsigned begin = std::min(iw * chunk, nentries);
+      const unsigned end = std::min(begin + chunk, nentries);
+      workers.emplace_back([&merger, &fill_chunk, begin, end, this]() {
+	  if(this->pin_threads_)
+	    parallelism::pin_this_thread();
+	  auto f = merger.GetFile();
+	  fill_chunk(*f, begin, end);
+	});
+    }
+  for(auto& w : workers)
+    w.join();
+}
+
+void Analyzer::save_to_file_layer_dependent_columnar(const std::string& filename, const columnar::WriterOptions& opt) {
+  std::cout << "SAVE (columnar): " << filename << std::endl;
+  for(unsigned int i=0; i<nfiles_; ++i)
+    {
+      const std::string name = "tree" + std::to_string(i);
+      const auto& fracs = this->layer_fracs_.at(i);
+      const auto& hitvars = this->layer_hitvars_.at(i);
+      assert( fracs.size() == hitvars.size() );
+      const unsigned nentries = fracs.size();
+
+      //position of the first hit of each event in the flattened hit columns
+      std::vector<ULong64_t> offsets(nentries+1, 0);
+      for(unsigned ientry=0; ientry<nentries; ++ientry)
+	offsets[ientry+1] = offsets[ientry] + sinks::nelements(hitvars[ientry]);
+
+      const float beamen = beam_energies_.at(i);
+      const unsigned lmax = this->lmax;
+      auto fill_chunk = [&, lmax, beamen](TFile& f, const unsigned& begin, const unsigned& end) {
+	f.cd();
+	sinks::LayerDepColumns cols(name, beamen, lmax, opt.basket_size);
+	for(unsigned ientry=begin; ientry<end; ++ientry)
+	  cols.fill(ientry, offsets[ientry], fracs[ientry], hitvars[ientry]);
+	f.Write();
+      };
+      _parallel_fill(_layerdep_filename(filename, i), opt, nentries, fill_chunk);
+    }
+}
+
+void Analyzer::save_to_file_cluster_dependent_columnar(const std::string& filename, const columnar::WriterOptions& opt) {
+  std::cout << "SAVE (columnar): " << filename << std::endl;
+  for(unsigned int i=0; i<nfiles_; ++i)
+    {
+      const std::string name = "tree" + std::to_string(i);
+      const auto& clusters = this->clusterdep_.at(i);
+      const unsigned nentries = clusters.size();
+
+      //position of the first cluster of each event in the flattened cluster columns
+      std::vector<ULong64_t> offsets(nentries+1, 0);
+      for(unsigned ientry=0; ientry<nentries; ++ientry)
+	offsets[ientry+1] = offsets[ientry] + sinks::nelements(clusters[ientry]);
+
+      const float beamen = beam_energies_.at(i);
+      const unsigned lmax = this->lmax;
+      auto fill_chunk = [&, lmax, beamen](TFile& f, const unsigned& begin, const unsigned& end) {
+	f.cd();
+	sinks::ClusterDepColumns cols(name, beamen, lmax, opt.basket_size);
+	for(unsigned ientry=begin; ientry<end; ++ientry)
+	  cols.fill(ientry, offsets[ientry], clusters[ientry]);
+	f.Write();
+      };
+      _parallel_fill(nfiles_ > 1 ? _layerdep_filename(filename, i) : filename, opt, nentries, fill_chunk);
+    }
+}
@@ -0,0 +1,260 @@
+#include "UserCode/DataProcessing/interface/calibration_db.h"
+#include "UserCode/DataProcessing/interface/CLUEAnalysis.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  //appends the table to the buffer, aligned to 8 bytes; returns its offset
+  std::uint64_t append(std::string& buf, const void* data, const size_t& nbytes)
+  {
+    buf.resize((buf.size() + 7) / 8 * 8, '\0');
+    const std::uint64_t offset = buf.size();
+    buf.append(static_cast<const char*>(data), nbytes);
+    return offset;
+  }
+
+  std::string getenv_or_throw(const char* name)
+  {
+    const char* value = std::getenv(name);
+    if(value == nullptr)
+      throw std::runtime_error(std::string("The environment variable ") + name + " is not defined.");
+    return value;
+  }
+}
+
+std::string calibdb::data_dir()
+{
+  return getenv_or_throw("HOME") + "/" + getenv_or_throw("CMSSW_VERSION") + "/src/UserCode/DataProcessing/";
+}
+
+std::string calibdb::default_path()
+{
+  const char* path = std::getenv("CALIBRATION_DB");
+  return path != nullptr ? std::string(path) : data_dir() + "Calibration.db";
+}
+
+std::map< std::pair<unsigned,unsigned>, float > calibdb::read_noise_map(const std::string& filename)
+{
+  std::ifstream in(filename);
+  if(!in.is_open())
+    throw std::invalid_argument("File " + filename + " could not be opened.");
+
+  std::map< std::pair<unsigned,unsigned>, float > noise_map;
+  unsigned layer, mod_id, mod_pos, chip;
+  float noise;
+  for(unsigned i=0; i<2; ++i) //lines to skip
+    in.ignore(std::numeric_limits<unsigned>::max(), '\n');
+  while(in >> layer >> mod_id >> mod_pos >> chip >> noise)
+    noise_map.insert( std::make_pair(std::make_pair(mod_id, chip), noise) );
+  return noise_map;
+}
+
+std::vector< std::pair<float,float> > calibdb::read_impact_shifts(const std::string& filename)
+{
+  std::ifstream in(filename);
+  if(!in.is_open())
+    throw std::invalid_argument("File " + filename + " could not be opened.");
+
+  std::vector< std::pair<float,float> > shifts;
+  unsigned layer;
+  float shiftx, shifty;
+  for(unsigned i=0; i<2; ++i) //lines to skip
+    in.ignore(std::numeric_limits<unsigned>::max(), '\n');
+  for(unsigned i=0; i<detectorConstants::totalnlayers; ++i) {
+    in >> layer >> shiftx >> shifty;
+    assert(layer == i+1);
+    shifts.emplace_back( shiftx, shifty );
+  }
+  return shifts;
+}
+
+//reads the 'input_data.append((run, beam energy, PDG ID, setup ID, valid DWC, valid XCET, valid MCP))' lines
+std::map<unsigned, calibdb::RunInfo> calibdb::read_run_list(const std::string& filename)
+{
+  std::ifstream in(filename);
+  if(!in.is_open())
+    throw std::invalid_argument("File " + filename + " could not be opened.");
+
+  const std::string prefix = "input_data.append((";
+  std::map<unsigned, RunInfo> runs;
+  std::string line;
+  while(std::getline(in, line)) {
+    const size_t start = line.find(prefix);
+    if(start == std::string::npos or line.find_first_not_of(" \t") != start)
+      continue; //also skips the commented lines
+    std::string fields = line.substr(start + prefix.size(), line.find("))") - start - prefix.size());
+    for(auto& c : fields)
+      if(c == ',')
+	c = ' ';
+    std::istringstream ss(fields);
+    unsigned run;
+    RunInfo info = {};
+    std::string dwc, xcet, mcp;
+    if(!(ss >> run >> info.beam_energy >> info.pdgid >> info.setup >> dwc >> xcet >> mcp))
+      throw std::invalid_argument("Wrong line in the run list " + filename + ": '" + line + "'.");
+    info.valid_dwc = dwc == "True";
+    info.valid_xcet = xcet == "True";
+    info.valid_mcp = mcp == "True";
+    runs[run] = info;
+  }
+  if(runs.empty())
+    throw std::invalid_argument("The run list " + filename + " is empty.");
+  return runs;
+}
+
+float calibdb::default_layer_weight(const unsigned& layer, const bool& st)
+{
+  if(layer == 0 or layer > (st ? detectorConstants::totalnlayers : detectorConstants::nlayers_emshowers))
+    return 0.f;
+  if(st and layer > detectorConstants::nlayers_emshowers)
+    return detectorConstants::globalWeightCEH;
+  return detectorConstants::dEdX.at(layer-1);
+}
+
+float calibdb::default_ahc_weight(const bool& st)
+{
+  return st ? detectorConstants::globalWeightCEH * detectorConstants::globalWeightRelative : 0.f;
+}
+
+void calibdb::compile(const std::string& noise_map, const std::string& impact_shifts, const std::string& run_list, const std::string& output)
+{
+  const ChannelThresholds thresholds(read_noise_map(noise_map), masked_channels);
+  const std::vector< std::pair<float,float> > shifts = read_impact_shifts(impact_shifts);
+  const std::map<unsigned, RunInfo> runs = read_run_list(run_list);
+
+  Header header = {};
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.nmodules = thresholds.nmodules();
+  header.nchips = ChannelThresholds::nchips;
+  header.nchannels = ChannelThresholds::nchannels;
+  header.nlayers = detectorConstants::totalnlayers;
+  header.nlayers_em = detectorConstants::nlayers_emshowers;
+  header.run_min = runs.cbegin()->first;
+  header.nruns = runs.crbegin()->first - header.run_min + 1;
+
+  std::vector<float> shift_table; //x and y next to each other
+  for(const auto& shift : shifts) {
+    shift_table.push_back(shift.first);
+    shift_table.push_back(shift.second);
+  }
+  std::vector<float> weight_table; //em layers, had layers, em AHCAL, had AHCAL
+  for(const bool st : {false, true})
+    for(unsigned layer=1; layer<=header.nlayers; ++layer)
+      weight_table.push_back( default_layer_weight(layer, st) );
+  weight_table.push_back( default_ahc_weight(false) );
+  weight_table.push_back( default_ahc_weight(true) );
+  std::vector<RunInfo> run_table(header.nruns, RunInfo{});
+  for(const auto& run : runs)
+    run_table[run.first - header.run_min] = run.second;
+
+  std::string buf(sizeof(Header), '\0');
+  header.thresholds_offset = append(buf, thresholds.data(), thresholds.size() * sizeof(float));
+  header.shifts_offset = append(buf, shift_table.data(), shift_table.size() * sizeof(float));
+  header.weights_offset = append(buf, weight_table.data(), weight_table.size() * sizeof(float));
+  header.runs_offset = append(buf, run_table.data(), run_table.size() * sizeof(RunInfo));
+  header.file_size = buf.size();
+  std::memcpy(&buf[0], &header, sizeof(Header));
+
+  const std::string tmp = output + ".tmp" + std::to_string(getpid());
+  std::ofstream out(tmp, std::ios::binary);
+  if(!out.write(buf.data(), buf.size()))
+    throw std::runtime_error("The calibration database " + tmp + " could not be written.");
+  out.close();
+  if(std::rename(tmp.c_str(), output.c_str()) != 0)
+    throw std::runtime_error("The calibration database " + output + " could not be written.");
+}
+
+std::shared_ptr<const CalibrationDB> CalibrationDB::open(const std::string& filename)
+{
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if(fd < 0)
+    throw std::invalid_argument("File " + filename + " could not be opened.");
+  struct stat st;
+  if(fstat(fd, &st) != 0 or static_cast<size_t>(st.st_size) < sizeof(calibdb::Header)) {
+    ::close(fd);
+    throw std::runtime_error("The calibration database " + filename + " is truncated.");
+  }
+
+  std::shared_ptr<CalibrationDB> db(new CalibrationDB());
+  db->size_ = st.st_size;
+  db->data_ = mmap(nullptr, db->size_, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd); //the mapping stays valid
+  if(db->data_ == MAP_FAILED) {
+    db->data_ = nullptr;
+    throw std::runtime_error("The calibration database " + filename + " could not be mapped.");
+  }
+
+  const calibdb::Header* h = db->_table<calibdb::Header>(0);
+  if(std::memcmp(h->magic, calibdb::magic, sizeof(calibdb::magic)) != 0)
+    throw std::runtime_error("File " + filename + " is not a calibration database.");
+  if(h->version != calibdb::version)
+    throw std::runtime_error("The calibration database " + filename + " has version " + std::to_string(h->version) + " instead of "
+			     + std::to_string(calibdb::version) + "; rebuild it with compile_calibration_exe.");
+  if(h->file_size != db->size_ or h->nchips != ChannelThresholds::nchips or h->nchannels != ChannelThresholds::nchannels
+     or h->nlayers != detectorConstants::totalnlayers or h->nlayers_em != detectorConstants::nlayers_emshowers
+     or h->runs_offset + h->nruns * sizeof(calibdb::RunInfo) > db->size_)
+    throw std::runtime_error("The calibration database " + filename + " is inconsistent with this build; rebuild it with compile_calibration_exe.");
+  db->header_ = h;
+  return db;
+}
+
+CalibrationDB::~CalibrationDB()
+{
+  if(data_ != nullptr)
+    munmap(data_, size_);
+}
+
+ChannelThresholds CalibrationDB::channel_thresholds() const
+{
+  return ChannelThresholds(std::shared_ptr<const float>(shared_from_this(), _table<float>(header_->thresholds_offset)), header_->nmodules, calibdb::masked_channels);
+}
+
+std::pair<float,float> CalibrationDB::shift(const unsigned& layer) const
+{
+  if(layer == 0 or layer > header_->nlayers)
+    throw std::out_of_range("Unphysical layer number: " + std::to_string(layer));
+  const float* shifts = _table<float>(header_->shifts_offset);
+  return std::make_pair(shifts[2*(layer-1)], shifts[2*(layer-1)+1]);
+}
+
+float CalibrationDB::layer_weight(const unsigned& layer, const bool& st) const
+{
+  if(layer == 0 or layer > header_->nlayers)
+    throw std::out_of_range("Unphysical layer number: " + std::to_string(layer));
+  return _table<float>(header_->weights_offset)[st * header_->nlayers + layer - 1];
+}
+
+float CalibrationDB::ahc_weight(const bool& st) const
+{
+  return _table<float>(header_->weights_offset)[2 * header_->nlayers + st];
+}
+
+const calibdb::RunInfo* CalibrationDB::run(const unsigned& run) const
+{
+  if(run < header_->run_min or run - header_->run_min >= header_->nruns)
+    return nullptr;
+  const calibdb::RunInfo* info = _table<calibdb::RunInfo>(header_->runs_offset) + (run - header_->run_min);
+  return info->beam_energy == 0 ? nullptr : info;
+}
+
+std::vector<unsigned> CalibrationDB::runs(const unsigned& setup) const
+{
+  std::vector<unsigned> selected;
+  const calibdb::RunInfo* table = _table<calibdb::RunInfo>(header_->runs_offset);
+  for(unsigned i=0; i<header_->nruns; ++i)
+    if(table[i].beam_energy != 0 and table[i].setup == setup)
+      selected.push_back(header_->run_min + i);
+  return selected;
+}
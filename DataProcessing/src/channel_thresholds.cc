@@ -0,0 +1,49 @@
+#include "UserCode/DataProcessing/interface/channel_thresholds.h"
+
+#include <algorithm>
+#include <limits>
+
+ChannelThresholds::ChannelThresholds(const std::map< std::pair<unsigned,unsigned>, float >& noise, const std::vector< std::pair<unsigned,unsigned> >& masked)
+{
+  for(const auto& elem : noise) {
+    if(elem.first.second >= nchips)
+      throw std::out_of_range("Unexpected chip number in the noise map: " + std::to_string(elem.first.second));
+    nmodules_ = std::max(nmodules_, elem.first.first + 1);
+  }
+  auto values = std::make_shared< std::vector<float> >(size(), std::numeric_limits<float>::quiet_NaN());
+  std::vector<float>& v = *values;
+
+  for(const auto& elem : noise) {
+    const unsigned module = elem.first.first, chip = elem.first.second;
+    for(unsigned channel=0; channel<nchannels; ++channel) {
+      const unsigned idx = ((module * nchips + chip) * nchannels + channel) * 2;
+      v[idx]   = sigma_em * elem.second;
+      v[idx+1] = sigma_had * elem.second;
+    }
+  }
+
+  _mask(masked);
+  for(const auto& elem : masked) {
+    const unsigned chip = elem.first, channel = elem.second;
+    for(unsigned module=0; module<nmodules_; ++module) {
+      const unsigned idx = ((module * nchips + chip) * nchannels + channel) * 2;
+      v[idx] = v[idx+1] = std::numeric_limits<float>::infinity();
+    }
+  }
+  values_ = std::shared_ptr<const float>(values, v.data()); //owns the vector
+}
+
+ChannelThresholds::ChannelThresholds(std::shared_ptr<const float> values, const unsigned& nmodules, const std::vector< std::pair<unsigned,unsigned> >& masked): nmodules_(nmodules), values_(values)
+{
+  _mask(masked);
+}
+
+void ChannelThresholds::_mask(const std::vector< std::pair<unsigned,unsigned> >& masked)
+{
+  for(const auto& elem : masked) {
+    const unsigned chip = elem.first, channel = elem.second;
+    if(chip >= nchips or channel >= nchannels)
+      throw std::out_of_range("Unexpected masked channel: chip " + std::to_string(chip) + ", channel " + std::to_string(channel));
+    masked_[chip * nchannels + channel] = true;
+  }
+}
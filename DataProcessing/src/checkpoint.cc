@@ -0,0 +1,99 @@
+#include "UserCode/DataProcessing/interface/checkpoint.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+namespace {
+  constexpr char magic[8] = {'C','L','U','E','C','K','P','T'};
+  constexpr std::uint32_t version = 1;
+  constexpr size_t header_size = sizeof(magic) + sizeof(version) + sizeof(std::uint64_t);
+}
+
+std::uint64_t checkpoint::hash(const std::string& s)
+{
+  std::uint64_t h = 14695981039346656037ull;
+  for(const char c : s) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+checkpoint::Log::Log(const std::string& path, const std::uint64_t& confighash): path_(path)
+{
+  std::string header;
+  header.append(magic, sizeof(magic));
+  put(header, version);
+  put(header, confighash);
+
+  //read the blocks left by a previous job, up to the first incomplete or corrupted one
+  size_t good_end = 0;
+  std::ifstream in(path_, std::ios::binary | std::ios::ate);
+  if(in.is_open()) {
+    const std::uint64_t file_size = in.tellg();
+    in.seekg(0);
+    std::string old_header(header_size, '\0');
+    if(in.read(&old_header[0], header_size) and old_header == header) {
+      good_end = header_size;
+      while(true) {
+	std::uint64_t size, checksum;
+	std::string block;
+	if(!in.read(reinterpret_cast<char*>(&size), sizeof(size)) or size > file_size - good_end)
+	  break;
+	block.resize(size);
+	if(!in.read(&block[0], size) or !in.read(reinterpret_cast<char*>(&checksum), sizeof(checksum)))
+	  break;
+	if(checksum != hash(block))
+	  break;
+	blocks_.push_back(std::move(block));
+	good_end += sizeof(size) + size + sizeof(checksum);
+      }
+    }
+    else
+      std::cout << "WARNING: the checkpoint " << path_ << " was written with a different configuration; starting over." << std::endl;
+    in.close();
+  }
+
+  if(good_end == 0) {
+    file_ = std::fopen(path_.c_str(), "wb");
+    if(file_ == nullptr)
+      throw std::runtime_error("The checkpoint " + path_ + " could not be created.");
+    if(std::fwrite(header.data(), 1, header.size(), file_) != header.size())
+      throw std::runtime_error("The checkpoint " + path_ + " could not be written.");
+    std::fflush(file_);
+  }
+  else {
+    std::filesystem::resize_file(path_, good_end); //drops an incomplete block
+    file_ = std::fopen(path_.c_str(), "ab");
+    if(file_ == nullptr)
+      throw std::runtime_error("The checkpoint " + path_ + " could not be opened.");
+  }
+}
+
+checkpoint::Log::~Log()
+{
+  if(file_ != nullptr)
+    std::fclose(file_);
+}
+
+void checkpoint::Log::append(const std::string& block)
+{
+  std::string record;
+  put(record, static_cast<std::uint64_t>(block.size()));
+  record += block;
+  put(record, hash(block));
+  if(std::fwrite(record.data(), 1, record.size(), file_) != record.size() or std::fflush(file_) != 0)
+    throw std::runtime_error("The checkpoint " + path_ + " could not be written.");
+  fsync(fileno(file_));
+}
+
+void checkpoint::Log::remove()
+{
+  if(file_ != nullptr) {
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+  std::remove(path_.c_str());
+}
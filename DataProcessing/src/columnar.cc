@@ -0,0 +1,56 @@
+#include "UserCode/DataProcessing/interface/columnar.h"
+
+#include <stdexcept>
+
+columnar::Compression columnar::parse_compression(const std::string& name)
+{
+  if(name == "lz4")
+    return Compression::LZ4;
+  else if(name == "zstd")
+    return Compression::ZSTD;
+  else if(name == "zlib")
+    return Compression::ZLIB;
+  else if(name == "lzma")
+    return Compression::LZMA;
+  else
+    throw std::invalid_argument("Compression algorithm " + name + " is not supported.");
+}
+
+int columnar::compression_settings(const WriterOptions& opt)
+{
+  if(opt.level < 0 or opt.level > 9)
+    throw std::invalid_argument("The compression level has to be within [0;9].");
+
+  ROOT::RCompressionSetting::EAlgorithm::EValues alg;
+  switch(opt.algorithm) {
+  case Compression::LZ4:  alg = ROOT::RCompressionSetting::EAlgorithm::kLZ4;  break;
+  case Compression::ZSTD: alg = ROOT::RCompressionSetting::EAlgorithm::kZSTD; break;
+  case Compression::ZLIB: alg = ROOT::RCompressionSetting::EAlgorithm::kZLIB; break;
+  case Compression::LZMA: alg = ROOT::RCompressionSetting::EAlgorithm::kLZMA; break;
+  default: throw std::invalid_argument("Unknown compression algorithm.");
+  }
+  return ROOT::CompressionSettings(alg, opt.level);
+}
+
+columnar::WriterOptions columnar::parse_args(int argc, char **argv, int first)
+{
+  WriterOptions opt;
+  for(int iarg=first; iarg<argc; ++iarg)
+    {
+      std::string arg = std::string(argv[iarg]);
+      if(arg == "--columnar")
+	opt.enabled = true;
+      else if(arg == "--compression" or arg == "--compression_level" or arg == "--basket_size") {
+	if(iarg+1 >= argc)
+	  throw std::invalid_argument("The '" + arg + "' option requires a value.");
+	std::string val = std::string(argv[++iarg]);
+	if(arg == "--compression")
+	  opt.algorithm = parse_compression(val);
+	else if(arg == "--compression_level")
+	  opt.level = std::stoi(val);
+	else
+	  opt.basket_size = std::stoi(val);
+      }
+    }
+  return opt;
+}
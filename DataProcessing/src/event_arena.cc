@@ -0,0 +1,33 @@
+#include "UserCode/DataProcessing/interface/event_arena.h"
+
+namespace arena {
+  EventArena::EventArena(const size_t& initial_bytes): capacity_(initial_bytes), buffer_(new std::byte[initial_bytes])
+  {
+    buffer_resource_.emplace(buffer_.get(), capacity_, &overflow_);
+  }
+
+  void EventArena::reset()
+  {
+    if(overflow_.bytes == 0) { //the common case: back to the start of the buffer
+      buffer_resource_->release();
+      return;
+    }
+    //the last event did not fit: the buffer grows to the memory it took
+    buffer_resource_.reset(); //returns the overflow to the heap
+    capacity_ += overflow_.bytes;
+    overflow_.bytes = 0;
+    buffer_.reset(new std::byte[capacity_]);
+    buffer_resource_.emplace(buffer_.get(), capacity_, &overflow_);
+  }
+
+  void* EventArena::Overflow::do_allocate(size_t bytes, size_t alignment)
+  {
+    this->bytes += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void EventArena::Overflow::do_deallocate(void* p, size_t bytes, size_t alignment)
+  {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+}
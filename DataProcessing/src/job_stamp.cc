@@ -0,0 +1,145 @@
+#include "UserCode/DataProcessing/interface/job_stamp.h"
+#include "UserCode/DataProcessing/interface/checkpoint.h"
+#include "UserCode/DataProcessing/interface/calibration_db.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+  std::string stamp_path(const std::string& output) { return output + jobstamp::suffix; }
+
+  //hash of the hashes of blocks of 1MB
+  std::string hash_content(const std::string& filename)
+  {
+    std::ifstream in(filename, std::ios::binary);
+    if(!in.is_open())
+      throw std::invalid_argument("File " + filename + " could not be opened.");
+    std::string block(1 << 20, '\0'), hashes;
+    while(in.read(&block[0], block.size()) or in.gcount() > 0)
+      hashes += std::to_string( checkpoint::hash(block.substr(0, in.gcount())) ) + " ";
+    return std::to_string( checkpoint::hash(hashes) );
+  }
+
+  //files recorded by Stamp::write(), one 'output <path>' line each
+  std::vector<std::string> read_outputs(const std::string& output)
+  {
+    std::vector<std::string> outputs;
+    std::ifstream in(stamp_path(output));
+    std::string line;
+    const std::string prefix = "output ";
+    while(std::getline(in, line))
+      if(line.compare(0, prefix.size(), prefix) == 0)
+	outputs.push_back(line.substr(prefix.size()));
+    return outputs;
+  }
+}
+
+std::string jobstamp::read_key(const std::string& output)
+{
+  std::ifstream in(stamp_path(output));
+  std::string word, key;
+  if(in >> word >> key and word == "key")
+    return key;
+  return "";
+}
+
+void jobstamp::Stamp::add_executable()
+{
+  std::set<std::string> files = { std::filesystem::read_symlink("/proc/self/exe").string() };
+  std::ifstream maps("/proc/self/maps"); //the code of the executables lives in the libraries of the packages
+  std::string line;
+  while(std::getline(maps, line)) {
+    const size_t path = line.find('/');
+    if(path != std::string::npos and line.find("UserCode", path) != std::string::npos)
+      files.insert(line.substr(path));
+  }
+  for(const auto& file : files)
+    add_file(file);
+}
+
+void jobstamp::Stamp::add_input(const std::string& filename)
+{
+  const std::string key = read_key(filename);
+  if(!key.empty()) {
+    components_.emplace_back("input", key);
+    return;
+  }
+  std::error_code ec;
+  const auto size = std::filesystem::file_size(filename, ec);
+  if(ec)
+    throw std::invalid_argument("File " + filename + " could not be opened.");
+  const auto mtime = std::filesystem::last_write_time(filename).time_since_epoch().count();
+  components_.emplace_back("input", filename + " " + std::to_string(size) + " " + std::to_string(mtime));
+}
+
+void jobstamp::Stamp::add_file(const std::string& filename)
+{
+  components_.emplace_back("file " + filename, hash_content(filename));
+}
+
+void jobstamp::Stamp::add_calibration()
+{
+  const std::string dir = calibdb::data_dir();
+  for(const auto& file : {calibdb::default_path(), dir + "Noise_Map.txt", dir + "Impact_Shifts.txt"})
+    if(std::filesystem::exists(file))
+      add_file(file);
+}
+
+std::string jobstamp::Stamp::key() const
+{
+  std::string all;
+  for(const auto& component : components_)
+    all += component.first + "=" + component.second + "\n";
+  char hex[17];
+  std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(checkpoint::hash(all)));
+  return hex;
+}
+
+bool jobstamp::Stamp::up_to_date(const std::string& output, const std::vector<std::string>& outputs) const
+{
+  if(read_key(output) != key())
+    return false;
+  for(const auto& files : {outputs, read_outputs(output)})
+    for(const auto& file : files)
+      if(!std::filesystem::exists(file))
+	return false;
+  return true;
+}
+
+void jobstamp::Stamp::remove(const std::string& output)
+{
+  std::error_code ec;
+  std::filesystem::remove(stamp_path(output), ec);
+}
+
+void jobstamp::Stamp::write(const std::string& output, const memprof::JobSummary& summary, const std::vector<std::string>& outputs) const
+{
+  const std::string path = stamp_path(output);
+  const std::string tmp = path + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream out(tmp);
+    if(!out.is_open())
+      throw std::runtime_error("The stamp " + path + " could not be written.");
+    out << "key " << key() << std::endl;
+    for(const auto& file : outputs)
+      out << "output " << file << std::endl;
+    for(const auto& component : components_)
+      out << "# " << component.first << ": " << component.second << std::endl;
+    summary.print(out);
+  }
+  if(std::rename(tmp.c_str(), path.c_str()) != 0)
+    throw std::runtime_error("The stamp " + path + " could not be written.");
+}
+
+void jobstamp::Stamp::print_summary(const std::string& output, std::ostream& os)
+{
+  memprof::JobSummary summary;
+  for(const auto& entry : memprof::read_summary(stamp_path(output)))
+    summary.add(entry.first, entry.second);
+  summary.add("up_to_date", 1);
+  summary.print(os);
+}
@@ -0,0 +1,81 @@
+#include "UserCode/DataProcessing/interface/memory_profile.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace {
+  const auto process_start = std::chrono::steady_clock::now();
+}
+
+double memprof::peak_rss_mb()
+{
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0.;
+  return usage.ru_maxrss / 1024.; //kilobytes on Linux
+}
+
+double memprof::current_rss_mb()
+{
+  std::ifstream statm("/proc/self/statm");
+  unsigned long size = 0, resident = 0;
+  if(!(statm >> size >> resident))
+    return 0.;
+  return resident * static_cast<double>(sysconf(_SC_PAGESIZE)) / (1024. * 1024.);
+}
+
+double memprof::elapsed_s()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - process_start).count();
+}
+
+void memprof::JobSummary::add(const std::string& key, const double& value)
+{
+  if(key.find_first_of(" \t\n") != std::string::npos)
+    throw std::invalid_argument("The job summary keys cannot contain whitespace: '" + key + "'.");
+  entries_.emplace_back(key, value);
+}
+
+void memprof::JobSummary::add_bytes(const std::string& key, const size_t& nbytes)
+{
+  add(key + "_mb", nbytes / (1024. * 1024.));
+}
+
+void memprof::JobSummary::add_rss()
+{
+  add("peak_rss_mb", peak_rss_mb());
+  add("current_rss_mb", current_rss_mb());
+}
+
+void memprof::JobSummary::add_wall_time()
+{
+  add("wall_s", elapsed_s());
+}
+
+void memprof::JobSummary::print(std::ostream& os) const
+{
+  for(const auto& entry : entries_) {
+    std::ostringstream ss; //event counts printed in full
+    ss.precision(15);
+    ss << prefix << " " << entry.first << " " << entry.second;
+    os << ss.str() << std::endl;
+  }
+}
+
+std::map<std::string, double> memprof::read_summary(const std::string& filename)
+{
+  std::map<std::string, double> summary;
+  std::ifstream f(filename);
+  std::string line;
+  while(std::getline(f, line)) {
+    std::istringstream ss(line);
+    std::string word, key;
+    double value;
+    if(ss >> word >> key >> value and word == JobSummary::prefix)
+      summary[key] = value;
+  }
+  return summary;
+}
@@ -0,0 +1,685 @@
+#include "UserCode/DataProcessing/interface/merger.h"
+#include "UserCode/DataProcessing/interface/output_sinks.h"
+#include "UserCode/DataProcessing/interface/parallelism.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include "TFile.h"
+#include "TFileMerger.h"
+#include "TH2F.h"
+#include "TH3F.h"
+#include "TProfile.h"
+#include "TROOT.h"
+#include "TTreeReader.h"
+#include "TTreeReaderArray.h"
+#include "TTreeReaderValue.h"
+#include "ROOT/TBufferMerger.hxx"
+
+namespace {
+  using merging::Analysis;
+  constexpr Long64_t min_chunk_entries = 1000;
+  constexpr Long64_t max_chunk_entries = 20000; //bounds the memory held by the buffer of each chunk until it is merged
+
+  //selections of the plots of layer_dep.py and cluster_dep.py, reproduced by the summary
+  constexpr float hit_energy_cut = 1000.f; //MeV
+  constexpr std::array<float, 2> cluster_energy_cuts = {{0.f, 1000.f}}; //MeV
+  constexpr unsigned resolution_nhits = 5; //minimum number of hits of the clusters entering the per-layer plots
+
+  struct Input {
+    std::string file;
+    Long64_t nentries = 0;
+    bool columnar = false;
+    int compression = 0;
+    bool valid = false; //the file could be opened and holds the tree
+  };
+
+  void inspect(Input& in, const std::string& tname, const Analysis& analysis, const unsigned& lmax)
+  {
+    std::unique_ptr<TFile> f( TFile::Open(in.file.c_str(), "READ") );
+    if(!f or f->IsZombie())
+      return;
+    TTree *tree = dynamic_cast<TTree*>( f->Get(tname.c_str()) );
+    if(tree == nullptr)
+      return;
+    in.nentries = tree->GetEntries();
+    in.columnar = tree->GetBranch("Offset") != nullptr;
+    in.compression = f->GetCompressionSettings();
+    if(!in.columnar) {
+      const std::string last = (analysis == Analysis::LAYERDEP ? "Energies_layer" : "Energy_layer") + std::to_string(lmax);
+      if(tree->GetBranch(last.c_str()) == nullptr)
+	throw std::invalid_argument("The tree of " + in.file + " has fewer than " + std::to_string(lmax) + " layers.");
+    }
+    in.valid = true;
+  }
+
+  //readers of the event quantities of either layout, filling the data formats of the Analyzer
+  struct LegacyLayerDep {
+    LegacyLayerDep(TTreeReader& reader, const unsigned& lmax) {
+      for(unsigned il=0; il<lmax; ++il) {
+	const std::string l = std::to_string(il + 1);
+	fracs_hits.emplace_back(reader,   ("NhitsFrac_layer"  + l).c_str());
+	fracs_en.emplace_back(reader,     ("EnergyFrac_layer" + l).c_str());
+	energies.emplace_back(reader,     ("Energies_layer"   + l).c_str());
+	posx.emplace_back(reader,         ("PosX_layer"       + l).c_str());
+	posy.emplace_back(reader,         ("PosY_layer"       + l).c_str());
+	rhos.emplace_back(reader,         ("Densities_layer"  + l).c_str());
+	deltas.emplace_back(reader,       ("Distances_layer"  + l).c_str());
+	seeds.emplace_back(reader,        ("isSeed_layer"     + l).c_str());
+	clustersizes.emplace_back(reader, ("ClustSize_layer"  + l).c_str());
+      }
+    }
+    std::deque< TTreeReaderValue<float> > fracs_hits, fracs_en;
+    std::deque< TTreeReaderValue< std::vector<float> > > energies, posx, posy, rhos, deltas;
+    std::deque< TTreeReaderValue< std::vector<bool> > > seeds;
+    std::deque< TTreeReaderValue< std::vector<unsigned> > > clustersizes;
+  };
+
+  struct ColumnarLayerDep {
+    ColumnarLayerDep(TTreeReader& reader):
+      fracs_hits(reader, "NhitsFrac"), fracs_en(reader, "EnergyFrac"), energy(reader, "Energy"), posx(reader, "PosX"),
+      posy(reader, "PosY"), rho(reader, "Density"), delta(reader, "Distance"), layer(reader, "Layer"),
+      clustersize(reader, "ClustSize"), seed(reader, "isSeed") {}
+    TTreeReaderArray<Float_t> fracs_hits, fracs_en, energy, posx, posy, rho, delta;
+    TTreeReaderArray<UInt_t> layer, clustersize;
+    TTreeReaderArray<UChar_t> seed;
+  };
+
+  class LayerDepReader {
+  public:
+    LayerDepReader(TTreeReader& reader, const unsigned& lmax, const bool& columnar): fracs(lmax), hitvars(lmax), lmax_(lmax) {
+      if(columnar)
+	columnar_.reset( new ColumnarLayerDep(reader) );
+      else
+	legacy_.reset( new LegacyLayerDep(reader, lmax) );
+    }
+
+    void read() {
+      if(legacy_) {
+	auto& l = *legacy_;
+	for(unsigned il=0; il<lmax_; ++il) {
+	  fracs[il] = std::make_tuple(*l.fracs_hits[il], *l.fracs_en[il]);
+	  hitvars[il] = std::make_tuple(*l.energies[il], *l.rhos[il], *l.deltas[il], *l.seeds[il], *l.posx[il], *l.posy[il], *l.clustersizes[il]);
+	}
+	return;
+      }
+      auto& c = *columnar_;
+      for(unsigned il=0; il<lmax_; ++il) {
+	fracs[il] = il < c.fracs_hits.GetSize() ? std::make_tuple(c.fracs_hits[il], c.fracs_en[il]) : std::make_tuple(0.f, 0.f);
+	auto& hv = hitvars[il];
+	std::get<0>(hv).clear(); std::get<1>(hv).clear(); std::get<2>(hv).clear(); std::get<3>(hv).clear();
+	std::get<4>(hv).clear(); std::get<5>(hv).clear(); std::get<6>(hv).clear();
+      }
+      for(size_t ihit=0; ihit<c.layer.GetSize(); ++ihit) {
+	const unsigned il = c.layer[ihit] - 1;
+	if(il >= lmax_)
+	  throw std::runtime_error("Layer " + std::to_string(il + 1) + " is beyond the layers of the output.");
+	auto& hv = hitvars[il];
+	std::get<0>(hv).push_back( c.energy[ihit] );
+	std::get<1>(hv).push_back( c.rho[ihit] );
+	std::get<2>(hv).push_back( c.delta[ihit] );
+	std::get<3>(hv).push_back( c.seed[ihit] != 0 );
+	std::get<4>(hv).push_back( c.posx[ihit] );
+	std::get<5>(hv).push_back( c.posy[ihit] );
+	std::get<6>(hv).push_back( c.clustersize[ihit] );
+      }
+    }
+
+    dataformats::layerfracs fracs;
+    dataformats::layerhitvars hitvars;
+
+  private:
+    unsigned lmax_;
+    std::unique_ptr<LegacyLayerDep> legacy_;
+    std::unique_ptr<ColumnarLayerDep> columnar_;
+  };
+
+  struct LegacyClusterDep {
+    LegacyClusterDep(TTreeReader& reader, const unsigned& lmax) {
+      for(unsigned il=0; il<lmax; ++il) {
+	const std::string l = std::to_string(il + 1);
+	hits.emplace_back(reader, ("Nhits_layer"  + l).c_str());
+	en.emplace_back(reader,   ("Energy_layer" + l).c_str());
+	x.emplace_back(reader,    ("X_layer"      + l).c_str());
+	y.emplace_back(reader,    ("Y_layer"      + l).c_str());
+	dx.emplace_back(reader,   ("dX_layer"     + l).c_str());
+	dy.emplace_back(reader,   ("dY_layer"     + l).c_str());
+      }
+    }
+    std::deque< TTreeReaderValue< std::vector<unsigned> > > hits;
+    std::deque< TTreeReaderValue< std::vector<float> > > en, x, y, dx, dy;
+  };
+
+  struct ColumnarClusterDep {
+    ColumnarClusterDep(TTreeReader& reader):
+      layer(reader, "Layer"), hits(reader, "Nhits"), en(reader, "Energy"), x(reader, "X"), y(reader, "Y"),
+      dx(reader, "dX"), dy(reader, "dY") {}
+    TTreeReaderArray<UInt_t> layer, hits;
+    TTreeReaderArray<Float_t> en, x, y, dx, dy;
+  };
+
+  class ClusterDepReader {
+  public:
+    ClusterDepReader(TTreeReader& reader, const unsigned& lmax, const bool& columnar): clusters(lmax), lmax_(lmax) {
+      if(columnar)
+	columnar_.reset( new ColumnarClusterDep(reader) );
+      else
+	legacy_.reset( new LegacyClusterDep(reader, lmax) );
+    }
+
+    void read() {
+      if(legacy_) {
+	auto& l = *legacy_;
+	for(unsigned il=0; il<lmax_; ++il)
+	  clusters[il] = std::make_tuple(*l.hits[il], *l.en[il], *l.x[il], *l.y[il], *l.dx[il], *l.dy[il]);
+	return;
+      }
+      auto& c = *columnar_;
+      for(auto& cv : clusters) {
+	std::get<0>(cv).clear(); std::get<1>(cv).clear(); std::get<2>(cv).clear();
+	std::get<3>(cv).clear(); std::get<4>(cv).clear(); std::get<5>(cv).clear();
+      }
+      for(size_t iclust=0; iclust<c.layer.GetSize(); ++iclust) {
+	const unsigned il = c.layer[iclust] - 1;
+	if(il >= lmax_)
+	  throw std::runtime_error("Layer " + std::to_string(il + 1) + " is beyond the layers of the output.");
+	auto& cv = clusters[il];
+	std::get<0>(cv).push_back( c.hits[iclust] );
+	std::get<1>(cv).push_back( c.en[iclust] );
+	std::get<2>(cv).push_back( c.x[iclust] );
+	std::get<3>(cv).push_back( c.y[iclust] );
+	std::get<4>(cv).push_back( c.dx[iclust] );
+	std::get<5>(cv).push_back( c.dy[iclust] );
+      }
+    }
+
+    dataformats::clustervars clusters;
+
+  private:
+    unsigned lmax_;
+    std::unique_ptr<LegacyClusterDep> legacy_;
+    std::unique_ptr<ColumnarClusterDep> columnar_;
+  };
+
+  //number of hits (clusters) of each entry, reading a single branch per layer (or the counter only, in the columnar layout)
+  class ElementCounter {
+  public:
+    ElementCounter(TTreeReader& reader, const Analysis& analysis, const unsigned& lmax, const bool& columnar) {
+      if(columnar)
+	counter_.reset( new TTreeReaderValue<UInt_t>(reader, analysis == Analysis::LAYERDEP ? "Nhits" : "Nclusters") );
+      else
+	for(unsigned il=0; il<lmax; ++il)
+	  sizes_.emplace_back(reader, ((analysis == Analysis::LAYERDEP ? "Energies_layer" : "Energy_layer") + std::to_string(il + 1)).c_str());
+    }
+    ULong64_t count() {
+      if(counter_)
+	return **counter_;
+      ULong64_t n = 0;
+      for(auto& s : sizes_)
+	n += s->size();
+      return n;
+    }
+
+  private:
+    std::unique_ptr< TTreeReaderValue<UInt_t> > counter_;
+    std::deque< TTreeReaderValue< std::vector<float> > > sizes_;
+  };
+
+  //per-layer profiles and distributions of an output, binned as the plots of layer_dep.py and cluster_dep.py, which read them
+  //with '--summary' instead of the trees; the spread of the cluster positions is the spatial resolution
+  class Summary {
+  public:
+    //created on the main thread, outside of any directory
+    Summary(const Analysis& analysis, const unsigned& lmax): lmax_(lmax) {
+      const bool add_directory = TH1::AddDirectoryStatus();
+      TH1::AddDirectory(false);
+      if(analysis == Analysis::LAYERDEP) {
+	nhitsfrac_ = _profile("NhitsFrac");
+	energyfrac_ = _profile("EnergyFrac");
+	nhits_ = _profile("Nhits");
+	hitenergy_ = _profile("HitEnergy");
+	nhitsfrac2d_ = _layer2d("NhitsFrac2D", "fraction of clusterized hits", 60, 0., 1.);
+	energyfrac2d_ = _layer2d("EnergyFrac2D", "fraction of clusterized energy", 60, 0., 1.);
+	densities2d_ = _layer2d("Densities2D", "density [MeV]", 100, 1000., 5500.);
+	densities_seeds2d_ = _layer2d("DensitiesSeeds2D", "density [MeV]", 100, 1000., 5500.);
+	densities_noseeds2d_ = _layer2d("DensitiesNoSeeds2D", "density [MeV]", 100, 1000., 5500.);
+	distances2d_ = _layer2d("Distances2D", "distance [cm]", 100, 0., 5.);
+	densdist3d_ = _layer3d("DensDist3D", "density [MeV]", "distance [cm]", 35, 0., 7000., 10, 0., 5.);
+	posxy3d_ = _layer3d("PosXY3D", "X [cm]", "Y [cm]", 30, -5., 5., 30, -5., 5.);
+      }
+      else {
+	nclusters_ = _profile("Nclusters");
+	clusternhits_ = _profile("ClusterNhits");
+	clusterenergy_ = _profile("ClusterEnergy");
+	dx_ = _profile("dX", "s");
+	dy_ = _profile("dY", "s");
+	posfailed2d_ = _layer2d("PosFailed2D", "position measurement failed", 2, -.5, 1.5);
+	for(unsigned icut=0; icut<cluster_energy_cuts.size(); ++icut) {
+	  const std::string cut = "_Ecut" + std::to_string(static_cast<unsigned>(cluster_energy_cuts[icut]));
+	  nclusters2d_[icut] = _layer2d("Nclusters2D" + cut, "clusters", 30, .5, 30.5);
+	  clusternhits2d_[icut] = _layer2d("ClusterNhits2D" + cut, "hits per cluster", 100, .5, 100.5);
+	  clusterenergy2d_[icut] = _layer2d("ClusterEnergy2D" + cut, "energy [MeV]", 60, 0., 30000.);
+	  x2d_[icut] = _layer2d("X2D" + cut, "X [cm]", 50, -5., 5.);
+	  y2d_[icut] = _layer2d("Y2D" + cut, "Y [cm]", 50, -5., 5.);
+	  dx2d_[icut] = _layer2d("dX2D" + cut, "dX [cm]", 50, -1., 1.);
+	  dy2d_[icut] = _layer2d("dY2D" + cut, "dY [cm]", 50, -1., 1.);
+	  xy3d_[icut] = _layer3d("XY3D" + cut, "X [cm]", "Y [cm]", 30, -4., 2., 30, -2., 4.);
+	}
+	dxres2d_ = _layer2d("dXres2D", "dX [cm]", 200, -1., 1.);
+	dyres2d_ = _layer2d("dYres2D", "dY [cm]", 200, -1., 1.);
+	dxdy3d_ = _layer3d("dXdY3D", "dX [cm]", "dY [cm]", 40, -1., 1., 40, -1., 1.);
+	nhitsenergy3d_ = _layer3d("NhitsEnergy3D", "hits per cluster", "energy [MeV]", 15, .1, 15., 50, .1, 200.);
+      }
+      TH1::AddDirectory(add_directory);
+    }
+
+    void fill(const dataformats::layerfracs& fracs, const dataformats::layerhitvars& hitvars) {
+      for(unsigned il=0; il<fracs.size(); ++il) {
+	const unsigned layer = il + 1;
+	const auto& [en, rho, delta, seed, x, y, size] = hitvars[il];
+	nhitsfrac_->Fill(layer, std::get<0>(fracs[il]));
+	energyfrac_->Fill(layer, std::get<1>(fracs[il]));
+	nhitsfrac2d_->Fill(layer, std::get<0>(fracs[il]));
+	energyfrac2d_->Fill(layer, std::get<1>(fracs[il]));
+	nhits_->Fill(layer, en.size());
+	for(size_t ih=0; ih<en.size(); ++ih) {
+	  hitenergy_->Fill(layer, en[ih]);
+	  const float distance = seed[ih] ? .5f : (delta[ih] > 1e38f ? 4.f : delta[ih]); //seeds and undefined distances, as layer_dep.py
+	  distances2d_->Fill(layer, distance);
+	  densdist3d_->Fill(layer, rho[ih], distance, std::pow(static_cast<double>(rho[ih]), 6));
+	  if(en[ih] > hit_energy_cut and size[ih] > 0) {
+	    densities2d_->Fill(layer, rho[ih]);
+	    (seed[ih] ? densities_seeds2d_ : densities_noseeds2d_)->Fill(layer, rho[ih]);
+	  }
+	  if(rho[ih] > hit_energy_cut)
+	    posxy3d_->Fill(layer, x[ih], y[ih], rho[ih]);
+	}
+      }
+    }
+
+    void fill(const dataformats::clustervars& clusters) {
+      for(unsigned il=0; il<clusters.size(); ++il) {
+	const unsigned layer = il + 1;
+	const auto& [nh, en, x, y, dx, dy] = clusters[il];
+	nclusters_->Fill(layer, nh.size());
+	std::array<unsigned, cluster_energy_cuts.size()> nabove = {};
+	for(size_t iclust=0; iclust<nh.size(); ++iclust) {
+	  clusternhits_->Fill(layer, nh[iclust]);
+	  clusterenergy_->Fill(layer, en[iclust]);
+	  dx_->Fill(layer, dx[iclust]);
+	  dy_->Fill(layer, dy[iclust]);
+	  if(nh[iclust] > 0)
+	    posfailed2d_->Fill(layer, x[iclust] < -98.f and y[iclust] < -98.f);
+	  for(unsigned icut=0; icut<cluster_energy_cuts.size(); ++icut) {
+	    if(en[iclust] <= cluster_energy_cuts[icut])
+	      continue;
+	    ++nabove[icut];
+	    clusternhits2d_[icut]->Fill(layer, nh[iclust], en[iclust]);
+	    clusterenergy2d_[icut]->Fill(layer, en[iclust]);
+	    x2d_[icut]->Fill(layer, x[iclust], en[iclust]);
+	    y2d_[icut]->Fill(layer, y[iclust], en[iclust]);
+	    dx2d_[icut]->Fill(layer, dx[iclust]);
+	    dy2d_[icut]->Fill(layer, dy[iclust]);
+	    if(nh[iclust] < resolution_nhits)
+	      continue;
+	    xy3d_[icut]->Fill(layer, x[iclust], y[iclust], en[iclust]);
+	    if(icut == 0) {
+	      dxres2d_->Fill(layer, dx[iclust]);
+	      dyres2d_->Fill(layer, dy[iclust]);
+	      dxdy3d_->Fill(layer, dx[iclust], dy[iclust]);
+	      nhitsenergy3d_->Fill(layer, nh[iclust], en[iclust]);
+	    }
+	  }
+	}
+	for(unsigned icut=0; icut<cluster_energy_cuts.size(); ++icut)
+	  if(nabove[icut] > 0)
+	    nclusters2d_[icut]->Fill(layer, nabove[icut]);
+      }
+    }
+
+    void add(const Summary& other) {
+      for(unsigned ih=0; ih<hists_.size(); ++ih)
+	hists_[ih]->Add(other.hists_[ih].get());
+    }
+
+    void reset() {
+      for(auto& h : hists_)
+	h->Reset();
+    }
+
+    void write(TDirectory& dir) const {
+      for(const auto& h : hists_)
+	dir.WriteTObject(h.get());
+    }
+
+  private:
+    template<typename T>
+    T* _own(T *h) {
+      hists_.emplace_back(h);
+      return h;
+    }
+    TProfile* _profile(const std::string& name, const char *option = "") {
+      return _own( new TProfile(name.c_str(), (name + ";layer").c_str(), lmax_, .5, lmax_ + .5, option) );
+    }
+    TH2F* _layer2d(const std::string& name, const std::string& ytitle, const int& ny, const double& ymin, const double& ymax) {
+      return _own( new TH2F(name.c_str(), (name + ";layer;" + ytitle).c_str(), lmax_, .5, lmax_ + .5, ny, ymin, ymax) );
+    }
+    TH3F* _layer3d(const std::string& name, const std::string& ytitle, const std::string& ztitle, const int& ny, const double& ymin,
+		   const double& ymax, const int& nz, const double& zmin, const double& zmax) {
+      return _own( new TH3F(name.c_str(), (name + ";layer;" + ytitle + ";" + ztitle).c_str(), lmax_, .5, lmax_ + .5,
+			    ny, ymin, ymax, nz, zmin, zmax) );
+    }
+
+    unsigned lmax_;
+    std::vector< std::unique_ptr<TH1> > hists_;
+    TProfile *nhitsfrac_, *energyfrac_, *nhits_, *hitenergy_;
+    TH2F *nhitsfrac2d_, *energyfrac2d_, *densities2d_, *densities_seeds2d_, *densities_noseeds2d_, *distances2d_;
+    TH3F *densdist3d_, *posxy3d_;
+    TProfile *nclusters_, *clusternhits_, *clusterenergy_, *dx_, *dy_;
+    std::array<TH2F*, cluster_energy_cuts.size()> nclusters2d_, clusternhits2d_, clusterenergy2d_, x2d_, y2d_, dx2d_, dy2d_;
+    std::array<TH3F*, cluster_energy_cuts.size()> xy3d_;
+    TH2F *posfailed2d_, *dxres2d_, *dyres2d_;
+    TH3F *dxdy3d_, *nhitsenergy3d_;
+  };
+
+  //summaries filled by the chunks being processed, at most one per thread, shared by all the outputs: each chunk adds its
+  //summary to the one of its output once filled, so that the memory taken does not grow with the number of chunks
+  class SummaryPool {
+  public:
+    SummaryPool(const Analysis& analysis, const unsigned& lmax, const unsigned& size) {
+      for(unsigned i=0; i<size; ++i) {
+	summaries_.emplace_back( new Summary(analysis, lmax) );
+	free_.push_back(summaries_.back().get());
+      }
+    }
+
+    Summary* acquire() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(free_.empty())
+	throw std::runtime_error("More chunks are processed than there are summaries.");
+      Summary *s = free_.back();
+      free_.pop_back();
+      s->reset();
+      return s;
+    }
+
+    void release(Summary *s) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(s);
+    }
+
+  private:
+    std::mutex mutex_;
+    std::vector< std::unique_ptr<Summary> > summaries_;
+    std::vector<Summary*> free_;
+  };
+
+  //everything needed to merge the inputs of a job
+  struct State {
+    std::chrono::steady_clock::time_point start;
+    merging::Result result;
+    float beam_energy;
+    std::vector<std::string> files;
+    std::vector<Long64_t> first = {0}; //index of the first entry of each file in the merged tree
+    bool columnar = false;
+    int compression = 0;
+    std::vector< std::pair<Long64_t, Long64_t> > chunks;
+    std::vector<ULong64_t> offsets; //index of the first element of each chunk in the merged columns
+    std::unique_ptr<Summary> summary; //sum of the summaries of the chunks, created on the main thread
+    std::mutex summary_mutex;
+    std::unique_ptr<ROOT::Experimental::TBufferMerger> merger;
+    std::atomic<size_t> remaining{0}; //chunks not written yet
+  };
+
+  //runs 'process(reader, entry)' over the entries [begin, end) of the merged tree, opening the inputs they belong to
+  template<typename Make, typename Process>
+  void for_entries(const State& s, const std::string& tname, const Long64_t& begin, const Long64_t& end, Make&& make, Process&& process)
+  {
+    for(size_t ifile=0; ifile<s.files.size(); ++ifile) {
+      const Long64_t fbegin = std::max(begin, s.first[ifile]);
+      const Long64_t fend = std::min(end, s.first[ifile+1]);
+      if(fbegin >= fend)
+	continue;
+      std::unique_ptr<TFile> f( TFile::Open(s.files[ifile].c_str(), "READ") );
+      if(!f or f->IsZombie())
+	throw std::runtime_error("File " + s.files[ifile] + " could not be opened.");
+      TTreeReader reader(tname.c_str(), f.get());
+      auto r = make(reader);
+      reader.SetEntriesRange(fbegin - s.first[ifile], fend - s.first[ifile]);
+      Long64_t entry = fbegin;
+      while(reader.Next())
+	process(*r, entry++);
+      if(entry != fend)
+	throw std::runtime_error("The entries of " + s.files[ifile] + " could not be read.");
+    }
+  }
+
+  void fill_chunk(State& s, const size_t& ichunk, const Analysis& analysis, const unsigned& lmax, const merging::Options& opt,
+		  SummaryPool *summaries)
+  {
+    const Long64_t begin = s.chunks[ichunk].first, end = s.chunks[ichunk].second;
+    Summary *summary = summaries ? summaries->acquire() : nullptr;
+    ULong64_t offset = opt.wopt.enabled ? s.offsets[ichunk] : 0;
+    {
+      auto f = s.merger->GetFile();
+      f->cd();
+      if(analysis == Analysis::LAYERDEP) {
+	std::unique_ptr<sinks::LayerDepTree> tree;
+	std::unique_ptr<sinks::LayerDepColumns> cols;
+	if(opt.wopt.enabled)
+	  cols.reset( new sinks::LayerDepColumns(opt.tname, s.beam_energy, lmax, opt.wopt.basket_size) );
+	else
+	  tree.reset( new sinks::LayerDepTree(opt.tname, s.beam_energy, lmax) );
+	auto make = [&](TTreeReader& reader) { return std::make_unique<LayerDepReader>(reader, lmax, s.columnar); };
+	for_entries(s, opt.tname, begin, end, make, [&](LayerDepReader& r, const Long64_t& entry) {
+	    r.read();
+	    if(cols) {
+	      cols->fill(entry, offset, r.fracs, r.hitvars);
+	      offset += sinks::nelements(r.hitvars);
+	    }
+	    else
+	      tree->fill(r.fracs, r.hitvars);
+	    if(summary)
+	      summary->fill(r.fracs, r.hitvars);
+	  });
+      }
+      else {
+	std::unique_ptr<sinks::ClusterDepTree> tree;
+	std::unique_ptr<sinks::ClusterDepColumns> cols;
+	if(opt.wopt.enabled)
+	  cols.reset( new sinks::ClusterDepColumns(opt.tname, s.beam_energy, lmax, opt.wopt.basket_size) );
+	else
+	  tree.reset( new sinks::ClusterDepTree(opt.tname, s.beam_energy, lmax) );
+	auto make = [&](TTreeReader& reader) { return std::make_unique<ClusterDepReader>(reader, lmax, s.columnar); };
+	for_entries(s, opt.tname, begin, end, make, [&](ClusterDepReader& r, const Long64_t& entry) {
+	    r.read();
+	    if(cols) {
+	      cols->fill(entry, offset, r.clusters);
+	      offset += sinks::nelements(r.clusters);
+	    }
+	    else
+	      tree->fill(r.clusters);
+	    if(summary)
+	      summary->fill(r.clusters);
+	  });
+      }
+      f->Write();
+    } //the buffer is queued for merging
+    if(summary) {
+      {
+	std::lock_guard<std::mutex> lock(s.summary_mutex);
+	s.summary->add(*summary);
+      }
+      summaries->release(summary);
+    }
+
+    if(--s.remaining > 0)
+      return;
+    //last chunk of the output
+    s.merger.reset(); //returns once all the buffers are written
+    if(opt.summary) {
+      TFile out(s.result.output.c_str(), "UPDATE");
+      TDirectory *dir = out.mkdir("summary");
+      s.summary->write(*dir);
+      out.Close();
+    }
+    s.result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - s.start).count();
+  }
+
+  //copies the compressed baskets, keeping the compression of the first input
+  void fast_merge(State& s)
+  {
+    TFileMerger merger(false, false);
+    if(!merger.OutputFile(s.result.output.c_str(), "RECREATE", s.compression))
+      throw std::runtime_error("File " + s.result.output + " could not be created.");
+    for(const auto& file : s.files)
+      if(!merger.AddFile(file.c_str(), false))
+	throw std::runtime_error("File " + file + " could not be opened.");
+    if(!merger.Merge())
+      throw std::runtime_error("The inputs of " + s.result.output + " could not be merged.");
+    s.result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - s.start).count();
+  }
+}
+
+merging::Analysis merging::parse_analysis(const std::string& name)
+{
+  if(name == "layerdep")
+    return Analysis::LAYERDEP;
+  else if(name == "clusterdep")
+    return Analysis::CLUSTERDEP;
+  else
+    throw std::invalid_argument("Analysis type " + name + " is not supported.");
+}
+
+std::vector<merging::Result> merging::merge(const std::vector<Job>& jobs, const Analysis& analysis, const unsigned& lmax, const Options& opt)
+{
+  if(opt.fast and (opt.wopt.enabled or opt.summary))
+    throw std::invalid_argument("The '--fast' option copies the legacy layout as it is: '--columnar' and '--summary' are not supported.");
+  const auto start = std::chrono::steady_clock::now();
+  ROOT::EnableThreadSafety();
+  parallelism::WorkStealingPool pool(std::max(1u, opt.ncpus), opt.pin);
+
+  //the inputs are inspected concurrently, since they are usually on a remote file system
+  std::vector< std::vector<Input> > inputs(jobs.size());
+  for(size_t ij=0; ij<jobs.size(); ++ij) {
+    inputs[ij].resize(jobs[ij].inputs.size());
+    for(size_t ii=0; ii<inputs[ij].size(); ++ii) {
+      inputs[ij][ii].file = jobs[ij].inputs[ii];
+      pool.submit([&, ij, ii]() { inspect(inputs[ij][ii], opt.tname, analysis, lmax); });
+    }
+  }
+  pool.wait();
+
+  std::vector< std::unique_ptr<State> > states;
+  Long64_t total_entries = 0;
+  for(size_t ij=0; ij<jobs.size(); ++ij) {
+    states.emplace_back( new State() );
+    State& s = *states.back();
+    s.start = start;
+    s.result.output = jobs[ij].output;
+    s.beam_energy = jobs[ij].beam_energy;
+    for(const auto& in : inputs[ij]) {
+      ++s.result.ninputs;
+      if(!in.valid) {
+	std::cout << "WARNING: " << in.file << " could not be read and is skipped." << std::endl;
+	++s.result.nskipped;
+	continue;
+      }
+      if(s.files.empty()) {
+	s.columnar = in.columnar;
+	s.compression = in.compression;
+      }
+      else if(in.columnar != s.columnar)
+	throw std::invalid_argument("The inputs of " + s.result.output + " do not have the same layout.");
+      s.files.push_back(in.file);
+      s.first.push_back(s.first.back() + in.nentries);
+    }
+    s.result.nentries = s.first.back();
+    total_entries += s.first.back();
+    if(opt.fast and s.columnar)
+      throw std::invalid_argument("The columnar inputs of " + s.result.output + " are indexed again when merged: '--fast' is not supported.");
+  }
+
+  if(opt.fast) {
+    for(auto& s : states)
+      if(!s->files.empty())
+	pool.submit([&s]() { fast_merge(*s); });
+    pool.wait();
+  }
+  else {
+    //a few chunks per thread, so that the outputs are balanced across the threads
+    const Long64_t chunk_entries = std::clamp(total_entries / (4 * static_cast<Long64_t>(pool.size())), min_chunk_entries, max_chunk_entries);
+    for(auto& s : states)
+      for(Long64_t begin=0; begin<s->first.back(); begin+=chunk_entries)
+	s->chunks.emplace_back(begin, std::min(begin + chunk_entries, s->first.back()));
+
+    //index of the first element of each chunk in the merged columns, from the number of elements of the entries
+    if(opt.wopt.enabled) {
+      for(auto& s : states) {
+	s->offsets.assign(s->chunks.size() + 1, 0);
+	for(size_t ic=0; ic<s->chunks.size(); ++ic)
+	  pool.submit([&, sp = s.get(), ic]() {
+	      auto make = [&](TTreeReader& reader) { return std::make_unique<ElementCounter>(reader, analysis, lmax, sp->columnar); };
+	      ULong64_t n = 0;
+	      for_entries(*sp, opt.tname, sp->chunks[ic].first, sp->chunks[ic].second, make,
+			  [&n](ElementCounter& c, const Long64_t&) { n += c.count(); });
+	      sp->offsets[ic+1] = n;
+	    });
+      }
+      pool.wait();
+      for(auto& s : states)
+	for(size_t ic=0; ic<s->chunks.size(); ++ic)
+	  s->offsets[ic+1] += s->offsets[ic];
+    }
+
+    for(auto& sp : states) {
+      State& s = *sp;
+      if(s.chunks.empty())
+	continue;
+      if(opt.summary)
+	s.summary.reset( new Summary(analysis, lmax) );
+      s.merger.reset( new ROOT::Experimental::TBufferMerger(s.result.output.c_str(), "RECREATE", columnar::compression_settings(opt.wopt)) );
+      s.remaining = s.chunks.size();
+    }
+    //the chunks of all the outputs share the pool
+    std::unique_ptr<SummaryPool> summaries;
+    if(opt.summary)
+      summaries.reset( new SummaryPool(analysis, lmax, pool.size()) );
+    for(auto& s : states)
+      for(size_t ic=0; ic<s->chunks.size(); ++ic)
+	pool.submit([&, sp = s.get(), ic]() { fill_chunk(*sp, ic, analysis, lmax, opt, summaries.get()); });
+    pool.wait();
+  }
+
+  std::vector<Result> results;
+  for(const auto& s : states)
+    results.push_back(s->result);
+  return results;
+}
+
+void merging::fill_summary(const std::vector<Result>& results, memprof::JobSummary& summary)
+{
+  unsigned noutputs = 0, ninputs = 0, nskipped = 0;
+  unsigned long long nentries = 0;
+  for(const auto& r : results) {
+    noutputs += r.nentries > 0;
+    ninputs += r.ninputs;
+    nskipped += r.nskipped;
+    nentries += r.nentries;
+  }
+  summary.add("noutputs", noutputs);
+  summary.add("ninputs", ninputs);
+  summary.add("nskipped", nskipped);
+  summary.add("nentries", nentries);
+  double seconds = 0.;
+  for(const auto& r : results)
+    seconds = std::max(seconds, r.seconds);
+  summary.add("merge_s", seconds);
+}
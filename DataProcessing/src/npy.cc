@@ -0,0 +1,88 @@
+#include "UserCode/DataProcessing/interface/npy.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+
+namespace {
+  template<typename T> std::string descr();
+  template<> std::string descr<float>()         { return "<f4"; }
+  template<> std::string descr<double>()        { return "<f8"; }
+  template<> std::string descr<int>()           { return "<i4"; }
+  template<> std::string descr<unsigned>()      { return "<u4"; }
+  template<> std::string descr<std::uint64_t>() { return "<u8"; }
+
+  constexpr std::size_t bufsize = 1 << 20; //bytes
+}
+
+template<typename T>
+void npy::save(const std::string& filename, const std::vector<T>& data)
+{
+  static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The '.npy' writer assumes a little-endian machine.");
+
+  std::string header = "{'descr': '" + descr<T>() + "', 'fortran_order': False, 'shape': (" + std::to_string(data.size()) + ",), }";
+  //magic string (6) + version (2) + header length (2) + header, padded with spaces and ended by '\n' to a multiple of 64 bytes
+  const std::size_t preamble = 10;
+  const std::size_t total = ((preamble + header.size() + 1 + 63) / 64) * 64;
+  header.append(total - preamble - header.size() - 1, ' ');
+  header.push_back('\n');
+  const std::uint16_t header_len = static_cast<std::uint16_t>(header.size());
+
+  std::vector<char> buffer(bufsize);
+  std::ofstream f;
+  f.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+  f.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+  if(!f.is_open())
+    throw std::invalid_argument("File " + filename + " could not be opened.");
+
+  f.write("\x93NUMPY", 6);
+  const char version[2] = {1, 0};
+  f.write(version, 2);
+  const char len[2] = {static_cast<char>(header_len & 0xff), static_cast<char>(header_len >> 8)};
+  f.write(len, 2);
+  f.write(header.data(), header.size());
+  f.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
+  f.close();
+  if(f.fail())
+    throw std::runtime_error("File " + filename + " could not be written.");
+}
+
+template<typename T>
+std::vector<T> npy::load(const std::string& filename)
+{
+  std::ifstream f(filename, std::ios::in | std::ios::binary);
+  if(!f.is_open())
+    throw std::invalid_argument("File " + filename + " could not be opened.");
+  char preamble[8];
+  if(!f.read(preamble, 8) or std::string(preamble, 6) != "\x93NUMPY")
+    throw std::runtime_error("File " + filename + " is not in the NumPy format.");
+  //the header length takes 2 bytes in version 1.0 and 4 bytes in the later versions
+  unsigned char len[4] = {0, 0, 0, 0};
+  f.read(reinterpret_cast<char*>(len), preamble[6] == 1 ? 2 : 4);
+  const std::size_t header_len = len[0] | (len[1] << 8) | (len[2] << 16) | (static_cast<std::size_t>(len[3]) << 24);
+  std::string header(header_len, '\0');
+  f.read(&header[0], header_len);
+
+  const std::size_t shape = header.find("'shape': (");
+  if(header.find("'descr': '" + descr<T>() + "'") == std::string::npos or header.find("'fortran_order': False") == std::string::npos
+     or shape == std::string::npos)
+    throw std::runtime_error("File " + filename + " does not hold a one-dimensional array of the expected type.");
+  const std::size_t n = std::stoull(header.substr(shape + 10));
+
+  std::vector<T> data(n);
+  if(!f.read(reinterpret_cast<char*>(data.data()), n * sizeof(T)))
+    throw std::runtime_error("File " + filename + " could not be read.");
+  return data;
+}
+
+template void npy::save(const std::string&, const std::vector<float>&);
+template void npy::save(const std::string&, const std::vector<double>&);
+template void npy::save(const std::string&, const std::vector<int>&);
+template void npy::save(const std::string&, const std::vector<unsigned>&);
+template void npy::save(const std::string&, const std::vector<std::uint64_t>&);
+
+template std::vector<float> npy::load(const std::string&);
+template std::vector<double> npy::load(const std::string&);
+template std::vector<int> npy::load(const std::string&);
+template std::vector<unsigned> npy::load(const std::string&);
+template std::vector<std::uint64_t> npy::load(const std::string&);
@@ -0,0 +1,188 @@
+#include "UserCode/DataProcessing/interface/output_sinks.h"
+
+sinks::LayerDepTree::LayerDepTree(const std::string& name, const float& beamen, const unsigned& lmax):
+  lmax_(lmax), beamen_(beamen), fracs_hits_(lmax), fracs_en_(lmax), energies_(lmax), posx_(lmax), posy_(lmax),
+  rhos_(lmax), deltas_(lmax), seeds_(lmax), clustersizes_(lmax)
+{
+  tree_ = new TTree(name.c_str(), name.c_str()); //owned by the current directory
+  tree_->Branch("BeamEnergy", &beamen_);
+  for(unsigned int ilayer=0; ilayer<lmax_; ++ilayer)
+    {
+      std::string bname_hits     = "NhitsFrac_layer"  + std::to_string(ilayer + 1);
+      std::string bname_energy   = "EnergyFrac_layer" + std::to_string(ilayer + 1);
+      std::string bname_energies = "Energies_layer"   + std::to_string(ilayer + 1);
+      std::string bname_posx     = "PosX_layer"       + std::to_string(ilayer + 1);
+      std::string bname_posy     = "PosY_layer"       + std::to_string(ilayer + 1);
+      std::string bname_rho      = "Densities_layer"  + std::to_string(ilayer + 1);
+      std::string bname_delta    = "Distances_layer"  + std::to_string(ilayer + 1);
+      std::string bname_seeds    = "isSeed_layer"     + std::to_string(ilayer + 1);
+      std::string bname_clsize   = "ClustSize_layer"  + std::to_string(ilayer + 1);
+      tree_->Branch(bname_hits.c_str(),     &fracs_hits_[ilayer]);
+      tree_->Branch(bname_energy.c_str(),   &fracs_en_[ilayer]);
+      tree_->Branch(bname_energies.c_str(), &energies_[ilayer]);
+      tree_->Branch(bname_posx.c_str(),     &posx_[ilayer]);
+      tree_->Branch(bname_posy.c_str(),     &posy_[ilayer]);
+      tree_->Branch(bname_rho.c_str(),      &rhos_[ilayer]);
+      tree_->Branch(bname_delta.c_str(),    &deltas_[ilayer]);
+      tree_->Branch(bname_seeds.c_str(),    &seeds_[ilayer]);
+      tree_->Branch(bname_clsize.c_str(),   &clustersizes_[ilayer]);
+    }
+}
+
+void sinks::LayerDepTree::fill(const dataformats::layerfracs& fracs, const dataformats::layerhitvars& hitvars)
+{
+  for(unsigned int ilayer=0; ilayer<lmax_; ++ilayer)
+    {
+      fracs_hits_[ilayer]   = std::get<0>( fracs[ilayer] );
+      fracs_en_[ilayer]     = std::get<1>( fracs[ilayer] );
+      energies_[ilayer]     = std::get<0>( hitvars[ilayer] );
+      rhos_[ilayer]         = std::get<1>( hitvars[ilayer] );
+      deltas_[ilayer]       = std::get<2>( hitvars[ilayer] );
+      seeds_[ilayer]        = std::get<3>( hitvars[ilayer] );
+      posx_[ilayer]         = std::get<4>( hitvars[ilayer] );
+      posy_[ilayer]         = std::get<5>( hitvars[ilayer] );
+      clustersizes_[ilayer] = std::get<6>( hitvars[ilayer] );
+    }
+  tree_->Fill();
+}
+
+sinks::ClusterDepTree::ClusterDepTree(const std::string& name, const float& beamen, const unsigned& lmax):
+  lmax_(lmax), beamen_(beamen), hits_(lmax), en_(lmax), x_(lmax), y_(lmax), dx_(lmax), dy_(lmax)
+{
+  tree_ = new TTree(name.c_str(), name.c_str()); //owned by the current directory
+  tree_->Branch("BeamEnergy", &beamen_);
+  for(unsigned int ilayer=0; ilayer<lmax_; ++ilayer)
+    {
+      std::string bname_hits   = "Nhits_layer"  + std::to_string(ilayer + 1);
+      std::string bname_energy = "Energy_layer" + std::to_string(ilayer + 1);
+      std::string bname_x      = "X_layer"      + std::to_string(ilayer + 1);
+      std::string bname_y      = "Y_layer"      + std::to_string(ilayer + 1);
+      std::string bname_dx     = "dX_layer"     + std::to_string(ilayer + 1);
+      std::string bname_dy     = "dY_layer"     + std::to_string(ilayer + 1);
+      tree_->Branch(bname_hits.c_str(),   &hits_[ilayer]);
+      tree_->Branch(bname_energy.c_str(), &en_[ilayer]);
+      tree_->Branch(bname_x.c_str(),      &x_[ilayer]);
+      tree_->Branch(bname_y.c_str(),      &y_[ilayer]);
+      tree_->Branch(bname_dx.c_str(),     &dx_[ilayer]);
+      tree_->Branch(bname_dy.c_str(),     &dy_[ilayer]);
+    }
+}
+
+void sinks::ClusterDepTree::fill(const dataformats::clustervars& clusters)
+{
+  for(unsigned int ilayer=0; ilayer<lmax_; ++ilayer)
+    {
+      hits_[ilayer] = std::get<0>( clusters[ilayer] );
+      en_[ilayer]   = std::get<1>( clusters[ilayer] );
+      x_[ilayer]    = std::get<2>( clusters[ilayer] );
+      y_[ilayer]    = std::get<3>( clusters[ilayer] );
+      dx_[ilayer]   = std::get<4>( clusters[ilayer] );
+      dy_[ilayer]   = std::get<5>( clusters[ilayer] );
+    }
+  tree_->Fill();
+}
+
+sinks::LayerDepColumns::LayerDepColumns(const std::string& name, const float& beamen, const unsigned& lmax, const int& basket_size):
+  lmax_(lmax), beamen_(beamen), fracs_hits_(lmax), fracs_en_(lmax)
+{
+  tree_ = new TTree(name.c_str(), name.c_str()); //owned by the current directory
+  const std::string nl = std::to_string(lmax_);
+  tree_->Branch("BeamEnergy", &beamen_, "BeamEnergy/F", basket_size);
+  tree_->Branch("Entry",      &entry_,  "Entry/l",      basket_size);
+  tree_->Branch("Offset",     &offset_, "Offset/l",     basket_size);
+  tree_->Branch("NhitsFrac",  fracs_hits_.data(), ("NhitsFrac["  + nl + "]/F").c_str(), basket_size);
+  tree_->Branch("EnergyFrac", fracs_en_.data(),   ("EnergyFrac[" + nl + "]/F").c_str(), basket_size);
+  tree_->Branch("Nhits",      &nhits_,  "Nhits/i",      basket_size);
+  layer_.attach(*tree_,       "Layer",     "Nhits", basket_size);
+  energy_.attach(*tree_,      "Energy",    "Nhits", basket_size);
+  posx_.attach(*tree_,        "PosX",      "Nhits", basket_size);
+  posy_.attach(*tree_,        "PosY",      "Nhits", basket_size);
+  rho_.attach(*tree_,         "Density",   "Nhits", basket_size);
+  delta_.attach(*tree_,       "Distance",  "Nhits", basket_size);
+  seed_.attach(*tree_,        "isSeed",    "Nhits", basket_size);
+  clustersize_.attach(*tree_, "ClustSize", "Nhits", basket_size);
+}
+
+void sinks::LayerDepColumns::fill(const ULong64_t& entry, const ULong64_t& offset, const dataformats::layerfracs& fracs, const dataformats::layerhitvars& hitvars)
+{
+  entry_ = entry;
+  offset_ = offset;
+  layer_.clear(); energy_.clear(); posx_.clear(); posy_.clear();
+  rho_.clear(); delta_.clear(); seed_.clear(); clustersize_.clear();
+  for(unsigned ilayer=0; ilayer<lmax_; ++ilayer)
+    {
+      fracs_hits_[ilayer] = std::get<0>( fracs[ilayer] );
+      fracs_en_[ilayer]   = std::get<1>( fracs[ilayer] );
+      const auto& hv = hitvars[ilayer];
+      for(unsigned ihit=0; ihit<std::get<0>(hv).size(); ++ihit)
+	{
+	  layer_.push_back( ilayer + 1 );
+	  energy_.push_back( std::get<0>(hv)[ihit] );
+	  rho_.push_back( std::get<1>(hv)[ihit] );
+	  delta_.push_back( std::get<2>(hv)[ihit] );
+	  seed_.push_back( std::get<3>(hv)[ihit] );
+	  posx_.push_back( std::get<4>(hv)[ihit] );
+	  posy_.push_back( std::get<5>(hv)[ihit] );
+	  clustersize_.push_back( std::get<6>(hv)[ihit] );
+	}
+    }
+  nhits_ = layer_.size();
+  tree_->Fill();
+}
+
+sinks::ClusterDepColumns::ClusterDepColumns(const std::string& name, const float& beamen, const unsigned& lmax, const int& basket_size):
+  lmax_(lmax), beamen_(beamen)
+{
+  tree_ = new TTree(name.c_str(), name.c_str()); //owned by the current directory
+  tree_->Branch("BeamEnergy", &beamen_,    "BeamEnergy/F", basket_size);
+  tree_->Branch("Entry",      &entry_,     "Entry/l",      basket_size);
+  tree_->Branch("Offset",     &offset_,    "Offset/l",     basket_size);
+  tree_->Branch("Nclusters",  &nclusters_, "Nclusters/i",  basket_size);
+  layer_.attach(*tree_,  "Layer",  "Nclusters", basket_size);
+  nhits_.attach(*tree_,  "Nhits",  "Nclusters", basket_size);
+  energy_.attach(*tree_, "Energy", "Nclusters", basket_size);
+  x_.attach(*tree_,      "X",      "Nclusters", basket_size);
+  y_.attach(*tree_,      "Y",      "Nclusters", basket_size);
+  dx_.attach(*tree_,     "dX",     "Nclusters", basket_size);
+  dy_.attach(*tree_,     "dY",     "Nclusters", basket_size);
+}
+
+void sinks::ClusterDepColumns::fill(const ULong64_t& entry, const ULong64_t& offset, const dataformats::clustervars& clusters)
+{
+  entry_ = entry;
+  offset_ = offset;
+  layer_.clear(); nhits_.clear(); energy_.clear();
+  x_.clear(); y_.clear(); dx_.clear(); dy_.clear();
+  for(unsigned ilayer=0; ilayer<lmax_; ++ilayer)
+    {
+      const auto& cv = clusters[ilayer];
+      for(unsigned iclust=0; iclust<std::get<0>(cv).size(); ++iclust)
+	{
+	  layer_.push_back( ilayer + 1 );
+	  nhits_.push_back( std::get<0>(cv)[iclust] );
+	  energy_.push_back( std::get<1>(cv)[iclust] );
+	  x_.push_back( std::get<2>(cv)[iclust] );
+	  y_.push_back( std::get<3>(cv)[iclust] );
+	  dx_.push_back( std::get<4>(cv)[iclust] );
+	  dy_.push_back( std::get<5>(cv)[iclust] );
+	}
+    }
+  nclusters_ = layer_.size();
+  tree_->Fill();
+}
+
+ULong64_t sinks::nelements(const dataformats::layerhitvars& hitvars)
+{
+  ULong64_t n = 0;
+  for(const auto& hv : hitvars)
+    n += std::get<0>(hv).size();
+  return n;
+}
+
+ULong64_t sinks::nelements(const dataformats::clustervars& clusters)
+{
+  ULong64_t n = 0;
+  for(const auto& cv : clusters)
+    n += std::get<0>(cv).size();
+  return n;
+}
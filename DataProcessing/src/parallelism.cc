@@ -0,0 +1,235 @@
+#include "UserCode/DataProcessing/interface/parallelism.h"
+
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <sched.h>
+#include <pthread.h>
+
+namespace {
+  //cpus the process is allowed to run on
+  std::vector<int> affinity_cpus()
+  {
+    std::vector<int> cpus;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if(sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+      for(int i=0; i<CPU_SETSIZE; ++i) {
+	if(CPU_ISSET(i, &mask))
+	  cpus.push_back(i);
+      }
+    }
+    return cpus;
+  }
+
+  //cpu quota imposed by the cgroup (v2 first, v1 otherwise); returns 0 when no quota is defined
+  unsigned cgroup_cpus()
+  {
+    std::ifstream v2("/sys/fs/cgroup/cpu.max");
+    if(v2.is_open()) {
+      std::string quota;
+      long period = 0;
+      if(v2 >> quota >> period and quota != "max" and period > 0)
+	return std::max(1l, static_cast<long>( std::ceil( std::stol(quota) / static_cast<double>(period) ) ));
+      return 0;
+    }
+
+    std::ifstream v1_quota("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    std::ifstream v1_period("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    long quota = -1, period = 0;
+    if(v1_quota >> quota and v1_period >> period and quota > 0 and period > 0)
+      return std::max(1l, static_cast<long>( std::ceil( quota / static_cast<double>(period) ) ));
+    return 0;
+  }
+}
+
+unsigned parallelism::detect_ncpus()
+{
+  const char* condor = std::getenv("_CONDOR_NPROCS");
+  if(condor != nullptr) {
+    int n = std::atoi(condor);
+    if(n > 0)
+      return static_cast<unsigned>(n);
+  }
+
+  unsigned ncpus = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<int> cpus = affinity_cpus();
+  if(!cpus.empty())
+    ncpus = std::min(ncpus, static_cast<unsigned>(cpus.size()));
+  unsigned quota = cgroup_cpus();
+  if(quota > 0)
+    ncpus = std::min(ncpus, quota);
+  return ncpus;
+}
+
+unsigned parallelism::resolve_ncpus(std::optional<unsigned> ncpus_override)
+{
+  if(ncpus_override != std::nullopt) {
+    if(ncpus_override.value() == 0)
+      throw std::invalid_argument("The number of cpus has to be positive.");
+    return ncpus_override.value();
+  }
+  return detect_ncpus();
+}
+
+void parallelism::pin_this_thread()
+{
+  thread_local bool pinned = false;
+  if(pinned)
+    return;
+  pinned = true;
+
+  static const std::vector<int> cpus = affinity_cpus();
+  static std::atomic<unsigned> next{0};
+  if(cpus.empty())
+    return;
+
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  CPU_SET(cpus[ next.fetch_add(1) % cpus.size() ], &mask);
+  if(pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) != 0)
+    std::cout << "WARNING: parallelism::pin_this_thread(): the thread could not be pinned." << std::endl;
+}
+
+parallelism::Options parallelism::parse_args(int argc, char **argv, int first)
+{
+  Options opt;
+  for(int iarg=first; iarg<argc; ++iarg)
+    {
+      std::string arg = std::string(argv[iarg]);
+      if(arg == "--ncpus") {
+	if(iarg+1 >= argc)
+	  throw std::invalid_argument("The '--ncpus' option requires a value.");
+	opt.ncpus = static_cast<unsigned>( std::stoul(argv[++iarg]) );
+      }
+      else if(arg == "--pin")
+	opt.pin = true;
+    }
+  return opt;
+}
+
+namespace {
+  //pool and queue of the calling thread, if it is a worker
+  thread_local const parallelism::WorkStealingPool* this_pool = nullptr;
+  thread_local unsigned this_queue = 0;
+}
+
+parallelism::WorkStealingPool::WorkStealingPool(const unsigned& nworkers, const bool& pin)
+{
+  if(nworkers == 0)
+    throw std::invalid_argument("The number of workers has to be positive.");
+  for(unsigned iw=0; iw<nworkers; ++iw)
+    queues_.emplace_back( new Queue() );
+  for(unsigned iw=0; iw<nworkers; ++iw)
+    workers_.emplace_back([this, iw, pin]() {
+	if(pin)
+	  pin_this_thread();
+	this_pool = this;
+	this_queue = iw;
+	this->_run(iw);
+      });
+}
+
+parallelism::WorkStealingPool::~WorkStealingPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mut_);
+    stop_ = true;
+  }
+  work_.notify_all();
+  for(auto& w : workers_)
+    w.join();
+}
+
+void parallelism::WorkStealingPool::submit(std::function<void()> task)
+{
+  unsigned iq;
+  {
+    std::lock_guard<std::mutex> lock(mut_);
+    iq = this_pool == this ? this_queue : next_++ % queues_.size();
+    ++pending_;
+  }
+  {
+    std::lock_guard<std::mutex> lock(queues_[iq]->mut);
+    queues_[iq]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(mut_);
+    ++queued_;
+  }
+  work_.notify_one();
+}
+
+void parallelism::WorkStealingPool::wait()
+{
+  std::unique_lock<std::mutex> lock(mut_);
+  done_.wait(lock, [this]{ return pending_ == 0; });
+  if(error_ != nullptr) {
+    std::exception_ptr e = error_;
+    error_ = nullptr;
+    std::rethrow_exception(e);
+  }
+}
+
+//takes a task from the front of the worker's own queue or, if empty, steals one from the back of another queue
+bool parallelism::WorkStealingPool::_pop(const unsigned& iw, std::function<void()>& task)
+{
+  const unsigned nq = queues_.size();
+  for(unsigned k=0; k<nq; ++k)
+    {
+      Queue& q = *queues_[(iw + k) % nq];
+      std::lock_guard<std::mutex> lock(q.mut);
+      if(q.tasks.empty())
+	continue;
+      if(k == 0) {
+	task = std::move(q.tasks.front());
+	q.tasks.pop_front();
+      }
+      else {
+	task = std::move(q.tasks.back());
+	q.tasks.pop_back();
+      }
+      return true;
+    }
+  return false;
+}
+
+void parallelism::WorkStealingPool::_run(const unsigned& iw)
+{
+  while(true)
+    {
+      {
+	std::unique_lock<std::mutex> lock(mut_);
+	work_.wait(lock, [this]{ return stop_ or queued_ > 0; });
+	if(stop_ and queued_ <= 0)
+	  return;
+      }
+
+      std::function<void()> task;
+      if(!_pop(iw, task))
+	continue; //taken by another worker in the meantime
+      {
+	std::lock_guard<std::mutex> lock(mut_);
+	--queued_;
+      }
+
+      try {
+	task();
+      }
+      catch(...) {
+	std::lock_guard<std::mutex> lock(mut_);
+	if(error_ == nullptr)
+	  error_ = std::current_exception();
+      }
+
+      std::lock_guard<std::mutex> lock(mut_);
+      if(--pending_ == 0)
+	done_.notify_all();
+    }
+}
@@ -0,0 +1,311 @@
+#include "UserCode/DataProcessing/interface/reducer.h"
+#include "UserCode/DataProcessing/interface/npy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include "TF1.h"
+#include "TFitResult.h"
+#include "TH1D.h"
+
+namespace {
+  using reduction::nenergies;
+  using Parameters = std::array< std::array<double, 3>, nenergies >; //initial amplitude, mean and sigma of the fits
+
+  //binning and initial parameters of resp_res.py
+  const std::array<int, nenergies> bins_em  = {{1000, 1800, 4200, 5000, 5000, 4200, 5700, 5500, 5500, 500}};
+  const std::array<int, nenergies> bins_had = {{1000, 1000, 1000, 1000, 1000, 1000, 1000, 750, 600, 500}};
+  const Parameters pars_rechits_em = {{ {750, 20000., 2000.}, {750, 30000., 1200.}, {750, 50000., 2100.}, {750, 80000., 2500.},
+					{750, 100000., 3000.}, {750, 110000., 2800.}, {750, 150000., 3000.}, {750, 190000., 3500.},
+					{750, 245000., 4000.}, {750, 290000., 4500.} }};
+  const Parameters pars_rechits_had = {{ {750, 15000., 2000.}, {750, 24000., 1200.}, {750, 40000., 2100.}, {750, 75000., 2500.},
+					 {750, 95000., 3000.}, {750, 115000., 2800.}, {750, 150000., 3000.}, {750, 195000., 3500.},
+					 {750, 250000., 4000.}, {750, 310000., 4500.} }};
+  const Parameters pars_clusterized = {{ {750, 18000., 2000.}, {750, 25000., 1200.}, {750, 43000., 2000.}, {750, 77000., 2500.},
+					 {750, 98000., 2700.}, {750, 109000., 2750.}, {750, 140000., 3500.}, {750, 185000., 3500.},
+					 {750, 240000., 4000.}, {750, 290000., 4500.} }};
+
+  int energy_index(const float& beamen)
+  {
+    const auto it = std::find(reduction::beam_energies.begin(), reduction::beam_energies.end(), static_cast<int>(std::lround(beamen)));
+    return it == reduction::beam_energies.end() ? -1 : std::distance(reduction::beam_energies.begin(), it);
+  }
+
+  std::string read_file(const std::string& filename)
+  {
+    std::ifstream in(filename, std::ios::binary);
+    if(!in.is_open())
+      throw std::invalid_argument("File " + filename + " could not be opened.");
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+  }
+
+  //columns 'ensum<run>,beamen<run>' for each run of the file, padded with -99 to the length of the longest run
+  void parse_csv(const std::string& filename, reduction::Samples& samples)
+  {
+    const std::string text = read_file(filename);
+    const size_t header_end = text.find('\n');
+    if(header_end == std::string::npos)
+      return;
+    const unsigned ncols = std::count(text.begin(), text.begin() + header_end, ',') + 1;
+    if(ncols % 2 != 0)
+      throw std::runtime_error("The header of " + filename + " does not have pairs of columns.");
+    std::vector< std::vector<float> > ensums(ncols / 2);
+    std::vector<float> beamens(ncols / 2, -99.f);
+
+    const char *p = text.c_str() + header_end + 1;
+    const char *end = text.c_str() + text.size();
+    while(p < end) {
+      for(unsigned icol=0; icol<ncols; ++icol) {
+	char *next;
+	const float val = std::strtof(p, &next);
+	if(next == p)
+	  throw std::runtime_error("Wrong value in " + filename + ".");
+	if(icol % 2 == 0) {
+	  if(val > -1.f)
+	    ensums[icol / 2].push_back(val);
+	}
+	else if(beamens[icol / 2] < 0.f)
+	  beamens[icol / 2] = val;
+	p = next;
+	while(p < end and (*p == ',' or *p == ' ' or *p == '\r'))
+	  ++p;
+      }
+      while(p < end and *p == '\n')
+	++p;
+    }
+
+    for(unsigned irun=0; irun<ensums.size(); ++irun) {
+      const int ie = energy_index(beamens[irun]);
+      if(ie < 0) {
+	if(!ensums[irun].empty())
+	  std::cout << "WARNING: unknown beam energy " << beamens[irun] << " in " << filename << ": the column is skipped." << std::endl;
+	continue;
+      }
+      samples[ie].insert(samples[ie].end(), ensums[irun].begin(), ensums[irun].end());
+    }
+  }
+
+  void parse_npy(const std::string& filename, reduction::Samples& samples)
+  {
+    const size_t pos = filename.rfind("_ensum");
+    if(pos == std::string::npos)
+      throw std::invalid_argument("File " + filename + " is not an '_ensum' NumPy file.");
+    const std::vector<float> ensum = npy::load<float>(filename);
+    if(ensum.empty())
+      return;
+    const std::vector<float> beamen = npy::load<float>(filename.substr(0, pos) + "_beamen" + filename.substr(pos + 6));
+    const int ie = beamen.empty() ? -1 : energy_index(beamen.front());
+    if(ie < 0) {
+      std::cout << "WARNING: unknown beam energy in " << filename << ": the file is skipped." << std::endl;
+      return;
+    }
+    for(const auto& val : ensum)
+      if(val > -1.f)
+	samples[ie].push_back(val);
+  }
+
+  //same binning as numpy.histogram(range=(min, max)): the maximum falls in the last bin
+  std::unique_ptr<TH1D> histogram(const std::vector<float>& vals, const int& nbins, const std::string& name)
+  {
+    if(vals.empty())
+      return nullptr;
+    const auto minmax = std::minmax_element(vals.begin(), vals.end());
+    const double xmin = *minmax.first;
+    const double xmax = std::nextafter(static_cast<double>(*minmax.second), std::numeric_limits<double>::max());
+    std::unique_ptr<TH1D> h( new TH1D(name.c_str(), (name + ";Total RecHit energy per event [MeV];Counts").c_str(), nbins, xmin, xmax) );
+    h->SetDirectory(nullptr);
+    for(const auto& val : vals)
+      h->Fill(val);
+    return h;
+  }
+
+  //the energy sums scaled and shifted as 'scale * x + shift': the contents are the same, the axis is transformed
+  std::unique_ptr<TH1D> transform(const TH1D* h, const double& scale, const double& shift, const std::string& name)
+  {
+    if(h == nullptr)
+      return nullptr;
+    const TAxis *ax = h->GetXaxis();
+    std::unique_ptr<TH1D> t( new TH1D(name.c_str(), h->GetTitle(), ax->GetNbins(), scale * ax->GetXmin() + shift, scale * ax->GetXmax() + shift) );
+    t->SetDirectory(nullptr);
+    for(int ib=1; ib<=ax->GetNbins(); ++ib)
+      t->SetBinContent(ib, h->GetBinContent(ib));
+    t->SetEntries(h->GetEntries());
+    return t;
+  }
+
+  //first fit over the whole histogram, second fit within [mean - sigma, mean + 2.5 sigma] of the first
+  reduction::GaussianFit fit(TH1D* h, const std::array<double, 3>& p0, const std::string& label)
+  {
+    constexpr double sigma_units_left = 1., sigma_units_right = 2.5;
+    reduction::GaussianFit res;
+    if(h == nullptr or h->GetEntries() == 0) {
+      std::cout << "WARNING: Missing dataset for " << label << "." << std::endl;
+      return res;
+    }
+    const double xmin = h->GetXaxis()->GetXmin(), xmax = h->GetXaxis()->GetXmax();
+    TF1 first("first", "gaus", xmin, xmax);
+    first.SetParameters(p0[0], p0[1], p0[2]);
+    double lo = xmin, hi = xmax;
+    if(static_cast<int>(h->Fit(&first, "QSRN0")) == 0) {
+      lo = first.GetParameter(1) - sigma_units_left * std::abs(first.GetParameter(2));
+      hi = first.GetParameter(1) + sigma_units_right * std::abs(first.GetParameter(2));
+    }
+    if(h->FindFixBin(hi) - h->FindFixBin(lo) < 2) {
+      std::cout << "WARNING: There appears to be no data available for " << label << " in the second fit." << std::endl;
+      return res;
+    }
+
+    TF1 second("gaus_truncated", "gaus", lo, hi);
+    second.SetParameters(p0[0], p0[1], p0[2]);
+    if(static_cast<int>(h->Fit(&second, "QSR")) != 0) //the function is kept with the histogram
+      return res;
+    res.valid = true;
+    res.mean = second.GetParameter(1);
+    res.emean = second.GetParError(1);
+    res.sigma = std::abs(second.GetParameter(2));
+    res.esigma = second.GetParError(2);
+    return res;
+  }
+
+  //least squares line through the fitted means [GeV] as a function of the true beam energies; slope 1 and shift 1
+  //(as resp_res.py) with less than two means
+  std::pair<double, double> calibration(const std::array<reduction::GaussianFit, nenergies>& fits)
+  {
+    double n = 0., sx = 0., sy = 0., sxx = 0., sxy = 0.;
+    for(unsigned ie=0; ie<nenergies; ++ie) {
+      if(!fits[ie].valid or fits[ie].mean == 0.)
+	continue;
+      const double x = reduction::true_beam_energies[ie], y = fits[ie].mean / 1000.;
+      n += 1.; sx += x; sy += y; sxx += x * x; sxy += x * y;
+    }
+    if(n < 2.)
+      return {1., 1.};
+    double slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    const double shift = (sy - slope * sx) / n;
+    if(slope <= 0.) {
+      std::cout << "WARNING: the calibration slope is not positive!" << std::endl;
+      slope = 1.;
+    }
+    return {slope, shift};
+  }
+
+  std::array<double, 3> scaled(const std::array<double, 3>& p0, const double& slope)
+  {
+    return {{p0[0], p0[1] / slope, p0[2]}};
+  }
+}
+
+reduction::Samples reduction::read_samples(const std::vector<std::string>& files, const bool& npy, parallelism::WorkStealingPool& pool)
+{
+  Samples samples;
+  std::mutex mut;
+  for(const auto& file : files)
+    pool.submit([&, file]() {
+	Samples local; //merged once the file is parsed
+	if(npy)
+	  parse_npy(file, local);
+	else
+	  parse_csv(file, local);
+	std::lock_guard<std::mutex> lock(mut);
+	for(unsigned ie=0; ie<nenergies; ++ie)
+	  samples[ie].insert(samples[ie].end(), local[ie].begin(), local[ie].end());
+      });
+  pool.wait();
+  return samples;
+}
+
+reduction::Results reduction::reduce(const Samples& rechits, const Samples& clusterized, const std::string& showertype, TFile* histograms)
+{
+  if(showertype != "em" and showertype != "had")
+    throw std::invalid_argument("Wrong shower type.");
+  const auto& bins = showertype == "em" ? bins_em : bins_had;
+  const Parameters& pars1 = showertype == "em" ? pars_rechits_em : pars_rechits_had;
+  const Parameters& pars2 = pars_clusterized;
+
+  Results res;
+  std::array< std::unique_ptr<TH1D>, nenergies > h1, h2;
+  std::vector< std::unique_ptr<TH1D> > kept; //written at the end
+  for(unsigned ie=0; ie<nenergies; ++ie) {
+    const std::string en = std::to_string(beam_energies[ie]);
+    h1[ie] = histogram(rechits[ie], bins[ie], "rechits_beamen" + en);
+    h2[ie] = histogram(clusterized[ie], bins[ie], "clusterized_beamen" + en);
+    res.rechits[ie] = fit(h1[ie].get(), pars1[ie], en + " GeV (rechits)");
+    res.clusterized[ie] = fit(h2[ie].get(), pars2[ie], en + " GeV (clusterized)");
+  }
+  std::tie(res.slope1, res.shift1) = calibration(res.rechits);
+  std::tie(res.slope2, res.shift2) = calibration(res.clusterized);
+
+  for(unsigned ie=0; ie<nenergies; ++ie) {
+    const std::string en = std::to_string(beam_energies[ie]);
+    const double true_MeV = true_beam_energies[ie] * 1000.;
+
+    //response and resolution of the rechits, with their own calibration
+    auto h1c = transform(h1[ie].get(), 1. / res.slope1, -res.shift1, "rechits_calibrated_beamen" + en);
+    const GaussianFit f1 = fit(h1c.get(), scaled(pars1[ie], res.slope1), en + " GeV (calibrated rechits)");
+    //response of the clusterized hits with the calibration of the rechits
+    auto h2c1 = transform(h2[ie].get(), 1. / res.slope1, -res.shift1, "clusterized_calibrated1_beamen" + en);
+    const GaussianFit f2 = fit(h2c1.get(), scaled(pars2[ie], res.slope1), en + " GeV (clusterized, rechits calibration)");
+    //resolution of the clusterized hits with their own calibration
+    auto h2c2 = transform(h2[ie].get(), 1. / res.slope2, -res.shift2, "clusterized_calibrated2_beamen" + en);
+    const GaussianFit f3 = fit(h2c2.get(), scaled(pars2[ie], res.slope2), en + " GeV (clusterized, clusterized calibration)");
+
+    if(f1.valid) {
+      res.resp1[ie] = (f1.mean - true_MeV) / true_MeV;
+      res.eresp1[ie] = f1.emean / true_MeV;
+      res.res1[ie] = f1.sigma / true_MeV;
+      res.eres1[ie] = f1.esigma / true_MeV;
+    }
+    if(f2.valid) {
+      res.resp2[ie] = (f2.mean - true_MeV) / true_MeV;
+      res.eresp2[ie] = f2.emean / true_MeV;
+    }
+    if(f3.valid) {
+      res.res2[ie] = f3.sigma / true_MeV;
+      res.eres2[ie] = f3.esigma / true_MeV;
+    }
+    for(auto h : {&h1c, &h2c1, &h2c2})
+      if(*h)
+	kept.push_back( std::move(*h) );
+  }
+
+  if(histograms != nullptr) {
+    for(auto& h : h1)
+      if(h)
+	histograms->WriteTObject(h.get());
+    for(auto& h : h2)
+      if(h)
+	histograms->WriteTObject(h.get());
+    for(auto& h : kept)
+      histograms->WriteTObject(h.get());
+  }
+  return res;
+}
+
+void reduction::write_csv(const Results& res, const std::string& filename)
+{
+  std::ofstream out(filename);
+  if(!out.is_open())
+    throw std::invalid_argument("File " + filename + " could not be opened.");
+  std::cout << "SAVE: " << filename << std::endl;
+  out << "beamen,true_beamen,mean1,emean1,mean2,emean2,resp1,eresp1,res1,eres1,resp2,eresp2,res2,eres2" << std::endl;
+  out.precision(9);
+  for(unsigned ie=0; ie<nenergies; ++ie)
+    out << beam_energies[ie] << "," << true_beam_energies[ie] << ","
+	<< res.rechits[ie].mean << "," << res.rechits[ie].emean << ","
+	<< res.clusterized[ie].mean << "," << res.clusterized[ie].emean << ","
+	<< res.resp1[ie] << "," << res.eresp1[ie] << "," << res.res1[ie] << "," << res.eres1[ie] << ","
+	<< res.resp2[ie] << "," << res.eresp2[ie] << "," << res.res2[ie] << "," << res.eres2[ie] << '\n';
+  if(out.fail())
+    throw std::runtime_error("File " + filename + " could not be written.");
+}
@@ -1,9 +1,70 @@
 #include "UserCode/DataProcessing/interface/selector.h"
 #include "TCanvas.h"
+#include <atomic>
+#include <filesystem>
+#include <sstream>
+#include <unistd.h>
+
+namespace {
+  //compiled counterparts of the scalar column types found in the input ntuples (which differ between data and
+  //simulation), as spelled by RDataFrame::GetColumnType()
+  enum class ScalarType { INT, UINT, FLOAT, DOUBLE, OTHER };
+
+  ScalarType scalar_type(const std::string& type)
+  {
+    if(type == "Int_t" or type == "int")
+      return ScalarType::INT;
+    else if(type == "UInt_t" or type == "unsigned int")
+      return ScalarType::UINT;
+    else if(type == "Float_t" or type == "float")
+      return ScalarType::FLOAT;
+    else if(type == "Double_t" or type == "double")
+      return ScalarType::DOUBLE;
+    return ScalarType::OTHER;
+  }
+
+  //defines 'name' as the scalar column 'col' cast to T; unlike a string expression, nothing is compiled at runtime
+  template<typename T>
+  ROOT::RDF::RNode define_cast(ROOT::RDF::RNode node, const std::string& name, const std::string& col)
+  {
+    const std::string type = node.GetColumnType(col);
+    switch(scalar_type(type)) {
+    case ScalarType::INT:
+      return node.Define(name, [](const int& x) { return static_cast<T>(x); }, {col});
+    case ScalarType::UINT:
+      return node.Define(name, [](const unsigned& x) { return static_cast<T>(x); }, {col});
+    case ScalarType::FLOAT:
+      return node.Define(name, [](const float& x) { return static_cast<T>(x); }, {col});
+    case ScalarType::DOUBLE:
+      return node.Define(name, [](const double& x) { return static_cast<T>(x); }, {col});
+    default:
+      throw std::invalid_argument("Column " + col + " has the unsupported type " + type + ".");
+    }
+  }
+
+  //snapshot of the columns saved by the Selector with their types known at compile time: I is the type of the
+  //'event', 'run' and 'NRechits' columns, AHC the type of the AHCAL energies (had showers only)
+  template<typename I, typename... AHC>
+  auto snapshot_typed(ROOT::RDF::RNode& node, const std::string& tree, const std::string& file,
+		      const ROOT::Detail::RDF::ColumnNames_t& cols, const ROOT::RDF::RSnapshotOptions& opts)
+  {
+    return node.Snapshot<I, I, I, ULong64_t, std::vector<unsigned>, std::vector<float>, std::vector<float>, std::vector<float>,
+			 std::vector<unsigned>, std::vector<float>, AHC..., float, std::vector<float>, std::vector<float>>(tree, file, cols, opts);
+  }
+}
 
 Selector::Selector(const std::string& in_file_path, const std::string& out_file_path,
 		   const std::string& datatype_, const std::string& showertype_, const int& beam_energy_,
-		   std::optional<std::string> in_tree_name, std::optional<std::string> in_tree_name_friend, std::optional<std::string> out_tree_name)
+		   std::optional<std::string> in_tree_name, std::optional<std::string> in_tree_name_friend, std::optional<std::string> out_tree_name):
+  Selector(in_file_path, out_file_path, datatype_, showertype_, beam_energy_, load_calibration(), in_tree_name, in_tree_name_friend, out_tree_name)
+{
+}
+
+Selector::Selector(const std::string& in_file_path, const std::string& out_file_path,
+		   const std::string& datatype_, const std::string& showertype_, const int& beam_energy_,
+		   std::shared_ptr<const Calibration> calib,
+		   std::optional<std::string> in_tree_name, std::optional<std::string> in_tree_name_friend, std::optional<std::string> out_tree_name):
+  calib_(calib)
 {
   sanity_checks(in_file_path);
   this->indata_.file_path = in_file_path;
@@ -30,86 +91,109 @@ Selector::Selector(const std::string& in_file_path, const std::string& out_file_
     this->indata_.tree_name = out_tree_name.value();
 
   //establish which data columns will be saved
-  this->savedcols_ = {"event", "run", "NRechits", new_detid_, new_x_, new_y_, new_z_, new_layer_, new_en_MeV_, new_ahc_en_MeV_, "beamEnergy", new_impX_, new_impY_};
+  this->savedcols_ = {"event", "run", "NRechits", source_entry_, new_detid_, new_x_, new_y_, new_z_, new_layer_, new_en_MeV_, new_ahc_en_MeV_, "beamEnergy", new_impX_, new_impY_};
   for(unsigned i=1; i<=detectorConstants::totalnlayers; ++i) {
     impactXcols_.push_back("myFriend.impactX_HGCal_layer_" + std::to_string(i));
     impactcols_.push_back("myFriend.impactX_HGCal_layer_" + std::to_string(i));
     impactYcols_.push_back("myFriend.impactY_HGCal_layer_" + std::to_string(i));
     impactcols_.push_back("myFriend.impactY_HGCal_layer_" + std::to_string(i));
   }
-  
-
-  //load external data
-  this->load_noise_values();
-  this->load_shift_values();
 }
 
 Selector::~Selector()
 {
 }
 
-void Selector::load_noise_values()
+void Selector::set_ncpus(const unsigned& ncpus)
 {
-  std::string home( getenv("HOME") );
-  std::string rel( getenv("CMSSW_VERSION") );
-  std::string filename = home + "/" + rel + "/src/UserCode/DataProcessing/Noise_Map.txt";
-  std::ifstream in(filename);
-  if(!in.is_open())
-    throw std::invalid_argument("File " + filename + " could not be opened.");
+  this->ncpus_ = parallelism::resolve_ncpus(ncpus);
+}
 
-  std::pair<int,int> mod_chip;
-  std::pair<std::pair<int,int>, float> temp;
-  unsigned layer, mod_id, mod_pos, chip;
-  float noise;
+void Selector::set_thread_pinning(const bool& pin)
+{
+  this->pin_threads_ = pin;
+}
 
-  for(unsigned i=0; i<2; ++i) //lines to skip
-    in.ignore(std::numeric_limits<unsigned>::max(), '\n');
-  while(in >> layer >> mod_id >> mod_pos >> chip >> noise)
-    {
-      mod_chip = std::make_pair(mod_id, chip);
-      temp = std::make_pair(mod_chip, noise);
-      this->noise_map_.insert(temp);
-    }
+//the index tree is written in the output file, next to the selected hits
+void Selector::set_event_index(const bool& index)
+{
+  this->event_index_ = index;
 }
 
-void Selector::load_shift_values()
+//the shifted impact points and track variables are read from 'filename', built from the friend tree if missing or stale
+void Selector::set_impact_cache(const std::string& filename)
 {
-  std::string home( getenv("HOME") );
-  std::string rel( getenv("CMSSW_VERSION") );
-  std::string filename = home + "/" + rel + "/src/UserCode/DataProcessing/Impact_Shifts.txt";
-  std::ifstream in(filename);
-  if(!in.is_open())
-    throw std::invalid_argument("File " + filename + " could not be opened.");
+  this->impact_cache_ = filename;
+}
 
-  unsigned layer;
-  float shiftx, shifty;
-  for(unsigned i=0; i<2; ++i) //lines to skip
-    in.ignore(std::numeric_limits<unsigned>::max(), '\n');
-  for(unsigned i=0; i<detectorConstants::totalnlayers; ++i) {
-    in >> layer >> shiftx >> shifty;
-    assert(layer == i+1);
-    this->shifts_map_.emplace_back( shiftx, shifty );
-  }
+//only the input entries in [first, last) are selected (a large run is split in several jobs); the selected events
+//keep their input entry in 'source_entry'
+void Selector::set_entry_range(const ULong64_t& first, const ULong64_t& last)
+{
+  if(last <= first)
+    throw std::invalid_argument("Empty entry range: [" + std::to_string(first) + ", " + std::to_string(last) + ").");
+  this->first_entry_ = first;
+  this->last_entry_ = last;
 }
 
-bool Selector::reject_noise(const mapT& map, const unsigned& mod, const unsigned& chip, const unsigned& l, const float& amp, const bool& st)
+//event counts and memory taken by the structures kept in memory; the caller adds the resident set size
+void Selector::fill_summary(memprof::JobSummary& summary)
 {
-  float temp_noise = -1.0;
-  std::pair<unsigned, unsigned> mod_chip = std::make_pair(mod, chip);
-  mapT::const_iterator it = map.find(mod_chip);
-  if(it != map.end())
-    temp_noise = it->second;
-  else
-    throw std::out_of_range("Value NOT found for Module = " + std::to_string(mod_chip.first) + " and chip = " + std::to_string(mod_chip.second));
+  summary.add("ncpus", ncpus_);
+  summary.add("input_events", input_events());
+  summary.add("selected_events", selected_events());
+  summary.add("startup_s", startup_.seconds());
+  summary.add_bytes("mem_channel_thresholds", calib_->thresholds.size() * sizeof(float));
+  summary.add_bytes("mem_shifts_map", memprof::bytes(calib_->shifts));
+  summary.add_bytes("mem_event_index", index_bytes_);
+  summary.add("impact_cache_built", impact_cache_built_);
+  summary.add_bytes("mem_impact_cache", impact_cache_bytes_);
+}
 
-  float sigma = 3.;
-  if(st)
-    sigma = 4.;
-  
-  return amp < sigma * temp_noise;
+//the binary calibration database is mapped when available (see compile_calibration_exe), unless one of its text
+//sources was modified afterwards; the text sources are parsed otherwise
+std::shared_ptr<const Selector::Calibration> Selector::load_calibration()
+{
+  auto calib = std::make_shared<Calibration>();
+  const std::string dir = calibdb::data_dir();
+  const std::string noise_file = dir + "Noise_Map.txt", shifts_file = dir + "Impact_Shifts.txt";
+  const std::string db_file = calibdb::default_path();
+
+  std::error_code ec;
+  bool use_db = std::filesystem::exists(db_file, ec);
+  for(const auto& source : {noise_file, shifts_file}) {
+    if(use_db and std::filesystem::exists(source, ec)
+       and std::filesystem::last_write_time(source, ec) > std::filesystem::last_write_time(db_file, ec)) {
+      std::cout << "WARNING: " << source << " is newer than the calibration database " << db_file
+		<< "; the text sources are used instead." << std::endl;
+      use_db = false;
+    }
+  }
+
+  const unsigned nlayers = detectorConstants::totalnlayers;
+  if(use_db) {
+    const auto db = CalibrationDB::open(db_file);
+    calib->thresholds = db->channel_thresholds();
+    for(unsigned layer=1; layer<=nlayers; ++layer) {
+      calib->shifts.push_back( db->shift(layer) );
+      calib->weights_ce[layer-1] = db->layer_weight(layer, false);
+      calib->weights_ce[nlayers+layer-1] = db->layer_weight(layer, true);
+    }
+    calib->weights_ahc = {{db->ahc_weight(false), db->ahc_weight(true)}};
+  }
+  else {
+    calib->thresholds = ChannelThresholds(calibdb::read_noise_map(noise_file), calibdb::masked_channels);
+    calib->shifts = calibdb::read_impact_shifts(shifts_file);
+    for(unsigned layer=1; layer<=nlayers; ++layer) {
+      calib->weights_ce[layer-1] = calibdb::default_layer_weight(layer, false);
+      calib->weights_ce[nlayers+layer-1] = calibdb::default_layer_weight(layer, true);
+    }
+    calib->weights_ahc = {{calibdb::default_ahc_weight(false), calibdb::default_ahc_weight(true)}};
+  }
+  return calib;
 }
 
-bool Selector::common_selection(const unsigned& layer, const float& energy, const unsigned& chip, const unsigned& channel, const unsigned& module, const float& amplitude, const bool& noise_flag, const mapT& map, const bool& showertype)
+bool Selector::common_selection(const unsigned& layer, const float& energy, const unsigned& chip, const unsigned& channel, const unsigned& module, const float& amplitude, const bool& noise_flag, const ChannelThresholds& thresholds, const bool& showertype)
 {
   if(layer<1 || layer>detectorConstants::totalnlayers)
     throw std::out_of_range("Unphysical layer number: " + std::to_string(layer));
@@ -121,49 +205,51 @@ bool Selector::common_selection(const unsigned& layer, const float& energy, cons
 
   if(energy<=0.5) //MIP noise cut
     return false;
-  if( (chip==0 and layer==1) or (chip==0 and channel==44) or (chip==3 and channel==22) or (chip==3 and channel==28) ) //mask noisy chips
-    return false;
-  if( chip==1 and layer==36 and channel==16 and module==39 )
+  if( (chip==0 and layer==1) or (chip==1 and layer==36 and channel==16 and module==39) ) //mask noisy chips (layer-dependent)
     return false;
 
-  if( reject_noise(map, module, chip, layer, amplitude, showertype) )
-    return false;
-    
-  return true;
+  //noise rejection; the channels masked in all modules have an infinite threshold, whatever the module
+  const float threshold = thresholds.threshold(module, chip, channel, showertype);
+  if(std::isnan(threshold))
+    throw std::out_of_range("Value NOT found for Module = " + std::to_string(module) + " and chip = " + std::to_string(chip));
+  return !(amplitude < threshold);
 }
 
-//cleans hits in CE-E and CE-H
-template<typename T>
-std::vector<T> Selector::clean_ce(const std::vector<T>& var, const std::vector<float>& en, const std::vector<unsigned>& l, const std::vector<unsigned>& chip, const std::vector<unsigned>& channel, const std::vector<unsigned>& module, const std::vector<float>& amplitude, const std::vector<bool>& noise_flag, const mapT& map, const bool& st)
+//indices of the CE-E and CE-H hits passing the cleaning, computed once per event and shared by all cleaned columns
+std::vector<unsigned> Selector::clean_ce_indices(const std::vector<float>& en, const std::vector<unsigned>& l, const std::vector<unsigned>& chip, const std::vector<unsigned>& channel, const std::vector<unsigned>& module, const std::vector<float>& amplitude, const std::vector<bool>& noise_flag, const ChannelThresholds& thresholds, const bool& st)
 {
   size_t nhits = en.size();
-  std::vector<T> var_clean;
-  var_clean.reserve(nhits);
+  std::vector<unsigned> indices;
+  indices.reserve(nhits);
 
   for(unsigned i=0; i<nhits; ++i) {
-    if( common_selection(l[i], en[i], chip[i], channel[i], module[i], amplitude[i], noise_flag[i], map, st) )
-      var_clean.push_back( var[i] );
+    if( common_selection(l[i], en[i], chip[i], channel[i], module[i], amplitude[i], noise_flag[i], thresholds, st) )
+      indices.push_back(i);
   }
-  return var_clean;  
+  return indices;
 }
 
-//cleans hits in AHCAL
-template<typename T>
-std::vector<T> Selector::clean_ahc(const std::vector<T>& var, const std::vector<float>& en, const std::vector<int>& l, const bool& st)
+//indices of the AHCAL hits passing the cleaning
+std::vector<unsigned> Selector::clean_ahc_indices(const std::vector<int>& l, const bool& st)
 {
-  size_t nhits = var.size();
-  std::vector<T> var_clean;
-  var_clean.reserve(nhits);
+  size_t nhits = l.size();
+  std::vector<unsigned> indices;
+  indices.reserve(nhits);
 
-  if(st)
-    {
-      for(unsigned i=0; i<nhits; ++i) {
-	if(l[i] != 38) //mask AHCAL layer #38
-	  var_clean.push_back(var[i]);
-      }
-    }
-  else //no change for em showers
-    return var;
+  for(unsigned i=0; i<nhits; ++i) {
+    if(!st or l[i] != 38) //mask AHCAL layer #38; no change for em showers
+      indices.push_back(i);
+  }
+  return indices;
+}
+
+//keeps the elements of 'var' at the given indices
+template<typename T>
+std::vector<T> Selector::gather(const std::vector<T>& var, const std::vector<unsigned>& indices)
+{
+  std::vector<T> var_clean(indices.size());
+  for(unsigned i=0; i<indices.size(); ++i)
+    var_clean[i] = var[ indices[i] ];
   return var_clean;
 }
 
@@ -173,7 +259,7 @@ float Selector::ahc_energy_sum(const std::vector<float>& ahc_en)
 }
 
 //weights the energy of the CE-E and CE-H hits
-std::vector<float> Selector::weight_energy_ce(const std::vector<float>& en, const std::vector<unsigned>& l, const bool& st) 
+std::vector<float> Selector::weight_energy_ce(const std::vector<float>& en, const std::vector<unsigned>& l, const Calibration& calib, const bool& st) 
 {
   unsigned layer = 0;
   float energy = 0.f;
@@ -189,12 +275,7 @@ std::vector<float> Selector::weight_energy_ce(const std::vector<float>& en, cons
 
       if( (!st and layer>0 and layer<=detectorConstants::nlayers_emshowers)
 	  or (st and layer>0 and layer<=detectorConstants::totalnlayers) )
-	{
-	  if(st and layer>detectorConstants::nlayers_emshowers)
-	    weight = detectorConstants::globalWeightCEH;
-	  else
-	    weight = detectorConstants::dEdX.at(layer-1);
-	}
+	weight = calib.weights_ce[ st * detectorConstants::totalnlayers + layer - 1 ];
       else
 	continue;
 
@@ -204,16 +285,13 @@ std::vector<float> Selector::weight_energy_ce(const std::vector<float>& en, cons
 }
 
 //weights the energy of the AHCAL hits
-std::vector<float> Selector::weight_energy_ahc(const std::vector<float>& en, const bool& st) 
+std::vector<float> Selector::weight_energy_ahc(const std::vector<float>& en, const Calibration& calib, const bool& st) 
 {
-  float weight = detectorConstants::globalWeightCEH * detectorConstants::globalWeightRelative;
+  const float weight = calib.weights_ahc[st]; //zero for em showers
   size_t nhits = en.size();
   std::vector<float> en_weighted;
   en_weighted.reserve(nhits); //maximum possible size
 
-  if(!st)
-    weight = 0.f;
-
   for(unsigned i=0; i<nhits; ++i)
     en_weighted.push_back( weight * en[i] );
       
@@ -228,88 +306,401 @@ bool Selector::remove_missing_dwc(const std::vector<float>& v)
   }
   return true;
 }
+
+//impact point in the detector frame
+float Selector::shift_impact(const float& impact, const float& shift)
+{
+  return (-1.f * impact) + shift;
+}
+
+//identifies the input and the shifts the impact point cache was built from; stored as the title of the cache tree
+std::string Selector::impact_cache_key() const
+{
+  std::ostringstream ss;
+  ss.precision(9);
+  ss << this->indata_.file_path << " " << this->indata_.tree_name_friend;
+  for(const auto& shift : calib_->shifts)
+    ss << " " << shift.first << " " << shift.second;
+  return std::to_string( checkpoint::hash(ss.str()) );
+}
+
+//the cache exists and was built from the same input and shifts
+bool Selector::impact_cache_valid(const Long64_t& nentries) const
+{
+  if(!std::filesystem::exists(this->impact_cache_))
+    return false;
+  TFile file(this->impact_cache_.c_str());
+  if(file.IsZombie())
+    return false;
+  TTree *tree = nullptr;
+  file.GetObject(this->outdata_.impact_cache_tree_name.c_str(), tree);
+  return tree != nullptr and tree->GetEntries() == nentries and impact_cache_key() == tree->GetTitle();
+}
+
+//reads the 2*totalnlayers impact point branches of the friend tree once and writes the shifted impact points as two
+//arrays, aligned entry by entry with the hits tree; the file is written under a temporary name and then renamed, so
+//that the jobs of the same run never read a partial cache
+void Selector::build_impact_cache(const Long64_t& nentries)
+{
+  constexpr unsigned nlayers = detectorConstants::totalnlayers;
+  struct CacheRow {
+    std::array<Float_t, nlayers> x, y;
+    Bool_t valid;
+    Int_t dwc_type;
+    Float_t chi2x, chi2y;
+  };
+  std::vector<CacheRow> rows(nentries);
+  impact_cache_bytes_ = rows.capacity() * sizeof(CacheRow);
+
+  ROOT::Detail::RDF::ColumnNames_t cols; //same order as 'impactcols_'
+  for(unsigned i=1; i<=nlayers; ++i) {
+    cols.push_back("impactX_HGCal_layer_" + std::to_string(i));
+    cols.push_back("impactY_HGCal_layer_" + std::to_string(i));
+  }
+  ROOT::RDataFrame d(this->indata_.tree_name_friend, this->indata_.file_path);
+  ROOT::RDF::RNode node = d;
+  node = define_cast<Int_t>(node, "cache_dwc_type", "dwcReferenceType");
+  node = define_cast<Float_t>(node, "cache_chi2x", "trackChi2_X");
+  node = define_cast<Float_t>(node, "cache_chi2y", "trackChi2_Y");
+  node = node.Define("cache_impact", ROOT::RDF::PassAsVec<2*nlayers, float>([](const std::vector<float>& v) { return v; }), cols);
+
+  //for a single tree, 'rdfentry_' is the entry number also when running in parallel
+  std::atomic<Long64_t> nfilled(0);
+  auto fill = [this, &rows, &nfilled, nentries](ULong64_t entry, const std::vector<float>& impact, Int_t dwc_type, Float_t chi2x, Float_t chi2y) {
+    if(entry >= static_cast<ULong64_t>(nentries))
+      throw std::out_of_range("The " + this->indata_.tree_name_friend + " tree has more entries than the hits tree.");
+    CacheRow& row = rows[entry];
+    row.valid = remove_missing_dwc(impact);
+    for(unsigned i=0; i<nlayers; ++i) {
+      row.x[i] = shift_impact(impact[2*i], this->calib_->shifts[i].first);
+      row.y[i] = shift_impact(impact[2*i+1], this->calib_->shifts[i].second);
+    }
+    row.dwc_type = dwc_type;
+    row.chi2x = chi2x;
+    row.chi2y = chi2y;
+    ++nfilled;
+  };
+  node.Foreach(fill, {"rdfentry_", "cache_impact", "cache_dwc_type", "cache_chi2x", "cache_chi2y"});
+  if(nfilled != nentries)
+    throw std::runtime_error("The " + this->indata_.tree_name_friend + " tree is not aligned with the hits tree.");
+
+  const std::string tmp = this->impact_cache_ + ".tmp" + std::to_string(getpid());
+  TFile file(tmp.c_str(), "RECREATE");
+  TTree tree(this->outdata_.impact_cache_tree_name.c_str(), impact_cache_key().c_str());
+  CacheRow row;
+  const std::string nl = std::to_string(nlayers);
+  tree.Branch(cache_impX_.c_str(),  row.x.data(),   (cache_impX_ + "[" + nl + "]/F").c_str());
+  tree.Branch(cache_impY_.c_str(),  row.y.data(),   (cache_impY_ + "[" + nl + "]/F").c_str());
+  tree.Branch(cache_valid_.c_str(), &row.valid,     (cache_valid_ + "/O").c_str());
+  tree.Branch("dwcReferenceType",   &row.dwc_type,  "dwcReferenceType/I");
+  tree.Branch("trackChi2_X",        &row.chi2x,     "trackChi2_X/F");
+  tree.Branch("trackChi2_Y",        &row.chi2y,     "trackChi2_Y/F");
+  for(const auto& r : rows) {
+    row = r;
+    tree.Fill();
+  }
+  tree.Write("", TObject::kOverwrite);
+  file.Close();
+  if(std::rename(tmp.c_str(), this->impact_cache_.c_str()) != 0)
+    throw std::runtime_error("The impact point cache " + this->impact_cache_ + " could not be written.");
+  impact_cache_built_ = true;
+  std::cout << "Selector: impact point cache written to " << this->impact_cache_ << "." << std::endl;
+}
     
-void Selector::select_relevant_branches()
+//builds the selection of the input events and returns the node with the selected columns; 'snapshot' books a lazy
+//snapshot of the selected events, written by the first event loop run on the returned node
+ROOT::RDF::RNode Selector::selection(const bool& snapshot)
 {
-  ROOT::RDataFrame *d;
-  TFile *f_had = nullptr;
   TTree *t_had1 = nullptr;
   TTree *t_had2 = nullptr;
 
-  f_had = new TFile(this->indata_.file_path.c_str());
-  t_had1 = static_cast<TTree*>( f_had->Get(this->indata_.tree_name.c_str()) ); 
-  t_had2 = static_cast<TTree*>( f_had->Get(this->indata_.tree_name_friend.c_str()) ); 
-  t_had1->AddFriend(t_had2, "myFriend");
-  d = new ROOT::RDataFrame(*t_had1);
+  //enable parallelism; must happen before the RDataFrame is created, otherwise it runs with one slot only
+  //the Selectors of a batch of runs share the pool, enabled once
+  if(!ROOT::IsImplicitMTEnabled())
+    ROOT::EnableImplicitMT( ncpus_ );
+  std::cout << "Selector: running with " << ncpus_ << " cpus." << std::endl;
+
+  in_file_.reset( new TFile(this->indata_.file_path.c_str()) );
+  t_had1 = static_cast<TTree*>( in_file_->Get(this->indata_.tree_name.c_str()) ); 
+  if(this->impact_cache_.empty()) {
+    t_had2 = static_cast<TTree*>( in_file_->Get(this->indata_.tree_name_friend.c_str()) ); 
+    t_had1->AddFriend(t_had2, "myFriend");
+  }
+  else { //the cache replaces the friend tree; built by the first selection of the run
+    if(!impact_cache_valid(t_had1->GetEntries()))
+      build_impact_cache(t_had1->GetEntries());
+    t_had1->AddFriend(("myFriend=" + this->outdata_.impact_cache_tree_name).c_str(), this->impact_cache_.c_str());
+  }
+  df_.reset( new ROOT::RDataFrame(*t_had1) );
 
-  ROOT::EnableImplicitMT( ncpus_ ); //enable parallelism
   ROOT::Detail::RDF::ColumnNames_t clean_cols = {"rechit_energy", "rechit_layer", "rechit_chip", "rechit_channel", "rechit_module", "rechit_amplitudeHigh", "rechit_noise_flag", "st"};
-  ROOT::Detail::RDF::ColumnNames_t clean_cols_detid = clean_cols; clean_cols_detid.insert( clean_cols_detid.begin(), "rechit_detid");
-  ROOT::Detail::RDF::ColumnNames_t clean_cols_x = clean_cols; clean_cols_x.insert( clean_cols_x.begin(), "rechit_x");
-  ROOT::Detail::RDF::ColumnNames_t clean_cols_y = clean_cols; clean_cols_y.insert( clean_cols_y.begin(), "rechit_y");
-  ROOT::Detail::RDF::ColumnNames_t clean_cols_z = clean_cols; clean_cols_z.insert( clean_cols_z.begin(), "rechit_z");
-  ROOT::Detail::RDF::ColumnNames_t clean_cols_layer = clean_cols; clean_cols_layer.insert( clean_cols_layer.begin(), "rechit_layer");
-  ROOT::Detail::RDF::ColumnNames_t clean_cols_en = clean_cols; clean_cols_en.insert( clean_cols_en.begin(), "rechit_energy");
   
-  //wrappers required to circumvent the static-ness of the wrapped methods (required by RDataFrame) while passing a class variable (this->noise_map_)
-  auto wrapper_float = [this](const std::vector<float>& var, const std::vector<float>& en, const std::vector<unsigned>& l, const std::vector<unsigned>& chip, const std::vector<unsigned>& channel, const std::vector<unsigned>& module, const std::vector<float>& amplitude, const std::vector<bool>& noise_flag, const bool& st)
-			{
-			  std::vector<float> v = clean_ce<float>(var, en, l, chip, channel, module, amplitude, noise_flag, this->noise_map_, st);
-			  return v;
-			};
-  auto wrapper_uint = [this](const std::vector<unsigned>& var, const std::vector<float>& en, const std::vector<unsigned>& l, const std::vector<unsigned>& chip, const std::vector<unsigned>& channel, const std::vector<unsigned>& module, const std::vector<float>& amplitude, const std::vector<bool>& noise_flag, const bool& st)
-			{
-			  std::vector<unsigned> v = clean_ce<unsigned>(var, en, l, chip, channel, module, amplitude, noise_flag, this->noise_map_, st);
-			  return v;
-			};
+  //wrapper required to circumvent the static-ness of the wrapped method (required by RDataFrame) while passing a class variable (this->calib_)
+  auto wrapper_indices = [this](const std::vector<float>& en, const std::vector<unsigned>& l, const std::vector<unsigned>& chip, const std::vector<unsigned>& channel, const std::vector<unsigned>& module, const std::vector<float>& amplitude, const std::vector<bool>& noise_flag, const bool& st)
+			 {
+			   return clean_ce_indices(en, l, chip, channel, module, amplitude, noise_flag, this->calib_->thresholds, st);
+			 };
 
   auto shift_impactX = [this](const std::vector<float>& v) {
     std::vector<float> newv(v.size());
     for(unsigned i=0; i<v.size(); ++i)
-      newv[i] = (-1.f * v[i]) + this->shifts_map_[i].first;
+      newv[i] = shift_impact(v[i], this->calib_->shifts[i].first);
     return newv;
   };
 
   auto shift_impactY = [this](const std::vector<float>& v) {
     std::vector<float> newv(v.size());
     for(unsigned i=0; i<v.size(); ++i)
-      newv[i] = (-1.f * v[i]) + this->shifts_map_[i].second;
+      newv[i] = shift_impact(v[i], this->calib_->shifts[i].second);
     return newv;
   };
 
-  std::string filter_str = "true", define_str = "return false;";
-  if(this->showertype == SHOWERTYPE::HAD) {
-    filter_str = "myFriend.dwcReferenceType>=13 && myFriend.trackChi2_X<10 && myFriend.trackChi2_Y<10";
-    define_str = "return true;";
+  //the casts make the column types independent of the ntuple (data or simulation); used by the selection and the index
+  //the other columns are not read for the entries outside the range
+  ROOT::RDF::RNode input = *df_;
+  if(last_entry_ > first_entry_) {
+    const ULong64_t first = first_entry_, last = last_entry_;
+    input = input.Filter([first, last](ULong64_t entry) { return entry >= first and entry < last; }, {"rdfentry_"});
+  }
+  ROOT::RDF::RNode dcast = input;
+  dcast = define_cast<UInt_t>(dcast, "index_run", "run");
+  dcast = define_cast<UInt_t>(dcast, "index_event", "event");
+  dcast = define_cast<UInt_t>(dcast, "index_nrechits", "NRechits");
+  dcast = define_cast<Float_t>(dcast, "index_beamen", "beamEnergy");
+  dcast = define_cast<Int_t>(dcast, "index_dwc_type", "myFriend.dwcReferenceType");
+  dcast = define_cast<Float_t>(dcast, "index_chi2x", "myFriend.trackChi2_X");
+  dcast = define_cast<Float_t>(dcast, "index_chi2y", "myFriend.trackChi2_Y");
+
+  //records when the first entry is processed (startup time) and pins each worker thread to a core
+  const bool pin = this->pin_threads_;
+  auto first_entry = [this, pin]() {
+    this->startup_.mark();
+    if(pin)
+      parallelism::pin_this_thread();
+    return true;
+  };
+
+  ROOT::RDF::RNode partial_process = dcast.Filter(first_entry, {});
+  const bool st = this->showertype == SHOWERTYPE::HAD;
+  if(st)
+    partial_process = partial_process.Filter([](const Int_t& dwc_type, const Float_t& chi2x, const Float_t& chi2y) {
+	return dwc_type>=13 and chi2x<10 and chi2y<10;
+      }, {"index_dwc_type", "index_chi2x", "index_chi2y"});
+
+  if(this->impact_cache_.empty())
+    partial_process = partial_process
+      .Filter(ROOT::RDF::PassAsVec<static_cast<unsigned>(2*detectorConstants::totalnlayers), float>(remove_missing_dwc),
+	      impactcols_)
+      .Define(new_impX_, ROOT::RDF::PassAsVec<static_cast<unsigned>(detectorConstants::totalnlayers), float>(shift_impactX), impactXcols_)
+      .Define(new_impY_, ROOT::RDF::PassAsVec<static_cast<unsigned>(detectorConstants::totalnlayers), float>(shift_impactY), impactYcols_);
+  else {
+    auto to_vector = [](const ROOT::VecOps::RVec<float>& v) { return std::vector<float>(v.begin(), v.end()); };
+    partial_process = partial_process
+      .Filter([](const bool& valid) { return valid; }, {"myFriend." + cache_valid_})
+      .Define(new_impX_, to_vector, {"myFriend." + cache_impX_})
+      .Define(new_impY_, to_vector, {"myFriend." + cache_impY_});
   }
 
-  auto partial_process = d->Filter(filter_str.c_str())
-    .Filter(ROOT::RDF::PassAsVec<static_cast<unsigned>(2*detectorConstants::totalnlayers), float>(remove_missing_dwc),
-	    impactcols_)
-    .Define(new_impX_, ROOT::RDF::PassAsVec<static_cast<unsigned>(detectorConstants::totalnlayers), float>(shift_impactX), impactXcols_)
-    .Define(new_impY_, ROOT::RDF::PassAsVec<static_cast<unsigned>(detectorConstants::totalnlayers), float>(shift_impactY), impactYcols_)
-    .Define(clean_cols.back(), define_str) //showertype: em or had
-    .Define(new_detid_,   wrapper_uint,  clean_cols_detid)
-    .Define(new_x_,       wrapper_float, clean_cols_x)
-    .Define(new_y_,       wrapper_float, clean_cols_y)
-    .Define(new_z_,       wrapper_float, clean_cols_z)
-    .Define(new_layer_,   wrapper_uint,  clean_cols_layer)
-    .Define(new_en_,      wrapper_float, clean_cols_en)
-    .Define(new_en_MeV_, weight_energy_ce, {new_en_, new_layer_, clean_cols.back()});
+  partial_process = partial_process
+    .Define(clean_cols.back(), [st]() { return st; }, {}) //showertype: em or had
+    .Define(new_indices_, wrapper_indices, clean_cols) //the cleaning runs once per event
+    .Define(new_detid_,   gather<unsigned>, {"rechit_detid",  new_indices_})
+    .Define(new_x_,       gather<float>,    {"rechit_x",      new_indices_})
+    .Define(new_y_,       gather<float>,    {"rechit_y",      new_indices_})
+    .Define(new_z_,       gather<float>,    {"rechit_z",      new_indices_})
+    .Define(new_layer_,   gather<unsigned>, {"rechit_layer",  new_indices_})
+    .Define(new_en_,      gather<float>,    {"rechit_energy", new_indices_})
+    .Define(new_en_MeV_, [this](const std::vector<float>& en, const std::vector<unsigned>& l, const bool& st) {
+	return weight_energy_ce(en, l, *this->calib_, st);
+      }, {new_en_, new_layer_, clean_cols.back()});
 
   if(this->showertype == SHOWERTYPE::HAD) {
-    partial_process = partial_process.Define(new_ahc_en_,  clean_ahc<float>, {"ahc_hitEnergy", "ahc_hitEnergy", "ahc_hitK", clean_cols.back()})
-    .Define(new_ahc_en_MeV_, weight_energy_ahc, {new_ahc_en_, clean_cols.back()});
+    partial_process = partial_process.Define(new_ahc_indices_, clean_ahc_indices, {"ahc_hitK", clean_cols.back()})
+    .Define(new_ahc_en_, gather<float>, {"ahc_hitEnergy", new_ahc_indices_})
+    .Define(new_ahc_en_MeV_, [this](const std::vector<float>& en, const bool& st) {
+	return weight_energy_ahc(en, *this->calib_, st);
+      }, {new_ahc_en_, clean_cols.back()});
   }
     
-  if(this->datatype == DATATYPE::MC and this->showertype == SHOWERTYPE::HAD) {
-    partial_process.Filter("ahc_energySum == 0").Snapshot(this->outdata_.tree_name.c_str(), this->outdata_.file_path.c_str(), savedcols_);
+  partial_process = partial_process.Define(source_entry_, [](ULong64_t entry) { return entry; }, {"rdfentry_"});
+
+  ROOT::RDF::RNode selected = partial_process;
+  if(this->datatype == DATATYPE::MC and this->showertype == SHOWERTYPE::HAD)
+    selected = define_cast<double>(partial_process, "ahc_energy_sum_in", "ahc_energySum")
+      .Filter([](const double& en) { return en == 0; }, {"ahc_energy_sum_in"});
+  else if(this->showertype == SHOWERTYPE::EM)
+    savedcols_.erase(std::remove(savedcols_.begin(), savedcols_.end(), new_ahc_en_MeV_), savedcols_.end()); //erase-remove idiom
+
+  //event counts reported in the job summary, filled by the same event loop as the snapshot
+  count_in_ = input.Count();
+  count_out_ = selected.Count();
+
+  if(snapshot) {
+    ROOT::RDF::RSnapshotOptions opts;
+    opts.fLazy = true;
+    snapshot_ = _snapshot(selected, opts);
+  }
+  return selected;
+}
+
+//the snapshot is compiled for the column types of the data and simulation ntuples; other types are jitted
+Selector::SnapshotResult Selector::_snapshot(ROOT::RDF::RNode& selected, const ROOT::RDF::RSnapshotOptions& opts)
+{
+  const std::string& tree = this->outdata_.tree_name;
+  const std::string& file = this->outdata_.file_path;
+  const ScalarType itype = scalar_type(selected.GetColumnType("event"));
+  const bool known = (itype == ScalarType::INT or itype == ScalarType::UINT)
+    and scalar_type(selected.GetColumnType("run")) == itype
+    and scalar_type(selected.GetColumnType("NRechits")) == itype
+    and scalar_type(selected.GetColumnType("beamEnergy")) == ScalarType::FLOAT;
+  const bool had = this->showertype == SHOWERTYPE::HAD;
+  if(known and itype == ScalarType::INT)
+    return had ? snapshot_typed<int, std::vector<float>>(selected, tree, file, savedcols_, opts) : snapshot_typed<int>(selected, tree, file, savedcols_, opts);
+  else if(known)
+    return had ? snapshot_typed<unsigned, std::vector<float>>(selected, tree, file, savedcols_, opts) : snapshot_typed<unsigned>(selected, tree, file, savedcols_, opts);
+  std::cout << "Selector: unexpected column types, the snapshot is compiled at runtime." << std::endl;
+  return selected.Snapshot(tree, file, savedcols_, opts);
+}
+
+ULong64_t Selector::input_events()
+{
+  return count_in_ ? *count_in_ : 0;
+}
+
+ULong64_t Selector::selected_events()
+{
+  return count_out_ ? *count_out_ : 0;
+}
+
+//identifies the events returned by selection() (e.g. in the checkpoints of the fused mode): the input tree and its
+//number of entries, and the parameters of the selection
+std::string Selector::source_id() const
+{
+  TFile file(this->indata_.file_path.c_str(), "READ");
+  TTree *tree = nullptr;
+  if(!file.IsZombie())
+    file.GetObject(this->indata_.tree_name.c_str(), tree);
+  if(tree == nullptr)
+    throw std::runtime_error("The tree " + this->indata_.tree_name + " is missing in " + this->indata_.file_path + ".");
+  std::ostringstream ss;
+  ss << this->indata_.file_path << " " << this->indata_.tree_name << " " << tree->GetEntries()
+     << " " << static_cast<int>(this->datatype) << " " << static_cast<int>(this->showertype) << " " << this->beam_energy
+     << " " << this->first_entry_ << " " << this->last_entry_;
+  return ss.str();
+}
+
+//seconds from the creation of the Selector to the first event processed; negative if no event loop ran
+double Selector::startup_seconds() const
+{
+  return startup_.seconds();
+}
+
+void Selector::select_relevant_branches()
+{
+  //the index is collected in the same event loop as the snapshot, which is therefore lazy
+  ROOT::RDF::RNode selected = selection(true);
+
+  if(!this->event_index_) {
+    snapshot_.GetValue(); //runs the event loop
+    std::cout << "Selector: first event processed after " << startup_.seconds() << " s." << std::endl;
+    return;
+  }
+
+  if(this->showertype == SHOWERTYPE::HAD)
+    selected = selected.Define("index_ahc_energy", ahc_energy_sum, {new_ahc_en_MeV_});
+  else
+    selected = selected.Define("index_ahc_energy", []() { return 0.f; }, {});
+
+  const unsigned nslots = std::max(1u, ROOT::GetImplicitMTPoolSize());
+  std::vector< std::vector<IndexRow> > rows(nslots);
+  auto collect = [&rows](unsigned slot, ULong64_t entry, UInt_t run, UInt_t event, UInt_t nrechits, Float_t beamen,
+			 Int_t dwc_type, Float_t chi2x, Float_t chi2y, Float_t ahc_energy,
+			 const std::vector<unsigned>& layer, const std::vector<float>& en) {
+    IndexRow row;
+    row.source_entry = entry;
+    row.run = run;
+    row.event = event;
+    row.nrechits = nrechits;
+    row.beamen = beamen;
+    row.dwc_type = dwc_type;
+    row.chi2x = chi2x;
+    row.chi2y = chi2y;
+    row.ahc_energy = ahc_energy;
+    row.nhits = layer.size();
+    row.energy = 0.f;
+    row.nhits_layer.fill(0);
+    row.energy_layer.fill(0.f);
+    for(unsigned i=0; i<en.size(); ++i) { //the weighted energies only include hits in the valid layers
+      row.nhits_layer[ layer[i]-1 ] += 1;
+      row.energy_layer[ layer[i]-1 ] += en[i];
+      row.energy += en[i];
+    }
+    rows[slot].push_back(row);
+  };
+  selected.ForeachSlot(collect, {source_entry_, "index_run", "index_event", "index_nrechits", "index_beamen",
+	"index_dwc_type", "index_chi2x", "index_chi2y", "index_ahc_energy", new_layer_, new_en_MeV_});
+  snapshot_.GetValue(); //already written by the event loop above
+  std::cout << "Selector: first event processed after " << startup_.seconds() << " s." << std::endl;
+  write_event_index(rows);
+}
+
+//writes the index tree with the entry of each event in the output tree, in the same order
+void Selector::write_event_index(std::vector< std::vector<IndexRow> >& rows)
+{
+  std::vector<IndexRow> index;
+  for(auto& v : rows) {
+    index.insert(index.end(), v.begin(), v.end());
+    v.clear();
+  }
+
+  //the snapshot written in parallel does not preserve the input order: map the input entries to the output ones
+  ROOT::RDataFrame dout(this->outdata_.tree_name.c_str(), this->outdata_.file_path.c_str());
+  const unsigned nslots = std::max(1u, ROOT::GetImplicitMTPoolSize());
+  std::vector< std::vector< std::pair<ULong64_t, ULong64_t> > > entries_split(nslots); //(input, output) entries
+  dout.ForeachSlot([&entries_split](unsigned slot, ULong64_t source, ULong64_t entry) {
+      entries_split[slot].emplace_back(source, entry);
+    }, {source_entry_, "rdfentry_"});
+  std::vector< std::pair<ULong64_t, ULong64_t> > entries;
+  for(auto& v : entries_split)
+    entries.insert(entries.end(), v.begin(), v.end());
+  if(entries.size() != index.size())
+    throw std::runtime_error("The index does not match the " + this->outdata_.tree_name + " tree.");
+
+  std::sort(entries.begin(), entries.end());
+  std::sort(index.begin(), index.end(), [](const IndexRow& a, const IndexRow& b) { return a.source_entry < b.source_entry; });
+  std::vector<ULong64_t> order(index.size()); //position in 'index' of each output entry
+  for(unsigned i=0; i<index.size(); ++i) {
+    if(entries[i].first != index[i].source_entry)
+      throw std::runtime_error("The index does not match the " + this->outdata_.tree_name + " tree.");
+    order[ entries[i].second ] = i;
   }
-  else if(this->datatype == DATATYPE::DATA or this->showertype == SHOWERTYPE::EM) {
-    if(this->showertype == SHOWERTYPE::EM)
-      savedcols_.erase(std::remove(savedcols_.begin(), savedcols_.end(), new_ahc_en_MeV_), savedcols_.end()); //erase-remove idiom
-    partial_process.Snapshot(this->outdata_.tree_name.c_str(), this->outdata_.file_path.c_str(), savedcols_);
+  index_bytes_ = index.capacity() * sizeof(IndexRow) + memprof::heap_bytes(entries) + memprof::heap_bytes(order);
+
+  TFile file(this->outdata_.file_path.c_str(), "UPDATE");
+  TTree tree(this->outdata_.index_tree_name.c_str(), "per-event summary of the selected events");
+  ULong64_t entry;
+  IndexRow row;
+  const std::string nl = std::to_string(detectorConstants::totalnlayers);
+  tree.Branch("Entry",            &entry,              "Entry/l");
+  tree.Branch("SourceEntry",      &row.source_entry,   "SourceEntry/l");
+  tree.Branch("run",              &row.run,            "run/i");
+  tree.Branch("event",            &row.event,          "event/i");
+  tree.Branch("beamEnergy",       &row.beamen,         "beamEnergy/F");
+  tree.Branch("NRechits",         &row.nrechits,       "NRechits/i");
+  tree.Branch("NhitsClean",       &row.nhits,          "NhitsClean/i");
+  tree.Branch("EnergyClean",      &row.energy,         "EnergyClean/F");
+  tree.Branch("NhitsLayer",       row.nhits_layer.data(),  ("NhitsLayer["  + nl + "]/i").c_str());
+  tree.Branch("EnergyLayer",      row.energy_layer.data(), ("EnergyLayer[" + nl + "]/F").c_str());
+  tree.Branch("AhcEnergy",        &row.ahc_energy,     "AhcEnergy/F");
+  tree.Branch("dwcReferenceType", &row.dwc_type,       "dwcReferenceType/I");
+  tree.Branch("trackChi2_X",      &row.chi2x,          "trackChi2_X/F");
+  tree.Branch("trackChi2_Y",      &row.chi2y,          "trackChi2_Y/F");
+  for(entry=0; entry<order.size(); ++entry) {
+    row = index[ order[entry] ];
+    tree.Fill();
   }
+  tree.Write("", TObject::kOverwrite);
+  file.Close();
 }
 
 void Selector::print_relevant_branches(const int& nrows=5, std::optional<std::string> filename)
@@ -335,6 +726,5 @@ int Selector::sanity_checks(const std::string& fname)
   return 1;
 }
 
-template std::vector<float> Selector::clean_ce(const std::vector<float>&, const std::vector<float>&, const std::vector<unsigned>&, const std::vector<unsigned>&, const std::vector<unsigned>&, const std::vector<unsigned>&, const std::vector<float>&, const std::vector<bool>&, const mapT&, const bool&);
-template std::vector<unsigned> Selector::clean_ce(const std::vector<unsigned>&, const std::vector<float>&, const std::vector<unsigned>&, const std::vector<unsigned>&, const std::vector<unsigned>&, const std::vector<unsigned>&, const std::vector<float>&, const std::vector<bool>&, const mapT&, const bool&);
-template std::vector<float> Selector::clean_ahc(const std::vector<float>&, const std::vector<float>&, const std::vector<int>&, const bool&);
+template std::vector<float> Selector::gather(const std::vector<float>&, const std::vector<unsigned>&);
+template std::vector<unsigned> Selector::gather(const std::vector<unsigned>&, const std::vector<unsigned>&);
@@ -0,0 +1,88 @@
+#ifndef synthetic_ntuple_h
+#define synthetic_ntuple_h
+
+#include <array>
+#include <random>
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TTree.h"
+#include "UserCode/DataProcessing/interface/CLUEAnalysis.h"
+
+//small original ntuples written by the tests, read by the selection as the ntuples of the test beam
+namespace synthetic {
+  //electromagnetic showers in the CE-E, with the branches of the original ntuples read by the selection
+  inline void write_ntuple(const std::string& fname, const unsigned& nevents, const unsigned& run = 1, const float& beam_energy = 20.f)
+  {
+    TFile file(fname.c_str(), "RECREATE");
+    file.mkdir("rechitntupler")->cd();
+    TTree *hits = new TTree("hits", "hits"); //owned by the file
+    UInt_t event, run_number = run, nrechits;
+    Float_t beamen = beam_energy;
+    std::vector<float> energy, amplitude, x, y, z;
+    std::vector<unsigned> detid, layer, chip, channel, module;
+    std::vector<bool> noise_flag;
+    hits->Branch("event", &event);
+    hits->Branch("run", &run_number);
+    hits->Branch("NRechits", &nrechits);
+    hits->Branch("beamEnergy", &beamen);
+    hits->Branch("rechit_energy", &energy);
+    hits->Branch("rechit_amplitudeHigh", &amplitude);
+    hits->Branch("rechit_x", &x);
+    hits->Branch("rechit_y", &y);
+    hits->Branch("rechit_z", &z);
+    hits->Branch("rechit_detid", &detid);
+    hits->Branch("rechit_layer", &layer);
+    hits->Branch("rechit_chip", &chip);
+    hits->Branch("rechit_channel", &channel);
+    hits->Branch("rechit_module", &module);
+    hits->Branch("rechit_noise_flag", &noise_flag);
+
+    file.mkdir("trackimpactntupler")->cd();
+    TTree *impact = new TTree("impactPoints", "impactPoints");
+    std::array<Float_t, detectorConstants::totalnlayers> impx, impy;
+    Int_t dwc_type = 13;
+    Float_t chi2x = 1.f, chi2y = 1.f;
+    for(unsigned i=1; i<=detectorConstants::totalnlayers; ++i) {
+      impact->Branch(("impactX_HGCal_layer_" + std::to_string(i)).c_str(), &impx[i-1]);
+      impact->Branch(("impactY_HGCal_layer_" + std::to_string(i)).c_str(), &impy[i-1]);
+    }
+    impact->Branch("dwcReferenceType", &dwc_type);
+    impact->Branch("trackChi2_X", &chi2x);
+    impact->Branch("trackChi2_Y", &chi2y);
+
+    std::mt19937 gen(1);
+    std::normal_distribution<float> pos(0.f, 1.5f);
+    std::uniform_real_distribution<float> mip(1.f, 30.f);
+    for(event=0; event<nevents; ++event) {
+      for(auto* v : {&energy, &amplitude, &x, &y, &z})
+	v->clear();
+      for(auto* v : {&detid, &layer, &chip, &channel, &module})
+	v->clear();
+      noise_flag.clear();
+      for(unsigned l=2; l<=detectorConstants::nlayers_emshowers; ++l)
+	for(unsigned h=0; h<20; ++h) {
+	  energy.push_back(mip(gen));
+	  amplitude.push_back(1000.f); //well above the noise of module 78
+	  x.push_back(pos(gen));
+	  y.push_back(pos(gen));
+	  z.push_back(l);
+	  detid.push_back(100 * l + h);
+	  layer.push_back(l);
+	  chip.push_back(1);
+	  channel.push_back(h);
+	  module.push_back(78);
+	  noise_flag.push_back(false);
+	}
+      nrechits = energy.size();
+      impx.fill(0.f);
+      impy.fill(0.f);
+      hits->Fill();
+      impact->Fill();
+    }
+    file.Write();
+    file.Close();
+  }
+}
+
+#endif //synthetic_ntuple_h
@@ -0,0 +1,78 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include "UserCode/DataProcessing/interface/analyzer.h"
+#include "UserCode/DataProcessing/interface/selector.h"
+#include "UserCode/DataProcessing/test/synthetic_ntuple.h"
+
+//fused selection and analysis of a small synthetic ntuple with a checkpoint, as run by the 'fused' jobs of launcher.sh:
+//a job interrupted in the middle of the run resumes from its checkpoint and writes the same energy sums as the full job
+namespace {
+  constexpr unsigned nevents = 40;
+  constexpr unsigned every = 5; //events per checkpoint block
+  constexpr size_t header_size = 20; //magic, version and configuration hash of the checkpoint file
+
+  void check(const bool& cond, const std::string& message)
+  {
+    if(!cond)
+      throw std::runtime_error("test_fused_checkpoint: " + message);
+  }
+
+  std::string read_file(const std::string& fname, const size_t& max_bytes = std::string::npos)
+  {
+    std::ifstream in(fname, std::ios::binary);
+    check(in.is_open(), "the file " + fname + " is missing.");
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    return ss.str().substr(0, max_bytes);
+  }
+
+  //fused job on the entries [first, last) of the ntuple; returns the energy sums, as written to the CSV output
+  std::string fused_job(const std::string& in_fname, const std::string& ckpt, const std::string& out_fname,
+			const ULong64_t& first, const ULong64_t& last)
+  {
+    Analyzer ana(in_fname, "relevant_branches", 1.3f, 9.f, 3.f, SHOWERTYPE::EM, 2.9f, 1.3f);
+    ana.set_ncpus(1);
+    Selector selector(in_fname, "", "data", "em", 20, Selector::load_calibration());
+    selector.set_ncpus(1);
+    selector.set_entry_range(first, last);
+    std::vector<ROOT::RDF::RNode> nodes = { selector.selection() };
+    ana.set_input_nodes(nodes, {selector.source_id()});
+    ana.set_checkpoint(ckpt, every);
+    ana.runCLUE();
+    ana.save_to_file(out_fname);
+    return read_file(out_fname); //the checkpoint is kept, as by a job interrupted before clear_checkpoint()
+  }
+}
+
+int main()
+{
+  const std::string dir = std::filesystem::temp_directory_path().string() + "/test_fused_checkpoint_" + std::to_string(getpid()) + "/";
+  std::filesystem::create_directories(dir);
+  const std::string in_fname = dir + "ntuple.root", ckpt = dir + "job.ckpt";
+  try {
+    synthetic::write_ntuple(in_fname, nevents);
+
+    //full job, then the same job interrupted in the middle of a block: the last block of its checkpoint is incomplete
+    const std::string full = fused_job(in_fname, ckpt, dir + "full.csv", 0, nevents);
+    const std::string header = read_file(ckpt, header_size);
+    std::filesystem::resize_file(ckpt, std::filesystem::file_size(ckpt) - 1);
+    const std::string resumed = fused_job(in_fname, ckpt, dir + "resumed.csv", 0, nevents);
+    check(read_file(ckpt, header_size) == header, "the checkpoint of the same selection was discarded.");
+    check(resumed == full, "the resumed job does not reproduce the full job.");
+
+    //another part of the same run is not resumed from the checkpoint of the first one
+    fused_job(in_fname, ckpt, dir + "part.csv", 0, nevents / 2);
+    check(read_file(ckpt, header_size) != header, "the checkpoint of another entry range was resumed.");
+  }
+  catch(const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    std::filesystem::remove_all(dir);
+    return 1;
+  }
+  std::filesystem::remove_all(dir);
+  std::cout << "test_fused_checkpoint: OK" << std::endl;
+  return 0;
+}
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <unistd.h>
+#include "UserCode/DataProcessing/interface/analyzer.h"
+#include "UserCode/DataProcessing/interface/job_stamp.h"
+#include "UserCode/DataProcessing/interface/selector.h"
+#include "UserCode/DataProcessing/test/synthetic_ntuple.h"
+
+//stamp of a fused analysis of two runs, as written by analyze_data_exe: the layer- and cluster-dependent outputs are named
+//after the beam energy of each run (also when written by the asynchronous output stage), and a second identical job is
+//skipped only while all of them exist
+namespace {
+  constexpr unsigned nevents = 10;
+  const std::vector<int> beam_energies = {20, 30};
+
+  void check(const bool& cond, const std::string& message)
+  {
+    if(!cond)
+      throw std::runtime_error("test_skip_up_to_date: " + message);
+  }
+
+  jobstamp::Stamp make_stamp(const std::vector<std::string>& in_fnames)
+  {
+    jobstamp::Stamp stamp;
+    for(const auto& in_fname : in_fnames)
+      stamp.add_input(in_fname);
+    stamp.add_config("datatype", "data");
+    stamp.add_config("showertype", static_cast<int>(SHOWERTYPE::EM));
+    return stamp;
+  }
+
+  //returns the files written by the job
+  std::vector<std::string> analysis_job(const std::vector<std::string>& in_fnames, const std::string& out_stem, const bool& async_output)
+  {
+    Analyzer ana(in_fnames, "relevant_branches", 1.3f, 9.f, 3.f, SHOWERTYPE::EM, 2.9f, 1.3f);
+    ana.set_ncpus(1);
+    if(async_output)
+      ana.set_async_output(out_stem + "_layerdep_em.root", out_stem + "_clusterdepem.root", columnar::WriterOptions());
+    std::vector< std::unique_ptr<Selector> > selectors;
+    std::vector<ROOT::RDF::RNode> nodes;
+    std::vector<std::string> sources;
+    const auto calib = Selector::load_calibration();
+    for(size_t i=0; i<in_fnames.size(); ++i) {
+      selectors.emplace_back( new Selector(in_fnames[i], "", "data", "em", beam_energies[i], calib) );
+      selectors.back()->set_ncpus(1);
+      nodes.push_back( selectors.back()->selection() );
+      sources.push_back( selectors.back()->source_id() );
+    }
+    ana.set_input_nodes(nodes, sources);
+    ana.runCLUE();
+    ana.save_to_file(out_stem + ".csv");
+    if(!async_output) {
+      ana.save_to_file_layer_dependent(out_stem + "_layerdep_em.root");
+      ana.save_to_file_cluster_dependent(out_stem + "_clusterdepem.root");
+    }
+    ana.save_to_file_noclusters(out_stem + "_noclusters.csv");
+
+    memprof::JobSummary summary;
+    ana.fill_summary(summary);
+    make_stamp(in_fnames).write(out_stem + ".csv", summary, ana.written_outputs());
+    return ana.written_outputs();
+  }
+}
+
+int main()
+{
+  const std::string dir = std::filesystem::temp_directory_path().string() + "/test_skip_up_to_date_" + std::to_string(getpid()) + "/";
+  std::filesystem::create_directories(dir);
+  try {
+    std::vector<std::string> in_fnames;
+    for(size_t i=0; i<beam_energies.size(); ++i) {
+      in_fnames.push_back(dir + "ntuple" + std::to_string(i) + ".root");
+      synthetic::write_ntuple(in_fnames.back(), nevents, i + 1, beam_energies[i]);
+    }
+    for(const bool async_output : {false, true}) {
+      const std::string out_stem = dir + (async_output ? "analysis_async" : "analysis");
+      check(!make_stamp(in_fnames).up_to_date(out_stem + ".csv"), "a job without stamp is up to date.");
+
+      const std::vector<std::string> outputs = analysis_job(in_fnames, out_stem, async_output);
+      for(const int& en : beam_energies)
+	for(const std::string& name : {"_layerdep_em_beamen", "_clusterdepem_beamen"}) {
+	  const std::string fname = out_stem + name + std::to_string(en) + ".root";
+	  check(std::find(outputs.begin(), outputs.end(), fname) != outputs.end(), fname + " is not among the written outputs.");
+	}
+      for(const auto& fname : outputs)
+	check(std::filesystem::exists(fname), "the output " + fname + " is missing.");
+
+      //the second identical job is skipped, unless one of the outputs of the first one is gone
+      check(make_stamp(in_fnames).up_to_date(out_stem + ".csv"), "the second identical job is not skipped.");
+      std::filesystem::remove(out_stem + "_clusterdepem_beamen30.root");
+      check(!make_stamp(in_fnames).up_to_date(out_stem + ".csv"), "a job with a missing output is skipped.");
+    }
+  }
+  catch(const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    std::filesystem::remove_all(dir);
+    return 1;
+  }
+  std::filesystem::remove_all(dir);
+  std::cout << "test_skip_up_to_date: OK" << std::endl;
+  return 0;
+}
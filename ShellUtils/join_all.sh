@@ -5,6 +5,7 @@ declare -a TAGS=( "W2p3_dpos1p3"
 		  "W5p0_dpos1p3"
 		  "W2p9_dpos3p4"
 		  "W2p9_dpos999" )
+#one tag after the other: each merge already uses all the cpus
 for t in "${TAGS[@]}"; do
-    bash DataProcessing/join_ntuples.sh --datatype data --showertype em --analysistype clusterdep --tag ${t} &
+    bash DataProcessing/join_ntuples.sh --datatype data --showertype em --analysistype clusterdep --tag ${t}
 done
@@ -0,0 +1,50 @@
+#ifndef HitColumns_h
+#define HitColumns_h
+
+#include <cstddef>
+#include <vector>
+#include <TTree.h>
+
+//per-hit columns of an event (one vector per quantity), with the names and types of the test beam ntuples,
+//so that the selection of DataProcessing reads the simulated hits as they are
+struct HitColumns {
+  std::vector<unsigned> detid, layer;
+  std::vector<float> x, y, z, energy;
+
+  void attach(TTree& tree) {
+    tree.Branch("rechit_detid",  &detid);
+    tree.Branch("rechit_x",      &x);
+    tree.Branch("rechit_y",      &y);
+    tree.Branch("rechit_z",      &z);
+    tree.Branch("rechit_layer",  &layer);
+    tree.Branch("rechit_energy", &energy);
+  }
+
+  void clear() {
+    detid.clear(); layer.clear(); x.clear(); y.clear(); z.clear(); energy.clear();
+  }
+
+  void reserve(const size_t& n) {
+    detid.reserve(n); layer.reserve(n); x.reserve(n); y.reserve(n); z.reserve(n); energy.reserve(n);
+  }
+
+  //appends the hits of a collection; 'Tools' provides the position and the layer of a detector id
+  //(hgcal::RecHitTools, whose geometry has to be set)
+  template<typename Collection, typename Tools>
+  void fill(const Collection& hits, const Tools& tools) {
+    for(const auto& hit : hits) {
+      const auto id = hit.detid();
+      const auto pos = tools.getPosition(id);
+      detid.push_back( id.rawId() );
+      x.push_back( pos.x() );
+      y.push_back( pos.y() );
+      z.push_back( pos.z() );
+      layer.push_back( tools.getLayerWithOffset(id) );
+      energy.push_back( hit.energy() );
+    }
+  }
+
+  size_t size() const { return detid.size(); }
+};
+
+#endif //HitColumns_h
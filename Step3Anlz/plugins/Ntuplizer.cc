@@ -12,16 +12,18 @@ Ntuplizer::Ntuplizer(const edm::ParameterSet& iConfig) :
   usesResource("TFileService");
   edm::Service<TFileService> file;
 
-  tree = file->make<TTree>("tree", "pidtree");
-  void initialize_branches();
+  //named as the tree of the test beam ntuples, 'rechitntupler/hits' with the module label of ntuplizer_cfg.py
+  tree = file->make<TTree>("hits", "hits");
+  initialize_branches();
 }
 
 void Ntuplizer::initialize_branches()
 {
-  tree->Branch("run", &run, "run/I");
-  tree->Branch("event", &event, "event/I");
-  tree->Branch("lumi", &lumi, "lumi/I");
-  tree->Branch("weight", &weight, "weight/F");
+  tree->Branch("run", &run, "run/i");
+  tree->Branch("event", &event, "event/i");
+  tree->Branch("lumi", &lumi, "lumi/i");
+  tree->Branch("NRechits", &nrechits, "NRechits/i");
+  hits.attach(*tree);
 }
 
 void Ntuplizer::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup) {
@@ -36,12 +38,25 @@ void Ntuplizer::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup)
   edm::Handle<HGCRecHitCollection> recHitHandleBH;
   iEvent.getByToken(hgcalRecHitsBHToken_, recHitHandleBH);
 
-  // init vars
-  edm::ESHandle<CaloGeometry> geom; 
-  iSetup.get<CaloGeometryRecord>().get(geom); 
-  recHitTools->setGeometry(*geom);
+  if(geometryWatcher_.check(iSetup)) {
+    edm::ESHandle<CaloGeometry> geom;
+    iSetup.get<CaloGeometryRecord>().get(geom);
+    recHitTools->setGeometry(*geom);
+  }
 
-  //tree->Fill();
+  run = iEvent.id().run();
+  event = iEvent.id().event();
+  lumi = iEvent.id().luminosityBlock();
+
+  //single pass over the hits of the three collections, without reallocation
+  hits.clear();
+  hits.reserve(recHitHandleEE->size() + recHitHandleFH->size() + recHitHandleBH->size());
+  hits.fill(*recHitHandleEE, *recHitTools);
+  hits.fill(*recHitHandleFH, *recHitTools);
+  hits.fill(*recHitHandleBH, *recHitTools);
+  nrechits = hits.size();
+
+  tree->Fill();
 }
 
 // ------------ method called once each job just before starting event loop  ------------
@@ -52,10 +67,10 @@ void Ntuplizer::endJob() {}
 
 // ------------ method fills 'descriptions' with the allowed parameters for the module  ------------
 void Ntuplizer::fillDescriptions(edm::ConfigurationDescriptions& descriptions) {
-  //The following says we do not know what parameters are allowed so do no validation
-  // Please change this to state exactly what you do use, even if it is no parameters
   edm::ParameterSetDescription desc;
-  desc.setUnknown();
+  desc.add<edm::InputTag>("hgcalRecHitsEE", edm::InputTag("HGCalRecHit", "HGCEERecHits"));
+  desc.add<edm::InputTag>("hgcalRecHitsFH", edm::InputTag("HGCalRecHit", "HGCHEFRecHits"));
+  desc.add<edm::InputTag>("hgcalRecHitsBH", edm::InputTag("HGCalRecHit", "HGCHEBRecHits"));
   descriptions.addDefault(desc);
 }
 
@@ -9,8 +9,11 @@
 #include "FWCore/Framework/interface/one/EDAnalyzer.h"
 #include "FWCore/Framework/interface/Event.h"
 #include "FWCore/Framework/interface/ESHandle.h"
+#include "FWCore/Framework/interface/ESWatcher.h"
 #include "FWCore/Framework/interface/MakerMacros.h"
 #include "FWCore/ParameterSet/interface/ParameterSet.h"
+#include "FWCore/ParameterSet/interface/ParameterSetDescription.h"
+#include "FWCore/ParameterSet/interface/ConfigurationDescriptions.h"
 #include "FWCore/Utilities/interface/InputTag.h"
 #include "Geometry/CaloTopology/interface/HGCalTopology.h"
 #include "Geometry/HGCalGeometry/interface/HGCalGeometry.h"
@@ -21,21 +24,7 @@
 #include "DataFormats/HGCRecHit/interface/HGCRecHitCollections.h"
 #include "DataFormats/ForwardDetId/interface/HGCalDetId.h"
 #include "DataFormats/HGCRecHit/interface/HGCRecHit.h"
-#include "DataFormats/Math/interface/deltaR.h"
-#include "DataFormats/ParticleFlowReco/interface/HGCalMultiCluster.h"
-#include "DataFormats/Common/interface/ValueMap.h"
-#include "DataFormats/Math/interface/LorentzVector.h"
-#include "DataFormats/HGCalReco/interface/Trackster.h"
-#include "SimDataFormats/CaloAnalysis/interface/CaloParticle.h"
-#include "SimDataFormats/CaloAnalysis/interface/CaloParticleFwd.h"
-#include "SimDataFormats/CaloAnalysis/interface/SimClusterFwd.h"
-#include "SimDataFormats/CaloAnalysis/interface/SimCluster.h"
-#include "SimDataFormats/Vertex/interface/SimVertex.h"
 #include "RecoLocalCalo/HGCalRecAlgos/interface/RecHitTools.h"
-#include "RecoLocalCalo/HGCalRecProducers/interface/HGCalClusteringAlgoBase.h"
-
-// from HGC Validator code
-#include "Validation/HGCalValidation/interface/HGVHistoProducerAlgo.h"
 
 //ROOT includes
 #include "FWCore/ServiceRegistry/interface/Service.h"
@@ -44,13 +33,9 @@
 #include <TFile.h>
 #include <TROOT.h>
 #include <TBranch.h>
-#include <TSystem.h>
-#include <TVector3.h>
-#include <TLorentzVector.h>
-#include <TH1.h>
 
-// Common Data Formats used by the ntuple
-#include "UserCode/Step3Anlz/interface/CommonDataFormats.h"
+// flat per-hit output
+#include "UserCode/Step3Anlz/plugins/HitColumns.h"
 
 class Ntuplizer : public edm::one::EDAnalyzer<edm::one::SharedResources> {
 public:
@@ -66,6 +51,8 @@ private:
 
   void initialize_branches();
   std::shared_ptr<hgcal::RecHitTools> recHitTools;
+  //the geometry is set again only when the record changes (once per run at most), not on every event
+  edm::ESWatcher<CaloGeometryRecord> geometryWatcher_;
 
   // ----------member data ---------------------------
   edm::EDGetTokenT<HGCRecHitCollection> hgcalRecHitsEEToken_;
@@ -74,13 +61,6 @@ private:
 
   TTree* tree;
 
-  edm::RunNumber_t irun;
-  edm::EventNumber_t ievent;
-  edm::LuminosityBlockNumber_t ilumiblock;
-  edm::Timestamp itime;
-
-  //size_t run, event, lumi, time;
-  size_t run, lumi, time;
-  int event;
-  float weight;
+  unsigned run, event, lumi, nrechits;
+  HitColumns hits; //EE, FH and BH hits of the event
 };
@@ -36,9 +36,10 @@ process.source = cms.Source(
     fileNames = cms.untracked.vstring(options.inputFiles)
 )
 
-process.ntuplizer = cms.EDAnalyzer( 'Ntuplizer',
+#the label names the output tree 'rechitntupler/hits', as in the test beam ntuples read by DataProcessing
+process.rechitntupler = cms.EDAnalyzer( 'Ntuplizer',
                                     hgcalRecHitsEE = cms.InputTag("HGCalRecHit", "HGCEERecHits"),
                                     hgcalRecHitsFH = cms.InputTag("HGCalRecHit", "HGCHEFRecHits"),
                                     hgcalRecHitsBH = cms.InputTag("HGCalRecHit", "HGCHEBRecHits") )
 
-process.p = cms.Path(process.ntuplizer)
+process.p = cms.Path(process.rechitntupler)
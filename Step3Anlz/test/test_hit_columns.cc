@@ -0,0 +1,127 @@
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <TFile.h>
+#include <TTree.h>
+#include "UserCode/Step3Anlz/plugins/HitColumns.h"
+
+//fills the per-hit columns of the Ntuplizer from mock rec-hit collections and a mock geometry, as Ntuplizer::analyze(),
+//and reads them back from the tree
+namespace {
+  struct MockId {
+    unsigned raw;
+    unsigned rawId() const { return raw; }
+  };
+
+  struct MockHit {
+    MockId id;
+    float en;
+    MockId detid() const { return id; }
+    float energy() const { return en; }
+  };
+
+  struct MockPoint {
+    float px, py, pz;
+    float x() const { return px; }
+    float y() const { return py; }
+    float z() const { return pz; }
+  };
+
+  //geometry derived from the raw id, so that the expected columns are known for any hit
+  struct MockTools {
+    MockPoint getPosition(const MockId& id) const { return MockPoint{0.5f * id.raw, -0.25f * id.raw, 10.f + id.raw}; }
+    unsigned getLayerWithOffset(const MockId& id) const { return id.raw / 100; }
+  };
+
+  void check(const bool& cond, const std::string& message)
+  {
+    if(!cond)
+      throw std::runtime_error("test_hit_columns: " + message);
+  }
+
+  //columns expected from the hits of the collections, in their order
+  void check_event(const std::vector< std::vector<MockHit> >& collections, const unsigned& nrechits,
+		   const std::vector<unsigned>& detid, const std::vector<unsigned>& layer, const std::vector<float>& x,
+		   const std::vector<float>& y, const std::vector<float>& z, const std::vector<float>& energy)
+  {
+    std::vector<MockHit> hits;
+    for(const auto& coll : collections)
+      hits.insert(hits.end(), coll.begin(), coll.end());
+    check(nrechits == hits.size(), "NRechits is " + std::to_string(nrechits) + " instead of " + std::to_string(hits.size()) + ".");
+    for(const size_t& n : {detid.size(), layer.size(), x.size(), y.size(), z.size(), energy.size()})
+      check(n == hits.size(), "a column has " + std::to_string(n) + " hits instead of " + std::to_string(hits.size()) + ".");
+
+    const MockTools tools;
+    for(size_t i=0; i<hits.size(); ++i) {
+      const MockPoint pos = tools.getPosition(hits[i].id);
+      check(detid[i] == hits[i].id.raw, "wrong rechit_detid of hit " + std::to_string(i) + ".");
+      check(layer[i] == tools.getLayerWithOffset(hits[i].id), "wrong rechit_layer of hit " + std::to_string(i) + ".");
+      check(x[i] == pos.x() and y[i] == pos.y() and z[i] == pos.z(), "wrong position of hit " + std::to_string(i) + ".");
+      check(energy[i] == hits[i].en, "wrong rechit_energy of hit " + std::to_string(i) + ".");
+    }
+  }
+}
+
+int main()
+{
+  //EE, FH and BH collections of two events; the second one is smaller, so that hits left from the first one would show
+  const std::vector< std::vector< std::vector<MockHit> > > events = {
+    { {{{101}, 1.5f}, {{102}, 2.5f}, {{2805}, 0.7f}}, {{{2901}, 3.f}, {{3612}, 4.25f}}, {{{4001}, 12.f}} },
+    { {{{1703}, 0.9f}}, {}, {{{3907}, 6.5f}} },
+  };
+  const std::string fname = "test_hit_columns.root";
+
+  try {
+    {
+      TFile file(fname.c_str(), "RECREATE");
+      TTree *tree = new TTree("hits", "hits"); //owned by the file
+      unsigned nrechits;
+      HitColumns hits;
+      tree->Branch("NRechits", &nrechits, "NRechits/i");
+      hits.attach(*tree);
+
+      const MockTools tools;
+      for(const auto& collections : events) {
+	hits.clear();
+	hits.reserve(collections[0].size() + collections[1].size() + collections[2].size());
+	for(const auto& coll : collections)
+	  hits.fill(coll, tools);
+	nrechits = hits.size();
+	check_event(collections, nrechits, hits.detid, hits.layer, hits.x, hits.y, hits.z, hits.energy);
+	tree->Fill();
+      }
+      file.Write();
+      file.Close();
+    }
+
+    //the columns are read back with the names and types read by the selection of DataProcessing
+    TFile file(fname.c_str(), "READ");
+    TTree *tree = nullptr;
+    file.GetObject("hits", tree);
+    check(tree != nullptr and tree->GetEntries() == static_cast<Long64_t>(events.size()), "the tree does not hold one entry per event.");
+    unsigned nrechits;
+    std::vector<unsigned> *detid = nullptr, *layer = nullptr;
+    std::vector<float> *x = nullptr, *y = nullptr, *z = nullptr, *energy = nullptr;
+    tree->SetBranchAddress("NRechits", &nrechits);
+    tree->SetBranchAddress("rechit_detid", &detid);
+    tree->SetBranchAddress("rechit_layer", &layer);
+    tree->SetBranchAddress("rechit_x", &x);
+    tree->SetBranchAddress("rechit_y", &y);
+    tree->SetBranchAddress("rechit_z", &z);
+    tree->SetBranchAddress("rechit_energy", &energy);
+    for(size_t ientry=0; ientry<events.size(); ++ientry) {
+      tree->GetEntry(ientry);
+      check_event(events[ientry], nrechits, *detid, *layer, *x, *y, *z, *energy);
+    }
+  }
+  catch(const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    std::remove(fname.c_str());
+    return 1;
+  }
+  std::remove(fname.c_str());
+  std::cout << "test_hit_columns: OK" << std::endl;
+  return 0;
+}